@@ -0,0 +1,208 @@
+#include "animation.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "batchRenderer.h"
+#include "phongLightSource.h"
+#include "viewport.h"
+
+
+// The values of a keyframe that are interpolated, each as a point (index picks the light).
+static FCoord3D fromPointOf(const CameraKey &key, int index) { return key.camera.fromPoint; }
+static FCoord3D atPointOf(const CameraKey &key, int index) { return key.camera.atPoint; }
+static FCoord3D upVectorOf(const CameraKey &key, int index) { return key.camera.upVector; }
+static FCoord3D viewingAngleOf(const CameraKey &key, int index) { return FCoord3D(key.camera.viewingAngleDeg, 0, 0); }
+static FCoord3D lightPositionOf(const CameraKey &key, int index) { return key.lightPositions.at(index); }
+
+
+/*** CameraKey ***/
+
+CameraKey::CameraKey()
+{
+	frame = 0;
+}
+
+
+/*** Public Member Functions ***/
+
+Animation::Animation(ThreadPool* _pool, ImageWriter* _imageWriter, Metrics* _metrics)
+{
+	pool = _pool;
+	imageWriter = _imageWriter;
+	metrics = _metrics;
+	keys = new std::vector<CameraKey>();
+
+	framesRendered = 0;
+	framesInFlight = 0;
+	renderMs = 0.0;
+}
+
+Animation::~Animation()
+{
+	delete keys;
+}
+
+void Animation::addKey(int frame, Viewport* viewport)
+{
+	CameraKey key;
+	key.frame = frame;
+	key.camera = viewport->getCamera();
+	for (int i = 0; i < viewport->numLights(); i++)
+	{
+		key.lightPositions.push_back(viewport->getLight(i)->position);
+	}
+
+	removeKey(frame);
+	auto position = std::upper_bound(keys->begin(), keys->end(), frame,
+		[](int f, const CameraKey &k) { return f < k.frame; });
+	keys->insert(position, key);
+}
+
+bool Animation::removeKey(int frame)
+{
+	for (int k = 0; k < (int)keys->size(); k++)
+	{
+		if (keys->at(k).frame == frame)
+		{
+			keys->erase(keys->begin() + k);
+			return true;
+		}
+	}
+	return false;
+}
+
+void Animation::clear()
+{
+	keys->clear();
+}
+
+int Animation::numKeys()
+{
+	return keys->size();
+}
+
+int Animation::numFrames()
+{
+	return keys->empty() ? 0 : keys->back().frame + 1;
+}
+
+CameraKey Animation::interpolate(int frame)
+{
+	if (frame <= keys->front().frame)
+	{
+		CameraKey key = keys->front();
+		key.frame = frame;
+		return key;
+	}
+	if (frame >= keys->back().frame)
+	{
+		CameraKey key = keys->back();
+		key.frame = frame;
+		return key;
+	}
+
+	// The keyframes k and k + 1 are on either side of the frame.
+	int k = 0;
+	while (keys->at(k + 1).frame <= frame)
+	{
+		k++;
+	}
+	const CameraKey &a = keys->at(k);
+	const CameraKey &b = keys->at(k + 1);
+	int span = b.frame - a.frame;
+	float t = (float)(frame - a.frame) / span;
+
+	// The tangents are per frame, so they are scaled up to the keyframes' span.
+	auto along = [this, k, span, t, &a, &b](FCoord3D (*get)(const CameraKey&, int), int index)
+	{
+		return hermite(get(a, index), tangent(k, get, index).multiply(span),
+			get(b, index), tangent(k + 1, get, index).multiply(span), t);
+	};
+
+	CameraKey key;
+	key.frame = frame;
+	key.camera.fromPoint = along(fromPointOf, 0);
+	key.camera.atPoint = along(atPointOf, 0);
+	key.camera.upVector = along(upVectorOf, 0);
+	key.camera.viewingAngleDeg = along(viewingAngleOf, 0).x;
+
+	// Lights are only interpolated between keyframes that have the same ones.
+	bool sameLights = true;
+	for (int i = 0; i < (int)keys->size(); i++)
+	{
+		sameLights = sameLights && keys->at(i).lightPositions.size() == a.lightPositions.size();
+	}
+	for (int i = 0; i < (int)a.lightPositions.size(); i++)
+	{
+		key.lightPositions.push_back(sameLights ? along(lightPositionOf, i) : a.lightPositions.at(i));
+	}
+	return key;
+}
+
+bool Animation::render(Viewport* viewport, ShapeCollection* shapes, int frames, std::string fileName, int inFlight)
+{
+	if (keys->empty()) return false;
+
+	// Lights are only moved when the scene has the lights the keyframes were recorded with.
+	std::vector<BatchView> views(std::max(frames, 0));
+	for (int frame = 0; frame < (int)views.size(); frame++)
+	{
+		CameraKey key = interpolate(frame);
+		views[frame].number = frame;
+		views[frame].camera = key.camera;
+		views[frame].lightPositions = key.lightPositions;
+		views[frame].fileName = BatchRenderer::numberedFileName(fileName, frame, frames);
+	}
+
+	BatchRenderer batch(pool, imageWriter, metrics, "Frame");
+	framesInFlight = batch.render(viewport, shapes, views, inFlight);
+	framesRendered = views.size();
+	renderMs = batch.getRenderMs();
+	return true;
+}
+
+void Animation::printStatus(std::ostream& s)
+{
+	if (keys->empty())
+	{
+		s << "There are no keyframes." << std::endl;
+	}
+	for (int k = 0; k < (int)keys->size(); k++)
+	{
+		const CameraKey &key = keys->at(k);
+		const Camera &c = key.camera;
+		s << "Frame " << key.frame << ": from (" << c.fromPoint.x << ", " << c.fromPoint.y << ", " << c.fromPoint.z
+			<< ") at (" << c.atPoint.x << ", " << c.atPoint.y << ", " << c.atPoint.z << "), angle "
+			<< c.viewingAngleDeg << ", " << key.lightPositions.size() << " lights." << std::endl;
+	}
+	if (framesRendered > 0)
+	{
+		s << "Rendered " << framesRendered << " frames (" << framesInFlight << " at once) in " << renderMs << " ms ("
+			<< renderMs / framesRendered << " ms per frame)." << std::endl;
+	}
+}
+
+
+/*** Private Member Functions ***/
+
+FCoord3D Animation::hermite(FCoord3D p0, FCoord3D m0, FCoord3D p1, FCoord3D m1, float t)
+{
+	float t2 = t * t;
+	float t3 = t2 * t;
+	return p0.multiply(2 * t3 - 3 * t2 + 1)
+		.plus(m0.multiply(t3 - 2 * t2 + t))
+		.plus(p1.multiply(-2 * t3 + 3 * t2))
+		.plus(m1.multiply(t3 - t2));
+}
+
+FCoord3D Animation::tangent(int k, FCoord3D (*get)(const CameraKey&, int), int index)
+{
+	// The tangent is the slope between the neighbouring keyframes (or the keyframe itself at either end).
+	int before = std::max(k - 1, 0);
+	int after = std::min(k + 1, (int)keys->size() - 1);
+	int frames = keys->at(after).frame - keys->at(before).frame;
+	if (frames <= 0) return FCoord3D(0, 0, 0);
+
+	return get(keys->at(after), index).minus(get(keys->at(before), index)).multiply(1.0 / frames);
+}
@@ -0,0 +1,98 @@
+#ifndef __ANIMATION_H__
+#define __ANIMATION_H__
+
+/* animation.h
+ *
+ * Renders a sequence of frames from keyframes. Each keyframe holds the camera and the positions of the lights
+ * at a frame number, and the frames in between are interpolated along splines that pass through every keyframe
+ * (Catmull-Rom splines, with the tangents scaled to the number of frames between keyframes).
+ *
+ * The frames are rendered as a batch (see batchRenderer.h), so several are in flight at once over the same
+ * prepared scene.
+ *
+ */
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "misc.h"
+
+class ImageWriter;
+class Metrics;
+class ShapeCollection;
+class ThreadPool;
+class Viewport;
+
+// The camera and lights at a frame of an animation.
+struct CameraKey
+{
+	CameraKey();
+
+	// The number of the frame.
+	int frame;
+	// The camera.
+	Camera camera;
+	// The positions of the lights, in the order the viewport holds them.
+	std::vector<FCoord3D> lightPositions;
+};
+
+class Animation
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates an animation without keyframes, whose frames render on the pool, are written by the writer and
+		// are counted by the metrics (which may be null).
+		Animation(ThreadPool* _pool, ImageWriter* _imageWriter, Metrics* _metrics);
+		~Animation();
+
+		// Records the camera and lights of the viewport as the keyframe at the frame (replacing one that is there).
+		void addKey(int frame, Viewport* viewport);
+		// Removes the keyframe at the frame. Returns false if there isn't one.
+		bool removeKey(int frame);
+		// Removes every keyframe.
+		void clear();
+		// Returns the number of keyframes.
+		int numKeys();
+		// Returns the number of frames the keyframes span (one more than the last keyframe's frame).
+		int numFrames();
+
+		// Returns the camera and lights at the frame, interpolated between the keyframes. Frames before the first
+		// keyframe or after the last are held at it. There must be at least one keyframe.
+		CameraKey interpolate(int frame);
+
+		// Renders the frames [0, frames) of the scene, with the viewport's size, lights and settings and the
+		// interpolated cameras. Lights are only moved if every keyframe has as many as the viewport. Each frame
+		// is written to the file name with its number inserted before the extension. inFlight is the number of
+		// frames rendered at once (see BatchRenderer::render). Returns false if there are no keyframes.
+		bool render(Viewport* viewport, ShapeCollection* shapes, int frames, std::string fileName, int inFlight);
+
+		// Prints the keyframes, and how the last animation rendered.
+		void printStatus(std::ostream& s);
+
+	private:
+		/*** Private Member Functions ***/
+		// Returns the value at t (from 0 to 1) of the Hermite curve from p0 to p1 with the tangents m0 and m1.
+		static FCoord3D hermite(FCoord3D p0, FCoord3D m0, FCoord3D p1, FCoord3D m1, float t);
+		// Returns the tangent of the spline at keyframe k for the value returned by get, per frame.
+		FCoord3D tangent(int k, FCoord3D (*get)(const CameraKey&, int), int index);
+
+		// Animations can't be copied.
+		Animation(const Animation&) = delete;
+		Animation& operator=(const Animation&) = delete;
+
+		/*** Private Member Variables ***/
+		ThreadPool* pool;
+		ImageWriter* imageWriter;
+		Metrics* metrics;
+		// The keyframes, in order of their frames.
+		std::vector<CameraKey>* keys;
+
+		/** The last render **/
+		int framesRendered;
+		int framesInFlight;
+		double renderMs;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "batchRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include "frameBuffer.h"
+#include "imageWriter.h"
+#include "metrics.h"
+#include "phongLightSource.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+#include "viewport.h"
+
+
+/*** BatchView ***/
+
+BatchView::BatchView()
+{
+	number = 0;
+	fileName = "";
+}
+
+
+/*** Public Member Functions ***/
+
+BatchRenderer::BatchRenderer(ThreadPool* _pool, ImageWriter* _imageWriter, Metrics* _metrics, std::string _label)
+{
+	pool = _pool;
+	imageWriter = _imageWriter;
+	metrics = _metrics;
+	label = _label;
+	renderMs = 0.0;
+}
+
+int BatchRenderer::render(Viewport* scene, ShapeCollection* shapes, const std::vector<BatchView> &views, int inFlight)
+{
+	// A view with fewer tiles than there are threads leaves some of them idle, so more views are rendered at
+	// once. Even views with plenty of tiles overlap with the next one, which fills in while they finish.
+	if (inFlight <= 0)
+	{
+		int threads = pool ? pool->numThreads() : 1;
+		int tiles = std::max(scene->countTiles(), 1);
+		inFlight = (threads + tiles - 1) / tiles + 1;
+	}
+	inFlight = std::max(1, std::min(std::min(inFlight, BATCH_MAX_IN_FLIGHT), (int)views.size()));
+
+	// The shapes are prepared here, so the views only read them.
+	shapes->prepare();
+
+	double startMs = nowMs();
+	std::atomic<int> nextView(0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < inFlight; i++)
+	{
+		threads.push_back(std::thread([this, scene, shapes, &views, &nextView]()
+		{
+			int k;
+			while ((k = nextView++) < (int)views.size())
+			{
+				renderView(scene, shapes, views[k]);
+			}
+		}));
+	}
+	for (int i = 0; i < (int)threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	renderMs = nowMs() - startMs;
+	return inFlight;
+}
+
+double BatchRenderer::getRenderMs()
+{
+	return renderMs;
+}
+
+std::string BatchRenderer::numberedFileName(std::string fileName, int number, int count)
+{
+	int digits = std::max((int)std::to_string(std::max(count - 1, 0)).size(), BATCH_FILE_DIGITS);
+	std::string text = std::to_string(number);
+	text.insert(0, std::max(digits - (int)text.size(), 0), '0');
+
+	size_t dot = fileName.rfind('.');
+	if (dot == std::string::npos) return fileName + text;
+	return fileName.substr(0, dot) + text + fileName.substr(dot);
+}
+
+
+/*** Private Member Functions ***/
+
+void BatchRenderer::renderView(Viewport* scene, ShapeCollection* shapes, const BatchView &view)
+{
+	double startMs = nowMs();
+	int width = scene->getWidth();
+	int height = scene->getHeight();
+
+	FrameBuffer* buffer = new FrameBuffer(width, height);
+	Viewport* viewport = new Viewport(Coord(0, 0), width, height, shapes);
+	viewport->setThreadPool(pool);
+	viewport->setFrameBuffer(buffer);
+	viewport->copySceneFrom(scene);
+	viewport->setCamera(view.camera);
+	if ((int)view.lightPositions.size() == viewport->numLights())
+	{
+		for (int i = 0; i < viewport->numLights(); i++)
+		{
+			viewport->getLight(i)->position = view.lightPositions.at(i);
+		}
+	}
+
+	int x0, y0, x1, y1;
+	if (scene->getRegion(x0, y0, x1, y1))
+	{
+		viewport->setRegion(x0, y0, x1, y1);
+	}
+
+	viewport->redraw(false);
+	std::vector<float> pixels;
+	viewport->readPixels(x0, y0, x1, y1, pixels);
+	RenderStats stats = viewport->getStats();
+	delete viewport;
+	delete buffer;
+	if (metrics)
+	{
+		metrics->addFrame(stats);
+	}
+
+	// The writer takes its own copy, so the thread can start on the next view.
+	bool queued = imageWriter && imageWriter->write(view.fileName, x1 - x0, y1 - y0, std::move(pixels));
+
+	std::unique_lock<std::mutex> lock(printMutex);
+	std::cout << label << " " << view.number << ": " << (nowMs() - startMs) << " ms, " << stats.primaryRays
+		<< " primary rays";
+	if (queued)
+	{
+		std::cout << ", writing \"" << view.fileName << "\"";
+	}
+	std::cout << "." << std::endl;
+}
@@ -0,0 +1,89 @@
+#ifndef __BATCHRENDERER_H__
+#define __BATCHRENDERER_H__
+
+/* batchRenderer.h
+ *
+ * Renders one scene from many cameras. The shapes (and their bounding volume hierarchies) are prepared once and
+ * shared, read-only, by every view; each view is rendered by a viewport and frame buffer of its own, with its
+ * own camera and light positions. Several views are in flight at once on the shared thread pool, so the threads
+ * are kept busy while a view renders its last tiles or is anti-aliased, and each view is handed to the image
+ * writer as soon as it is finished.
+ *
+ * Animations render a view per frame, and multi-view batches a view per camera.
+ *
+ */
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "misc.h"
+
+class ImageWriter;
+class Metrics;
+class ShapeCollection;
+class ThreadPool;
+class Viewport;
+
+// The most views that may be in flight at once.
+const int BATCH_MAX_IN_FLIGHT = 8;
+// The fewest digits view numbers are written with in file names.
+const int BATCH_FILE_DIGITS = 4;
+
+// A view of a batch.
+struct BatchView
+{
+	BatchView();
+
+	// The number of the view (such as its frame).
+	int number;
+	// The camera the view is rendered from.
+	Camera camera;
+	// The positions of the lights, in the order the scene holds them (empty to leave the lights where they are).
+	std::vector<FCoord3D> lightPositions;
+	// The file the view is written to.
+	std::string fileName;
+};
+
+class BatchRenderer
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates a renderer whose views render on the pool, are written by the writer and are counted by the
+		// metrics (which may be null). Views are called by the label (such as "Frame") in the messages printed as
+		// they finish.
+		BatchRenderer(ThreadPool* _pool, ImageWriter* _imageWriter, Metrics* _metrics, std::string _label);
+
+		// Renders the views of the shapes, each at the size of the scene's viewport and with its lights, scene
+		// attributes, anti-aliasing settings and region. inFlight is the number of views rendered at once (0
+		// chooses it from the number of threads and tiles). Returns the number that were rendered at once.
+		int render(Viewport* scene, ShapeCollection* shapes, const std::vector<BatchView> &views, int inFlight);
+		// Returns the time the last render took (in milliseconds).
+		double getRenderMs();
+
+		// Returns the file name with the number inserted before its extension, padded with zeros to the digits
+		// of the largest number below count.
+		static std::string numberedFileName(std::string fileName, int number, int count);
+
+	private:
+		/*** Private Member Functions ***/
+		// Renders a view (on the calling thread and the pool), and queues it to be written.
+		void renderView(Viewport* scene, ShapeCollection* shapes, const BatchView &view);
+
+		// Renderers can't be copied.
+		BatchRenderer(const BatchRenderer&) = delete;
+		BatchRenderer& operator=(const BatchRenderer&) = delete;
+
+		/*** Private Member Variables ***/
+		ThreadPool* pool;
+		ImageWriter* imageWriter;
+		Metrics* metrics;
+		std::string label;
+		double renderMs;
+
+		// Held while a view prints its progress.
+		std::mutex printMutex;
+};
+
+#endif
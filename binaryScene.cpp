@@ -0,0 +1,607 @@
+#include "binaryScene.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "bvh.h"
+#include "implicitShape.h"
+#include "instanceShape.h"
+#include "mappedFile.h"
+#include "phongLightSource.h"
+#include "shape.h"
+#include "shapeCollection.h"
+#include "surfaceShape.h"
+#include "viewport.h"
+
+// Every section starts on a multiple of this many bytes.
+const uint64_t SECTION_ALIGNMENT = 16;
+// The size of the version 2 header, which ends where the fields added in version 3 begin.
+const uint64_t V2_HEADER_SIZE = offsetof(BinarySceneHeader, numTransforms);
+// How much of the file the checks read before dropping the pages they have read.
+const uint64_t CHECK_RELEASE_BYTES = (uint64_t)1 << 20;
+
+
+/*** Helper Functions ***/
+
+static uint64_t alignOffset(uint64_t offset)
+{
+	return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+// Returns true if count elements of elementSize bytes starting at offset lie inside the file.
+static bool sectionFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+{
+	if (offset % SECTION_ALIGNMENT != 0 || offset > fileSize) return false;
+	return count <= (fileSize - offset) / elementSize;
+}
+
+// Returns true if every corner of the triangles is a vertex of the shape (corners are 1-indexed). The pages
+// read are dropped every CHECK_RELEASE_BYTES, so checking a file bigger than memory doesn't read it in whole.
+static bool trianglesValid(MappedFile* file, const SurfaceIndices* triangles, uint64_t count, uint64_t numVertices)
+{
+	const uint64_t perRelease = CHECK_RELEASE_BYTES / sizeof(SurfaceIndices);
+	for (uint64_t i = 0; i < count; i++)
+	{
+		if (i > 0 && i % perRelease == 0)
+		{
+			file->release((const char*)(triangles + i - perRelease), perRelease * sizeof(SurfaceIndices));
+		}
+		const SurfaceIndices& t = triangles[i];
+		if (t.a <= 0 || t.b <= 0 || t.c <= 0 ||
+			(uint64_t)t.a > numVertices || (uint64_t)t.b > numVertices || (uint64_t)t.c > numVertices)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Returns true if every inner node's children are later nodes of the hierarchy, and every leaf's triangles
+// are triangles of the shape. The pages read are dropped as by trianglesValid.
+static bool nodesValid(MappedFile* file, const BVHNode* nodes, uint64_t count, uint64_t numTriangles)
+{
+	const uint64_t perRelease = CHECK_RELEASE_BYTES / sizeof(BVHNode);
+	for (uint64_t i = 0; i < count; i++)
+	{
+		if (i > 0 && i % perRelease == 0)
+		{
+			file->release((const char*)(nodes + i - perRelease), perRelease * sizeof(BVHNode));
+		}
+		const BVHNode& n = nodes[i];
+		if (n.count > 0)
+		{
+			if ((uint64_t)n.first + n.count > numTriangles) return false;
+		}
+		else if (i + 1 >= count || n.first <= i + 1 || n.first >= count)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void rgbToFloats(RGB c, float f[3])
+{
+	f[0] = c.red;
+	f[1] = c.green;
+	f[2] = c.blue;
+}
+
+static void coordToFloats(FCoord3D c, float f[3])
+{
+	f[0] = c.x;
+	f[1] = c.y;
+	f[2] = c.z;
+}
+
+static BinaryMaterial getMaterial(Shape* shape)
+{
+	BinaryMaterial m;
+	rgbToFloats(shape->getColor(), m.color);
+	m.reflection = shape->getRefl();
+	m.refraction = shape->getRefr();
+	m.refractiveIndex = shape->getRefractiveIndex();
+	m.phongExponent = shape->getPhongExponent();
+	return m;
+}
+
+static void setMaterial(Shape* shape, const BinaryMaterial& m)
+{
+	shape->setColor(RGB(m.color[0], m.color[1], m.color[2]));
+	shape->setRefl(m.reflection);
+	shape->setRefr(m.refraction);
+	shape->setRefractiveIndex(m.refractiveIndex);
+	shape->setPhongExponent(m.phongExponent);
+}
+
+static Transform toTransform(const BinaryTransform& b)
+{
+	Transform t;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			t.m[i][j] = b.m[i * 4 + j];
+		}
+	}
+	return t;
+}
+
+static BinaryTransform fromTransform(const Transform& t)
+{
+	BinaryTransform b;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			b.m[i * 4 + j] = t.m[i][j];
+		}
+	}
+	return b;
+}
+
+// Returns true if every corner of the shape's triangles is one of its vertices (corners are 1-indexed). The text
+// format doesn't check them, but a binary scene must hold only valid ones.
+static bool cornersValid(SurfaceShape* surface)
+{
+	for (int i = 0; i < surface->numSurfaces(); i++)
+	{
+		SurfaceIndices si = surface->getSurfaceByIndices(i);
+		if (si.a <= 0 || si.b <= 0 || si.c <= 0 ||
+			si.a > surface->numPoints() || si.b > surface->numPoints() || si.c > surface->numPoints())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Fills in the geometry fields of a surface shape or mesh record, and counts its elements in the header.
+static void setSurfaceRecord(BinaryShape& r, SurfaceShape* surface, BinarySceneHeader& h)
+{
+	// The hierarchy decides the order the triangles are stored in.
+	surface->prepare();
+	
+	r.first = h.numVertices;
+	r.count = surface->numPoints();
+	r.firstTriangle = h.numTriangles;
+	r.numTriangles = surface->numSurfaces();
+	r.firstNode = h.numNodes;
+	r.numNodes = surface->getBVH()->numNodes();
+	h.numVertices += r.count;
+	h.numTriangles += r.numTriangles;
+	h.numNodes += r.numNodes;
+}
+
+// Writes zeros up to the next section boundary.
+static void pad(std::ostream& s, uint64_t& offset)
+{
+	static const char zeros[SECTION_ALIGNMENT] = {0};
+	uint64_t aligned = alignOffset(offset);
+	s.write(zeros, aligned - offset);
+	offset = aligned;
+}
+
+static void writeBytes(std::ostream& s, uint64_t& offset, const void* data, uint64_t n)
+{
+	s.write((const char*)data, n);
+	offset += n;
+}
+
+
+/*** Public Functions ***/
+
+bool isBinarySceneFile(std::string fileName)
+{
+	std::ifstream file(fileName.c_str(), std::ios::binary);
+	if (!file.is_open()) return false;
+
+	char magic[sizeof(BINARY_SCENE_MAGIC)];
+	file.read(magic, sizeof(magic));
+	return file.gcount() == sizeof(magic) && memcmp(magic, BINARY_SCENE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool hasBinarySceneExtension(std::string fileName)
+{
+	return fileName.size() >= BINARY_SCENE_EXTENSION.size() &&
+		strcasecmp(fileName.c_str() + fileName.size() - BINARY_SCENE_EXTENSION.size(), BINARY_SCENE_EXTENSION.c_str()) == 0;
+}
+
+bool loadBinaryScene(std::string fileName, ShapeCollection* shapes, Viewport* viewport)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(fileName, shapes->getMappedFiles());
+	if (!file->isOpen() || file->size() < V2_HEADER_SIZE) return false;
+
+	const char* base = file->data();
+	uint64_t size = file->size();
+
+	BinarySceneHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(&h, base, std::min<uint64_t>(size, sizeof(h)));
+
+	if (memcmp(h.magic, BINARY_SCENE_MAGIC, sizeof(h.magic)) != 0) return false;
+	if (h.version < BINARY_SCENE_OLDEST_VERSION || h.version > BINARY_SCENE_VERSION)
+	{
+		std::cout << "Unsupported binary scene version " << h.version
+			<< " (expected " << BINARY_SCENE_OLDEST_VERSION << " to " << BINARY_SCENE_VERSION << ")." << std::endl;
+		return false;
+	}
+	
+	// Older headers end early, so whatever was copied past their end isn't part of them.
+	uint64_t headerSize = sizeof(BinarySceneHeader);
+	if (h.version == 2)
+	{
+		headerSize = V2_HEADER_SIZE;
+		h.numTransforms = 0;
+		h.transformsOffset = 0;
+	}
+
+	if (h.headerSize != headerSize || size < headerSize ||
+		!sectionFits(h.transformsOffset, h.numTransforms, sizeof(BinaryTransform), size) ||
+		!sectionFits(h.lightsOffset, h.numLights, sizeof(BinaryLight), size) ||
+		!sectionFits(h.materialsOffset, h.numMaterials, sizeof(BinaryMaterial), size) ||
+		!sectionFits(h.quadricsOffset, h.numQuadrics, sizeof(BinaryQuadric), size) ||
+		!sectionFits(h.shapesOffset, h.numShapes, sizeof(BinaryShape), size) ||
+		!sectionFits(h.verticesOffset, h.numVertices, sizeof(FCoord3D), size) ||
+		!sectionFits(h.trianglesOffset, h.numTriangles, sizeof(SurfaceIndices), size) ||
+		!sectionFits(h.nodesOffset, h.numNodes, sizeof(BVHNode), size))
+	{
+		std::cout << "Binary scene \"" << fileName << "\" is truncated or corrupt." << std::endl;
+		return false;
+	}
+
+	// The mapping is page aligned and every section is 16 byte aligned, so these can be used in place.
+	const BinaryLight* lights = (const BinaryLight*)(base + h.lightsOffset);
+	const BinaryMaterial* materials = (const BinaryMaterial*)(base + h.materialsOffset);
+	const BinaryQuadric* quadrics = (const BinaryQuadric*)(base + h.quadricsOffset);
+	const BinaryShape* records = (const BinaryShape*)(base + h.shapesOffset);
+	const FCoord3D* vertices = (const FCoord3D*)(base + h.verticesOffset);
+	const SurfaceIndices* triangles = (const SurfaceIndices*)(base + h.trianglesOffset);
+	const BVHNode* nodes = (const BVHNode*)(base + h.nodesOffset);
+	const BinaryTransform* transforms = (const BinaryTransform*)(base + h.transformsOffset);
+
+	// Check every shape before changing the scene, so a bad file leaves it untouched.
+	for (uint32_t i = 0; i < h.numShapes; i++)
+	{
+		const BinaryShape& r = records[i];
+		bool valid = r.material < h.numMaterials;
+		if (r.type == bstImplicit)
+		{
+			valid = valid && r.first < h.numQuadrics;
+		}
+		else if (r.type == bstSurface || r.type == bstMesh)
+		{
+			valid = valid &&
+				r.first <= h.numVertices && r.count <= h.numVertices - r.first &&
+				r.firstTriangle <= h.numTriangles && r.numTriangles <= h.numTriangles - r.firstTriangle &&
+				r.firstNode <= h.numNodes && r.numNodes <= h.numNodes - r.firstNode &&
+				r.count <= INT32_MAX && r.numTriangles <= INT32_MAX && r.numNodes <= INT32_MAX;
+			// The mapped triangles and nodes are used without checks, so every index in them is checked here.
+			valid = valid &&
+				trianglesValid(file.get(), triangles + r.firstTriangle, r.numTriangles, r.count) &&
+				nodesValid(file.get(), nodes + r.firstNode, r.numNodes, r.numTriangles);
+		}
+		else if (r.type == bstInstance)
+		{
+			valid = valid &&
+				r.first < h.numShapes && records[r.first].type == bstMesh &&
+				r.count < h.numTransforms && toTransform(transforms[r.count]).isInvertible();
+		}
+		else
+		{
+			valid = false;
+		}
+
+		if (!valid)
+		{
+			std::cout << "Binary scene \"" << fileName << "\" has an invalid shape record (" << i << ")." << std::endl;
+			return false;
+		}
+	}
+
+	// Rays reach the geometry in no particular order, so reading ahead would mostly read pages that aren't needed.
+	// The pages read by the checks are dropped, so that only what the rays reach becomes resident.
+	file->adviseRandomAccess();
+	file->release();
+	
+	// Scene attributes.
+	viewport->setBackgroundColor(RGB(h.backgroundColor[0], h.backgroundColor[1], h.backgroundColor[2]));
+	viewport->setFromPoint(FCoord3D(h.fromPoint[0], h.fromPoint[1], h.fromPoint[2]));
+	viewport->setAtPoint(FCoord3D(h.atPoint[0], h.atPoint[1], h.atPoint[2]));
+	viewport->setUpVector(FCoord3D(h.upVector[0], h.upVector[1], h.upVector[2]));
+	viewport->setViewingAngle(h.viewingAngleDeg);
+	viewport->setAmbientIntensity(h.ambientIntensity);
+
+	for (uint32_t i = 0; i < h.numLights; i++)
+	{
+		const BinaryLight& l = lights[i];
+		viewport->addLight(new PhongLightSource(
+			RGB(l.color[0], l.color[1], l.color[2]),
+			l.intensity,
+			FCoord3D(l.position[0], l.position[1], l.position[2])
+		));
+	}
+
+	// Shapes. Surface shapes and meshes are set up the same way, but meshes are only added through their instances.
+	auto mapSurface = [&](SurfaceShape* surface, const BinaryShape& r)
+	{
+		surface->setMappedData(file,
+			vertices + r.first, r.count,
+			triangles + r.firstTriangle, r.numTriangles);
+		if (r.numNodes > 0)
+		{
+			surface->setMappedBVH(file, nodes + r.firstNode, r.numNodes);
+		}
+	};
+	
+	std::vector<std::shared_ptr<SurfaceShape>> meshes(h.numShapes);
+	for (uint32_t i = 0; i < h.numShapes; i++)
+	{
+		if (records[i].type == bstMesh)
+		{
+			meshes[i] = std::make_shared<SurfaceShape>();
+			mapSurface(meshes[i].get(), records[i]);
+		}
+	}
+	
+	for (uint32_t i = 0; i < h.numShapes; i++)
+	{
+		const BinaryShape& r = records[i];
+		Shape* shape;
+		if (r.type == bstImplicit)
+		{
+			const float* c = quadrics[r.first].coefficients;
+			shape = new ImplicitShape(c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7], c[8], c[9]);
+		}
+		else if (r.type == bstSurface)
+		{
+			SurfaceShape* surface = new SurfaceShape();
+			mapSurface(surface, r);
+			shape = surface;
+		}
+		else if (r.type == bstInstance)
+		{
+			// Mesh names aren't stored, so each mesh is named after its record.
+			shape = new InstanceShape(meshes[r.first], "mesh" + std::to_string(r.first), toTransform(transforms[r.count]));
+		}
+		else
+		{
+			continue;
+		}
+
+		setMaterial(shape, materials[r.material]);
+		shapes->add(shape);
+	}
+
+	return true;
+}
+
+bool saveBinaryScene(std::string fileName, ShapeCollection* shapes, Viewport* viewport)
+{
+	// Shapes may still be mapped from the file being replaced, so write a new file and rename it over the old one.
+	std::string tempFileName = fileName + ".tmp";
+	std::ofstream file(tempFileName.c_str(), std::ios::binary);
+	if (!file.is_open()) return false;
+
+	BinarySceneHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, BINARY_SCENE_MAGIC, sizeof(h.magic));
+	h.version = BINARY_SCENE_VERSION;
+	h.headerSize = sizeof(BinarySceneHeader);
+
+	rgbToFloats(viewport->getBackgroundColor(), h.backgroundColor);
+	coordToFloats(viewport->getFromPoint(), h.fromPoint);
+	coordToFloats(viewport->getAtPoint(), h.atPoint);
+	coordToFloats(viewport->getUpVector(), h.upVector);
+	h.viewingAngleDeg = viewport->getViewingAngle();
+	h.ambientIntensity = viewport->getAmbientIntensity();
+
+	// Build the small sections in memory. Vertices and triangles are streamed straight from the shapes.
+	std::vector<BinaryLight> lights;
+	for (int i = 0; i < viewport->numLights(); i++)
+	{
+		PhongLightSource* light = viewport->getLight(i);
+		BinaryLight l;
+		rgbToFloats(light->color, l.color);
+		l.intensity = light->intensity;
+		coordToFloats(light->position, l.position);
+		lights.push_back(l);
+	}
+
+	std::vector<BinaryMaterial> materials;
+	std::vector<BinaryQuadric> quadrics;
+	std::vector<BinaryShape> records;
+	std::vector<BinaryTransform> transforms;
+	std::vector<SurfaceShape*> surfaces;
+	// The record index of each mesh that has been stored.
+	std::map<SurfaceShape*, uint64_t> meshRecords;
+	for (int i = 0; i < shapes->numShapes(); i++)
+	{
+		Shape* shape = shapes->get(i);
+		BinaryShape r;
+		memset(&r, 0, sizeof(r));
+
+		// Shapes usually share a handful of materials, so store each one once.
+		BinaryMaterial m = getMaterial(shape);
+		r.material = materials.size();
+		for (int j = 0; j < (int)materials.size(); j++)
+		{
+			if (memcmp(&materials[j], &m, sizeof(m)) == 0)
+			{
+				r.material = j;
+				break;
+			}
+		}
+		if (r.material == materials.size())
+		{
+			materials.push_back(m);
+		}
+
+		ImplicitShape* implicit = dynamic_cast<ImplicitShape*>(shape);
+		SurfaceShape* surface = dynamic_cast<SurfaceShape*>(shape);
+		InstanceShape* instance = dynamic_cast<InstanceShape*>(shape);
+		SurfaceShape* geometry = surface ? surface : (instance ? instance->getMesh().get() : nullptr);
+		if (geometry && !cornersValid(geometry))
+		{
+			std::cout << "Shape " << i << " has a triangle corner that isn't one of its vertices, so it can't be "
+				<< "stored in a binary scene." << std::endl;
+			file.close();
+			remove(tempFileName.c_str());
+			return false;
+		}
+
+		if (implicit)
+		{
+			BinaryQuadric q;
+			implicit->getCoefficients(q.coefficients);
+			r.type = bstImplicit;
+			r.first = quadrics.size();
+			r.count = 1;
+			quadrics.push_back(q);
+		}
+		else if (surface)
+		{
+			r.type = bstSurface;
+			setSurfaceRecord(r, surface, h);
+			surfaces.push_back(surface);
+		}
+		else if (instance && instance->getMesh())
+		{
+			// Each mesh is stored just before its first instance.
+			SurfaceShape* mesh = instance->getMesh().get();
+			if (meshRecords.count(mesh) == 0)
+			{
+				BinaryShape m = r;
+				m.type = bstMesh;
+				setSurfaceRecord(m, mesh, h);
+				meshRecords[mesh] = records.size();
+				records.push_back(m);
+				surfaces.push_back(mesh);
+			}
+			
+			r.type = bstInstance;
+			r.first = meshRecords[mesh];
+			r.count = transforms.size();
+			transforms.push_back(fromTransform(instance->getTransform()));
+		}
+		else
+		{
+			std::cout << "Shape " << i << " can't be stored in a binary scene." << std::endl;
+			file.close();
+			remove(tempFileName.c_str());
+			return false;
+		}
+
+		records.push_back(r);
+	}
+
+	h.numLights = lights.size();
+	h.numMaterials = materials.size();
+	h.numQuadrics = quadrics.size();
+	h.numShapes = records.size();
+	h.numTransforms = transforms.size();
+
+	h.lightsOffset = alignOffset(sizeof(h));
+	h.materialsOffset = alignOffset(h.lightsOffset + lights.size() * sizeof(BinaryLight));
+	h.quadricsOffset = alignOffset(h.materialsOffset + materials.size() * sizeof(BinaryMaterial));
+	h.shapesOffset = alignOffset(h.quadricsOffset + quadrics.size() * sizeof(BinaryQuadric));
+	h.transformsOffset = alignOffset(h.shapesOffset + records.size() * sizeof(BinaryShape));
+	h.verticesOffset = alignOffset(h.transformsOffset + transforms.size() * sizeof(BinaryTransform));
+	h.trianglesOffset = alignOffset(h.verticesOffset + h.numVertices * sizeof(FCoord3D));
+	h.nodesOffset = alignOffset(h.trianglesOffset + h.numTriangles * sizeof(SurfaceIndices));
+
+	uint64_t offset = 0;
+	writeBytes(file, offset, &h, sizeof(h));
+	pad(file, offset);
+	writeBytes(file, offset, lights.data(), lights.size() * sizeof(BinaryLight));
+	pad(file, offset);
+	writeBytes(file, offset, materials.data(), materials.size() * sizeof(BinaryMaterial));
+	pad(file, offset);
+	writeBytes(file, offset, quadrics.data(), quadrics.size() * sizeof(BinaryQuadric));
+	pad(file, offset);
+	writeBytes(file, offset, records.data(), records.size() * sizeof(BinaryShape));
+	pad(file, offset);
+	writeBytes(file, offset, transforms.data(), transforms.size() * sizeof(BinaryTransform));
+	pad(file, offset);
+
+	// Number each shape's vertices in the order its triangles (in hierarchy order) first use them.
+	std::vector<std::vector<int>> newIndices(surfaces.size());
+	for (int i = 0; i < (int)surfaces.size(); i++)
+	{
+		SurfaceShape* surface = surfaces[i];
+		BVH* bvh = surface->getBVH();
+		std::vector<int> &newIndex = newIndices[i];
+		std::vector<FCoord3D> points;
+		points.reserve(surface->numPoints());
+		newIndex.assign(surface->numPoints(), -1);
+
+		for (int j = 0; j < surface->numSurfaces(); j++)
+		{
+			SurfaceIndices si = surface->getSurfaceByIndices(bvh->isBuilt() ? bvh->primitive(j) : j);
+			int corners[3] = {si.a, si.b, si.c};
+			for (int k = 0; k < 3; k++)
+			{
+				int v = corners[k] - 1;
+				if (newIndex[v] < 0)
+				{
+					newIndex[v] = points.size();
+					points.push_back(surface->getPoint(v));
+				}
+			}
+		}
+		// Points no surface uses go at the end.
+		for (int v = 0; v < surface->numPoints(); v++)
+		{
+			if (newIndex[v] < 0)
+			{
+				newIndex[v] = points.size();
+				points.push_back(surface->getPoint(v));
+			}
+		}
+
+		writeBytes(file, offset, points.data(), points.size() * sizeof(FCoord3D));
+	}
+	pad(file, offset);
+
+	for (int i = 0; i < (int)surfaces.size(); i++)
+	{
+		SurfaceShape* surface = surfaces[i];
+		BVH* bvh = surface->getBVH();
+		const std::vector<int> &newIndex = newIndices[i];
+		std::vector<SurfaceIndices> triangles(surface->numSurfaces());
+		for (int j = 0; j < surface->numSurfaces(); j++)
+		{
+			SurfaceIndices si = surface->getSurfaceByIndices(bvh->isBuilt() ? bvh->primitive(j) : j);
+			int corners[3] = {si.a, si.b, si.c};
+			for (int k = 0; k < 3; k++)
+			{
+				corners[k] = newIndex[corners[k] - 1] + 1;
+			}
+			triangles[j] = SurfaceIndices(corners[0], corners[1], corners[2]);
+		}
+		writeBytes(file, offset, triangles.data(), triangles.size() * sizeof(SurfaceIndices));
+	}
+	pad(file, offset);
+
+	// With the triangles in hierarchy order, the leaves can refer to them directly.
+	for (int i = 0; i < (int)surfaces.size(); i++)
+	{
+		BVH* bvh = surfaces[i]->getBVH();
+		writeBytes(file, offset, bvh->nodeData(), bvh->numNodes() * sizeof(BVHNode));
+	}
+
+	file.close();
+	if (file.fail() || rename(tempFileName.c_str(), fileName.c_str()) != 0)
+	{
+		remove(tempFileName.c_str());
+		return false;
+	}
+	return true;
+}
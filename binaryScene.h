@@ -0,0 +1,138 @@
+#ifndef __BINARYSCENE_H__
+#define __BINARYSCENE_H__
+
+/* binaryScene.h
+ *
+ * A versioned binary scene format that is memory-mapped and used in place, as an alternative to the
+ * .data text format. The file is a header followed by contiguous sections (lights, materials, quadric
+ * coefficients, shapes, vertices, triangles and BVH nodes), each aligned to 16 bytes. Vertices and
+ * triangles are stored exactly as SurfaceShape keeps them (FCoord3D and 1-indexed SurfaceIndices), so
+ * surface shapes point straight into the mapping without any per-element parsing.
+ *
+ * Meshes shared by instance shapes are stored once, as mesh records laid out like surface shapes, and each
+ * instance record refers to its mesh record and to a transformation in the transforms section.
+ *
+ * Each surface shape's triangles are stored in the order of the leaves of its bounding volume hierarchy,
+ * and its vertices in the order the triangles first use them. Triangles that are near each other in
+ * space are therefore near each other in the file, so a mesh larger than memory can be rendered with
+ * only the parts the rays reach being read in.
+ *
+ * All values are stored in the native (little-endian) byte order.
+ *
+ */
+
+#include <stdint.h>
+#include <string>
+
+class ShapeCollection;
+class Viewport;
+
+// The first 8 bytes of every binary scene file.
+const char BINARY_SCENE_MAGIC[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', 0};
+// The current version of the format. Files with a different version are rejected, except that version 2
+// files (which have no instances, and a header that ends before numTransforms) are still loaded.
+const uint32_t BINARY_SCENE_VERSION = 3;
+const uint32_t BINARY_SCENE_OLDEST_VERSION = 2;
+// The file extension used when saving a binary scene.
+const std::string BINARY_SCENE_EXTENSION = ".rtscene";
+
+// Shape types stored in BinaryShape::type.
+enum BinaryShapeType {bstImplicit = 0, bstSurface = 1, bstInstance = 2, bstMesh = 3};
+
+struct BinarySceneHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+
+	// Scene attributes.
+	float backgroundColor[3];
+	float fromPoint[3];
+	float atPoint[3];
+	float upVector[3];
+	float viewingAngleDeg;
+	float ambientIntensity;
+
+	// The number of entries in each section.
+	uint32_t numLights;
+	uint32_t numMaterials;
+	uint32_t numQuadrics;
+	uint32_t numShapes;
+	uint64_t numVertices;
+	uint64_t numTriangles;
+	uint64_t numNodes;
+
+	// The byte offset of each section from the start of the file.
+	uint64_t lightsOffset;
+	uint64_t materialsOffset;
+	uint64_t quadricsOffset;
+	uint64_t shapesOffset;
+	uint64_t verticesOffset;
+	uint64_t trianglesOffset;
+	uint64_t nodesOffset;
+
+	// Added in version 3.
+	uint32_t numTransforms;
+	uint32_t reserved;
+	uint64_t transformsOffset;
+};
+
+struct BinaryLight
+{
+	float color[3];
+	float intensity;
+	float position[3];
+};
+
+struct BinaryMaterial
+{
+	float color[3];
+	float reflection;
+	float refraction;
+	float refractiveIndex;
+	int32_t phongExponent;
+};
+
+struct BinaryQuadric
+{
+	// c200, c020, c002, c110, c101, c011, c100, c010, c001, c000.
+	float coefficients[10];
+};
+
+struct BinaryTransform
+{
+	// The 3 rows of a Transform.
+	float m[12];
+};
+
+struct BinaryShape
+{
+	// A BinaryShapeType.
+	uint32_t type;
+	// Index into the materials section (unused by meshes, which take the material of each instance).
+	uint32_t material;
+	// For implicit shapes, the index into the quadrics section.
+	// For surface shapes and meshes, the first vertex and the number of vertices.
+	// For instance shapes, the index of the mesh record and the index into the transforms section.
+	uint64_t first;
+	uint64_t count;
+	// For surface shapes and meshes, the first triangle and the number of triangles.
+	// Triangle indices are 1-indexed and relative to the shape's first vertex.
+	uint64_t firstTriangle;
+	uint64_t numTriangles;
+	// For surface shapes and meshes, the first node and the number of nodes of the shape's bounding volume hierarchy.
+	// Child indices are relative to the first node, and leaves refer directly to the shape's triangles.
+	uint64_t firstNode;
+	uint64_t numNodes;
+};
+
+// Returns true if the file starts with the binary scene magic bytes.
+bool isBinarySceneFile(std::string fileName);
+// Returns true if the file name has the binary scene extension (in any case).
+bool hasBinarySceneExtension(std::string fileName);
+// Maps the file, and adds its shapes to the collection and its attributes and lights to the viewport.
+bool loadBinaryScene(std::string fileName, ShapeCollection* shapes, Viewport* viewport);
+// Writes the collection and the viewport's scene attributes to the file.
+bool saveBinaryScene(std::string fileName, ShapeCollection* shapes, Viewport* viewport);
+
+#endif
@@ -0,0 +1,305 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "mappedFile.h"
+
+// The number of bins candidate splits are sorted into along each axis.
+const int SAH_BINS = 12;
+// The relative costs of testing a node's box and of testing a primitive.
+const float SAH_TRAVERSAL_COST = 1.0;
+const float SAH_INTERSECTION_COST = 1.0;
+// Leaves hold at most this many primitives, unless their primitives can't be separated.
+const int MAX_LEAF_SIZE = 8;
+// Node boxes are grown by this fraction of their size, so that rounding in the primitive tests never misses a box.
+const float BOX_PADDING = 1e-5;
+
+
+/*** AABB ***/
+
+AABB::AABB()
+{
+	min = FCoord3D(INFINITY, INFINITY, INFINITY);
+	max = FCoord3D(-INFINITY, -INFINITY, -INFINITY);
+}
+
+void AABB::extend(FCoord3D p)
+{
+	min = FCoord3D(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+	max = FCoord3D(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+}
+
+void AABB::extend(const AABB &box)
+{
+	if (box.isEmpty()) return;
+	extend(box.min);
+	extend(box.max);
+}
+
+FCoord3D AABB::centroid() const
+{
+	return FCoord3D((min.x + max.x) / 2.0, (min.y + max.y) / 2.0, (min.z + max.z) / 2.0);
+}
+
+float AABB::surfaceArea() const
+{
+	if (isEmpty()) return 0.0;
+	float x = max.x - min.x;
+	float y = max.y - min.y;
+	float z = max.z - min.z;
+	return 2.0 * (x * y + y * z + z * x);
+}
+
+bool AABB::isEmpty() const
+{
+	return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+bool AABB::overlaps(const AABB &box) const
+{
+	return min.x <= box.max.x && box.min.x <= max.x &&
+		min.y <= box.max.y && box.min.y <= max.y &&
+		min.z <= box.max.z && box.min.z <= max.z;
+}
+
+
+/*** Public Member Functions ***/
+
+BVH::BVH()
+{
+	nodes = new std::vector<BVHNode>();
+	order = new std::vector<uint32_t>();
+
+	mapping = nullptr;
+	mappedNodes = nullptr;
+	mappedNumNodes = 0;
+	mappedOrder = nullptr;
+	mappedNumPrimitives = 0;
+}
+
+BVH::~BVH()
+{
+	delete nodes;
+	delete order;
+}
+
+void BVH::build(const std::vector<AABB> &boxes)
+{
+	clear();
+
+	int n = boxes.size();
+	if (n == 0) return;
+
+	std::vector<FCoord3D> centroids(n);
+	for (int i = 0; i < n; i++)
+	{
+		centroids[i] = boxes[i].centroid();
+	}
+
+	order->resize(n);
+	std::iota(order->begin(), order->end(), 0);
+	nodes->reserve(2 * n / MAX_LEAF_SIZE + 1);
+	buildNode(boxes, centroids, 0, n, 0);
+}
+
+void BVH::setMappedData(std::shared_ptr<MappedFile> _mapping, const BVHNode* _nodes, int _numNodes,
+	const uint32_t* _order, int _numPrimitives)
+{
+	clear();
+	mapping = _mapping;
+	mappedNodes = _nodes;
+	mappedNumNodes = _numNodes;
+	mappedOrder = _order;
+	mappedNumPrimitives = _numPrimitives;
+}
+
+void BVH::clear()
+{
+	nodes->clear();
+	nodes->shrink_to_fit();
+	order->clear();
+	order->shrink_to_fit();
+
+	mapping = nullptr;
+	mappedNodes = nullptr;
+	mappedNumNodes = 0;
+	mappedOrder = nullptr;
+	mappedNumPrimitives = 0;
+}
+
+bool BVH::isBuilt()
+{
+	return numNodes() > 0;
+}
+
+const BVHNode* BVH::nodeData()
+{
+	return mapping ? mappedNodes : nodes->data();
+}
+
+int BVH::numNodes()
+{
+	return mapping ? mappedNumNodes : nodes->size();
+}
+
+int BVH::primitive(int position)
+{
+	if (mapping)
+	{
+		return mappedOrder ? mappedOrder[position] : position;
+	}
+	return (*order)[position];
+}
+
+int BVH::numPrimitives()
+{
+	return mapping ? mappedNumPrimitives : order->size();
+}
+
+AABB BVH::getBounds()
+{
+	AABB bounds;
+	if (!isBuilt()) return bounds;
+
+	const BVHNode &root = nodeData()[0];
+	bounds.min = FCoord3D(root.min[0], root.min[1], root.min[2]);
+	bounds.max = FCoord3D(root.max[0], root.max[1], root.max[2]);
+	return bounds;
+}
+
+size_t BVH::memoryBytes()
+{
+	return nodes->capacity() * sizeof(BVHNode) + order->capacity() * sizeof(uint32_t);
+}
+
+size_t BVH::estimateBytes(long long numPrimitives)
+{
+	return numPrimitives * (sizeof(BVHNode) + sizeof(uint32_t));
+}
+
+
+/*** Private Member Functions ***/
+
+int BVH::buildNode(const std::vector<AABB> &boxes, const std::vector<FCoord3D> &centroids,
+	int first, int count, int depth)
+{
+	int index = nodes->size();
+	nodes->push_back(BVHNode());
+
+	AABB bounds, centroidBounds;
+	for (int i = first; i < first + count; i++)
+	{
+		bounds.extend(boxes[(*order)[i]]);
+		centroidBounds.extend(centroids[(*order)[i]]);
+	}
+
+	// Find the cheapest split by the surface area heuristic, binning the primitives by centroid.
+	int bestAxis = -1;
+	int bestBin = 0;
+	float bestCost = SAH_INTERSECTION_COST * count;
+	if (count > 1 && depth < BVH_MAX_DEPTH)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float lo = (axis == 0) ? centroidBounds.min.x : (axis == 1) ? centroidBounds.min.y : centroidBounds.min.z;
+			float hi = (axis == 0) ? centroidBounds.max.x : (axis == 1) ? centroidBounds.max.y : centroidBounds.max.z;
+			if (hi <= lo) continue;
+
+			AABB binBounds[SAH_BINS];
+			int binCounts[SAH_BINS] = {0};
+			float scale = SAH_BINS / (hi - lo);
+			for (int i = first; i < first + count; i++)
+			{
+				const FCoord3D &c = centroids[(*order)[i]];
+				float v = (axis == 0) ? c.x : (axis == 1) ? c.y : c.z;
+				int bin = std::min(SAH_BINS - 1, (int)((v - lo) * scale));
+				binCounts[bin]++;
+				binBounds[bin].extend(boxes[(*order)[i]]);
+			}
+
+			// Sweep from the right, then from the left, to cost every split between bins.
+			float rightArea[SAH_BINS];
+			int rightCount[SAH_BINS];
+			AABB right;
+			int n = 0;
+			for (int b = SAH_BINS - 1; b > 0; b--)
+			{
+				right.extend(binBounds[b]);
+				n += binCounts[b];
+				rightArea[b] = right.surfaceArea();
+				rightCount[b] = n;
+			}
+
+			AABB left;
+			n = 0;
+			for (int b = 1; b < SAH_BINS; b++)
+			{
+				left.extend(binBounds[b - 1]);
+				n += binCounts[b - 1];
+				if (n == 0 || rightCount[b] == 0) continue;
+
+				float cost = SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST *
+					(left.surfaceArea() * n + rightArea[b] * rightCount[b]) / bounds.surfaceArea();
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+	}
+
+	// A large leaf is split even when the heuristic says otherwise, as long as it can be.
+	if (bestAxis < 0 && count > MAX_LEAF_SIZE && depth < BVH_MAX_DEPTH)
+	{
+		FCoord3D extent = centroidBounds.max.minus(centroidBounds.min);
+		if (extent.x > 0.0 || extent.y > 0.0 || extent.z > 0.0)
+		{
+			bestAxis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z) ? 1 : 2;
+			bestBin = SAH_BINS / 2;
+		}
+	}
+
+	int leftCount = 0;
+	if (bestAxis >= 0)
+	{
+		float lo = (bestAxis == 0) ? centroidBounds.min.x : (bestAxis == 1) ? centroidBounds.min.y : centroidBounds.min.z;
+		float hi = (bestAxis == 0) ? centroidBounds.max.x : (bestAxis == 1) ? centroidBounds.max.y : centroidBounds.max.z;
+		float scale = SAH_BINS / (hi - lo);
+		uint32_t* middle = std::partition(order->data() + first, order->data() + first + count, [&](uint32_t i)
+		{
+			float v = (bestAxis == 0) ? centroids[i].x : (bestAxis == 1) ? centroids[i].y : centroids[i].z;
+			return std::min(SAH_BINS - 1, (int)((v - lo) * scale)) < bestBin;
+		});
+		leftCount = middle - (order->data() + first);
+	}
+
+	// Pad the box by a fraction of its size and position, so that it also contains nearby rounding errors.
+	FCoord3D size = bounds.max.minus(bounds.min);
+	float reach = std::max(std::max(fabsf(bounds.min.x), fabsf(bounds.max.x)),
+		std::max(std::max(fabsf(bounds.min.y), fabsf(bounds.max.y)), std::max(fabsf(bounds.min.z), fabsf(bounds.max.z))));
+	float pad = BOX_PADDING * (reach + std::max(size.x, std::max(size.y, size.z)));
+	BVHNode &node = (*nodes)[index];
+	node.min[0] = bounds.min.x - pad;
+	node.min[1] = bounds.min.y - pad;
+	node.min[2] = bounds.min.z - pad;
+	node.max[0] = bounds.max.x + pad;
+	node.max[1] = bounds.max.y + pad;
+	node.max[2] = bounds.max.z + pad;
+
+	if (leftCount == 0 || leftCount == count)
+	{
+		node.first = first;
+		node.count = count;
+		return index;
+	}
+
+	// The left child is built first, so it is the next node.
+	buildNode(boxes, centroids, first, leftCount, depth + 1);
+	int right = buildNode(boxes, centroids, first + leftCount, count - leftCount, depth + 1);
+	(*nodes)[index].first = right;
+	(*nodes)[index].count = 0;
+	return index;
+}
@@ -0,0 +1,260 @@
+#ifndef __BVH_H__
+#define __BVH_H__
+
+/* bvh.h
+ *
+ * A bounding volume hierarchy over any set of primitives that have axis-aligned bounding boxes.
+ * It is built with the surface area heuristic, and the nodes are stored depth first (a node's left child
+ * directly follows it) so that a traversal tends to walk forwards through memory.
+ *
+ * The nodes can be owned by the BVH or used in place from a memory-mapped file, like the points and
+ * surfaces of a SurfaceShape. Traversal never reads outside the nodes or primitives it was given, so
+ * a corrupt file can't make it crash.
+ *
+ */
+
+#include <math.h>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "misc.h"
+
+class MappedFile;
+
+struct AABB
+{
+	AABB();
+
+	// Grows the box to contain the point or other box.
+	void extend(FCoord3D p);
+	void extend(const AABB &box);
+	// Returns the center of the box.
+	FCoord3D centroid() const;
+	// Returns the surface area of the box (0 if it is empty).
+	float surfaceArea() const;
+	// Returns true if nothing has been added to the box.
+	bool isEmpty() const;
+	// Returns true if the boxes share any point (touching counts).
+	bool overlaps(const AABB &box) const;
+
+	FCoord3D min;
+	FCoord3D max;
+};
+
+struct BVHNode
+{
+	// The bounds of every primitive below this node.
+	float min[3];
+	float max[3];
+	// For a leaf, the position of the first primitive in the BVH order, and the number of primitives.
+	// For an inner node, count is 0 and first is the index of the right child (the left child is the next node).
+	uint32_t first;
+	uint32_t count;
+};
+
+class BVH
+{
+	public:
+		/*** Public Member Functions ***/
+		BVH();
+		~BVH();
+
+		// Builds the hierarchy over the primitives with the passed boxes.
+		void build(const std::vector<AABB> &boxes);
+		// Uses nodes that live in a mapped file (the mapping is kept alive while they are used).
+		// If order is null, the primitives are already stored in the BVH order.
+		void setMappedData(std::shared_ptr<MappedFile> _mapping, const BVHNode* _nodes, int _numNodes,
+			const uint32_t* _order, int _numPrimitives);
+		// Throws the hierarchy away.
+		void clear();
+
+		// Returns true if the hierarchy has been built or mapped.
+		bool isBuilt();
+		// Returns the nodes, and the number of nodes.
+		const BVHNode* nodeData();
+		int numNodes();
+		// Returns the primitive at the passed position in the BVH order.
+		int primitive(int position);
+		// Returns the number of primitives.
+		int numPrimitives();
+		// Returns the bounds of every primitive.
+		AABB getBounds();
+		// Returns the bytes of memory the nodes and primitive order take (0 if they live in a mapped file).
+		size_t memoryBytes();
+		// Returns about how many bytes a hierarchy built over that many primitives takes (the surface area
+		// heuristic makes about as many nodes as there are primitives).
+		static size_t estimateBytes(long long numPrimitives);
+
+		// Finds the nearest primitive hit by the ray defined by the point and direction vector.
+		// intersect(index, t) tests one primitive, returning true and setting t if it is hit.
+		// When several primitives are hit at the same t, the one with the lowest index is returned.
+		template <class Intersect>
+		bool closestHit(FCoord3D p0, FCoord3D d, float &t, int &index, Intersect intersect);
+		// Returns true if intersect(index) is true for any primitive whose box the segment from p0 to p1 passes through.
+		template <class Intersect>
+		bool anyHit(FCoord3D p0, FCoord3D p1, Intersect intersect);
+
+	private:
+		/*** Private Member Functions ***/
+		// Builds the subtree over order[first, first + count), returning the index of its root node.
+		int buildNode(const std::vector<AABB> &boxes, const std::vector<FCoord3D> &centroids,
+			int first, int count, int depth);
+		// Returns true if the ray enters the node's box before maxT, and the t at which it does.
+		static bool rayHitsNode(const BVHNode &node, FCoord3D p0, FCoord3D invD, float maxT, float &entryT);
+
+		/*** Private Member Variables ***/
+		std::vector<BVHNode>* nodes;
+		// Maps positions in the BVH order to primitive indices.
+		std::vector<uint32_t>* order;
+
+		// The file that mapped nodes live in (null if the BVH owns its nodes).
+		std::shared_ptr<MappedFile> mapping;
+		const BVHNode* mappedNodes;
+		int mappedNumNodes;
+		const uint32_t* mappedOrder;
+		int mappedNumPrimitives;
+};
+
+// Leaves are no deeper than this, which bounds the traversal stack.
+const int BVH_MAX_DEPTH = 64;
+
+
+/*** Template Member Functions ***/
+
+template <class Intersect>
+bool BVH::closestHit(FCoord3D p0, FCoord3D d, float &t, int &index, Intersect intersect)
+{
+	const BVHNode* n = nodeData();
+	int total = numNodes();
+	int primitives = numPrimitives();
+	if (total == 0) return false;
+
+	FCoord3D invD = FCoord3D(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+	bool hit = false;
+	float bestT = INFINITY;
+	int bestIndex = -1;
+
+	int stack[BVH_MAX_DEPTH + 2];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const BVHNode &node = n[stack[--top]];
+		float entryT;
+		if (!rayHitsNode(node, p0, invD, bestT, entryT)) continue;
+
+		if (node.count > 0)
+		{
+			if (node.first > (uint32_t)primitives || node.count > (uint32_t)primitives - node.first) continue;
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				int prim = primitive(i);
+				float currT;
+				if (intersect(prim, currT) && (currT < bestT || (currT == bestT && prim < bestIndex)))
+				{
+					hit = true;
+					bestT = currT;
+					bestIndex = prim;
+				}
+			}
+		}
+		else
+		{
+			int left = (int)(&node - n) + 1;
+			int right = node.first;
+			if (left >= total || right >= total || right <= left || top + 2 > BVH_MAX_DEPTH + 2) continue;
+
+			// Visit the nearer child first, so that further boxes are more likely to be skipped.
+			float leftT, rightT;
+			bool hitLeft = rayHitsNode(n[left], p0, invD, bestT, leftT);
+			bool hitRight = rayHitsNode(n[right], p0, invD, bestT, rightT);
+			if (hitLeft && hitRight)
+			{
+				stack[top++] = (leftT <= rightT) ? right : left;
+				stack[top++] = (leftT <= rightT) ? left : right;
+			}
+			else if (hitLeft)
+			{
+				stack[top++] = left;
+			}
+			else if (hitRight)
+			{
+				stack[top++] = right;
+			}
+		}
+	}
+
+	if (hit)
+	{
+		t = bestT;
+		index = bestIndex;
+	}
+	return hit;
+}
+
+template <class Intersect>
+bool BVH::anyHit(FCoord3D p0, FCoord3D p1, Intersect intersect)
+{
+	const BVHNode* n = nodeData();
+	int total = numNodes();
+	int primitives = numPrimitives();
+	if (total == 0) return false;
+
+	// The segment runs from t = 0 to t = 1 along d.
+	FCoord3D d = p1.minus(p0);
+	FCoord3D invD = FCoord3D(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+
+	int stack[BVH_MAX_DEPTH + 2];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const BVHNode &node = n[stack[--top]];
+		float entryT;
+		if (!rayHitsNode(node, p0, invD, 1.0f, entryT)) continue;
+
+		if (node.count > 0)
+		{
+			if (node.first > (uint32_t)primitives || node.count > (uint32_t)primitives - node.first) continue;
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				if (intersect(primitive(i))) return true;
+			}
+		}
+		else
+		{
+			int left = (int)(&node - n) + 1;
+			int right = node.first;
+			if (left >= total || right >= total || right <= left || top + 2 > BVH_MAX_DEPTH + 2) continue;
+
+			stack[top++] = right;
+			stack[top++] = left;
+		}
+	}
+	return false;
+}
+
+inline bool BVH::rayHitsNode(const BVHNode &node, FCoord3D p0, FCoord3D invD, float maxT, float &entryT)
+{
+	// Slab test. The boxes are padded when they are built, so hits on their faces aren't lost to rounding.
+	float t0 = (node.min[0] - p0.x) * invD.x;
+	float t1 = (node.max[0] - p0.x) * invD.x;
+	float entry = fminf(t0, t1);
+	float leave = fmaxf(t0, t1);
+
+	t0 = (node.min[1] - p0.y) * invD.y;
+	t1 = (node.max[1] - p0.y) * invD.y;
+	entry = fmaxf(entry, fminf(t0, t1));
+	leave = fminf(leave, fmaxf(t0, t1));
+
+	t0 = (node.min[2] - p0.z) * invD.z;
+	t1 = (node.max[2] - p0.z) * invD.z;
+	entry = fmaxf(entry, fminf(t0, t1));
+	leave = fminf(leave, fmaxf(t0, t1));
+
+	entryT = entry;
+	return entry <= leave && leave >= 0.0f && entry <= maxT;
+}
+
+#endif
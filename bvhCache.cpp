@@ -0,0 +1,172 @@
+#include "bvhCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+
+#include "bvh.h"
+#include "mappedFile.h"
+#include "surfaceShape.h"
+
+// Every section starts on a multiple of this many bytes.
+const uint64_t CACHE_ALIGNMENT = 16;
+
+
+/*** Helper Functions ***/
+
+static uint64_t alignCacheOffset(uint64_t offset)
+{
+	return (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+// Returns true if count elements of elementSize bytes starting at offset lie inside the file.
+static bool cacheSectionFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+{
+	if (offset % CACHE_ALIGNMENT != 0 || offset > fileSize) return false;
+	return count <= (fileSize - offset) / elementSize;
+}
+
+// Returns true if the shape's hierarchy should be kept in the cache.
+static bool isCacheable(SurfaceShape* surface)
+{
+	return surface->numSurfaces() >= BVH_CACHE_MIN_SURFACES;
+}
+
+
+/*** Public Functions ***/
+
+int loadBVHCache(std::string fileName, const std::vector<SurfaceShape*>& surfaces,
+	std::shared_ptr<MappedFiles> files)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(fileName, files);
+	if (!file->isOpen() || file->size() < sizeof(BVHCacheHeader)) return 0;
+
+	const char* base = file->data();
+	uint64_t size = file->size();
+
+	BVHCacheHeader h;
+	memcpy(&h, base, sizeof(h));
+	if (memcmp(h.magic, BVH_CACHE_MAGIC, sizeof(h.magic)) != 0 || h.version != BVH_CACHE_VERSION ||
+		!cacheSectionFits(alignCacheOffset(sizeof(h)), h.numEntries, sizeof(BVHCacheEntry), size))
+	{
+		return 0;
+	}
+
+	// Index the entries that lie inside the file.
+	const BVHCacheEntry* entries = (const BVHCacheEntry*)(base + alignCacheOffset(sizeof(h)));
+	std::map<uint64_t, const BVHCacheEntry*> byHash;
+	for (uint32_t i = 0; i < h.numEntries; i++)
+	{
+		const BVHCacheEntry& e = entries[i];
+		if (e.numNodes == 0 || e.numNodes > INT32_MAX || e.numPrimitives > INT32_MAX ||
+			!cacheSectionFits(e.nodesOffset, e.numNodes, sizeof(BVHNode), size) ||
+			!cacheSectionFits(e.orderOffset, e.numPrimitives, sizeof(uint32_t), size))
+		{
+			continue;
+		}
+		byHash[e.geometryHash] = &e;
+	}
+
+	int loaded = 0;
+	for (int i = 0; i < (int)surfaces.size(); i++)
+	{
+		SurfaceShape* surface = surfaces[i];
+		if (surface->getBVH()->isBuilt() || !isCacheable(surface)) continue;
+
+		auto found = byHash.find(surface->geometryHash());
+		if (found == byHash.end() || found->second->numPrimitives != (uint64_t)surface->numSurfaces()) continue;
+
+		// Traversal trusts the order, so check that it only names the shape's surfaces.
+		const BVHCacheEntry& e = *found->second;
+		const uint32_t* order = (const uint32_t*)(base + e.orderOffset);
+		bool valid = true;
+		for (uint64_t k = 0; k < e.numPrimitives && valid; k++)
+		{
+			valid = (order[k] < e.numPrimitives);
+		}
+		if (!valid) continue;
+
+		surface->setMappedBVH(file, (const BVHNode*)(base + e.nodesOffset), (int)e.numNodes, order);
+		loaded++;
+	}
+	return loaded;
+}
+
+bool saveBVHCache(std::string fileName, const std::vector<SurfaceShape*>& surfaces)
+{
+	// Collect one entry per distinct geometry.
+	std::vector<SurfaceShape*> cached;
+	std::map<uint64_t, bool> seen;
+	for (int i = 0; i < (int)surfaces.size(); i++)
+	{
+		SurfaceShape* surface = surfaces[i];
+		if (!surface->getBVH()->isBuilt() || !isCacheable(surface)) continue;
+		if (seen.count(surface->geometryHash())) continue;
+
+		seen[surface->geometryHash()] = true;
+		cached.push_back(surface);
+	}
+	if (cached.empty()) return false;
+
+	BVHCacheHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, BVH_CACHE_MAGIC, sizeof(h.magic));
+	h.version = BVH_CACHE_VERSION;
+	h.numEntries = cached.size();
+
+	// Lay the sections out after the table of entries.
+	std::vector<BVHCacheEntry> entries(cached.size());
+	uint64_t offset = alignCacheOffset(alignCacheOffset(sizeof(h)) + entries.size() * sizeof(BVHCacheEntry));
+	for (int i = 0; i < (int)cached.size(); i++)
+	{
+		BVH* bvh = cached[i]->getBVH();
+		entries[i].geometryHash = cached[i]->geometryHash();
+		entries[i].numPrimitives = bvh->numPrimitives();
+		entries[i].numNodes = bvh->numNodes();
+		entries[i].nodesOffset = offset;
+		offset = alignCacheOffset(offset + entries[i].numNodes * sizeof(BVHNode));
+		entries[i].orderOffset = offset;
+		offset = alignCacheOffset(offset + entries[i].numPrimitives * sizeof(uint32_t));
+	}
+
+	// Shapes may be using hierarchies mapped from the file being replaced, so write a new file and rename it.
+	std::string tempFileName = fileName + ".tmp";
+	std::ofstream file(tempFileName.c_str(), std::ios::binary);
+	if (!file.is_open()) return false;
+
+	static const char zeros[CACHE_ALIGNMENT] = {0};
+	uint64_t written = 0;
+	auto writeAligned = [&](const void* data, uint64_t n)
+	{
+		file.write((const char*)data, n);
+		written += n;
+		uint64_t aligned = alignCacheOffset(written);
+		file.write(zeros, aligned - written);
+		written = aligned;
+	};
+
+	writeAligned(&h, sizeof(h));
+	writeAligned(entries.data(), entries.size() * sizeof(BVHCacheEntry));
+	for (int i = 0; i < (int)cached.size(); i++)
+	{
+		BVH* bvh = cached[i]->getBVH();
+		writeAligned(bvh->nodeData(), entries[i].numNodes * sizeof(BVHNode));
+
+		std::vector<uint32_t> order(entries[i].numPrimitives);
+		for (int k = 0; k < (int)order.size(); k++)
+		{
+			order[k] = bvh->primitive(k);
+		}
+		writeAligned(order.data(), order.size() * sizeof(uint32_t));
+	}
+
+	file.close();
+	if (file.fail() || rename(tempFileName.c_str(), fileName.c_str()) != 0)
+	{
+		remove(tempFileName.c_str());
+		return false;
+	}
+	return true;
+}
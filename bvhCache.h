@@ -0,0 +1,62 @@
+#ifndef __BVHCACHE_H__
+#define __BVHCACHE_H__
+
+/* bvhCache.h
+ *
+ * A sidecar file that keeps the bounding volume hierarchies built for the surface shapes of a scene, so that
+ * loading the scene again maps them from the file instead of building them. It is written next to the
+ * scene file, with BVH_CACHE_EXTENSION added to its name.
+ *
+ * Each hierarchy is keyed by a hash of the points and surfaces it was built over. A hierarchy is only used
+ * by a shape with exactly the same geometry, so editing the scene (or the mesh it imports) makes the stale
+ * entries unused, and they are dropped the next time the file is written.
+ *
+ * The file is a header, a table of entries, then the nodes and primitive order of each hierarchy, each
+ * aligned to 16 bytes. All values are stored in the native (little-endian) byte order.
+ *
+ */
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class MappedFiles;
+class SurfaceShape;
+
+// The first 8 bytes of every cache file.
+const char BVH_CACHE_MAGIC[8] = {'R', 'T', 'B', 'V', 'H', 'C', 'A', 0};
+// The current version of the format. Files with a different version are ignored (and replaced).
+const uint32_t BVH_CACHE_VERSION = 1;
+// Added to the name of the scene file to get the name of its cache.
+const std::string BVH_CACHE_EXTENSION = ".bvhcache";
+// Shapes with fewer surfaces than this are not cached, since their hierarchies are built in no time.
+const int BVH_CACHE_MIN_SURFACES = 4096;
+
+struct BVHCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numEntries;
+};
+
+struct BVHCacheEntry
+{
+	// The hash of the geometry the hierarchy was built over (see SurfaceShape::geometryHash).
+	uint64_t geometryHash;
+	// The number of surfaces (primitives) and nodes.
+	uint64_t numPrimitives;
+	uint64_t numNodes;
+	// The byte offsets of the nodes, and of the surface index at each position in the hierarchy order.
+	uint64_t nodesOffset;
+	uint64_t orderOffset;
+};
+
+// Maps the hierarchies in the cache file into the shapes they were built for (shapes that already have one
+// are skipped), adding the mapping to the set of files. Returns the number of shapes that were given a hierarchy.
+int loadBVHCache(std::string fileName, const std::vector<SurfaceShape*>& surfaces,
+	std::shared_ptr<MappedFiles> files);
+// Writes the hierarchies of the shapes (those that have one) to the cache file, replacing it.
+bool saveBVHCache(std::string fileName, const std::vector<SurfaceShape*>& surfaces);
+
+#endif
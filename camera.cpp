@@ -0,0 +1,191 @@
+#include "camera.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+
+/*** Public Member Functions ***/
+
+Camera::Camera()
+{
+	fromPoint = FCoord3D(1000, 100, 1000);
+	atPoint = FCoord3D(0, 0, 0);
+	upVector = FCoord3D(0, 0, 1);
+	viewingAngleDeg = 30.0;
+}
+
+Camera::Camera(FCoord3D _fromPoint, FCoord3D _atPoint, FCoord3D _upVector, float _viewingAngleDeg)
+{
+	fromPoint = _fromPoint;
+	atPoint = _atPoint;
+	upVector = _upVector;
+	viewingAngleDeg = _viewingAngleDeg;
+}
+
+void Camera::move(Direction d, float f)
+{
+	FCoord3D vForward = atPoint.minus(fromPoint).makeUnit();
+	FCoord3D vRight = vForward.crossProduct(upVector).makeUnit();
+	FCoord3D vUp = vRight.crossProduct(vForward).makeUnit();
+
+	float multi = 1.0;
+
+	switch (d)
+	{
+		case dLeft:
+			multi = -1.0;
+		case dRight:
+			atPoint = atPoint.plus(vRight.multiply(multi * f));
+			fromPoint = fromPoint.plus(vRight.multiply(multi * f));
+			break;
+
+		case dDown:
+			multi = -1.0;
+		case dUp:
+			atPoint = atPoint.plus(vUp.multiply(multi * f));
+			fromPoint = fromPoint.plus(vUp.multiply(multi * f));
+			break;
+
+		case dBackward:
+			multi = -1.0;
+		case dForward:
+			atPoint = atPoint.plus(vForward.multiply(multi * f));
+			fromPoint = fromPoint.plus(vForward.multiply(multi * f));
+			break;
+
+		default:
+			break;
+	}
+}
+
+void Camera::moveAtPoint(Direction d, float f)
+{
+	FCoord3D vForward = atPoint.minus(fromPoint).makeUnit();
+	FCoord3D vRight = vForward.crossProduct(upVector).makeUnit();
+	FCoord3D vUp = vRight.crossProduct(vForward).makeUnit();
+
+	float multi = 1.0;
+
+	switch (d)
+	{
+		case dLeft:
+			multi = -1.0;
+		case dRight:
+			atPoint = atPoint.plus(vRight.multiply(multi * f));
+			break;
+
+		case dDown:
+			multi = -1.0;
+		case dUp:
+			atPoint = atPoint.plus(vUp.multiply(multi * f));
+			break;
+
+		case dBackward:
+			multi = -1.0;
+		case dForward:
+			atPoint = atPoint.plus(vForward.multiply(multi * f));
+			break;
+
+		default:
+			break;
+	}
+}
+
+void Camera::moveFromPoint(Direction d, float f)
+{
+	FCoord3D vForward = atPoint.minus(fromPoint).makeUnit();
+	FCoord3D vRight = vForward.crossProduct(upVector).makeUnit();
+	FCoord3D vUp = vRight.crossProduct(vForward).makeUnit();
+
+	float multi = 1.0;
+
+	switch (d)
+	{
+		case dLeft:
+			multi = -1.0;
+		case dRight:
+			fromPoint = fromPoint.plus(vRight.multiply(multi * f));
+			break;
+
+		case dDown:
+			multi = -1.0;
+		case dUp:
+			fromPoint = fromPoint.plus(vUp.multiply(multi * f));
+			break;
+
+		case dBackward:
+			multi = -1.0;
+		case dForward:
+			fromPoint = fromPoint.plus(vForward.multiply(multi * f));
+			break;
+
+		default:
+			break;
+	}
+}
+
+void Camera::orbit(float angleDeg)
+{
+	// Rodrigues' rotation of the offset from the at point.
+	FCoord3D k = upVector.makeUnit();
+	FCoord3D v = fromPoint.minus(atPoint);
+	float c = cos(angleDeg * M_PI / 180.0);
+	float s = sin(angleDeg * M_PI / 180.0);
+	v = v.multiply(c).plus(k.crossProduct(v).multiply(s)).plus(k.multiply(k.dotProduct(v) * (1.0 - c)));
+	fromPoint = atPoint.plus(v);
+}
+
+void Camera::getBasis(FCoord3D &b1, FCoord3D &b2, FCoord3D &b3)
+{
+	b3 = atPoint.minus(fromPoint).makeUnit();
+	b1 = b3.crossProduct(upVector).makeUnit();
+	b2 = b1.crossProduct(b3).makeUnit();
+}
+
+float Camera::getFocalLength()
+{
+	return 1.0 / (2.0 * tan(viewingAngleDeg * M_PI / 180.0));
+}
+
+FCoord3D Camera::getRayDir(float i, float j, int width, int height)
+{
+	assert(atPoint.minus(fromPoint).length() != 0.0);
+
+	FCoord3D b1, b2, b3;
+	getBasis(b1, b2, b3);
+
+	float span = (float)(std::min(width, height) - 1);
+	FCoord3D ptEye = FCoord3D(
+		(i / span) - 0.5 * (width - 1) / span,
+		(j / span) - 0.5 * (height - 1) / span,
+		getFocalLength()
+	);
+
+	FCoord3D ptWorld = FCoord3D(
+		fromPoint.x + (ptEye.x * b1.x) + (ptEye.y * b2.x) + (ptEye.z * b3.x),
+		fromPoint.y + (ptEye.x * b1.y) + (ptEye.y * b2.y) + (ptEye.z * b3.y),
+		fromPoint.z + (ptEye.x * b1.z) + (ptEye.y * b2.z) + (ptEye.z * b3.z)
+	);
+
+	return ptWorld.minus(fromPoint).makeUnit();
+}
+
+void Camera::read(std::istream& s)
+{
+	fromPoint.read(s);
+	atPoint.read(s);
+	upVector.read(s);
+
+	float f;
+	s >> f;
+	viewingAngleDeg = f;
+}
+
+void Camera::write(std::ostream& s)
+{
+	fromPoint.write(s);
+	atPoint.write(s);
+	upVector.write(s);
+	s << viewingAngleDeg << std::endl;
+}
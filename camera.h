@@ -0,0 +1,56 @@
+#ifndef __CAMERA_H__
+#define __CAMERA_H__
+
+/* camera.h
+ *
+ * Defines the camera viewing model: where the camera is, where it looks, which way is up, and how wide it sees.
+ * A camera is kept apart from the scene, so that the same scene can be rendered from several cameras at once.
+ *
+ */
+
+#include <istream>
+#include <ostream>
+
+#include "misc.h"
+
+// The fewest bytes a camera written as text can take: 10 numbers of a digit and a space each.
+const int CAMERA_MIN_TEXT_BYTES = 20;
+
+struct Camera
+{
+	// Constructors.
+	Camera();
+	Camera(FCoord3D _fromPoint, FCoord3D _atPoint, FCoord3D _upVector, float _viewingAngleDeg);
+
+	// Moves the camera/atPoint/fromPoint in relation to the current viewing direction.
+	void move(Direction d, float f);
+	void moveAtPoint(Direction d, float f);
+	void moveFromPoint(Direction d, float f);
+	// Turns the from point around the line through the at point along the up vector (counterclockwise when
+	// looking down it), keeping its distance.
+	void orbit(float angleDeg);
+
+	// Returns the unit vectors to the right of, up from and along the viewing direction.
+	void getBasis(FCoord3D &b1, FCoord3D &b2, FCoord3D &b3);
+	// Returns the distance from the eye to an image plane that the viewing angle spans 1 unit of.
+	float getFocalLength();
+	// Returns the direction of the ray through a (fractional) pixel of an image of the given size. The viewing
+	// angle spans the shorter side of the image, and pixels are square.
+	FCoord3D getRayDir(float i, float j, int width, int height);
+
+	// Reads the camera from the stream (in the scene file format).
+	void read(std::istream& s);
+	// Writes the camera to the stream (in the scene file format).
+	void write(std::ostream& s);
+
+	// The point where the camera resides.
+	FCoord3D fromPoint;
+	// The point where the camera is looking.
+	FCoord3D atPoint;
+	// The "up" direction.
+	FCoord3D upVector;
+	// How wide the camera view angle is.
+	float viewingAngleDeg;
+};
+
+#endif
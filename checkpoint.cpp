@@ -0,0 +1,207 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include "misc.h"
+
+// Written at the start of every checkpoint file.
+static const char CHECKPOINT_MAGIC[8] = {'R', 'T', 'C', 'H', 'E', 'C', 'K', '1'};
+// The magic bytes, the frame key, and the number of floats per pixel (padded to 8 bytes).
+const std::streamoff CHECKPOINT_HEADER_SIZE = 8 + 8 + 8;
+// Each tile record starts with its rectangle (x0, y0, x1, y1).
+const std::streamoff TILE_HEADER_SIZE = 4 * sizeof(int32_t);
+
+
+/*** Public Member Functions ***/
+
+Checkpoint::Checkpoint()
+{
+	fileName = "";
+	intervalSeconds = CHECKPOINT_INTERVAL_DEFAULT;
+
+	frameKey = 0;
+	frameFloatsPerPixel = 0;
+	inFrame = false;
+	tiles = new std::map<uint64_t, TileRecord>();
+	tilesRestored = 0;
+	lastFlushMs = 0.0;
+}
+
+Checkpoint::~Checkpoint()
+{
+	delete tiles;
+}
+
+void Checkpoint::setFile(std::string _fileName, double _intervalSeconds)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// A frame in progress keeps using the old file.
+	fileName = _fileName;
+	intervalSeconds = _intervalSeconds;
+}
+
+std::string Checkpoint::getFileName()
+{
+	return fileName;
+}
+
+bool Checkpoint::isEnabled()
+{
+	return fileName != "";
+}
+
+int Checkpoint::beginFrame(uint64_t key, int floatsPerPixel)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	output.close();
+	input.close();
+	tiles->clear();
+	tilesRestored = 0;
+	inFrame = false;
+	if (fileName == "") return 0;
+
+	frameKey = key;
+	frameFloatsPerPixel = floatsPerPixel;
+
+	// Carry on from the tiles in the file, dropping a record that was only partly written.
+	std::streamoff valid = readFile(key, floatsPerPixel);
+	if (valid > 0)
+	{
+		std::error_code error;
+		std::filesystem::resize_file(fileName, valid, error);
+		output.open(fileName.c_str(), std::ios::binary | std::ios::app);
+	}
+	else
+	{
+		output.open(fileName.c_str(), std::ios::binary | std::ios::trunc);
+		int32_t fpp[2] = {floatsPerPixel, 0};
+		output.write(CHECKPOINT_MAGIC, 8);
+		output.write((const char*)&key, sizeof(key));
+		output.write((const char*)fpp, sizeof(fpp));
+	}
+	if (!output.is_open())
+	{
+		tiles->clear();
+		return 0;
+	}
+
+	input.clear();
+	input.open(fileName.c_str(), std::ios::binary);
+	lastFlushMs = nowMs();
+	inFrame = true;
+	return tiles->size();
+}
+
+bool Checkpoint::restoreTile(int x0, int y0, int x1, int y1, std::vector<float>& data)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!inFrame) return false;
+
+	auto found = tiles->find(tileKey(x0, y0));
+	if (found == tiles->end() || found->second.x1 != x1 || found->second.y1 != y1) return false;
+
+	data.resize((size_t)(x1 - x0) * (y1 - y0) * frameFloatsPerPixel);
+	input.clear();
+	input.seekg(found->second.offset);
+	input.read((char*)data.data(), data.size() * sizeof(float));
+	if (!input) return false;
+
+	tilesRestored++;
+	return true;
+}
+
+void Checkpoint::saveTile(int x0, int y0, int x1, int y1, const std::vector<float>& data)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!inFrame) return;
+
+	int32_t rect[4] = {x0, y0, x1, y1};
+	output.write((const char*)rect, sizeof(rect));
+	output.write((const char*)data.data(), data.size() * sizeof(float));
+
+	if (nowMs() - lastFlushMs >= intervalSeconds * 1000.0)
+	{
+		output.flush();
+		lastFlushMs = nowMs();
+	}
+}
+
+void Checkpoint::endFrame()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!inFrame) return;
+
+	output.close();
+	input.close();
+	std::error_code error;
+	std::filesystem::remove(fileName, error);
+	tiles->clear();
+	inFrame = false;
+}
+
+void Checkpoint::printStatus(std::ostream& s)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if (fileName == "")
+	{
+		s << "Checkpoints are off." << std::endl;
+		return;
+	}
+	s << "Checkpoints are kept in \"" << fileName << "\", written every " << intervalSeconds << " s";
+	if (inFrame)
+	{
+		s << " (" << tilesRestored << " of " << tiles->size() << " saved tiles restored)";
+	}
+	s << "." << std::endl;
+}
+
+
+/*** Private Member Functions ***/
+
+std::streamoff Checkpoint::readFile(uint64_t key, int floatsPerPixel)
+{
+	std::error_code error;
+	std::streamoff length = std::filesystem::file_size(fileName, error);
+	if (error) return 0;
+
+	std::ifstream file(fileName.c_str(), std::ios::binary);
+	char magic[8];
+	uint64_t fileKey = 0;
+	int32_t fpp[2] = {0, 0};
+	file.read(magic, 8);
+	file.read((char*)&fileKey, sizeof(fileKey));
+	file.read((char*)fpp, sizeof(fpp));
+	if (!file || !std::equal(magic, magic + 8, CHECKPOINT_MAGIC) || fileKey != key || fpp[0] != floatsPerPixel)
+	{
+		return 0;
+	}
+
+	std::streamoff offset = CHECKPOINT_HEADER_SIZE;
+	while (offset + TILE_HEADER_SIZE <= length)
+	{
+		int32_t rect[4];
+		file.seekg(offset);
+		file.read((char*)rect, sizeof(rect));
+		if (!file || rect[2] <= rect[0] || rect[3] <= rect[1]) break;
+
+		std::streamoff dataSize = (std::streamoff)(rect[2] - rect[0]) * (rect[3] - rect[1]) * floatsPerPixel * sizeof(float);
+		if (offset + TILE_HEADER_SIZE + dataSize > length) break;
+
+		TileRecord record;
+		record.x1 = rect[2];
+		record.y1 = rect[3];
+		record.offset = offset + TILE_HEADER_SIZE;
+		(*tiles)[tileKey(rect[0], rect[1])] = record;
+		offset += TILE_HEADER_SIZE + dataSize;
+	}
+	return offset;
+}
+
+uint64_t Checkpoint::tileKey(int x0, int y0)
+{
+	return ((uint64_t)(uint32_t)x0 << 32) | (uint32_t)y0;
+}
@@ -0,0 +1,95 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+/* checkpoint.h
+ *
+ * Keeps the finished tiles of the frame being rendered in a file, so that a long render that is interrupted
+ * (by a crash, or by the machine being preempted) can be resumed without tracing those tiles again.
+ *
+ * The file starts with the key of the frame (a hash of the scene, the resolution and the render settings),
+ * followed by one record per finished tile: its rectangle, then its per-pixel data. Records are only ever
+ * appended, and written out at least every flush interval. A record that was cut short when the process
+ * died is ignored. A frame with a different key starts the file over, and the file is removed once its
+ * frame has finished.
+ *
+ */
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// How often (in seconds) finished tiles are written out, unless set otherwise.
+const double CHECKPOINT_INTERVAL_DEFAULT = 30.0;
+
+class Checkpoint
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates a checkpoint that is disabled until a file is set.
+		Checkpoint();
+		~Checkpoint();
+
+		// Sets the file that checkpoints are kept in (empty to disable), and how often it is written to.
+		void setFile(std::string _fileName, double _intervalSeconds);
+		std::string getFileName();
+		// Returns true if a file has been set.
+		bool isEnabled();
+
+		// Starts a frame with the given key, where each pixel is stored as floatsPerPixel values. If the file holds
+		// tiles of a frame with the same key, they can be restored. Otherwise the file is started over.
+		// Returns the number of tiles that can be restored.
+		int beginFrame(uint64_t key, int floatsPerPixel);
+		// If the tile [x0, x1) x [y0, y1) was finished in the checkpoint, fills data with its pixels
+		// (row by row, from y0 up) and returns true. Can be called from any thread.
+		bool restoreTile(int x0, int y0, int x1, int y1, std::vector<float>& data);
+		// Adds a finished tile to the checkpoint. Can be called from any thread.
+		void saveTile(int x0, int y0, int x1, int y1, const std::vector<float>& data);
+		// Called when the frame has finished. The file is no longer needed, so it is removed.
+		void endFrame();
+
+		// Prints the file, and how much of the current frame it holds.
+		void printStatus(std::ostream& s);
+
+	private:
+		/*** Private Member Types ***/
+		// Where a finished tile is in the file.
+		struct TileRecord
+		{
+			int x1;
+			int y1;
+			std::streamoff offset;
+		};
+
+		/*** Private Member Functions ***/
+		// Reads the tile records of the file, if its key matches. Returns the length of the valid part of the file.
+		std::streamoff readFile(uint64_t key, int floatsPerPixel);
+		// Returns the key of a tile in the tiles map.
+		static uint64_t tileKey(int x0, int y0);
+
+		/*** Private Member Variables ***/
+		std::string fileName;
+		double intervalSeconds;
+
+		// The key of the current frame, and the values stored per pixel.
+		uint64_t frameKey;
+		int frameFloatsPerPixel;
+		// True between beginFrame() and endFrame().
+		bool inFrame;
+		// The finished tiles of the current frame, by the corner they start at.
+		std::map<uint64_t, TileRecord>* tiles;
+		// The number of tiles that were restored from the file.
+		int tilesRestored;
+
+		std::ofstream output;
+		std::ifstream input;
+		// When the output was last flushed (in milliseconds).
+		double lastFlushMs;
+
+		std::mutex mutex;
+};
+
+#endif
@@ -1,14 +1,34 @@
 #include "commandHandler.h"
 
+#include <algorithm>
+#include <assert.h>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include "animation.h"
+#include "batchRenderer.h"
+#include "camera.h"
+#include "checkpoint.h"
+#include "fileWatcher.h"
+#include "frameCache.h"
+#include "imageWriter.h"
 #include "implicitShape.h"
+#include "mappedFile.h"
+#include "memoryUsage.h"
+#include "meshImport.h"
+#include "metrics.h"
+#include "numaBenchmark.h"
 #include "phongLightSource.h"
+#include "renderCluster.h"
 #include "shape.h"
 #include "shapeCollection.h"
-#include "main.h"
+#include "surfaceShape.h"
+#include "threadPool.h"
+#include "tileOrder.h"
 #include "viewport.h"
 
 
@@ -20,14 +40,37 @@ CommandHandler::CommandHandler()
 	input = "";
 	loadedFileName = "";
 	savedFileName = "";
+	cameras = new std::vector<Camera>();
+	animation = nullptr;
+	checkpoint = nullptr;
+	cluster = nullptr;
+	fileWatcher = nullptr;
+	imageWriter = nullptr;
+	metrics = nullptr;
+	memoryBudget = 0;
+	
+	for (int i = 0; i < (int)commandAliases.size(); i++)
+	{
+		bool added = commandMap.insert(commandAliases.at(i)).second;
+		if (!added)
+		{
+			std::cout << "The command alias \"" << commandAliases.at(i).first << "\" is used twice." << std::endl;
+		}
+		assert(added);
+	}
 }
 
-void CommandHandler::getUserInput()
+bool CommandHandler::getUserInput()
 {
 	std::cout << prompt;
-	std::getline(std::cin, input);
+	if (!std::getline(std::cin, input))
+	{
+		std::cout << std::endl;
+		return false;
+	}
 	
 	parseInput();
+	return true;
 }
 
 Command CommandHandler::execute(ShapeCollection* sc, Viewport* viewport, bool &redraw)
@@ -52,6 +95,14 @@ Command CommandHandler::execute(ShapeCollection* sc, Viewport* viewport, bool &r
 		return cError;
 	}
 	
+	// Remember the scene from before the command, so that it can be undone. Commands that only move the camera
+	// only need the camera.
+	SceneSnapshot sceneBefore;
+	if (isSceneCommand(command))
+	{
+		sceneBefore = sc->snapshot(isCameraCommand(command));
+	}
+	
 	// Execute the correct command on the shapeCollection/viewport.
 	redraw = true;
 	bool notEnoughArgs = false;
@@ -134,6 +185,86 @@ Command CommandHandler::execute(ShapeCollection* sc, Viewport* viewport, bool &r
 			break;
 		}
 		
+		case cAnimate:
+		{
+			if (!animation)
+			{
+				std::cout << "Animation is not available." << std::endl;
+			}
+			else if (args == 1)
+			{
+				animation->printStatus(std::cout);
+			}
+			else if (getArgString(1) == "key" && args > 2)
+			{
+				animation->addKey(getArgInt(2), viewport);
+				std::cout << "Recorded the camera and lights as the keyframe at frame " << getArgInt(2) << "." << std::endl;
+			}
+			else if (getArgString(1) == "remove" && args > 2)
+			{
+				if (!animation->removeKey(getArgInt(2)))
+				{
+					std::cout << "There is no keyframe at frame " << getArgInt(2) << "." << std::endl;
+				}
+			}
+			else if (getArgString(1) == "clear")
+			{
+				animation->clear();
+			}
+			else if (getArgString(1) == "render" && args > 2 && ImageWriter::formatOf(getArgString(2)) != ifUnknown)
+			{
+				int frames = (args > 3) ? getArgInt(3) : animation->numFrames();
+				if (!animation->render(viewport, sc, frames, getArgPath(2), args > 4 ? getArgInt(4) : 0))
+				{
+					std::cout << "There are no keyframes to render." << std::endl;
+				}
+				else
+				{
+					animation->printStatus(std::cout);
+				}
+			}
+			else
+			{
+				std::cout << "Usage: animate [key <frame> | remove <frame> | clear | render <file> [frames] [frames at once]]"
+					<< std::endl;
+			}
+			redraw = false;
+			break;
+		}
+		
+		case cAntiAliasing:
+		{
+			if (args == 1)
+			{
+				std::cout << "Anti-aliasing uses up to " << viewport->getAntiAliasingSamples()
+					<< " samples per pixel (threshold " << viewport->getAntiAliasingThreshold() << ")." << std::endl;
+				redraw = false;
+			}
+			else
+			{
+				float threshold = (args > 2) ? getArgFloat(2) : viewport->getAntiAliasingThreshold();
+				viewport->setAntiAliasing(getArgInt(1), threshold);
+				if (getArgInt(1) > 1 && viewport->getAntiAliasingSamples() != getArgInt(1))
+				{
+					if (viewport->getAntiAliasingSamples() > 1)
+					{
+						std::cout << "Anti-aliasing uses a square grid of samples, so it uses up to "
+							<< viewport->getAntiAliasingSamples() << " samples per pixel." << std::endl;
+					}
+					else
+					{
+						std::cout << "Anti-aliasing needs at least 4 samples (a 2x2 grid), so it is off." << std::endl;
+					}
+				}
+				if (viewport->getAntiAliasingSamples() > 1 && !viewport->getKeepFrame())
+				{
+					std::cout << "Frames streamed to a file are written as their tiles finish, so they are not"
+						<< " anti-aliased (PNG and PFM files are written whole)." << std::endl;
+				}
+			}
+			break;
+		}
+		
 		case cAtPointMove:
 		{
 			if (args <= 2)
@@ -147,6 +278,135 @@ Command CommandHandler::execute(ShapeCollection* sc, Viewport* viewport, bool &r
 			break;
 		}
 		
+		case cBudget:
+		{
+			if (args == 1)
+			{
+				if (viewport->getBudget() > 0.0)
+				{
+					std::cout << "Redraws have a budget of " << viewport->getBudget() << " ms." << std::endl;
+				}
+				else
+				{
+					std::cout << "Redraws have no time budget." << std::endl;
+				}
+				redraw = false;
+			}
+			else if (getArgString(1) == "off")
+			{
+				viewport->setBudget(0.0);
+			}
+			else
+			{
+				viewport->setBudget(getArgFloat(1));
+				if (viewport->getBudget() > 0.0 && !viewport->getKeepFrame())
+				{
+					std::cout << "Frames streamed to a file are written as their tiles finish, so they have no time"
+						<< " budget (PNG and PFM files are written whole)." << std::endl;
+				}
+			}
+			break;
+		}
+		
+		case cCache:
+		{
+			FrameCache* cache = viewport->getFrameCache();
+			if (!cache)
+			{
+				std::cout << "There is no frame cache." << std::endl;
+			}
+			else if (args == 1)
+			{
+				cache->printStatus(std::cout);
+			}
+			else if (getArgString(1) == "on" || getArgString(1) == "off")
+			{
+				cache->setEnabled(getArgString(1) == "on");
+			}
+			else if (getArgString(1) == "clear")
+			{
+				cache->clear();
+			}
+			else if (getArgString(1) == "mem" && args > 2)
+			{
+				cache->setMemoryLimit(getArgInt(2));
+			}
+			else if (getArgString(1) == "dir" && args > 2)
+			{
+				cache->setDirectory(getArgString(2) == "off" ? "" : getArgPath(2), args > 3 ? getArgInt(3) : 1024);
+			}
+			else
+			{
+				std::cout << "Usage: cache [on | off | clear | mem <MB> | dir <directory | off> [MB]]" << std::endl;
+			}
+			redraw = false;
+			break;
+		}
+		
+		case cCheckpoint:
+		{
+			if (!checkpoint)
+			{
+				std::cout << "Checkpoints are not available." << std::endl;
+			}
+			else if (args == 1)
+			{
+				checkpoint->printStatus(std::cout);
+			}
+			else if (getArgString(1) == "off")
+			{
+				checkpoint->setFile("", CHECKPOINT_INTERVAL_DEFAULT);
+			}
+			else
+			{
+				checkpoint->setFile(getArgPath(1), args > 2 ? getArgFloat(2) : CHECKPOINT_INTERVAL_DEFAULT);
+			}
+			redraw = false;
+			break;
+		}
+		
+		case cCluster:
+		{
+			if (!cluster)
+			{
+				std::cout << "Render workers are not available." << std::endl;
+			}
+			else if (args == 1)
+			{
+				cluster->printStatus(std::cout);
+			}
+			else if (getArgString(1) == "off")
+			{
+				cluster->stop();
+				std::cout << "Render workers disconnected." << std::endl;
+			}
+			else if (getArgString(1) == "timeout")
+			{
+				if (args > 2)
+				{
+					cluster->setTileTimeout(getArgInt(2));
+				}
+				std::cout << "Render workers that don't finish a tile in " << cluster->getTileTimeout()
+					<< " ms are dropped." << std::endl;
+			}
+			else if (!cluster->listen(getArgInt(1)))
+			{
+				std::cout << "Could not listen on port " << getArgInt(1) << "." << std::endl;
+			}
+			else
+			{
+				std::cout << "Listening for render workers on port " << cluster->getPort() << "." << std::endl;
+				if (args > 2)
+				{
+					// Scripts can wait for their workers, so that the next frame is already shared between them.
+					int joined = cluster->waitForWorkers(getArgInt(2), CLUSTER_JOIN_TIMEOUT_MS);
+					std::cout << joined << " of " << getArgInt(2) << " render workers joined." << std::endl;
+				}
+			}
+			redraw = false;
+			break;
+		}
+		
 		case cCameraMove:
 		{
 			if (args <= 2)
@@ -160,6 +420,141 @@ Command CommandHandler::execute(ShapeCollection* sc, Viewport* viewport, bool &r
 			break;
 		}
 		
+		case cCameras:
+		{
+			if (args == 1)
+			{
+				std::cout << cameras->size() << " cameras." << std::endl;
+				for (int i = 0; i < (int)cameras->size(); i++)
+				{
+					Camera c = cameras->at(i);
+					std::cout << i << ": from (" << c.fromPoint.x << ", " << c.fromPoint.y << ", " << c.fromPoint.z
+						<< ") at (" << c.atPoint.x << ", " << c.atPoint.y << ", " << c.atPoint.z << "), angle "
+						<< c.viewingAngleDeg << "." << std::endl;
+				}
+			}
+			else if (getArgString(1) == "add")
+			{
+				cameras->push_back(viewport->getCamera());
+				std::cout << "Added the camera as camera " << cameras->size() - 1 << "." << std::endl;
+			}
+			else if (getArgString(1) == "orbit" && args > 2 && getArgInt(2) > 0)
+			{
+				// The cameras are spread evenly around the at point, starting from the current one.
+				for (int i = 0; i < getArgInt(2); i++)
+				{
+					Camera c = viewport->getCamera();
+					c.orbit(360.0 * i / getArgInt(2));
+					cameras->push_back(c);
+				}
+				std::cout << "Added " << getArgInt(2) << " cameras around the at point." << std::endl;
+			}
+			else if (getArgString(1) == "clear")
+			{
+				cameras->clear();
+			}
+			else if (getArgString(1) == "save" && args > 2)
+			{
+				std::ofstream file(getArgPath(2));
+				file.precision(std::numeric_limits<float>::max_digits10);
+				file << cameras->size() << std::endl;
+				for (int i = 0; i < (int)cameras->size(); i++)
+				{
+					cameras->at(i).write(file);
+				}
+				if (file)
+				{
+					std::cout << "Saved " << cameras->size() << " cameras to \"" << getArgPath(2) << "\"." << std::endl;
+				}
+				else
+				{
+					std::cout << "Failed to save to file \"" << getArgPath(2) << "\"." << std::endl;
+				}
+			}
+			else if (getArgString(1) == "load" && args > 2)
+			{
+				std::ifstream file(getArgPath(2));
+				int n = 0;
+				file >> n;
+				// A damaged count is refused (before anything is allocated for it) if the cameras couldn't fit in the
+				// rest of the file.
+				std::streamoff count = file.tellg();
+				file.seekg(0, std::ios::end);
+				std::streamoff size = file.tellg();
+				file.seekg(count);
+				if (n > (size - count) / CAMERA_MIN_TEXT_BYTES) n = 0;
+				std::vector<Camera> loaded(std::max(n, 0));
+				for (int i = 0; i < (int)loaded.size(); i++)
+				{
+					loaded[i].read(file);
+				}
+				if (!file || n <= 0)
+				{
+					std::cout << "Failed to load cameras from \"" << getArgPath(2) << "\"." << std::endl;
+				}
+				else
+				{
+					cameras->insert(cameras->end(), loaded.begin(), loaded.end());
+					std::cout << "Loaded " << n << " cameras from \"" << getArgPath(2) << "\"." << std::endl;
+				}
+			}
+			else if (getArgString(1) == "render" && args > 2 && ImageWriter::formatOf(getArgString(2)) != ifUnknown)
+			{
+				if (cameras->empty())
+				{
+					std::cout << "There are no cameras to render from." << std::endl;
+				}
+				else if (!imageWriter)
+				{
+					std::cout << "Image output is not available." << std::endl;
+				}
+				else
+				{
+					// Every camera renders the same shapes, so they are loaded and prepared once.
+					std::vector<BatchView> views(cameras->size());
+					for (int i = 0; i < (int)views.size(); i++)
+					{
+						views[i].number = i;
+						views[i].camera = cameras->at(i);
+						views[i].fileName = BatchRenderer::numberedFileName(getArgPath(2), i, views.size());
+					}
+					BatchRenderer batch(viewport->getThreadPool(), imageWriter, metrics, "View");
+					int inFlight = batch.render(viewport, sc, views, args > 3 ? getArgInt(3) : 0);
+					std::cout << "Rendered " << views.size() << " views (" << inFlight << " at once) in "
+						<< batch.getRenderMs() << " ms." << std::endl;
+				}
+			}
+			else
+			{
+				std::cout << "Usage: cameras [add | orbit <count> | clear | save <file> | load <file> | render <file> [views at once]]"
+					<< std::endl;
+			}
+			redraw = false;
+			break;
+		}
+		
+		case cConvert:
+		{
+			if (args <= 2) notEnoughArgs = true;
+			else
+			{
+				double startMs = nowMs();
+				bool success = ShapeCollection::convertFile(getArgPath(1), getArgPath(2));
+				if (success)
+				{
+					std::cout << "Converted \"" << getArgPath(1) << "\" to \"" << getArgPath(2)
+						<< "\" in " << (nowMs() - startMs) << " ms." << std::endl;
+				}
+				else
+				{
+					std::cout << "Failed to convert \"" << getArgPath(1) << "\" to \""
+						<< getArgPath(2) << "\"." << std::endl;
+				}
+			}
+			redraw = false;
+			break;
+		}
+		
 		case cDelete:
 		{
 			if (args <= 1)
@@ -199,6 +594,43 @@ Command CommandHandler::execute(ShapeCollection* sc, Viewport* viewport, bool &r
 			break;
 		}
 		
+		case cImage:
+		{
+			if (!imageWriter)
+			{
+				std::cout << "Image output is not available." << std::endl;
+			}
+			else if (args == 1)
+			{
+				imageWriter->printStatus(std::cout);
+			}
+			else if (getArgString(1) == "gamma" && args > 2)
+			{
+				imageWriter->setGamma(getArgFloat(2));
+			}
+			else if (getArgString(1) == "wait")
+			{
+				imageWriter->wait();
+				imageWriter->printStatus(std::cout);
+			}
+			else if (ImageWriter::formatOf(getArgString(1)) == ifUnknown)
+			{
+				std::cout << "Usage: image [<file>.ppm | <file>.png | <file>.pfm | gamma <value> | wait]" << std::endl;
+			}
+			else
+			{
+				// The current frame (or its region) is copied, and written while the next commands run.
+				int x0, y0, x1, y1;
+				viewport->getRegion(x0, y0, x1, y1);
+				std::vector<float> pixels;
+				viewport->readPixels(x0, y0, x1, y1, pixels);
+				imageWriter->write(getArgPath(1), x1 - x0, y1 - y0, std::move(pixels));
+				std::cout << "Writing " << (x1 - x0) << "x" << (y1 - y0) << " image to \"" << getArgPath(1) << "\"." << std::endl;
+			}
+			redraw = false;
+			break;
+		}
+		
 		case cLight:
 		{
 			if (args <= 7)
@@ -224,17 +656,177 @@ Command CommandHandler::execute(ShapeCollection* sc, Viewport* viewport, bool &r
 			if (args <= 1) notEnoughArgs = true;
 			else
 			{
-				bool success = sc->loadFromFile(getArgString(1));
-				if (success)
+				// With a budget, loading stops as soon as the new shapes are known not to fit.
+				bool success = sc->loadFromFile(getArgPath(1), getLoadLimit(viewport));
+				if (success && isMeshFile(getArgPath(1)))
+				{
+					// Imported meshes come in their own units, so they can be moved and scaled into the scene.
+					if (args > 5)
+					{
+						SurfaceShape* mesh = (SurfaceShape*)sc->get(sc->numShapes() - 1);
+						FCoord3D min, max;
+						mesh->getBounds(min, max);
+						float extent = std::max(max.x - min.x, std::max(max.y - min.y, max.z - min.z));
+						float scale = (extent > 0.0) ? getArgFloat(5) / extent : 1.0;
+						mesh->translate(-(min.x + max.x) / 2.0, -(min.y + max.y) / 2.0, -(min.z + max.z) / 2.0);
+						mesh->scaleOrigin(scale, scale, scale);
+						mesh->translate(getArgFloat(2), getArgFloat(3), getArgFloat(4));
+					}
+					// The scene is never saved back over the mesh file.
+					std::cout << "Imported \"" << getArgPath(1) << "\" successfully." << std::endl;
+				}
+				else if (success)
+				{
+					std::cout << "Loaded from \"" << getArgPath(1) << "\" successfully." << std::endl;
+					loadedFileName = getArgPath(1);
+				}
+				else
+				{
+					std::cout << "Failed to load from file \"" << getArgPath(1) << "\"." << std::endl;
+				}
+				
+				// The estimate is checked again with the hierarchies built, and a scene that doesn't fit (even once
+				// the caches are emptied) is rolled back.
+				if (success && !fitsMemoryBudget(sc, viewport, getArgPath(1)))
+				{
+					sc->restore(sceneBefore);
+					redraw = false;
+				}
+			}
+			break;
+		}
+		
+		case cMemory:
+		{
+			if (args == 1)
+			{
+				getMemoryUsage(viewport).print(std::cout);
+			}
+			else if (getArgString(1) == "json")
+			{
+				getMemoryUsage(viewport).printJson(std::cout);
+			}
+			else if (getArgString(1) == "budget" && args > 2 && getArgString(2) == "off")
+			{
+				memoryBudget = 0;
+			}
+			else if (getArgString(1) == "budget" && args > 2 && getArgInt(2) > 0)
+			{
+				memoryBudget = (size_t)getArgInt(2) * 1024 * 1024;
+				if (!fitMemoryBudget(getMemoryUsage(viewport), 0, viewport->getFrameCache(),
+					sc->getMappedFiles().get()))
+				{
+					std::cout << "The scene already uses more than the budget; only further loads are rejected."
+						<< std::endl;
+				}
+			}
+			else
+			{
+				std::cout << "Usage: memory [json | budget <MB>|off]" << std::endl;
+			}
+			redraw = false;
+			break;
+		}
+		
+		case cMetrics:
+		{
+			if (!metrics)
+			{
+				std::cout << "Metrics aren't available." << std::endl;
+			}
+			else if (args == 1)
+			{
+				metrics->write(std::cout);
+			}
+			else if (getArgString(1) == "status")
+			{
+				metrics->printStatus(std::cout);
+			}
+			else if (getArgString(1) == "serve" && args > 2)
+			{
+				if (!metrics->serve(getArgInt(2)))
+				{
+					std::cout << "Could not listen on port " << getArgInt(2) << "." << std::endl;
+				}
+			}
+			else if (getArgString(1) == "file" && args > 2)
+			{
+				int intervalMs = (args > 3) ? getArgInt(3) * 1000 : METRICS_FILE_INTERVAL_MS;
+				if (!metrics->writeToFile(getArgPath(2), std::max(intervalMs, 1000)))
 				{
-					std::cout << "Loaded from \"" << getArgString(1) << "\" successfully." << std::endl;
-					loadedFileName = getArgString(1);
+					std::cout << "Could not write \"" << getArgPath(2) << "\"." << std::endl;
+				}
+			}
+			else if (getArgString(1) == "off")
+			{
+				metrics->stop();
+			}
+			else
+			{
+				std::cout << "Usage: metrics [status | serve <port> | file <name> [<seconds>] | off]" << std::endl;
+			}
+			redraw = false;
+			break;
+		}
+		
+		case cNuma:
+		{
+			ThreadPool* pool = viewport->getThreadPool();
+			bool numaAware = pool && pool->numNodes() > 0;
+			if (args == 1)
+			{
+				if (numaAware)
+				{
+					std::cout << "The " << pool->numThreads() << " render threads are spread over "
+						<< describeNumaNodes(pool->getNodes()) << "." << std::endl;
 				}
 				else
 				{
-					std::cout << "Failed to load from file \"" << getArgString(1) << "\"." << std::endl;
+					std::cout << "The render threads aren't NUMA-aware (start with -numa); the machine has "
+						<< describeNumaNodes(detectNumaNodes()) << "." << std::endl;
 				}
+				std::cout << "The scene is " << (sc->getReplication() ? "" : "not ") << "copied to each node."
+					<< std::endl;
 			}
+			else if ((getArgString(1) == "replicate" || getArgString(1) == "rep") && args > 2)
+			{
+				sc->setReplication(getArgString(2) == "on");
+			}
+			else if (getArgString(1) == "bench" || getArgString(1) == "benchmark")
+			{
+				int frames = (args > 2) ? getArgInt(2) : 3;
+				std::vector<NumaNode> nodes = numaAware ? pool->getNodes() : detectNumaNodes();
+				std::cout << "Rendering " << frames << " frames each way over " << describeNumaNodes(nodes) << "."
+					<< std::endl;
+				printNumaBenchmark(benchmarkNuma(viewport, sc, nodes, frames), std::cout);
+			}
+			else
+			{
+				std::cout << "Usage: numa [replicate on|off | bench [<frames>]]" << std::endl;
+			}
+			redraw = false;
+			break;
+		}
+		
+		case cOutOfCore:
+		{
+			if (args == 1)
+			{
+				sc->getMappedFiles()->printStatus(std::cout);
+			}
+			else if (getArgString(1) == "off")
+			{
+				sc->getMappedFiles()->setResidentLimit(0);
+			}
+			else if (getArgInt(1) > 0)
+			{
+				sc->getMappedFiles()->setResidentLimit((size_t)getArgInt(1) * 1024 * 1024);
+			}
+			else
+			{
+				std::cout << "Usage: outofcore [<resident limit in MB> | off]" << std::endl;
+			}
+			redraw = false;
 			break;
 		}
 		
@@ -260,15 +852,67 @@ Command CommandHandler::execute(ShapeCollection* sc, Viewport* viewport, bool &r
 					}
 				}
 			}
+			
+			// Files still being written would be cut short.
+			if (imageWriter)
+			{
+				imageWriter->wait();
+			}
 			exit(EXIT_SUCCESS);
 			break;
 		}
 		
+		case cRegion:
+		{
+			int x0, y0, x1, y1;
+			if (args == 1)
+			{
+				if (viewport->getRegion(x0, y0, x1, y1))
+				{
+					std::cout << "Rendering the region (" << x0 << ", " << y0 << ") to (" << x1 << ", " << y1 << ")." << std::endl;
+				}
+				else
+				{
+					std::cout << "Rendering the whole viewport." << std::endl;
+				}
+				redraw = false;
+			}
+			else if (getArgString(1) == "off" || getArgString(1) == "full")
+			{
+				viewport->clearRegion();
+			}
+			else if (args <= 4)
+			{
+				notEnoughArgs = true;
+			}
+			else
+			{
+				viewport->setRegion(getArgInt(1), getArgInt(2), getArgInt(3), getArgInt(4));
+			}
+			break;
+		}
+		
+		case cReprojection:
+		{
+			if (args == 1)
+			{
+				std::cout << "Reprojection is " << (viewport->getReprojection() ? "on" : "off")
+					<< " (threshold " << viewport->getReprojectionThreshold() << ")." << std::endl;
+			}
+			else
+			{
+				float threshold = (args > 2) ? getArgFloat(2) : viewport->getReprojectionThreshold();
+				viewport->setReprojection(getArgString(1) == "on", threshold);
+			}
+			redraw = false;
+			break;
+		}
+		
 		case cSave:
 		{
 			std::string fileName = (args == 1) ?
 				(savedFileName == "" ? loadedFileName : savedFileName) :
-				getArgString(1);
+				getArgPath(1);
 			
 			bool success = sc->saveToFile(fileName);
 			if (success)
@@ -344,6 +988,90 @@ Command CommandHandler::execute(ShapeCollection* sc, Viewport* viewport, bool &r
 			break;
 		}
 		
+		case cStats:
+		{
+			viewport->getStats().print(std::cout);
+			redraw = false;
+			break;
+		}
+		
+		case cTileOrder:
+		{
+			TileOrder order;
+			if (args == 1)
+			{
+				int x, y;
+				viewport->getTileFocus(x, y);
+				std::cout << "Tiles are rendered in " << tileOrderName(viewport->getTileOrder()) << " order (focus at ("
+					<< x << ", " << y << "))." << std::endl;
+			}
+			else if (!tileOrderFromName(getArgString(1), order))
+			{
+				std::cout << "Usage: order [scanline | centre | morton | cost | focus [<x> <y>]]" << std::endl;
+			}
+			else
+			{
+				viewport->setTileOrder(order);
+				if (order == toFocus && args > 3)
+				{
+					viewport->setTileFocus(getArgInt(2), getArgInt(3));
+				}
+			}
+			redraw = false;
+			break;
+		}
+		
+		case cUndo:
+		{
+			if (!sc->undo())
+			{
+				std::cout << "Nothing to undo." << std::endl;
+				redraw = false;
+			}
+			break;
+		}
+		
+		case cWatch:
+		{
+			if (!fileWatcher)
+			{
+				std::cout << "Watching files is not available." << std::endl;
+				redraw = false;
+			}
+			else if (args == 1)
+			{
+				fileWatcher->printStatus(std::cout);
+				redraw = false;
+			}
+			else if (getArgString(1) == "off")
+			{
+				fileWatcher->stop();
+				std::cout << "Stopped watching." << std::endl;
+				redraw = false;
+			}
+			else
+			{
+				// The scene is first made to match the file, then kept matching it as it changes.
+				SceneChanges changes;
+				if (!updateScene(sc, viewport, getArgPath(1), changes))
+				{
+					std::cout << "Failed to load from file \"" << getArgPath(1) << "\"." << std::endl;
+					redraw = false;
+				}
+				else if (!fileWatcher->watch(getArgPath(1)))
+				{
+					std::cout << "Could not watch \"" << getArgPath(1) << "\"." << std::endl;
+				}
+				else
+				{
+					std::cout << "Watching \"" << getArgPath(1) << "\": " << changes.shapesAdded << " shapes added, "
+						<< changes.shapesRemoved << " removed." << std::endl;
+					loadedFileName = getArgPath(1);
+				}
+			}
+			break;
+		}
+		
 		default:
 		{
 			std::cout << "Command not recognized." << std::endl;
@@ -358,9 +1086,114 @@ Command CommandHandler::execute(ShapeCollection* sc, Viewport* viewport, bool &r
 		redraw = false;
 		return cError;
 	}
+	
+	if (redraw && isSceneCommand(command))
+	{
+		sc->pushUndoState(sceneBefore);
+	}
 	return command;
 }
 
+void CommandHandler::setAnimation(Animation* _animation)
+{
+	animation = _animation;
+}
+
+void CommandHandler::setCheckpoint(Checkpoint* _checkpoint)
+{
+	checkpoint = _checkpoint;
+}
+
+void CommandHandler::setCluster(RenderCluster* _cluster)
+{
+	cluster = _cluster;
+}
+
+void CommandHandler::setFileWatcher(FileWatcher* _fileWatcher)
+{
+	fileWatcher = _fileWatcher;
+}
+
+void CommandHandler::setImageWriter(ImageWriter* _imageWriter)
+{
+	imageWriter = _imageWriter;
+}
+
+void CommandHandler::setMetrics(Metrics* _metrics)
+{
+	metrics = _metrics;
+}
+
+void CommandHandler::setMemoryBudget(size_t bytes)
+{
+	memoryBudget = bytes;
+}
+
+size_t CommandHandler::getMemoryBudget()
+{
+	return memoryBudget;
+}
+
+bool CommandHandler::updateScene(ShapeCollection* sc, Viewport* viewport, std::string fileName, SceneChanges &changes)
+{
+	SceneSnapshot before = sc->snapshot();
+	if (!sc->update(fileName, changes, getLoadLimit(viewport))) return false;
+	if (!changes.isEmpty() && !fitsMemoryBudget(sc, viewport, fileName))
+	{
+		sc->restore(before);
+		changes = SceneChanges();
+		return false;
+	}
+	return true;
+}
+
+bool CommandHandler::isCameraCommand(Command command)
+{
+	switch (command)
+	{
+		case cAtPointMove:
+		case cCameraMove:
+		case cFromPointMove:
+		case cSetAtPoint:
+		case cSetFromPoint:
+		case cSetViewingAngle:
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool CommandHandler::isSceneCommand(Command command)
+{
+	switch (command)
+	{
+		case cAnimate:
+		case cAntiAliasing:
+		case cBudget:
+		case cCache:
+		case cCameras:
+		case cCheckpoint:
+		case cCluster:
+		case cConvert:
+		case cImage:
+		case cMemory:
+		case cMetrics:
+		case cNuma:
+		case cOutOfCore:
+		case cQuit:
+		case cRegion:
+		case cReprojection:
+		case cSave:
+		case cStats:
+		case cTileOrder:
+		case cUndo:
+		case cError:
+			return false;
+		default:
+			return true;
+	}
+}
+
 void CommandHandler::debug_dumpParsed()
 {
 	for (int i = 0; i < (int)parsed.size(); i++)
@@ -377,30 +1210,40 @@ void CommandHandler::debug_dumpParsed()
 void CommandHandler::parseInput()
 {
 	std::vector<std::string> result;
-	char c;
-	std::string curr = "";
+	std::vector<std::string> resultPaths;
+	std::istringstream words(input);
+	std::string word;
 	
-	for (int i = 0; i < (int)input.length(); i++)
+	while (words >> word)
 	{
-		c = input.at(i);
-		if (ignoreChar(c))
+		// A word with a slash in it is a path, and is kept whole.
+		if (word.find('/') != std::string::npos)
 		{
-			if (curr != "")
-			{
-				result.push_back(toLower(curr));
-				curr = "";
-			}
+			result.push_back(toLower(word));
+			resultPaths.push_back(word);
+			continue;
 		}
-		else
+		
+		std::string curr = "";
+		for (int i = 0; i <= (int)word.length(); i++)
 		{
-			curr += c;
+			if (i == (int)word.length() || ignoreChar(word.at(i)))
+			{
+				if (curr != "")
+				{
+					result.push_back(toLower(curr));
+					resultPaths.push_back(curr);
+					curr = "";
+				}
+			}
+			else
+			{
+				curr += word.at(i);
+			}
 		}
 	}
-	if (curr != "")
-	{
-		result.push_back(toLower(curr));
-	}
 	parsed = result;
+	parsedPaths = resultPaths;
 }
 
 int CommandHandler::getArgInt(int index)
@@ -432,6 +1275,40 @@ std::string CommandHandler::getArgString(int index)
 	return parsed.at(index);
 }
 
+std::string CommandHandler::getArgPath(int index)
+{
+	return parsedPaths.at(index);
+}
+
+MemoryUsage CommandHandler::getMemoryUsage(Viewport* viewport)
+{
+	MemoryUsage usage = viewport->getMemoryUsage();
+	usage.budget = memoryBudget;
+	return usage;
+}
+
+size_t CommandHandler::getLoadLimit(Viewport* viewport)
+{
+	if (memoryBudget == 0) return 0;
+	
+	MemoryUsage usage = getMemoryUsage(viewport);
+	size_t kept = usage.total() - usage.frameCache - usage.mapped;
+	return (kept < memoryBudget) ? memoryBudget - kept : 1;
+}
+
+bool CommandHandler::fitsMemoryBudget(ShapeCollection* sc, Viewport* viewport, std::string fileName)
+{
+	if (memoryBudget == 0) return true;
+	
+	sc->prepare();
+	MemoryUsage usage = getMemoryUsage(viewport);
+	if (fitMemoryBudget(usage, 0, viewport->getFrameCache(), sc->getMappedFiles().get())) return true;
+	
+	std::cout << "\"" << fileName << "\" needs " << usage.total() / (1024 * 1024) << " MB, which is over the memory"
+		<< " budget of " << memoryBudget / (1024 * 1024) << " MB, so it was not loaded." << std::endl;
+	return false;
+}
+
 bool CommandHandler::ignoreChar(char c)
 {
 	if (isalnum(c) || c == '.' || c == '-' || c == '+' || c == '_') return false;
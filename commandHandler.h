@@ -12,27 +12,55 @@
 #include <string>
 #include <vector>
 
+#include "memoryUsage.h"
 #include "misc.h"
 
+class Animation;
+class Checkpoint;
+class FileWatcher;
+class ImageWriter;
+class Metrics;
+class RenderCluster;
+struct SceneChanges;
 class ShapeCollection;
 class Viewport;
+struct Camera;
 
 enum Command {
 	cAddCube,
 	cAddImplicit,
 	cAddSphere,
+	cAnimate,
+	cAntiAliasing,
 	cAtPointMove,
+	cBudget,
+	cCache,
 	cCameraMove,
+	cCameras,
+	cCheckpoint,
+	cCluster,
+	cConvert,
 	cDelete,
 	cDeleteLight,
 	cFromPointMove,
+	cImage,
 	cLight,
 	cLoad,
+	cMemory,
+	cMetrics,
+	cNuma,
+	cOutOfCore,
 	cQuit,
+	cRegion,
+	cReprojection,
 	cSave,
 	cSetAtPoint,
 	cSetFromPoint,
 	cSetViewingAngle,
+	cStats,
+	cTileOrder,
+	cUndo,
+	cWatch,
 	
 	cError
 };
@@ -45,13 +73,35 @@ class CommandHandler
 		CommandHandler();
 		
 		// Asks the user to input a command, then parses the input.
-		void getUserInput();
+		// Returns false if there is no more input.
+		bool getUserInput();
 		// Execute the command on the passed shape collection/ viewports (depending on command type).
 		Command execute(ShapeCollection* sc, Viewport* viewport, bool &redraw);
 		
+		// Set the parts of the renderer that commands work with besides the viewport and its shapes (each may be
+		// null, in which case its commands say that it isn't available).
+		void setAnimation(Animation* _animation);
+		void setCheckpoint(Checkpoint* _checkpoint);
+		void setCluster(RenderCluster* _cluster);
+		void setFileWatcher(FileWatcher* _fileWatcher);
+		void setImageWriter(ImageWriter* _imageWriter);
+		void setMetrics(Metrics* _metrics);
+		// Sets/returns the hard memory budget in bytes (0 for none, the default; see memoryUsage.h). Loads that
+		// don't fit in it are refused.
+		void setMemoryBudget(size_t bytes);
+		size_t getMemoryBudget();
+		// Makes the scene match the file (see ShapeCollection::update), as long as it fits in the memory budget.
+		// Returns false, leaving the scene as it was, if the file can't be loaded or doesn't fit.
+		bool updateScene(ShapeCollection* sc, Viewport* viewport, std::string fileName, SceneChanges &changes);
+		
 		// Prints the parsed command (debugging).
 		void debug_dumpParsed();
 		
+		// Returns true if the command only changes the camera (so the last frame can be reprojected).
+		static bool isCameraCommand(Command command);
+		// Returns true if the command may change the scene (so it can be undone).
+		static bool isSceneCommand(Command command);
+		
 		
 	private:
 		/*** Private Member Functions ***/
@@ -63,6 +113,16 @@ class CommandHandler
 		float getArgFloat(int index);
 		// Returns the argument at the specified index as a string.
 		std::string getArgString(int index);
+		// Returns the argument at the specified index as a file name (as it was typed, in its case).
+		std::string getArgPath(int index);
+		// Returns the memory used by the viewport and what it renders with, along with the memory budget.
+		MemoryUsage getMemoryUsage(Viewport* viewport);
+		// Returns the most bytes shapes being loaded may need under the memory budget (0 if there is none): what
+		// the rest of the renderer doesn't use, counting the frame cache and mapped pages as free.
+		size_t getLoadLimit(Viewport* viewport);
+		// Returns true if the scene, loaded from the file, fits in the memory budget once prepared (emptying the
+		// caches if need be). Otherwise says so, and returns false.
+		bool fitsMemoryBudget(ShapeCollection* sc, Viewport* viewport, std::string fileName);
 		
 		// Returns true if the character should be ignored by the parser.
 		static bool ignoreChar(char c);
@@ -74,16 +134,31 @@ class CommandHandler
 		std::string prompt;
 		// The raw user input (after it is gotten).
 		std::string input;
-		// The parsed user input.
+		// The parsed user input (made lowercase), and the same arguments as they were typed. A word with a slash
+		// in it is a path, and is one argument.
 		std::vector<std::string> parsed;
+		std::vector<std::string> parsedPaths;
 		// The name of the last loaded file.
 		std::string loadedFileName;
 		// The name of the last saved file.
 		std::string savedFileName;
+		// The cameras that multi-view batches are rendered from.
+		std::vector<Camera>* cameras;
+		// The parts of the renderer that commands work with (any may be null).
+		Animation* animation;
+		Checkpoint* checkpoint;
+		RenderCluster* cluster;
+		FileWatcher* fileWatcher;
+		ImageWriter* imageWriter;
+		Metrics* metrics;
+		// The hard memory budget in bytes (0 for none).
+		size_t memoryBudget;
 		
 		// The string-to-command mapping.
-		// Used to convert user input strings into a command.
-		std::map<std::string, Command> commandMap =
+		// Used to convert user input strings into a command (built from commandAliases).
+		std::map<std::string, Command> commandMap;
+		// The strings each command can be given as. No string may name two commands.
+		std::vector<std::pair<std::string, Command>> commandAliases =
 		{
 			{"ac", cAddCube},
 			{"cube", cAddCube},
@@ -97,6 +172,35 @@ class CommandHandler
 			{"sphere", cAddSphere},
 			{"addsphere", cAddSphere},
 			
+			{"an", cAnimate},
+			{"anim", cAnimate},
+			{"animate", cAnimate},
+			{"animation", cAnimate},
+			
+			{"ss", cAntiAliasing},
+			{"antialias", cAntiAliasing},
+			{"antialiasing", cAntiAliasing},
+			
+			{"bg", cBudget},
+			{"budget", cBudget},
+			{"deadline", cBudget},
+			
+			{"cache", cCache},
+			{"fc", cCache},
+			{"framecache", cCache},
+			
+			{"ck", cCheckpoint},
+			{"ckpt", cCheckpoint},
+			{"checkpoint", cCheckpoint},
+			
+			{"cl", cCluster},
+			{"cluster", cCluster},
+			{"workers", cCluster},
+			
+			{"cv", cConvert},
+			{"conv", cConvert},
+			{"convert", cConvert},
+			
 			{"ma", cAtPointMove},
 			{"mat", cAtPointMove},
 			{"mvat", cAtPointMove},
@@ -107,6 +211,11 @@ class CommandHandler
 			{"move", cCameraMove},
 			{"movecamera", cCameraMove},
 			
+			{"cams", cCameras},
+			{"cameras", cCameras},
+			{"views", cCameras},
+			{"multiview", cCameras},
+			
 			{"d", cDelete},
 			{"dt", cDelete},
 			{"del", cDelete},
@@ -127,6 +236,11 @@ class CommandHandler
 			{"mvfrom", cFromPointMove},
 			{"movefrom", cFromPointMove},
 			
+			{"im", cImage},
+			{"img", cImage},
+			{"image", cImage},
+			{"screenshot", cImage},
+			
 			{"li", cLight},
 			{"lt", cLight},
 			{"light", cLight},
@@ -139,10 +253,37 @@ class CommandHandler
 			{"loadf", cLoad},
 			{"loadfile", cLoad},
 			
+			{"mem", cMemory},
+			{"memory", cMemory},
+			{"usage", cMemory},
+			
+			{"met", cMetrics},
+			{"metrics", cMetrics},
+			{"prom", cMetrics},
+			{"prometheus", cMetrics},
+			
+			{"nu", cNuma},
+			{"numa", cNuma},
+			{"nodes", cNuma},
+			
+			{"ooc", cOutOfCore},
+			{"mapped", cOutOfCore},
+			{"outofcore", cOutOfCore},
+			
 			{"q", cQuit},
 			{"qt", cQuit},
 			{"quit", cQuit},
 			
+			{"rg", cRegion},
+			{"roi", cRegion},
+			{"crop", cRegion},
+			{"region", cRegion},
+			
+			{"rp", cReprojection},
+			{"reproj", cReprojection},
+			{"reproject", cReprojection},
+			{"reprojection", cReprojection},
+			
 			{"sv", cSave},
 			{"save", cSave},
 			{"sf", cSave},
@@ -168,6 +309,22 @@ class CommandHandler
 			{"viewangle", cSetViewingAngle},
 			{"viewingangle", cSetViewingAngle},
 			{"setviewingangle", cSetViewingAngle},
+			
+			{"st", cStats},
+			{"stat", cStats},
+			{"stats", cStats},
+			
+			{"to", cTileOrder},
+			{"order", cTileOrder},
+			{"tileorder", cTileOrder},
+			
+			{"u", cUndo},
+			{"un", cUndo},
+			{"undo", cUndo},
+			
+			{"wt", cWatch},
+			{"watch", cWatch},
+			{"hotreload", cWatch},
 		};
 };
 
@@ -0,0 +1,188 @@
+#include "connection.h"
+
+#include <algorithm>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+
+/*** Public Member Functions ***/
+
+Connection::Connection(int _fd)
+{
+	fd = _fd;
+	pending = "";
+}
+
+Connection::~Connection()
+{
+	close(fd);
+}
+
+Connection* Connection::connectTCP(std::string address)
+{
+	size_t colon = address.rfind(':');
+	if (colon == std::string::npos) return nullptr;
+	std::string host = address.substr(0, colon);
+	std::string port = address.substr(colon + 1);
+	if (host == "") host = "localhost";
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* results = nullptr;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0) return nullptr;
+
+	int connected = -1;
+	for (addrinfo* a = results; a && connected < 0; a = a->ai_next)
+	{
+		int s = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+		if (s < 0) continue;
+		if (connect(s, a->ai_addr, a->ai_addrlen) == 0)
+		{
+			connected = s;
+		}
+		else
+		{
+			close(s);
+		}
+	}
+	freeaddrinfo(results);
+	if (connected < 0) return nullptr;
+
+	// Requests are short lines that are answered straight away, so they aren't held back to be batched.
+	int one = 1;
+	setsockopt(connected, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return new Connection(connected);
+}
+
+int Connection::listenTCP(int port, bool loopbackOnly)
+{
+	int s = socket(loopbackOnly ? AF_INET : AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (s < 0) return -1;
+
+	int one = 1;
+	int zero = 0;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	int bound;
+	if (loopbackOnly)
+	{
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons(port);
+		bound = bind(s, (sockaddr*)&address, sizeof(address));
+	}
+	else
+	{
+		// Accept IPv4 connections on the same socket.
+		setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+
+		sockaddr_in6 address = {};
+		address.sin6_family = AF_INET6;
+		address.sin6_addr = in6addr_any;
+		address.sin6_port = htons(port);
+		bound = bind(s, (sockaddr*)&address, sizeof(address));
+	}
+	if (bound != 0 || listen(s, SOMAXCONN) != 0)
+	{
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+int Connection::localPort(int fd)
+{
+	sockaddr_storage address = {};
+	socklen_t length = sizeof(address);
+	if (getsockname(fd, (sockaddr*)&address, &length) != 0) return -1;
+	if (address.ss_family == AF_INET)
+	{
+		return ntohs(((sockaddr_in*)&address)->sin_port);
+	}
+	return ntohs(((sockaddr_in6*)&address)->sin6_port);
+}
+
+bool Connection::readLine(std::string &line)
+{
+	size_t newline;
+	while ((newline = pending.find('\n')) == std::string::npos)
+	{
+		if ((int)pending.size() > CONNECTION_MAX_LINE || !fill()) return false;
+	}
+
+	line = pending.substr(0, newline);
+	pending.erase(0, newline + 1);
+	if (!line.empty() && line.back() == '\r')
+	{
+		line.pop_back();
+	}
+	return true;
+}
+
+bool Connection::read(void* data, size_t length)
+{
+	char* p = (char*)data;
+	size_t buffered = std::min(length, pending.size());
+	std::copy(pending.begin(), pending.begin() + buffered, p);
+	pending.erase(0, buffered);
+	p += buffered;
+	length -= buffered;
+
+	while (length > 0)
+	{
+		ssize_t received = recv(fd, p, length, 0);
+		if (received <= 0) return false;
+		p += received;
+		length -= received;
+	}
+	return true;
+}
+
+bool Connection::writeLine(std::string line)
+{
+	line += "\n";
+	return write(line.data(), line.size());
+}
+
+bool Connection::write(const void* data, size_t length)
+{
+	const char* p = (const char*)data;
+	while (length > 0)
+	{
+		ssize_t sent = send(fd, p, length, MSG_NOSIGNAL);
+		if (sent <= 0) return false;
+		p += sent;
+		length -= sent;
+	}
+	return true;
+}
+
+void Connection::setWriteTimeout(int ms)
+{
+	timeval timeout = {};
+	timeout.tv_sec = ms / 1000;
+	timeout.tv_usec = (ms % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+void Connection::shutdown()
+{
+	::shutdown(fd, SHUT_RDWR);
+}
+
+
+/*** Private Member Functions ***/
+
+bool Connection::fill()
+{
+	char buffer[4096];
+	ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+	if (received <= 0) return false;
+	pending.append(buffer, received);
+	return true;
+}
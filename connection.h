@@ -0,0 +1,62 @@
+#ifndef __CONNECTION_H__
+#define __CONNECTION_H__
+
+/* connection.h
+ *
+ * A connected stream socket (Unix domain or TCP) that messages are exchanged over: lines of text, each
+ * optionally followed by a block of binary data. Reads are buffered. One thread may read while another writes.
+ *
+ */
+
+#include <stddef.h>
+#include <string>
+
+// The longest line that is read before the connection is treated as broken.
+const int CONNECTION_MAX_LINE = 4096;
+
+class Connection
+{
+	public:
+		/*** Public Member Functions ***/
+		// Takes over a connected socket.
+		Connection(int _fd);
+		// Closes the socket.
+		~Connection();
+
+		// Connects to a TCP port, given as "host:port". Returns null if it can't.
+		static Connection* connectTCP(std::string address);
+		// Listens on a TCP port (0 picks a free port), on every interface or only on the loopback interface
+		// (127.0.0.1), which other machines can't reach. Returns the listening socket, or -1.
+		static int listenTCP(int port, bool loopbackOnly = false);
+		// Returns the port a listening socket is bound to.
+		static int localPort(int fd);
+
+		// Reads a line, without its line ending. Returns false if the connection is closed first.
+		bool readLine(std::string &line);
+		// Reads exactly length bytes. Returns false if the connection is closed first.
+		bool read(void* data, size_t length);
+		// Writes the line (adding a line ending), or the data. Return false if the connection is closed.
+		bool writeLine(std::string line);
+		bool write(const void* data, size_t length);
+		// Makes writes fail once they have been blocked for the time (0 for never, the default), as they are when
+		// the other end stops reading.
+		void setWriteTimeout(int ms);
+		// Ends the connection in both directions, waking a thread that is blocked reading it.
+		void shutdown();
+
+	private:
+		/*** Private Member Functions ***/
+		// Reads whatever is available into the buffer. Returns false if the connection is closed.
+		bool fill();
+
+		// Connections can't be copied.
+		Connection(const Connection&) = delete;
+		Connection& operator=(const Connection&) = delete;
+
+		/*** Private Member Variables ***/
+		int fd;
+		// Bytes that have been received but not yet read.
+		std::string pending;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "fileWatcher.h"
+
+#include <filesystem>
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "misc.h"
+
+// The events that mean the file may have new contents.
+const uint32_t FILE_WATCH_EVENTS = IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE;
+
+
+/*** Public Member Functions ***/
+
+FileWatcher::FileWatcher()
+{
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	watchDescriptor = -1;
+	fileName = "";
+	baseName = "";
+	changesSeen = 0;
+	listener = nullptr;
+	stopping = false;
+	
+	if (inotifyFd >= 0)
+	{
+		worker = std::thread(&FileWatcher::watchLoop, this);
+	}
+}
+
+FileWatcher::~FileWatcher()
+{
+	stopping = true;
+	if (worker.joinable())
+	{
+		worker.join();
+	}
+	if (inotifyFd >= 0)
+	{
+		close(inotifyFd);
+	}
+}
+
+void FileWatcher::setListener(FileChangeListener _listener)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	listener = _listener;
+}
+
+bool FileWatcher::watch(std::string _fileName)
+{
+	if (inotifyFd < 0) return false;
+	
+	std::filesystem::path path(_fileName);
+	std::string directory = path.parent_path().string();
+	if (directory == "") directory = ".";
+	
+	std::unique_lock<std::mutex> lock(mutex);
+	if (watchDescriptor >= 0)
+	{
+		inotify_rm_watch(inotifyFd, watchDescriptor);
+	}
+	watchDescriptor = inotify_add_watch(inotifyFd, directory.c_str(), FILE_WATCH_EVENTS);
+	if (watchDescriptor < 0)
+	{
+		fileName = "";
+		baseName = "";
+		return false;
+	}
+	
+	fileName = _fileName;
+	baseName = path.filename().string();
+	changesSeen = 0;
+	return true;
+}
+
+void FileWatcher::stop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (watchDescriptor >= 0)
+	{
+		inotify_rm_watch(inotifyFd, watchDescriptor);
+		watchDescriptor = -1;
+	}
+	fileName = "";
+	baseName = "";
+}
+
+std::string FileWatcher::getFileName()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return fileName;
+}
+
+void FileWatcher::printStatus(std::ostream& s)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (inotifyFd < 0)
+	{
+		s << "Files can't be watched on this system." << std::endl;
+	}
+	else if (fileName == "")
+	{
+		s << "No file is being watched." << std::endl;
+	}
+	else
+	{
+		s << "Watching \"" << fileName << "\": " << changesSeen << " changes applied." << std::endl;
+	}
+}
+
+
+/*** Private Member Functions ***/
+
+void FileWatcher::watchLoop()
+{
+	// Events are read whole, so the buffer must hold at least one with the longest name.
+	alignas(struct inotify_event) char buffer[4096];
+	bool pending = false;
+	double lastChangeMs = 0.0;
+	
+	while (!stopping)
+	{
+		struct pollfd p;
+		p.fd = inotifyFd;
+		p.events = POLLIN;
+		p.revents = 0;
+		if (poll(&p, 1, FILE_WATCH_POLL_MS) > 0)
+		{
+			ssize_t length;
+			while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				for (char* e = buffer; e < buffer + length; )
+				{
+					struct inotify_event* event = (struct inotify_event*)e;
+					if (event->wd == watchDescriptor && event->len > 0 && baseName == event->name)
+					{
+						pending = true;
+						lastChangeMs = nowMs();
+					}
+					e += sizeof(struct inotify_event) + event->len;
+				}
+			}
+		}
+		
+		// Saving a file can take several writes, so the listener waits until they have stopped.
+		if (pending && nowMs() - lastChangeMs >= FILE_WATCH_SETTLE_MS)
+		{
+			pending = false;
+			
+			std::string changedFile;
+			FileChangeListener notify;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				changedFile = fileName;
+				notify = listener;
+				if (changedFile != "") changesSeen++;
+			}
+			if (changedFile != "" && notify)
+			{
+				notify(changedFile);
+			}
+		}
+	}
+}
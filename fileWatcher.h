@@ -0,0 +1,75 @@
+#ifndef __FILEWATCHER_H__
+#define __FILEWATCHER_H__
+
+/* fileWatcher.h
+ *
+ * Watches a file for changes with inotify, on a thread of its own. The directory that holds the file is watched
+ * rather than the file, so that editors that save by writing a new file and renaming it over the old one are
+ * noticed too. Once the file has been left alone for a moment after a change, the listener is called (on the
+ * watcher's thread) with the name of the file.
+ *
+ */
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+// Called from the watcher thread when the watched file has changed.
+typedef std::function<void(std::string fileName)> FileChangeListener;
+
+// How long the file must be left alone after a change before the listener is called.
+const int FILE_WATCH_SETTLE_MS = 100;
+// How often the watcher thread checks whether it is being stopped.
+const int FILE_WATCH_POLL_MS = 50;
+
+class FileWatcher
+{
+	public:
+		/*** Public Member Functions ***/
+		// Starts the watcher thread, watching nothing.
+		FileWatcher();
+		// Stops the watcher thread.
+		~FileWatcher();
+		
+		// Sets the function that is called when the watched file changes.
+		void setListener(FileChangeListener _listener);
+		// Watches the file (instead of any other). Returns false if it can't be watched.
+		bool watch(std::string _fileName);
+		// Stops watching the file.
+		void stop();
+		// Returns the name of the file being watched (empty if there isn't one).
+		std::string getFileName();
+		
+		// Prints the file being watched, and the number of changes seen.
+		void printStatus(std::ostream& s);
+		
+	private:
+		/*** Private Member Functions ***/
+		// The loop the watcher thread runs until the watcher is destroyed.
+		void watchLoop();
+		
+		// Watchers can't be copied.
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+		
+		/*** Private Member Variables ***/
+		// The inotify instance (-1 if it couldn't be created), and the watch on the file's directory (-1 if none).
+		int inotifyFd;
+		int watchDescriptor;
+		// The file as it was named, and its name within its directory.
+		std::string fileName;
+		std::string baseName;
+		// The number of changes the listener has been called for.
+		int changesSeen;
+		FileChangeListener listener;
+		
+		std::atomic<bool> stopping;
+		std::thread worker;
+		// Guards the watch, the names and the counter.
+		std::mutex mutex;
+};
+
+#endif
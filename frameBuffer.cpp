@@ -0,0 +1,266 @@
+#include "frameBuffer.h"
+
+#include <algorithm>
+
+// The number of floats in a tile.
+const int TILE_FLOATS = FRAME_BUFFER_TILE_SIZE * FRAME_BUFFER_TILE_SIZE * 3;
+
+
+/*** Public Member Functions ***/
+
+FrameBuffer::FrameBuffer(int _width, int _height)
+{
+	width = std::max(_width, 0);
+	height = std::max(_height, 0);
+
+	tilesX = (width + FRAME_BUFFER_TILE_SIZE - 1) / FRAME_BUFFER_TILE_SIZE;
+	tilesY = (height + FRAME_BUFFER_TILE_SIZE - 1) / FRAME_BUFFER_TILE_SIZE;
+	tiles = new std::atomic<float*>[tilesX * tilesY];
+	for (int i = 0; i < tilesX * tilesY; i++)
+	{
+		tiles[i] = nullptr;
+	}
+	fillColor = RGB(0.0, 0.0, 0.0);
+	allocated = 0;
+	peakAllocated = 0;
+
+	streaming = false;
+	streamX0 = streamY0 = streamX1 = streamY1 = 0;
+	nextScanline = 0;
+	scanlinePixels = new std::vector<int>();
+	streamConverter = new PixelConverter();
+}
+
+FrameBuffer::~FrameBuffer()
+{
+	if (streaming)
+	{
+		endStream();
+	}
+	for (int i = 0; i < tilesX * tilesY; i++)
+	{
+		delete[] tiles[i].load();
+	}
+	delete[] tiles;
+	delete scanlinePixels;
+	delete streamConverter;
+}
+
+void FrameBuffer::set(int x, int y, RGB color)
+{
+	if (x < 0 || x >= width || y < 0 || y >= height) return;
+
+	float* t = tile(x, y, true);
+	int index = ((y % FRAME_BUFFER_TILE_SIZE) * FRAME_BUFFER_TILE_SIZE + (x % FRAME_BUFFER_TILE_SIZE)) * 3;
+	t[index] = color.red;
+	t[index + 1] = color.green;
+	t[index + 2] = color.blue;
+}
+
+RGB FrameBuffer::get(int x, int y)
+{
+	if (x < 0 || x >= width || y < 0 || y >= height) return RGB();
+
+	float* t = tile(x, y, false);
+	if (!t) return fillColor;
+
+	int index = ((y % FRAME_BUFFER_TILE_SIZE) * FRAME_BUFFER_TILE_SIZE + (x % FRAME_BUFFER_TILE_SIZE)) * 3;
+	return RGB(t[index], t[index + 1], t[index + 2]);
+}
+
+void FrameBuffer::getRow(int x, int y, int n, float* out)
+{
+	int i = x;
+	while (i < x + n)
+	{
+		float* t = (i >= 0 && i < width && y >= 0 && y < height) ? tile(i, y, false) : nullptr;
+		if (!t)
+		{
+			// Pixels outside the buffer or in unallocated tiles are read one at a time.
+			RGB color = get(i, y);
+			out[(i - x) * 3] = color.red;
+			out[(i - x) * 3 + 1] = color.green;
+			out[(i - x) * 3 + 2] = color.blue;
+			i++;
+			continue;
+		}
+
+		// Copy the rest of the row that lies in the tile.
+		int end = std::min(std::min(x + n, width), (i / FRAME_BUFFER_TILE_SIZE + 1) * FRAME_BUFFER_TILE_SIZE);
+		const float* p = t + ((y % FRAME_BUFFER_TILE_SIZE) * FRAME_BUFFER_TILE_SIZE + (i % FRAME_BUFFER_TILE_SIZE)) * 3;
+		std::copy(p, p + (end - i) * 3, out + (i - x) * 3);
+		i = end;
+	}
+}
+
+void FrameBuffer::fill(RGB color)
+{
+	fillColor = color;
+	for (int ty = 0; ty < tilesY; ty++)
+	{
+		for (int tx = 0; tx < tilesX; tx++)
+		{
+			releaseTile(tx, ty);
+		}
+	}
+}
+
+int FrameBuffer::getWidth()
+{
+	return width;
+}
+
+int FrameBuffer::getHeight()
+{
+	return height;
+}
+
+size_t FrameBuffer::allocatedBytes()
+{
+	return allocated;
+}
+
+size_t FrameBuffer::peakAllocatedBytes()
+{
+	return peakAllocated;
+}
+
+
+/** Streaming **/
+
+bool FrameBuffer::beginStream(std::string fileName, int x0, int y0, int x1, int y1, float gamma)
+{
+	std::unique_lock<std::mutex> lock(streamMutex);
+
+	if (streaming)
+	{
+		stream.close();
+	}
+	streamX0 = std::max(0, std::min(x0, x1));
+	streamY0 = std::max(0, std::min(y0, y1));
+	streamX1 = std::max(streamX0, std::min(width, std::max(x0, x1)));
+	streamY1 = std::max(streamY0, std::min(height, std::max(y0, y1)));
+	nextScanline = 0;
+	scanlinePixels->assign(streamY1 - streamY0, 0);
+	peakAllocated = allocated.load();
+	if (streamConverter->getGamma() != gamma)
+	{
+		delete streamConverter;
+		streamConverter = new PixelConverter(gamma);
+	}
+
+	stream.clear();
+	stream.open(fileName.c_str(), std::ios::binary | std::ios::trunc);
+	if (!stream.is_open())
+	{
+		streaming = false;
+		return false;
+	}
+
+	stream << "P6\n" << (streamX1 - streamX0) << " " << (streamY1 - streamY0) << "\n255\n";
+	streaming = true;
+	return true;
+}
+
+void FrameBuffer::tileFinished(int x, int y, int tileWidth, int tileHeight)
+{
+	std::unique_lock<std::mutex> lock(streamMutex);
+	if (!streaming) return;
+
+	int x0 = std::max(x, streamX0);
+	int x1 = std::min(x + tileWidth, streamX1);
+	if (x1 <= x0) return;
+
+	int streamWidth = streamX1 - streamX0;
+	for (int j = std::max(y, streamY0); j < std::min(y + tileHeight, streamY1); j++)
+	{
+		int& done = scanlinePixels->at(streamY1 - 1 - j);
+		done = std::min(streamWidth, done + (x1 - x0));
+	}
+
+	while (nextScanline < (int)scanlinePixels->size() && scanlinePixels->at(nextScanline) == streamWidth)
+	{
+		writeScanline();
+	}
+}
+
+bool FrameBuffer::endStream()
+{
+	std::unique_lock<std::mutex> lock(streamMutex);
+	if (!streaming) return false;
+
+	while (nextScanline < (int)scanlinePixels->size())
+	{
+		writeScanline();
+	}
+
+	stream.close();
+	streaming = false;
+	return !stream.fail();
+}
+
+bool FrameBuffer::isStreaming()
+{
+	return streaming;
+}
+
+
+/*** Private Member Functions ***/
+
+float* FrameBuffer::tile(int x, int y, bool allocate)
+{
+	std::atomic<float*>& slot = tiles[(y / FRAME_BUFFER_TILE_SIZE) * tilesX + (x / FRAME_BUFFER_TILE_SIZE)];
+	float* t = slot.load();
+	if (t || !allocate) return t;
+
+	float* created = new float[TILE_FLOATS];
+	for (int i = 0; i < TILE_FLOATS; i += 3)
+	{
+		created[i] = fillColor.red;
+		created[i + 1] = fillColor.green;
+		created[i + 2] = fillColor.blue;
+	}
+
+	// Another thread may have allocated the tile first.
+	if (!slot.compare_exchange_strong(t, created))
+	{
+		delete[] created;
+		return t;
+	}
+
+	size_t now = (allocated += TILE_FLOATS * sizeof(float));
+	size_t peak = peakAllocated;
+	while (now > peak && !peakAllocated.compare_exchange_weak(peak, now));
+	return created;
+}
+
+void FrameBuffer::releaseTile(int tx, int ty)
+{
+	float* t = tiles[ty * tilesX + tx].exchange(nullptr);
+	if (t)
+	{
+		delete[] t;
+		allocated -= TILE_FLOATS * sizeof(float);
+	}
+}
+
+void FrameBuffer::writeScanline()
+{
+	// PPM files start with the top scanline, which is the last one in the buffer.
+	int y = streamY1 - 1 - nextScanline;
+	std::vector<float> row((streamX1 - streamX0) * 3);
+	std::vector<unsigned char> bytes(row.size());
+	getRow(streamX0, y, streamX1 - streamX0, row.data());
+	streamConverter->convert(row.data(), bytes.data(), row.size());
+	stream.write((const char*)bytes.data(), bytes.size());
+	nextScanline++;
+
+	// Once the lowest scanline of a band of tiles has been written, the whole band has been.
+	if (y % FRAME_BUFFER_TILE_SIZE == 0 || nextScanline == (int)scanlinePixels->size())
+	{
+		for (int tx = streamX0 / FRAME_BUFFER_TILE_SIZE; tx <= (streamX1 - 1) / FRAME_BUFFER_TILE_SIZE; tx++)
+		{
+			releaseTile(tx, y / FRAME_BUFFER_TILE_SIZE);
+		}
+	}
+}
@@ -0,0 +1,107 @@
+#ifndef __FRAMEBUFFER_H__
+#define __FRAMEBUFFER_H__
+
+/* frameBuffer.h
+ *
+ * The pixels of the window (or of the output image in headless mode), stored as square tiles of RGB floats
+ * rather than as one contiguous buffer. A tile is only allocated when a pixel in it is first drawn; until
+ * then it reads as the fill color.
+ *
+ * The buffer can stream an image to a file while it is being rendered: as render tiles finish, every
+ * scanline that is complete (and follows the last one written) is written out, and tiles whose scanlines
+ * have all been written are freed. Only the band of tiles that is still being rendered is ever held in
+ * memory, however large the image is.
+ *
+ */
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "misc.h"
+#include "pixelConverter.h"
+
+// The width and height of the tiles the buffer is split into.
+const int FRAME_BUFFER_TILE_SIZE = 32;
+
+class FrameBuffer
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates a buffer of the specified size, filled with black.
+		FrameBuffer(int _width, int _height);
+		~FrameBuffer();
+
+		// Sets/returns a single pixel. Pixels outside the buffer are ignored (and read as black).
+		// Pixels in different tiles can be set from different threads at the same time.
+		void set(int x, int y, RGB color);
+		RGB get(int x, int y);
+		// Copies n pixels of the row, starting at (x, y), to out (3 floats per pixel).
+		void getRow(int x, int y, int n, float* out);
+		// Fills the whole buffer with the color, and frees every tile.
+		void fill(RGB color);
+
+		int getWidth();
+		int getHeight();
+		// Returns the number of bytes of tiles currently allocated, and the most allocated at any one time.
+		size_t allocatedBytes();
+		size_t peakAllocatedBytes();
+
+		/** Streaming **/
+		// Starts writing the rectangle [x0, x1) x [y0, y1) to a binary PPM file, top scanline first, encoded
+		// with the gamma. Returns false if the file can't be created.
+		bool beginStream(std::string fileName, int x0, int y0, int x1, int y1, float gamma = 1.0);
+		// Tells the buffer that the pixels in the rectangle are finished. Completed scanlines are written out,
+		// and tiles that are no longer needed are freed. Can be called from any thread.
+		void tileFinished(int x, int y, int tileWidth, int tileHeight);
+		// Writes any scanlines that are still missing and closes the file. Returns false if writing failed.
+		bool endStream();
+		// Returns true between beginStream() and endStream().
+		bool isStreaming();
+
+	private:
+		/*** Private Member Functions ***/
+		// Returns the tile that holds the pixel, allocating it if needed (or returning null if not).
+		float* tile(int x, int y, bool allocate);
+		// Frees the tile at the passed tile coordinates.
+		void releaseTile(int tx, int ty);
+		// Writes the next scanline of the stream, and frees the tiles above it once they are all written.
+		void writeScanline();
+
+		// Buffers can't be copied.
+		FrameBuffer(const FrameBuffer&) = delete;
+		FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+		/*** Private Member Variables ***/
+		int width;
+		int height;
+		// The tiles, row by row (null until allocated).
+		int tilesX;
+		int tilesY;
+		std::atomic<float*>* tiles;
+		// The color of pixels in tiles that have not been allocated.
+		RGB fillColor;
+		std::atomic<size_t> allocated;
+		std::atomic<size_t> peakAllocated;
+
+		/** Streaming **/
+		bool streaming;
+		std::ofstream stream;
+		// The rectangle that is being streamed.
+		int streamX0;
+		int streamY0;
+		int streamX1;
+		int streamY1;
+		// The next scanline to write, counting from the top of the rectangle.
+		int nextScanline;
+		// The number of finished pixels in each scanline of the rectangle, from the top down.
+		std::vector<int>* scanlinePixels;
+		// Converts the scanlines to 8 bits.
+		PixelConverter* streamConverter;
+		std::mutex streamMutex;
+};
+
+#endif
@@ -0,0 +1,294 @@
+#include "frameCache.h"
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "misc.h"
+
+// Written at the start of every frame file.
+static const char FRAME_FILE_MAGIC[8] = {'R', 'T', 'F', 'R', 'A', 'M', 'E', '1'};
+
+
+/*** Public Member Functions ***/
+
+FrameCache::FrameCache(int _memoryLimitMB)
+{
+	enabled = true;
+
+	entries = new std::list<Entry>();
+	index = new std::map<uint64_t, std::list<Entry>::iterator>();
+	memoryBytes = 0;
+	memoryLimitBytes = (size_t)_memoryLimitMB * 1024 * 1024;
+
+	directory = "";
+	diskEntries = new std::list<std::pair<uint64_t, size_t> >();
+	diskBytes = 0;
+	diskLimitBytes = 0;
+
+	hits = 0;
+	misses = 0;
+}
+
+FrameCache::~FrameCache()
+{
+	delete entries;
+	delete index;
+	delete diskEntries;
+}
+
+bool FrameCache::get(uint64_t key, size_t count, std::vector<float>& pixels)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!enabled) return false;
+
+	Entry* entry = touch(key);
+	if (entry && entry->pixels.size() == count)
+	{
+		pixels = entry->pixels;
+		hits++;
+		return true;
+	}
+
+	if (!entry && readFromDisk(key, count, pixels))
+	{
+		// Keep the frame in memory for next time.
+		entries->push_front(Entry());
+		entries->front().key = key;
+		entries->front().pixels = pixels;
+		(*index)[key] = entries->begin();
+		memoryBytes += pixels.size() * sizeof(float);
+		evict();
+
+		hits++;
+		return true;
+	}
+
+	misses++;
+	return false;
+}
+
+void FrameCache::put(uint64_t key, const std::vector<float>& pixels)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!enabled) return;
+
+	Entry* entry = touch(key);
+	if (entry)
+	{
+		memoryBytes -= entry->pixels.size() * sizeof(float);
+		entry->pixels = pixels;
+	}
+	else
+	{
+		entries->push_front(Entry());
+		entries->front().key = key;
+		entries->front().pixels = pixels;
+		(*index)[key] = entries->begin();
+	}
+	memoryBytes += pixels.size() * sizeof(float);
+
+	if (directory != "")
+	{
+		writeToDisk(key, pixels);
+	}
+
+	evict();
+}
+
+void FrameCache::clear()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	entries->clear();
+	index->clear();
+	memoryBytes = 0;
+}
+
+size_t FrameCache::shrink(size_t bytes)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	size_t freed = 0;
+	while (freed < bytes && !entries->empty())
+	{
+		size_t entryBytes = entries->back().pixels.size() * sizeof(float);
+		memoryBytes -= entryBytes;
+		freed += entryBytes;
+		index->erase(entries->back().key);
+		entries->pop_back();
+	}
+	return freed;
+}
+
+size_t FrameCache::memoryUsed()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return memoryBytes;
+}
+
+void FrameCache::setEnabled(bool _enabled)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	enabled = _enabled;
+}
+
+bool FrameCache::isEnabled()
+{
+	return enabled;
+}
+
+void FrameCache::setMemoryLimit(int megabytes)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	memoryLimitBytes = (size_t)megabytes * 1024 * 1024;
+	evict();
+}
+
+void FrameCache::setDirectory(std::string _directory, int megabytes)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	directory = _directory;
+	diskLimitBytes = (size_t)megabytes * 1024 * 1024;
+	diskEntries->clear();
+	diskBytes = 0;
+	if (directory == "") return;
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	// Pick up frames from earlier runs, most recently written first.
+	std::vector<std::pair<std::filesystem::file_time_type, std::pair<uint64_t, size_t> > > found;
+	for (auto& file : std::filesystem::directory_iterator(directory, error))
+	{
+		std::string name = file.path().filename().string();
+		if (name.length() != 16 + 8 || name.substr(16) != ".rtframe") continue;
+
+		uint64_t key;
+		std::from_chars_result parsed = std::from_chars(name.data(), name.data() + 16, key, 16);
+		if (parsed.ec != std::errc() || parsed.ptr != name.data() + 16) continue;
+		found.push_back(std::make_pair(file.last_write_time(), std::make_pair(key, (size_t)file.file_size())));
+	}
+	std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+	for (int i = 0; i < (int)found.size(); i++)
+	{
+		diskEntries->push_back(found.at(i).second);
+		diskBytes += found.at(i).second.second;
+	}
+	evict();
+}
+
+void FrameCache::printStatus(std::ostream& s)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	s << "Frame cache is " << (enabled ? "on" : "off") << ": "
+		<< entries->size() << " frames in memory ("
+		<< memoryBytes / (1024 * 1024) << " of " << memoryLimitBytes / (1024 * 1024) << " MB)";
+	if (directory != "")
+	{
+		s << ", " << diskEntries->size() << " frames in \"" << directory << "\" ("
+			<< diskBytes / (1024 * 1024) << " of " << diskLimitBytes / (1024 * 1024) << " MB)";
+	}
+	s << ", " << hits << " hits, " << misses << " misses." << std::endl;
+}
+
+int FrameCache::getHits()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return hits;
+}
+
+int FrameCache::getMisses()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return misses;
+}
+
+
+/*** Private Member Functions ***/
+
+FrameCache::Entry* FrameCache::touch(uint64_t key)
+{
+	auto found = index->find(key);
+	if (found == index->end()) return nullptr;
+
+	entries->splice(entries->begin(), *entries, found->second);
+	return &entries->front();
+}
+
+void FrameCache::evict()
+{
+	while (memoryBytes > memoryLimitBytes && !entries->empty())
+	{
+		memoryBytes -= entries->back().pixels.size() * sizeof(float);
+		index->erase(entries->back().key);
+		entries->pop_back();
+	}
+
+	while (diskBytes > diskLimitBytes && !diskEntries->empty())
+	{
+		std::error_code error;
+		std::filesystem::remove(diskPath(diskEntries->back().first), error);
+		diskBytes -= diskEntries->back().second;
+		diskEntries->pop_back();
+	}
+}
+
+std::string FrameCache::diskPath(uint64_t key)
+{
+	return directory + "/" + hashToString(key) + ".rtframe";
+}
+
+bool FrameCache::readFromDisk(uint64_t key, size_t count, std::vector<float>& pixels)
+{
+	if (directory == "") return false;
+
+	auto found = diskEntries->begin();
+	while (found != diskEntries->end() && found->first != key) found++;
+	if (found == diskEntries->end()) return false;
+
+	// The count in the file has to match both the frame asked for and the size of the file, so that a damaged
+	// file can't make it allocate or read more than the frame.
+	std::ifstream file(diskPath(key).c_str(), std::ios::binary);
+	char magic[8];
+	uint64_t fileCount = 0;
+	file.read(magic, 8);
+	file.read((char*)&fileCount, sizeof(fileCount));
+	if (!file || !std::equal(magic, magic + 8, FRAME_FILE_MAGIC)) return false;
+	if (fileCount != count || found->second != 8 + sizeof(fileCount) + count * sizeof(float)) return false;
+
+	pixels.resize(count);
+	file.read((char*)pixels.data(), count * sizeof(float));
+	if (!file) return false;
+
+	diskEntries->splice(diskEntries->begin(), *diskEntries, found);
+	return true;
+}
+
+void FrameCache::writeToDisk(uint64_t key, const std::vector<float>& pixels)
+{
+	std::ofstream file(diskPath(key).c_str(), std::ios::binary);
+	if (!file.is_open()) return;
+
+	uint64_t count = pixels.size();
+	file.write(FRAME_FILE_MAGIC, 8);
+	file.write((const char*)&count, sizeof(count));
+	file.write((const char*)pixels.data(), count * sizeof(float));
+	file.close();
+
+	for (auto i = diskEntries->begin(); i != diskEntries->end(); i++)
+	{
+		if (i->first == key)
+		{
+			diskBytes -= i->second;
+			diskEntries->erase(i);
+			break;
+		}
+	}
+	size_t fileSize = 8 + sizeof(count) + count * sizeof(float);
+	diskEntries->push_front(std::make_pair(key, fileSize));
+	diskBytes += fileSize;
+}
@@ -0,0 +1,98 @@
+#ifndef __FRAMECACHE_H__
+#define __FRAMECACHE_H__
+
+/* frameCache.h
+ *
+ * A least-recently-used cache of finished frames, keyed by a hash of everything that determines the frame
+ * (the shapes, scene attributes, camera and resolution). Frames are kept in memory, and optionally also in a directory
+ * on disk so they survive between runs.
+ *
+ */
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class FrameCache
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates an in-memory cache that holds at most the specified number of megabytes of frames.
+		FrameCache(int _memoryLimitMB);
+		~FrameCache();
+
+		// Returns true if the frame with the given key is cached with count values (RGB floats), and fills pixels
+		// with it. A frame of any other size (such as one from a damaged file) is treated as missing.
+		bool get(uint64_t key, size_t count, std::vector<float>& pixels);
+		// Adds a frame to the cache, evicting the least recently used frames if needed.
+		void put(uint64_t key, const std::vector<float>& pixels);
+		// Removes all frames from memory (frames on disk are kept).
+		void clear();
+		// Removes the least recently used frames from memory until at least the number of bytes is freed (or the
+		// cache is empty). Returns the number of bytes freed.
+		size_t shrink(size_t bytes);
+		// Returns the number of bytes the frames in memory take.
+		size_t memoryUsed();
+
+		// Enables/disables the cache. A disabled cache never returns or stores frames.
+		void setEnabled(bool _enabled);
+		bool isEnabled();
+		// Sets the memory limit, evicting frames if needed.
+		void setMemoryLimit(int megabytes);
+		// Sets the directory frames are also saved to (empty to disable), and its size limit.
+		// Frames already in the directory are picked up, least recently written first (other files are left alone).
+		void setDirectory(std::string _directory, int megabytes);
+
+		// Prints the cache usage and hit rate.
+		void printStatus(std::ostream& s);
+		// Returns the number of lookups that found their frame, and that didn't.
+		int getHits();
+		int getMisses();
+
+	private:
+		/*** Private Member Types ***/
+		struct Entry
+		{
+			uint64_t key;
+			std::vector<float> pixels;
+		};
+
+		/*** Private Member Functions ***/
+		// Moves the entry to the front of the memory list and returns it.
+		Entry* touch(uint64_t key);
+		// Removes frames from the back of the lists until they are within their limits.
+		void evict();
+		// Returns the file that holds the frame with the given key.
+		std::string diskPath(uint64_t key);
+		// Reads the frame with the given key from disk. Returns false unless it is there with count values.
+		bool readFromDisk(uint64_t key, size_t count, std::vector<float>& pixels);
+		void writeToDisk(uint64_t key, const std::vector<float>& pixels);
+
+		/*** Private Member Variables ***/
+		bool enabled;
+
+		// Frames in memory, most recently used first.
+		std::list<Entry>* entries;
+		// Finds the list entry for a key.
+		std::map<uint64_t, std::list<Entry>::iterator>* index;
+		size_t memoryBytes;
+		size_t memoryLimitBytes;
+
+		// The directory frames are saved to (empty if disabled).
+		std::string directory;
+		// Keys of the frames on disk, most recently used first, with their file sizes.
+		std::list<std::pair<uint64_t, size_t> >* diskEntries;
+		size_t diskBytes;
+		size_t diskLimitBytes;
+
+		// Statistics.
+		int hits;
+		int misses;
+
+		std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,311 @@
+#include "imageWriter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <stdint.h>
+#include <zlib.h>
+
+#include "misc.h"
+
+// The size of the buffer compressed PNG data is collected in (and so of each IDAT chunk).
+const int PNG_CHUNK_BYTES = 1 << 16;
+
+
+/*** Helper Functions ***/
+
+// Writes a 32-bit value most significant byte first, as PNG stores them.
+static void putBigEndian(unsigned char* p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+}
+
+// Writes a PNG chunk: its length, type, data, and the CRC of the type and data.
+static void writePNGChunk(std::ofstream& file, const char* type, const unsigned char* data, uint32_t length)
+{
+	unsigned char header[8];
+	putBigEndian(header, length);
+	std::copy(type, type + 4, header + 4);
+
+	uLong crc = crc32(0L, header + 4, 4);
+	if (length > 0)
+	{
+		crc = crc32(crc, data, length);
+	}
+	unsigned char footer[4];
+	putBigEndian(footer, crc);
+
+	file.write((const char*)header, 8);
+	file.write((const char*)data, length);
+	file.write((const char*)footer, 4);
+}
+
+
+/*** Public Member Functions ***/
+
+ImageWriter::ImageWriter()
+{
+	gamma = 1.0;
+	jobs = new std::deque<ImageJob>();
+	busy = false;
+	stopping = false;
+
+	framesWritten = 0;
+	framesFailed = 0;
+	writeMs = 0.0;
+	lastFileName = "";
+
+	worker = std::thread(&ImageWriter::writerLoop, this);
+}
+
+ImageWriter::~ImageWriter()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+	worker.join();
+
+	delete jobs;
+}
+
+ImageFormat ImageWriter::formatOf(std::string fileName)
+{
+	size_t dot = fileName.find_last_of('.');
+	if (dot == std::string::npos) return ifUnknown;
+
+	std::string extension = fileName.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	if (extension == "ppm") return ifPPM;
+	if (extension == "png") return ifPNG;
+	if (extension == "pfm") return ifPFM;
+	return ifUnknown;
+}
+
+bool ImageWriter::write(std::string fileName, int width, int height, std::vector<float>&& pixels)
+{
+	ImageFormat format = formatOf(fileName);
+	if (format == ifUnknown || width <= 0 || height <= 0 || (int64_t)pixels.size() != (int64_t)width * height * 3)
+	{
+		return false;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	jobDone.wait(lock, [this]() { return (int)jobs->size() < IMAGE_WRITER_MAX_QUEUED; });
+
+	ImageJob job;
+	job.fileName = fileName;
+	job.format = format;
+	job.width = width;
+	job.height = height;
+	job.pixels = std::move(pixels);
+	job.gamma = gamma;
+	jobs->push_back(std::move(job));
+	jobAvailable.notify_one();
+	return true;
+}
+
+void ImageWriter::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	jobDone.wait(lock, [this]() { return jobs->empty() && !busy; });
+}
+
+void ImageWriter::setGamma(float _gamma)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	gamma = (_gamma > 0.0) ? _gamma : 1.0;
+}
+
+float ImageWriter::getGamma()
+{
+	return gamma;
+}
+
+void ImageWriter::printStatus(std::ostream& s)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	s << "Images are written with a gamma of " << gamma << ". " << framesWritten << " written";
+	if (framesWritten > 0)
+	{
+		s << " in " << writeMs << " ms (last to \"" << lastFileName << "\")";
+	}
+	if (framesFailed > 0)
+	{
+		s << ", " << framesFailed << " failed";
+	}
+	int waiting = jobs->size() + (busy ? 1 : 0);
+	if (waiting > 0)
+	{
+		s << ", " << waiting << " waiting";
+	}
+	s << "." << std::endl;
+}
+
+
+/*** Private Member Functions ***/
+
+void ImageWriter::writerLoop()
+{
+	while (true)
+	{
+		ImageJob job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs->empty(); });
+			if (jobs->empty()) return;
+
+			job = std::move(jobs->front());
+			jobs->pop_front();
+			busy = true;
+		}
+
+		double startMs = nowMs();
+		bool success = false;
+		switch (job.format)
+		{
+			case ifPPM:
+				success = writePPM(job);
+				break;
+			case ifPNG:
+				success = writePNG(job);
+				break;
+			case ifPFM:
+				success = writePFM(job);
+				break;
+			default:
+				break;
+		}
+		if (!success)
+		{
+			std::cout << "Could not write \"" << job.fileName << "\"." << std::endl;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (success)
+			{
+				framesWritten++;
+				writeMs += nowMs() - startMs;
+				lastFileName = job.fileName;
+			}
+			else
+			{
+				framesFailed++;
+			}
+			busy = false;
+		}
+		jobDone.notify_all();
+	}
+}
+
+bool ImageWriter::writePPM(const ImageJob& job)
+{
+	std::ofstream file(job.fileName.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) return false;
+
+	file << "P6\n" << job.width << " " << job.height << "\n255\n";
+
+	// PPM files start with the top row, which is the last one in the frame.
+	PixelConverter converter(job.gamma);
+	std::vector<unsigned char> row(job.width * 3);
+	for (int j = job.height - 1; j >= 0; j--)
+	{
+		converter.convert(job.pixels.data() + (size_t)j * job.width * 3, row.data(), row.size());
+		file.write((const char*)row.data(), row.size());
+	}
+
+	file.close();
+	return !file.fail();
+}
+
+bool ImageWriter::writePNG(const ImageJob& job)
+{
+	std::ofstream file(job.fileName.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) return false;
+
+	static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	file.write((const char*)signature, 8);
+
+	// 8-bit RGB, not interlaced.
+	unsigned char header[13] = {0};
+	putBigEndian(header, job.width);
+	putBigEndian(header + 4, job.height);
+	header[8] = 8;
+	header[9] = 2;
+	writePNGChunk(file, "IHDR", header, sizeof(header));
+
+	z_stream z;
+	z.zalloc = Z_NULL;
+	z.zfree = Z_NULL;
+	z.opaque = Z_NULL;
+	if (deflateInit(&z, Z_DEFAULT_COMPRESSION) != Z_OK) return false;
+
+	// Each row is filtered by subtracting the row above it, which suits the smooth shading of rendered frames.
+	// Rows are compressed one at a time, and each IDAT chunk is written as the output buffer fills.
+	PixelConverter converter(job.gamma);
+	int rowBytes = job.width * 3;
+	std::vector<unsigned char> row(rowBytes + 1);
+	std::vector<unsigned char> above(rowBytes + 1, 0);
+	std::vector<unsigned char> filtered(rowBytes + 1);
+	std::vector<unsigned char> compressed(PNG_CHUNK_BYTES);
+	z.next_out = compressed.data();
+	z.avail_out = compressed.size();
+
+	bool success = true;
+	for (int j = job.height - 1; j >= 0 && success; j--)
+	{
+		converter.convert(job.pixels.data() + (size_t)j * rowBytes, row.data() + 1, rowBytes);
+		filtered[0] = (j == job.height - 1) ? 0 : 2;
+		for (int k = 1; k <= rowBytes; k++)
+		{
+			filtered[k] = row[k] - above[k];
+		}
+		row.swap(above);
+
+		z.next_in = filtered.data();
+		z.avail_in = filtered.size();
+		int flush = (j == 0) ? Z_FINISH : Z_NO_FLUSH;
+		int result;
+		do
+		{
+			result = deflate(&z, flush);
+			if (result == Z_STREAM_ERROR)
+			{
+				success = false;
+				break;
+			}
+			if (z.avail_out == 0 || result == Z_STREAM_END)
+			{
+				writePNGChunk(file, "IDAT", compressed.data(), compressed.size() - z.avail_out);
+				z.next_out = compressed.data();
+				z.avail_out = compressed.size();
+			}
+		}
+		while (z.avail_in > 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+	}
+	deflateEnd(&z);
+
+	writePNGChunk(file, "IEND", nullptr, 0);
+	file.close();
+	return success && !file.fail();
+}
+
+bool ImageWriter::writePFM(const ImageJob& job)
+{
+	std::ofstream file(job.fileName.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) return false;
+
+	// A negative scale marks the values as little-endian. PFM files start with the bottom row, as the frame does.
+	file << "PF\n" << job.width << " " << job.height << "\n-1.0\n";
+	file.write((const char*)job.pixels.data(), job.pixels.size() * sizeof(float));
+
+	file.close();
+	return !file.fail();
+}
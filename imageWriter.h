@@ -0,0 +1,112 @@
+#ifndef __IMAGEWRITER_H__
+#define __IMAGEWRITER_H__
+
+/* imageWriter.h
+ *
+ * Writes rendered frames to image files on a thread of its own, so that encoding and writing one frame
+ * overlaps with rendering the next. The format is chosen by the extension of the file name:
+ *
+ *   .ppm  binary PPM, 8 bits per channel.
+ *   .png  PNG, 8 bits per channel, compressed with zlib.
+ *   .pfm  PFM, the linear float values as they are in the frame buffer (in the native byte order).
+ *
+ * The 8-bit formats are encoded with the writer's gamma at the time the frame is queued.
+ *
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pixelConverter.h"
+
+enum ImageFormat {
+	ifPPM,
+	ifPNG,
+	ifPFM,
+
+	ifUnknown
+};
+
+// The most frames that may wait to be written before queuing another one blocks.
+const int IMAGE_WRITER_MAX_QUEUED = 2;
+
+class ImageWriter
+{
+	public:
+		/*** Public Member Functions ***/
+		// Starts the writer thread.
+		ImageWriter();
+		// Writes the frames that are still queued, then stops the writer thread.
+		~ImageWriter();
+
+		// Returns the format of files with the name (ifUnknown if the extension isn't one of the formats).
+		static ImageFormat formatOf(std::string fileName);
+
+		// Queues a frame to be written to the file. The pixels are width x height RGB floats, bottom row first
+		// (as in the frame buffer), and are taken over by the writer. Blocks while the queue is full.
+		// Returns false (and queues nothing) if the format is unknown.
+		bool write(std::string fileName, int width, int height, std::vector<float>&& pixels);
+		// Blocks until every queued frame has been written.
+		void wait();
+
+		// Sets/returns the gamma the 8-bit formats are encoded with (1 writes the values unchanged).
+		void setGamma(float _gamma);
+		float getGamma();
+
+		// Prints the gamma, and the number of frames written and the time spent writing them.
+		void printStatus(std::ostream& s);
+
+	private:
+		// A frame waiting to be written.
+		struct ImageJob
+		{
+			std::string fileName;
+			ImageFormat format;
+			int width;
+			int height;
+			std::vector<float> pixels;
+			float gamma;
+		};
+
+		/*** Private Member Functions ***/
+		// The loop the writer thread runs until the writer is destroyed.
+		void writerLoop();
+		// Write the frame in each format. Return false if the file could not be written.
+		static bool writePPM(const ImageJob& job);
+		static bool writePNG(const ImageJob& job);
+		static bool writePFM(const ImageJob& job);
+
+		// Writers can't be copied.
+		ImageWriter(const ImageWriter&) = delete;
+		ImageWriter& operator=(const ImageWriter&) = delete;
+
+		/*** Private Member Variables ***/
+		float gamma;
+		// Frames that have not yet been started.
+		std::deque<ImageJob>* jobs;
+		// True while the writer thread is writing a frame.
+		bool busy;
+		// Set when the writer is being destroyed.
+		bool stopping;
+
+		// The number of frames written (and that failed), and the total time spent writing them.
+		int framesWritten;
+		int framesFailed;
+		double writeMs;
+		std::string lastFileName;
+
+		std::thread worker;
+		// Guards the queue and counters.
+		std::mutex mutex;
+		// Signalled when a frame is queued (or the writer is stopping).
+		std::condition_variable jobAvailable;
+		// Signalled when a frame has been written.
+		std::condition_variable jobDone;
+};
+
+#endif
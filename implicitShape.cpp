@@ -92,6 +92,21 @@ void ImplicitShape::setCoefficients(
 }
 
 
+void ImplicitShape::getCoefficients(float c[10])
+{
+	c[0] = c200;
+	c[1] = c020;
+	c[2] = c002;
+	c[3] = c110;
+	c[4] = c101;
+	c[5] = c011;
+	c[6] = c100;
+	c[7] = c010;
+	c[8] = c001;
+	c[9] = c000;
+}
+
+
 /** Implemented for Shape **/
 
 bool ImplicitShape::rayIntersects(FCoord3D p0, FCoord3D d, float &t, FCoord3D &normal)
@@ -211,3 +226,11 @@ void ImplicitShape::write(std::ostream& s)
 		<< c000;
 	s << std::endl;
 }
+
+
+/** Overridden from Shape **/
+
+size_t ImplicitShape::memoryBytes()
+{
+	return sizeof(ImplicitShape);
+}
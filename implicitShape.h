@@ -35,6 +35,8 @@ class ImplicitShape: public Shape
 			float _c100, float _c010, float _c001,
 			float _c000
 		);
+		// Fills the array with the 10 coefficients, in the order used by setCoefficients.
+		void getCoefficients(float c[10]);
 		
 		/** Implemented for Shape **/
 		bool rayIntersects(FCoord3D p0, FCoord3D d, float &t, FCoord3D &normal);
@@ -42,6 +44,9 @@ class ImplicitShape: public Shape
 		void read(std::istream& s);
 		void write(std::ostream& s);
 		
+		/** Overridden from Shape **/
+		size_t memoryBytes();
+		
 	private:
 		/*** Private Member Variables ***/
 		float c200, c020, c002, c110, c101, c011, c100, c010, c001, c000;
@@ -0,0 +1,140 @@
+#include "instanceShape.h"
+
+#include "surfaceShape.h"
+
+
+/*** Public Member Functions ***/
+
+InstanceShape::InstanceShape()
+{
+	mesh = nullptr;
+	meshName = "";
+	setTransform(Transform());
+
+	color = RGB(0.5, 0.5, 0.5);
+	reflectionCoefficient = 0.25;
+	refractionCoeffieient = 0.25;
+	refractiveIndex = 1.5;
+	phongExponent = 3;
+}
+
+InstanceShape::InstanceShape(std::shared_ptr<SurfaceShape> _mesh, std::string _meshName, Transform _transform)
+{
+	mesh = _mesh;
+	meshName = _meshName;
+	setTransform(_transform);
+
+	color = RGB(0.5, 0.5, 0.5);
+	reflectionCoefficient = 0.25;
+	refractionCoeffieient = 0.25;
+	refractiveIndex = 1.5;
+	phongExponent = 3;
+}
+
+InstanceShape::~InstanceShape()
+{
+}
+
+
+/** Implemented for Shape **/
+
+bool InstanceShape::rayIntersects(FCoord3D p0, FCoord3D d, float &t, FCoord3D &normal)
+{
+	if (!mesh || !invertible) return false;
+
+	// The direction isn't normalized in the mesh's space, so t is the same in both spaces.
+	FCoord3D meshNormal;
+	if (!mesh->rayIntersects(inverse.applyPoint(p0), inverse.applyVector(d), t, meshNormal)) return false;
+
+	normal = inverse.applyTransposed(meshNormal).makeUnit();
+	return true;
+}
+
+bool InstanceShape::lineSegmentIntersects(FCoord3D p0, FCoord3D p1)
+{
+	if (!mesh || !invertible) return false;
+	return mesh->lineSegmentIntersects(inverse.applyPoint(p0), inverse.applyPoint(p1));
+}
+
+void InstanceShape::read(std::istream& s)
+{
+	readAttributes(s);
+	s >> meshName;
+
+	Transform t;
+	t.read(s);
+	setTransform(t);
+}
+
+void InstanceShape::write(std::ostream& s)
+{
+	s << "INSTANCE_SHAPE" << std::endl;
+	writeAttributes(s);
+	s << meshName << std::endl;
+	transform.write(s);
+}
+
+
+/** Overridden from Shape **/
+
+bool InstanceShape::prepare()
+{
+	bool prepared = (mesh && mesh->prepare()) || moved;
+	moved = false;
+	return prepared;
+}
+
+bool InstanceShape::getBounds(FCoord3D &min, FCoord3D &max)
+{
+	FCoord3D meshMin, meshMax;
+	if (!mesh || !invertible || !mesh->getBounds(meshMin, meshMax)) return false;
+
+	// The transformed box is contained by the box around its transformed corners.
+	for (int i = 0; i < 8; i++)
+	{
+		FCoord3D corner = FCoord3D((i & 1) ? meshMax.x : meshMin.x, (i & 2) ? meshMax.y : meshMin.y, (i & 4) ? meshMax.z : meshMin.z);
+		FCoord3D p = transform.applyPoint(corner);
+		if (i == 0 || p.x < min.x) min.x = p.x;
+		if (i == 0 || p.y < min.y) min.y = p.y;
+		if (i == 0 || p.z < min.z) min.z = p.z;
+		if (i == 0 || p.x > max.x) max.x = p.x;
+		if (i == 0 || p.y > max.y) max.y = p.y;
+		if (i == 0 || p.z > max.z) max.z = p.z;
+	}
+	return true;
+}
+
+size_t InstanceShape::memoryBytes()
+{
+	return sizeof(InstanceShape) + meshName.capacity();
+}
+
+void InstanceShape::setMesh(std::shared_ptr<SurfaceShape> _mesh, std::string _meshName)
+{
+	mesh = _mesh;
+	meshName = _meshName;
+	moved = true;
+}
+
+std::shared_ptr<SurfaceShape> InstanceShape::getMesh()
+{
+	return mesh;
+}
+
+std::string InstanceShape::getMeshName()
+{
+	return meshName;
+}
+
+void InstanceShape::setTransform(Transform _transform)
+{
+	transform = _transform;
+	invertible = transform.isInvertible();
+	inverse = invertible ? transform.inverse() : Transform();
+	moved = true;
+}
+
+Transform InstanceShape::getTransform()
+{
+	return transform;
+}
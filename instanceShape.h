@@ -0,0 +1,75 @@
+#ifndef __INSTANCESHAPE_H__
+#define __INSTANCESHAPE_H__
+
+/* instanceShape.h
+ *
+ * A shape that places a shared mesh in the scene with a transformation and a material of its own
+ * (inherits from shape). Any number of instances can share one mesh, and with it the mesh's points,
+ * surfaces and bounding volume hierarchy. Rays are transformed into the mesh's space to be intersected.
+ *
+ * In scene files, meshes are defined by MESH entries (a name, then the points and surfaces) and placed by
+ * INSTANCE_SHAPE entries (the attributes, the mesh name, then the 3 rows of the transformation).
+ *
+ */
+
+#include <memory>
+#include <string>
+
+#include "misc.h"
+#include "shape.h"
+
+class SurfaceShape;
+
+// The name of the mesh that Shape::createCube makes instances of.
+const std::string UNIT_CUBE_MESH_NAME = "unit_cube";
+
+class InstanceShape: public Shape
+{
+	public:
+		/*** Public Member Functions ***/
+		// Default constructor (no mesh, so nothing is hit).
+		InstanceShape();
+		// Places the named mesh with the transformation.
+		InstanceShape(std::shared_ptr<SurfaceShape> _mesh, std::string _meshName, Transform _transform);
+		// Destructor. The mesh is destroyed with its last instance.
+		virtual ~InstanceShape();
+
+		/** Implemented for Shape **/
+		bool rayIntersects(FCoord3D p0, FCoord3D d, float &t, FCoord3D &normal);
+		bool lineSegmentIntersects(FCoord3D p0, FCoord3D p1);
+		// Reads the attributes, mesh name and transformation. The mesh itself must be set with setMesh().
+		void read(std::istream& s);
+		void write(std::ostream& s);
+
+		/** Overridden from Shape **/
+		// Builds the bounding volume hierarchy of the mesh, if no instance has yet.
+		// Also returns true if the bounds have changed since the last call.
+		bool prepare();
+		// Returns the box around the transformed bounds of the mesh.
+		bool getBounds(FCoord3D &min, FCoord3D &max);
+		// Leaves out the mesh, which is shared.
+		size_t memoryBytes();
+
+		// Sets/returns the mesh and the name it is saved under.
+		void setMesh(std::shared_ptr<SurfaceShape> _mesh, std::string _meshName);
+		std::shared_ptr<SurfaceShape> getMesh();
+		std::string getMeshName();
+		// Sets/returns the transformation from the mesh's space into the scene.
+		// A transformation that can't be inverted makes the instance invisible.
+		void setTransform(Transform _transform);
+		Transform getTransform();
+
+	private:
+		/*** Private Member Variables ***/
+		std::shared_ptr<SurfaceShape> mesh;
+		std::string meshName;
+		// The transformation into the scene, and back into the mesh's space.
+		Transform transform;
+		Transform inverse;
+		// False if the transformation can't be inverted.
+		bool invertible;
+		// Set when the mesh or transformation changes, until the next prepare().
+		bool moved;
+};
+
+#endif
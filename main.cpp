@@ -1,144 +1,336 @@
 #include "main.h"
 
 #include <GL/glut.h>
-#include <algorithm>
-#include <assert.h>
+#include <atomic>
 #include <cmath>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <time.h>
 #include <stdlib.h>
 
-#include "commandHandler.h"
-#include "implicitShape.h"
-#include "phongLightSource.h"
-#include "shape.h"
-#include "shapeCollection.h"
-#include "surfaceShape.h"
+#include "frameBuffer.h"
+#include "metrics.h"
 #include "misc.h"
+#include "pixelConverter.h"
+#include "renderSession.h"
 #include "viewport.h"
 
-int windowSize;
-float* pixelBuffer;
-Viewport* viewport;
-ShapeCollection* shapeCollection;
-CommandHandler* commandHandler = new CommandHandler();
+// How often (in milliseconds) the window checks for newly finished tiles.
+const int PRESENT_INTERVAL_MS = 30;
+
+// A rectangle of the window that has changed since it was last presented.
+struct DirtyRect
+{
+	int x;
+	int y;
+	int width;
+	int height;
+};
+
+int windowWidth;
+int windowHeight;
+// The renderer, with the scene and everything it is rendered with (see renderSession.h).
+RenderSession* session;
+// The session's frame buffer, which the window shows.
+FrameBuffer* frameBuffer;
+// The frame buffer packed into 8-bit RGB, which is what is uploaded to OpenGL.
+unsigned char* displayBuffer;
+// Converts the frame buffer to the display buffer (without gamma encoding).
+PixelConverter* displayConverter;
+
+// Tiles that have finished rendering but have not yet been drawn to the window.
+std::vector<DirtyRect> dirtyRects;
+std::mutex dirtyMutex;
+std::atomic<bool> dirty(false);
 
 void display();
+void presentDirtyTiles(int value);
+void mouse(int button, int state, int x, int y);
+void tileFinished(int x, int y, int width, int height);
+void packPixels(int x, int y, int width, int height);
+void commandLoop();
 
 int main(int argc, char *argv[])
 {
 	// Seed the random number generator.
 	srand(time(NULL));
 	
-	// Default window size is (300, 300).
-	windowSize = 300;
+	// Default window size is (300, 300). A single size makes a square window.
+	windowWidth = 300;
+	windowHeight = 0;
+	// In headless mode, no window is opened and the viewport covers the whole frame buffer.
+	bool headless = false;
+	// The region of interest to render (if given).
+	bool region = false;
+	int regionCoords[4];
+	// The number of sizes given (a width, then optionally a height).
+	int sizesGiven = 0;
+	// In headless mode, the file each frame is written to, and the file the memory usage is written to (if given).
+	std::string outputFileName = "";
+	std::string memoryFileName = "";
+	// The memory budget (0 for none).
+	size_t memoryBudget = 0;
+	// When serving, the socket that render jobs are taken from (no window is opened).
+	std::string socketPath = "";
+	// When working for a coordinator, its address as "host:port" (no window is opened).
+	std::string coordinatorAddress = "";
+	// Whether the render threads are NUMA-aware, and the number of nodes to emulate (0 uses the machine's).
+	bool numa = false;
+	int numaNodes = 0;
+	// The port the metrics are served on, and the file they are written to (if given).
+	int metricsPort = -1;
+	std::string metricsFileName = "";
 	
-	// Get window size from the command line.
-	if (argc > 1)
+	// Get the window size and options from the command line.
+	for (int i = 1; i < argc; i++)
 	{
-		windowSize = atoi(argv[1]);
+		std::string arg = argv[i];
+		if (arg == "-headless" || arg == "--headless")
+		{
+			headless = true;
+		}
+		else if ((arg == "-region" || arg == "--region") && i + 4 < argc)
+		{
+			region = true;
+			for (int k = 0; k < 4; k++)
+			{
+				regionCoords[k] = atoi(argv[++i]);
+			}
+		}
+		else if ((arg == "-output" || arg == "--output" || arg == "-o") && i + 1 < argc)
+		{
+			outputFileName = argv[++i];
+		}
+		else if ((arg == "-serve" || arg == "--serve") && i + 1 < argc)
+		{
+			socketPath = argv[++i];
+			headless = true;
+		}
+		else if ((arg == "-worker" || arg == "--worker") && i + 1 < argc)
+		{
+			coordinatorAddress = argv[++i];
+			headless = true;
+		}
+		else if ((arg == "-mem-budget" || arg == "--mem-budget") && i + 1 < argc)
+		{
+			memoryBudget = (size_t)atoi(argv[++i]) * 1024 * 1024;
+		}
+		else if ((arg == "-mem-json" || arg == "--mem-json") && i + 1 < argc)
+		{
+			memoryFileName = argv[++i];
+		}
+		else if (arg == "-numa" || arg == "--numa")
+		{
+			numa = true;
+		}
+		else if ((arg == "-numa-nodes" || arg == "--numa-nodes") && i + 1 < argc)
+		{
+			numa = true;
+			numaNodes = atoi(argv[++i]);
+		}
+		else if ((arg == "-metrics-port" || arg == "--metrics-port") && i + 1 < argc)
+		{
+			metricsPort = atoi(argv[++i]);
+		}
+		else if ((arg == "-metrics-file" || arg == "--metrics-file") && i + 1 < argc)
+		{
+			metricsFileName = argv[++i];
+		}
+		else if (sizesGiven++ == 0)
+		{
+			windowWidth = atoi(argv[i]);
+		}
+		else
+		{
+			windowHeight = atoi(argv[i]);
+		}
 	}
+	if (windowHeight == 0) windowHeight = windowWidth;
 	// Ensure that the window is at least (100, 100).
-	if (windowSize < 80) windowSize = 100;
+	if (windowWidth < 80) windowWidth = 100;
+	if (windowHeight < 80) windowHeight = 100;
+	
+	session = new RenderSession(windowWidth, windowHeight, headless, numa, numaNodes);
+	frameBuffer = session->getFrameBuffer();
+	session->setMemoryBudget(memoryBudget);
+	Viewport* viewport = session->getViewport();
+	if (region)
+	{
+		viewport->setRegion(regionCoords[0], regionCoords[1], regionCoords[2], regionCoords[3]);
+	}
+	Metrics* metrics = session->getMetrics();
+	if (metricsPort >= 0 && !metrics->serve(metricsPort))
+	{
+		std::cout << "Could not serve metrics on port " << metricsPort << "." << std::endl;
+	}
+	if (metricsFileName != "" && !metrics->writeToFile(metricsFileName, METRICS_FILE_INTERVAL_MS))
+	{
+		std::cout << "Could not write metrics to \"" << metricsFileName << "\"." << std::endl;
+	}
 	
-	// Allocate a new pixel buffer, and initialize to color black.
-	pixelBuffer = new float[windowSize * windowSize * 3];
-	fill(RGB(0.0, 0.0, 0.0));
+	if (coordinatorAddress != "")
+	{
+		// Tiles are rendered for the coordinator until it disconnects.
+		return session->runWorker(coordinatorAddress) ? 0 : EXIT_FAILURE;
+	}
+	if (socketPath != "")
+	{
+		// Jobs are rendered until interrupted.
+		return session->runServer(socketPath) ? 0 : EXIT_FAILURE;
+	}
 	
-	// Initialize the viewport and shape collection.
-	shapeCollection = new ShapeCollection();
-	int viewportSize = windowSize - 20;
-	viewport = new Viewport(Coord(10, 10), viewportSize, shapeCollection);
-	shapeCollection->setViewport(viewport);
+	session->setOutputFile(outputFileName);
+	session->setMemoryFile(memoryFileName);
+	if (headless)
+	{
+		// Commands are read and executed on this thread until the input ends.
+		commandLoop();
+		return 0;
+	}
+	session->setTileListener(tileFinished);
 	
-	// Draw the initial viewport
+	// Draw the viewport outline and background, which are uploaded on the first display.
 	viewport->drawOutline();
 	viewport->fillBackground();
-	viewport->redraw(true);
+	displayBuffer = new unsigned char[windowWidth * windowHeight * 3];
+	displayConverter = new PixelConverter();
+	packPixels(0, 0, windowWidth, windowHeight);
 	
 	// Initialize GLUT.
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_SINGLE);
 	// Set window size.
-	glutInitWindowSize(windowSize, windowSize);
+	glutInitWindowSize(windowWidth, windowHeight);
 	// Set window position.
 	glutInitWindowPosition(100, 100);
 
 	// Create and set main window title.
 	glutCreateWindow("Project 5");
 	glClearColor(0, 0, 0, 0); // Clears the buffer of OpenGL.
+	// Map raster positions directly to window pixels.
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0, windowWidth, 0, windowHeight, -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, windowWidth);
 	// Sets display function.
 	glutDisplayFunc(display);
+	glutTimerFunc(PRESENT_INTERVAL_MS, presentDirtyTiles, 0);
+	// Sets mouse function.
+	glutMouseFunc(mouse);
+	
+	// User commands (and the rendering they trigger) run on their own thread,
+	// so the window keeps responding while waiting for input.
+	std::thread commandThread(commandLoop);
+	commandThread.detach();
 
 	glutMainLoop();// Main display loop, will display until terminate.
 	return 0;
 }
 
-// Main display loop. This function will be called again and again by OpenGL.
+// Called by OpenGL when the whole window needs to be drawn (e.g. when it is uncovered).
 void display()
 {
-	// Misc.
-	glClear(GL_COLOR_BUFFER_BIT);
-	glLoadIdentity();
-
-	// Draws pixels on screen. Width and height must match pixel buffer dimension.
-	glDrawPixels(windowSize, windowSize, GL_RGB, GL_FLOAT, pixelBuffer);
-
-	// Window refresh.
+	{
+		std::unique_lock<std::mutex> lock(dirtyMutex);
+		dirtyRects.clear();
+		dirty = false;
+		
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+		glRasterPos2i(0, 0);
+		glDrawPixels(windowWidth, windowHeight, GL_RGB, GL_UNSIGNED_BYTE, displayBuffer);
+	}
+	
 	glFlush();
+}
+
+// Draws only the tiles that have finished since the last call. Nothing is uploaded while the window is idle.
+void presentDirtyTiles(int value)
+{
+	if (dirty.exchange(false))
+	{
+		std::vector<DirtyRect> rects;
+		std::unique_lock<std::mutex> lock(dirtyMutex);
+		rects.swap(dirtyRects);
+		
+		for (int i = 0; i < (int)rects.size(); i++)
+		{
+			DirtyRect r = rects.at(i);
+			glPixelStorei(GL_UNPACK_SKIP_PIXELS, r.x);
+			glPixelStorei(GL_UNPACK_SKIP_ROWS, r.y);
+			glRasterPos2i(r.x, r.y);
+			glDrawPixels(r.width, r.height, GL_RGB, GL_UNSIGNED_BYTE, displayBuffer);
+		}
+		glFlush();
+	}
 	
-	// Get user input.
-	commandHandler->getUserInput();
+	glutTimerFunc(PRESENT_INTERVAL_MS, presentDirtyTiles, value);
+}
+
+// Called by GLUT when a mouse button is pressed or released. A click sets the point that the focus tile order
+// renders the next frames out from.
+void mouse(int button, int state, int x, int y)
+{
+	if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN) return;
 	
-	// Execute the command.
-	bool redraw = true;
-	commandHandler->execute(shapeCollection, viewport, redraw);
+	// GLUT counts rows from the top of the window.
+	Viewport* viewport = session->getViewport();
+	Coord origin = viewport->getOrigin();
+	viewport->setTileFocus(x - origin.x, (windowHeight - 1 - y) - origin.y);
+}
+
+// Called from the render threads when a tile has finished.
+void tileFinished(int x, int y, int width, int height)
+{
+	std::unique_lock<std::mutex> lock(dirtyMutex);
+	packPixels(x, y, width, height);
 	
-	// Redraw the viewport.
-	if (redraw)
+	DirtyRect r;
+	r.x = x;
+	r.y = y;
+	r.width = width;
+	r.height = height;
+	dirtyRects.push_back(r);
+	dirty = true;
+}
+
+// Converts a rectangle of the frame buffer into the 8-bit display buffer.
+void packPixels(int x, int y, int width, int height)
+{
+	std::vector<float> row(width * 3);
+	for (int j = y; j < y + height; j++)
 	{
-		viewport->redraw(true);
+		frameBuffer->getRow(x, j, width, row.data());
+		displayConverter->convert(row.data(), displayBuffer + (x + j * windowWidth) * 3, row.size());
 	}
-	
-	glutPostRedisplay();
+}
+
+// Reads and executes user commands until the program quits or input ends.
+void commandLoop()
+{
+	session->runCommands();
+	exit(EXIT_SUCCESS);
 }
 
 
 void makePix(int x, int y, RGB color)
 {
-	int height = windowSize;
-	int width = windowSize;
-	if (x < 0 || x >= width) return;
-	if (y < 0 || y >= height) return;
-	
-	pixelBuffer[x * 3 + y * 3 * width] = color.red;
-	pixelBuffer[x * 3 + y * 3 * width + 1] = color.green;
-	pixelBuffer[x * 3 + y * 3 * width + 2] = color.blue;
+	frameBuffer->set(x, y, color);
 }
 
 RGB getPix(int x, int y)
 {
-	int height = windowSize;
-	int width = windowSize;
-	if (x < 0 || x >= width) return RGB();
-	if (y < 0 || y >= height) return RGB();
-	
-	return RGB(
-		pixelBuffer[x * 3 + y * 3 * width],
-		pixelBuffer[x * 3 + y * 3 * width + 1],
-		pixelBuffer[x * 3 + y * 3 * width + 2]
-	);
+	return frameBuffer->get(x, y);
 }
 
 void fill(RGB color)
 {
-	for (int i = 0; i < windowSize; i++)
-	{
-		for (int j = 0; j < windowSize; j++)
-		{
-			makePix(i, j, color);
-		}
-	}
+	frameBuffer->fill(color);
 }
 
 bool isLineSimple(int x1, int y1, int x2, int y2)
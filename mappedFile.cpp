@@ -0,0 +1,239 @@
+#include "mappedFile.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "misc.h"
+
+
+/*** MappedFile ***/
+
+MappedFile::MappedFile(std::string _fileName, std::shared_ptr<MappedFiles> _files)
+{
+	fileName = _fileName;
+	mapping = nullptr;
+	length = 0;
+
+	fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return;
+
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		void* address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address != MAP_FAILED)
+		{
+			mapping = (const char*)address;
+			length = info.st_size;
+		}
+	}
+
+	if (!mapping)
+	{
+		close(fd);
+		fd = -1;
+		return;
+	}
+
+	files = _files;
+	if (files)
+	{
+		files->add(this);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (mapping)
+	{
+		if (files)
+		{
+			files->remove(this);
+		}
+		munmap((void*)mapping, length);
+		close(fd);
+	}
+}
+
+bool MappedFile::isOpen()
+{
+	return mapping != nullptr;
+}
+
+const char* MappedFile::data()
+{
+	return mapping;
+}
+
+size_t MappedFile::size()
+{
+	return length;
+}
+
+std::string MappedFile::getFileName()
+{
+	return fileName;
+}
+
+void MappedFile::adviseRandomAccess()
+{
+	if (mapping)
+	{
+		madvise((void*)mapping, length, MADV_RANDOM);
+	}
+}
+
+size_t MappedFile::residentSize()
+{
+	if (!mapping) return 0;
+
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	std::vector<unsigned char> pages((length + pageSize - 1) / pageSize);
+	if (mincore((void*)mapping, length, pages.data()) != 0) return 0;
+
+	size_t resident = 0;
+	for (size_t i = 0; i < pages.size(); i++)
+	{
+		if (pages[i] & 1) resident++;
+	}
+	return std::min(resident * pageSize, length);
+}
+
+void MappedFile::release()
+{
+	release(mapping, length);
+}
+
+void MappedFile::release(const char* start, size_t bytes)
+{
+	if (!mapping || start < mapping || start >= mapping + length) return;
+
+	// Whole pages are dropped, including the partial ones at either end.
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t begin = (start - mapping) / pageSize * pageSize;
+	size_t end = std::min((size_t)(start - mapping) + bytes, length);
+
+	// The pages are never written to, so dropping them loses nothing. Unmapped pages would otherwise stay in the
+	// page cache (and still be counted by residentSize), so the kernel is asked to drop those as well.
+	madvise((void*)(mapping + begin), end - begin, MADV_DONTNEED);
+	posix_fadvise(fd, begin, end - begin, POSIX_FADV_DONTNEED);
+}
+
+
+/*** MappedFiles ***/
+
+MappedFiles::MappedFiles()
+{
+	files = new std::vector<MappedFile*>();
+	residentLimit = 0;
+	lastCheckMs = 0.0;
+}
+
+MappedFiles::~MappedFiles()
+{
+	delete files;
+}
+
+void MappedFiles::setResidentLimit(size_t bytes)
+{
+	residentLimit = bytes;
+	lastCheckMs = 0.0;
+	enforceResidentLimit();
+}
+
+size_t MappedFiles::getResidentLimit()
+{
+	return residentLimit;
+}
+
+void MappedFiles::enforceResidentLimit()
+{
+	size_t limit = residentLimit;
+	if (limit == 0) return;
+
+	double now = nowMs();
+	double last = lastCheckMs;
+	if (now - last < RESIDENT_CHECK_INTERVAL_MS || !lastCheckMs.compare_exchange_strong(last, now)) return;
+
+	// Only one thread gets here per interval. Release the files with the most resident until under the limit.
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<std::pair<size_t, MappedFile*>> bySize;
+	size_t total = 0;
+	for (size_t i = 0; i < files->size(); i++)
+	{
+		size_t resident = files->at(i)->residentSize();
+		bySize.push_back(std::make_pair(resident, files->at(i)));
+		total += resident;
+	}
+
+	std::sort(bySize.rbegin(), bySize.rend());
+	for (size_t i = 0; i < bySize.size() && total > limit; i++)
+	{
+		bySize[i].second->release();
+		total -= bySize[i].first;
+	}
+}
+
+size_t MappedFiles::residentTotal()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t total = 0;
+	for (size_t i = 0; i < files->size(); i++)
+	{
+		total += files->at(i)->residentSize();
+	}
+	return total;
+}
+
+void MappedFiles::releaseAll()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < files->size(); i++)
+	{
+		files->at(i)->release();
+	}
+}
+
+void MappedFiles::printStatus(std::ostream& s)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t totalSize = 0, totalResident = 0;
+	for (size_t i = 0; i < files->size(); i++)
+	{
+		size_t resident = files->at(i)->residentSize();
+		s << "  " << files->at(i)->getFileName() << ": " << files->at(i)->size() / (1024.0 * 1024.0) << " MB mapped, "
+			<< resident / (1024.0 * 1024.0) << " MB resident" << std::endl;
+		totalSize += files->at(i)->size();
+		totalResident += resident;
+	}
+
+	s << "Mapped files: " << files->size() << ", " << totalSize / (1024.0 * 1024.0) << " MB mapped, "
+		<< totalResident / (1024.0 * 1024.0) << " MB resident";
+	if (residentLimit > 0)
+	{
+		s << " (limit " << residentLimit / (1024.0 * 1024.0) << " MB)";
+	}
+	else
+	{
+		s << " (no limit)";
+	}
+	s << std::endl;
+}
+
+
+/*** Private Member Functions ***/
+
+void MappedFiles::add(MappedFile* file)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	files->push_back(file);
+}
+
+void MappedFiles::remove(MappedFile* file)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	files->erase(std::find(files->begin(), files->end(), file));
+}
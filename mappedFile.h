@@ -0,0 +1,122 @@
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+
+/* mappedFile.h
+ *
+ * A read-only memory mapping of a whole file. The mapping is released when the object is destroyed,
+ * so anything pointing into it must keep the object alive (usually through a std::shared_ptr).
+ *
+ * Pages are read in from the file when they are first touched. A mapping can belong to a set of mapped
+ * files (MappedFiles, usually the one of the scene it was loaded into), and a limit can be set on how much
+ * of the set may stay resident, which lets geometry larger than memory be rendered: once the limit is
+ * passed, resident pages are dropped and read back in when they are next needed.
+ *
+ * What is measured is how much of each file is in the kernel's page cache (as mincore reports it), not the
+ * process' resident set: a page read earlier, or by another process, counts even if this process hasn't
+ * touched it. Releasing a file both unmaps its pages and asks the kernel to drop them from the cache, so the
+ * limit bounds the cache and the part of the resident set the files take alike. It is only checked every
+ * RESIDENT_CHECK_INTERVAL_MS, so it can be passed by what the renderer reads in between, and pages the kernel
+ * keeps (because another process has them mapped) still count towards it.
+ *
+ */
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// The shortest time between two measurements of the resident size of a set of mapped files.
+const double RESIDENT_CHECK_INTERVAL_MS = 50.0;
+
+class MappedFiles;
+
+class MappedFile
+{
+	public:
+		/*** Public Member Functions ***/
+		// Maps the file, and adds it to the set (if given). Check isOpen() to see if it succeeded.
+		MappedFile(std::string _fileName, std::shared_ptr<MappedFiles> _files = nullptr);
+		// Unmaps the file, and removes it from its set.
+		~MappedFile();
+
+		// Returns true if the file was mapped.
+		bool isOpen();
+		// Returns the start of the mapped file.
+		const char* data();
+		// Returns the size of the file in bytes.
+		size_t size();
+		// Returns the name of the mapped file.
+		std::string getFileName();
+
+		// Tells the kernel that the file will be read in no particular order (so it doesn't read ahead).
+		void adviseRandomAccess();
+		// Returns how many bytes of the file are currently resident in memory.
+		size_t residentSize();
+		// Drops the resident pages (of the whole file, or of the bytes from start). They are read from the file
+		// again when next touched.
+		void release();
+		void release(const char* start, size_t bytes);
+
+	private:
+		/*** Private Member Functions ***/
+		// Mappings can't be copied.
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		/*** Private Member Variables ***/
+		std::string fileName;
+		// The open file, which is kept to drop its pages from the page cache.
+		int fd;
+		const char* mapping;
+		size_t length;
+		// The set the file belongs to (null if none). It is kept alive for as long as the file is mapped.
+		std::shared_ptr<MappedFiles> files;
+};
+
+// A set of mapped files that a resident limit is applied across: the files of a scene, or of every scene a
+// render server keeps loaded. Files add themselves when they are mapped, and remove themselves when unmapped.
+class MappedFiles
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates an empty set without a limit.
+		MappedFiles();
+		~MappedFiles();
+
+		// Sets how many bytes of the files may be resident (0 for no limit).
+		void setResidentLimit(size_t bytes);
+		size_t getResidentLimit();
+		// Releases files if the limit has been passed. This is cheap enough to call after every tile: the
+		// resident size is only measured every RESIDENT_CHECK_INTERVAL_MS.
+		void enforceResidentLimit();
+		// Returns how many bytes of the files are resident, and drops them all (see MappedFile::release).
+		size_t residentTotal();
+		void releaseAll();
+		// Prints every file, with its size and how much of it is resident.
+		void printStatus(std::ostream& s);
+
+	private:
+		friend class MappedFile;
+
+		/*** Private Member Functions ***/
+		// Adds/removes a file (as it is mapped and unmapped).
+		void add(MappedFile* file);
+		void remove(MappedFile* file);
+
+		// Sets can't be copied.
+		MappedFiles(const MappedFiles&) = delete;
+		MappedFiles& operator=(const MappedFiles&) = delete;
+
+		/*** Private Member Variables ***/
+		std::vector<MappedFile*>* files;
+		std::atomic<size_t> residentLimit;
+		// When the resident size was last measured by enforceResidentLimit.
+		std::atomic<double> lastCheckMs;
+		// Guards the files.
+		std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "memoryUsage.h"
+
+#include <iomanip>
+
+#include "frameCache.h"
+#include "mappedFile.h"
+
+// Writes a number of bytes in megabytes.
+static void printMB(std::ostream& s, size_t bytes)
+{
+	std::ios_base::fmtflags flags = s.flags();
+	std::streamsize precision = s.precision();
+	s << std::fixed << std::setprecision(1) << bytes / (1024.0 * 1024.0) << " MB";
+	s.flags(flags);
+	s.precision(precision);
+}
+
+
+MemoryUsage::MemoryUsage()
+{
+	shapes = 0;
+	meshes = 0;
+	hierarchies = 0;
+	replicas = 0;
+	mapped = 0;
+	frameBuffers = 0;
+	frameCache = 0;
+	renderBuffers = 0;
+	undo = 0;
+	budget = 0;
+}
+
+size_t MemoryUsage::total() const
+{
+	return shapes + meshes + hierarchies + replicas + mapped + frameBuffers + frameCache + renderBuffers + undo;
+}
+
+void MemoryUsage::print(std::ostream& s)
+{
+	const char* names[] = {"Shapes", "Meshes", "Hierarchies", "Replicas", "Mapped files", "Frame buffers",
+		"Frame cache", "Render buffers", "Undo states"};
+	size_t sizes[] = {shapes, meshes, hierarchies, replicas, mapped, frameBuffers, frameCache, renderBuffers, undo};
+	for (int k = 0; k < 9; k++)
+	{
+		s << "  " << std::left << std::setw(16) << names[k] << std::right;
+		printMB(s, sizes[k]);
+		s << std::endl;
+	}
+
+	s << "Memory used: ";
+	printMB(s, total());
+	if (budget > 0)
+	{
+		s << " of a budget of ";
+		printMB(s, budget);
+	}
+	else
+	{
+		s << " (no budget)";
+	}
+	s << std::endl;
+}
+
+void MemoryUsage::printJson(std::ostream& s)
+{
+	s << "{\"shapes\": " << shapes << ", \"meshes\": " << meshes << ", \"hierarchies\": " << hierarchies
+		<< ", \"replicas\": " << replicas << ", \"mapped\": " << mapped << ", \"frameBuffers\": " << frameBuffers
+		<< ", \"frameCache\": " << frameCache << ", \"renderBuffers\": " << renderBuffers << ", \"undo\": " << undo
+		<< ", \"total\": " << total() << ", \"budget\": " << budget << "}" << std::endl;
+}
+
+bool fitMemoryBudget(const MemoryUsage &usage, size_t extraBytes, FrameCache* cache, MappedFiles* mappedFiles)
+{
+	size_t budget = usage.budget;
+	size_t needed = usage.total() + extraBytes;
+	if (budget == 0 || needed <= budget) return true;
+
+	size_t over = needed - budget;
+	if (cache)
+	{
+		size_t freed = cache->shrink(over);
+		if (freed >= over) return true;
+		over -= freed;
+	}
+
+	if (mappedFiles && usage.mapped > 0)
+	{
+		mappedFiles->releaseAll();
+		if (usage.mapped >= over) return true;
+	}
+	return false;
+}
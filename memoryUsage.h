@@ -0,0 +1,62 @@
+#ifndef __MEMORYUSAGE_H__
+#define __MEMORYUSAGE_H__
+
+/* memoryUsage.h
+ *
+ * Accounts for the memory the renderer uses, by the part that holds it, and enforces a hard budget on the
+ * total (set with the "memory" command, or on the render server). When the budget would be passed, caches are emptied first (the least recently used frames of the
+ * frame cache, then the resident pages of mapped files). A load is given what the rest doesn't use, and is
+ * stopped as soon as the sizes in the file show that its shapes won't fit (see ShapeCollection::loadFromFile).
+ *
+ * The counts are of the data each part owns (shape arrays, hierarchy nodes, frame buffer tiles, cached
+ * frames), not of allocator overhead, so the process itself is somewhat larger.
+ *
+ */
+
+#include <iostream>
+#include <stddef.h>
+
+class FrameCache;
+class MappedFiles;
+
+struct MemoryUsage
+{
+	MemoryUsage();
+
+	// Returns the total of every part.
+	size_t total() const;
+	// Prints the usage in a human readable form (with the budget, if there is one).
+	void print(std::ostream& s);
+	// Prints the usage (and the budget, 0 if there is none) as a JSON object, in bytes.
+	void printJson(std::ostream& s);
+
+	// The shapes, with the points and surfaces they own.
+	size_t shapes;
+	// The meshes shared by instance shapes.
+	size_t meshes;
+	// The bounding volume hierarchies built in memory (those mapped from the cache file are counted as mapped).
+	size_t hierarchies;
+	// The copies of the shapes made for the NUMA nodes (see ShapeCollection::prepareReplicas).
+	size_t replicas;
+	// The resident pages of memory-mapped files (binary scenes and hierarchy caches), as counted by MappedFile:
+	// those in the page cache, which the process may not all have mapped.
+	size_t mapped;
+	// The allocated tiles of frame buffers.
+	size_t frameBuffers;
+	// The frames held in memory by the frame cache.
+	size_t frameCache;
+	// The per-pixel and per-tile records viewports keep between frames (primary hits, tile reaches and costs).
+	size_t renderBuffers;
+	// The shapes and meshes (with their hierarchies) that only undo states still hold.
+	size_t undo;
+
+	// The hard budget on the total in bytes (0 for none). It isn't part of the total.
+	size_t budget;
+};
+
+// Frees memory held by caches until the usage, plus the bytes about to be allocated, is within its budget. The
+// least recently used frames of the cache go first, then the resident pages of the mapped files (which are read
+// back in when next needed); either may be null. Returns false if it still wouldn't be within the budget.
+bool fitMemoryBudget(const MemoryUsage &usage, size_t extraBytes, FrameCache* cache, MappedFiles* mappedFiles);
+
+#endif
@@ -0,0 +1,687 @@
+#include "meshImport.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+#include <strings.h>
+#include <utility>
+#include <vector>
+
+#include "mappedFile.h"
+#include "shapeCollection.h"
+#include "surfaceShape.h"
+
+// The most points a PLY face may have (a larger count means the file is damaged).
+const int PLY_MAX_FACE_POINTS = 1 << 16;
+
+// PLY property types.
+enum PlyType {ptInt8, ptUInt8, ptInt16, ptUInt16, ptInt32, ptUInt32, ptFloat32, ptFloat64, ptInvalid};
+
+struct PlyProperty
+{
+	std::string name;
+	PlyType type;
+	// For list properties, the type of the element count that precedes the values.
+	bool isList;
+	PlyType countType;
+};
+
+struct PlyElement
+{
+	std::string name;
+	long long count;
+	std::vector<PlyProperty> properties;
+};
+
+
+/*** Helper Functions ***/
+
+// Returns true if the file name ends with the (lowercase) extension, in any case.
+static bool hasExtension(std::string fileName, std::string extension)
+{
+	return fileName.size() >= extension.size() &&
+		strcasecmp(fileName.c_str() + fileName.size() - extension.size(), extension.c_str()) == 0;
+}
+
+static bool isBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Adds the polygon made of the (1-indexed) points as a fan of triangles.
+static void addPolygon(SurfaceShape* shape, const int* indices, int n)
+{
+	for (int i = 2; i < n; i++)
+	{
+		shape->addSurfaceByIndices(indices[0], indices[i - 1], indices[i]);
+	}
+}
+
+// Returns true if a mesh of that size fits in the memory limit (0 for none). Sets the error if it doesn't.
+static bool fitsMemoryLimit(long long numVertices, long long numTriangles, size_t memoryLimit, std::string &error)
+{
+	size_t bytes = SurfaceShape::estimateBytes(numVertices, numTriangles);
+	if (memoryLimit == 0 || bytes <= memoryLimit) return true;
+	error = "the mesh needs about " + std::to_string(bytes / (1024 * 1024)) + " MB, more than the " +
+		std::to_string(memoryLimit / (1024 * 1024)) + " MB of memory it may use";
+	return false;
+}
+
+
+/** OBJ **/
+
+// Counts the vertices and the triangles the faces will be split into, so that the shape can reserve exactly.
+// It only looks for line starts and blanks, which is much cheaper than parsing the numbers.
+static void countObj(const char* p, const char* end, long long &numVertices, long long &numTriangles)
+{
+	numVertices = 0;
+	numTriangles = 0;
+	while (p < end)
+	{
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (!lineEnd) lineEnd = end;
+
+		while (p < lineEnd && isBlank(*p)) p++;
+
+		if (lineEnd - p > 1 && p[0] == 'v' && isBlank(p[1]))
+		{
+			numVertices++;
+		}
+		else if (lineEnd - p > 1 && p[0] == 'f' && isBlank(p[1]))
+		{
+			int n = 0;
+			p += 2;
+			while (true)
+			{
+				while (p < lineEnd && isBlank(*p)) p++;
+				if (p >= lineEnd) break;
+				n++;
+				while (p < lineEnd && !isBlank(*p)) p++;
+			}
+			if (n > 2) numTriangles += n - 2;
+		}
+
+		p = (lineEnd < end) ? lineEnd + 1 : end;
+	}
+}
+
+static bool importObj(const char* p, const char* end, size_t memoryLimit, SurfaceShape* shape, std::string &error)
+{
+	// OBJ files don't state their sizes, so count first: reserving for the most the file could hold would keep
+	// several times the memory the mesh needs.
+	long long numVertices, numTriangles;
+	countObj(p, end, numVertices, numTriangles);
+	if (numVertices > INT32_MAX || numTriangles > INT32_MAX)
+	{
+		error = "too many vertices or faces";
+		return false;
+	}
+	if (!fitsMemoryLimit(numVertices, numTriangles, memoryLimit, error)) return false;
+	shape->reserve(numVertices, numTriangles);
+
+	std::vector<int> polygon;
+	int line = 0;
+	int maxIndex = 0;
+	while (p < end)
+	{
+		line++;
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (!lineEnd) lineEnd = end;
+
+		while (p < lineEnd && isBlank(*p)) p++;
+
+		if (lineEnd - p > 1 && p[0] == 'v' && isBlank(p[1]))
+		{
+			float c[3];
+			p += 2;
+			for (int i = 0; i < 3; i++)
+			{
+				while (p < lineEnd && isBlank(*p)) p++;
+				std::from_chars_result result = std::from_chars(p, lineEnd, c[i]);
+				if (result.ec != std::errc())
+				{
+					error = "bad vertex on line " + std::to_string(line);
+					return false;
+				}
+				p = result.ptr;
+			}
+			shape->addPoint(c[0], c[1], c[2]);
+		}
+		else if (lineEnd - p > 1 && p[0] == 'f' && isBlank(p[1]))
+		{
+			polygon.clear();
+			p += 2;
+			while (true)
+			{
+				while (p < lineEnd && isBlank(*p)) p++;
+				if (p >= lineEnd) break;
+
+				// Each vertex is "v", "v/vt", "v//vn" or "v/vt/vn". Only v is used.
+				int index;
+				std::from_chars_result result = std::from_chars(p, lineEnd, index);
+				if (result.ec != std::errc() || index == 0)
+				{
+					error = "bad face on line " + std::to_string(line);
+					return false;
+				}
+				p = result.ptr;
+				while (p < lineEnd && !isBlank(*p)) p++;
+
+				// Negative indices count back from the last vertex.
+				if (index < 0) index += shape->numPoints() + 1;
+				if (index < 1)
+				{
+					error = "face uses a vertex before the first on line " + std::to_string(line);
+					return false;
+				}
+				if (index > maxIndex) maxIndex = index;
+				polygon.push_back(index);
+			}
+
+			if (polygon.size() < 3)
+			{
+				error = "face with fewer than 3 vertices on line " + std::to_string(line);
+				return false;
+			}
+			addPolygon(shape, polygon.data(), polygon.size());
+		}
+
+		p = (lineEnd < end) ? lineEnd + 1 : end;
+	}
+
+	if (maxIndex > shape->numPoints())
+	{
+		error = "a face uses vertex " + std::to_string(maxIndex) + ", but there are only " +
+			std::to_string(shape->numPoints()) + " vertices";
+		return false;
+	}
+	return true;
+}
+
+
+/** PLY **/
+
+static PlyType plyTypeFromName(std::string name)
+{
+	if (name == "char" || name == "int8") return ptInt8;
+	if (name == "uchar" || name == "uint8") return ptUInt8;
+	if (name == "short" || name == "int16") return ptInt16;
+	if (name == "ushort" || name == "uint16") return ptUInt16;
+	if (name == "int" || name == "int32") return ptInt32;
+	if (name == "uint" || name == "uint32") return ptUInt32;
+	if (name == "float" || name == "float32") return ptFloat32;
+	if (name == "double" || name == "float64") return ptFloat64;
+	return ptInvalid;
+}
+
+static int plyTypeSize(PlyType type)
+{
+	switch (type)
+	{
+		case ptInt8:
+		case ptUInt8:
+			return 1;
+		case ptInt16:
+		case ptUInt16:
+			return 2;
+		case ptInt32:
+		case ptUInt32:
+		case ptFloat32:
+			return 4;
+		case ptFloat64:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+// Reads property values from the body of a PLY file, in either the binary or the ascii encoding.
+class PlyReader
+{
+	public:
+		PlyReader(const char* _p, const char* _end, bool _ascii, bool _swapBytes)
+		{
+			p = _p;
+			end = _end;
+			ascii = _ascii;
+			swapBytes = _swapBytes;
+		}
+
+		// Reads one value. Returns false at the end of the file or on a malformed value.
+		bool read(PlyType type, double &value)
+		{
+			if (ascii)
+			{
+				while (p < end && (isBlank(*p) || *p == '\n')) p++;
+				std::from_chars_result result = std::from_chars(p, end, value);
+				if (result.ec != std::errc()) return false;
+				p = result.ptr;
+				return true;
+			}
+
+			int size = plyTypeSize(type);
+			if (end - p < size) return false;
+
+			unsigned char bytes[8];
+			memcpy(bytes, p, size);
+			if (swapBytes)
+			{
+				for (int i = 0; i < size / 2; i++)
+				{
+					std::swap(bytes[i], bytes[size - 1 - i]);
+				}
+			}
+			p += size;
+
+			switch (type)
+			{
+				case ptInt8: { int8_t v; memcpy(&v, bytes, 1); value = v; break; }
+				case ptUInt8: { uint8_t v; memcpy(&v, bytes, 1); value = v; break; }
+				case ptInt16: { int16_t v; memcpy(&v, bytes, 2); value = v; break; }
+				case ptUInt16: { uint16_t v; memcpy(&v, bytes, 2); value = v; break; }
+				case ptInt32: { int32_t v; memcpy(&v, bytes, 4); value = v; break; }
+				case ptUInt32: { uint32_t v; memcpy(&v, bytes, 4); value = v; break; }
+				case ptFloat32: { float v; memcpy(&v, bytes, 4); value = v; break; }
+				case ptFloat64: { double v; memcpy(&v, bytes, 8); value = v; break; }
+				default: return false;
+			}
+			return true;
+		}
+
+		// Skips one property (a list property is skipped along with all its values).
+		bool skip(const PlyProperty &property)
+		{
+			double n = 1;
+			if (property.isList && (!read(property.countType, n) || n < 0 || !mayHold(n))) return false;
+
+			if (!ascii)
+			{
+				long long bytes = (long long)n * plyTypeSize(property.type);
+				if (end - p < bytes) return false;
+				p += bytes;
+				return true;
+			}
+
+			double value;
+			for (int i = 0; i < (int)n; i++)
+			{
+				if (!read(property.type, value)) return false;
+			}
+			return true;
+		}
+
+		// Returns true if a list of n values may still be in the file (every value takes at least a byte).
+		bool mayHold(double n)
+		{
+			return n <= end - p;
+		}
+
+		// Give direct access to the binary data, so fixed-size records can be copied out in place.
+		const char* position()
+		{
+			return p;
+		}
+		void advance(long long bytes)
+		{
+			p += bytes;
+		}
+		long long remaining()
+		{
+			return end - p;
+		}
+		bool isBinary()
+		{
+			return !ascii;
+		}
+		bool needsSwap()
+		{
+			return swapBytes;
+		}
+
+	private:
+		const char* p;
+		const char* end;
+		bool ascii;
+		bool swapBytes;
+};
+
+static bool readPlyHeader(const char* begin, const char* end, std::vector<PlyElement> &elements,
+	bool &ascii, bool &swapBytes, const char* &body, std::string &error)
+{
+	const char* marker = "end_header";
+	const char* headerEnd = std::search(begin, end, marker, marker + strlen(marker));
+	if (headerEnd == end || end - begin < 4 || memcmp(begin, "ply", 3) != 0)
+	{
+		error = "not a PLY file";
+		return false;
+	}
+	body = (const char*)memchr(headerEnd, '\n', end - headerEnd);
+	body = body ? body + 1 : end;
+
+	std::istringstream header(std::string(begin, headerEnd - begin));
+	std::string line;
+	std::getline(header, line);
+
+	bool haveFormat = false;
+	while (std::getline(header, line))
+	{
+		std::istringstream words(line);
+		std::string keyword;
+		words >> keyword;
+
+		if (keyword == "format")
+		{
+			std::string format;
+			words >> format;
+			const uint16_t one = 1;
+			bool littleEndianHost = (*(const unsigned char*)&one == 1);
+			if (format == "ascii") ascii = true;
+			else if (format == "binary_little_endian") swapBytes = !littleEndianHost;
+			else if (format == "binary_big_endian") swapBytes = littleEndianHost;
+			else
+			{
+				error = "unknown format \"" + format + "\"";
+				return false;
+			}
+			haveFormat = true;
+		}
+		else if (keyword == "element")
+		{
+			PlyElement element;
+			words >> element.name >> element.count;
+			if (!words || element.count < 0)
+			{
+				error = "bad element \"" + line + "\"";
+				return false;
+			}
+			elements.push_back(element);
+		}
+		else if (keyword == "property")
+		{
+			PlyProperty property;
+			std::string typeName;
+			words >> typeName;
+			property.isList = (typeName == "list");
+			property.countType = ptInvalid;
+			if (property.isList)
+			{
+				std::string countTypeName;
+				words >> countTypeName >> typeName;
+				property.countType = plyTypeFromName(countTypeName);
+			}
+			property.type = plyTypeFromName(typeName);
+			words >> property.name;
+
+			if (elements.empty() || property.type == ptInvalid || (property.isList && property.countType == ptInvalid))
+			{
+				error = "bad property \"" + line + "\"";
+				return false;
+			}
+			elements.back().properties.push_back(property);
+		}
+		// Comments, obj_info and anything else are ignored.
+	}
+
+	if (!haveFormat)
+	{
+		error = "no format line";
+		return false;
+	}
+	return true;
+}
+
+static bool importPlyVertices(PlyReader &reader, const PlyElement &element, SurfaceShape* shape, std::string &error)
+{
+	int x = -1, y = -1, z = -1;
+	bool fixedSize = true;
+	long long stride = 0;
+	for (int i = 0; i < (int)element.properties.size(); i++)
+	{
+		const PlyProperty &property = element.properties[i];
+		if (property.name == "x") x = i;
+		if (property.name == "y") y = i;
+		if (property.name == "z") z = i;
+		if (property.isList) fixedSize = false;
+		stride += plyTypeSize(property.type);
+	}
+	if (x < 0 || y < 0 || z < 0)
+	{
+		error = "vertices have no x, y and z properties";
+		return false;
+	}
+
+	// The common case (binary, native byte order, float coordinates) is copied straight out of the file.
+	const std::vector<PlyProperty> &properties = element.properties;
+	if (reader.isBinary() && !reader.needsSwap() && fixedSize &&
+		properties[x].type == ptFloat32 && properties[y].type == ptFloat32 && properties[z].type == ptFloat32)
+	{
+		if (reader.remaining() / stride < element.count)
+		{
+			error = "file is truncated";
+			return false;
+		}
+
+		long long offsets[3] = {0, 0, 0};
+		int which[3] = {x, y, z};
+		for (int k = 0; k < 3; k++)
+		{
+			for (int i = 0; i < which[k]; i++)
+			{
+				offsets[k] += plyTypeSize(properties[i].type);
+			}
+		}
+
+		const char* p = reader.position();
+		FCoord3D point;
+		for (long long i = 0; i < element.count; i++, p += stride)
+		{
+			memcpy(&point.x, p + offsets[0], sizeof(float));
+			memcpy(&point.y, p + offsets[1], sizeof(float));
+			memcpy(&point.z, p + offsets[2], sizeof(float));
+			shape->addPoint(point);
+		}
+		reader.advance(stride * element.count);
+		return true;
+	}
+
+	double values[3];
+	for (long long i = 0; i < element.count; i++)
+	{
+		for (int j = 0; j < (int)properties.size(); j++)
+		{
+			int k = (j == x) ? 0 : (j == y) ? 1 : (j == z) ? 2 : -1;
+			bool ok = (k >= 0) ? reader.read(properties[j].type, values[k]) : reader.skip(properties[j]);
+			if (!ok)
+			{
+				error = "bad vertex " + std::to_string(i);
+				return false;
+			}
+		}
+		shape->addPoint(values[0], values[1], values[2]);
+	}
+	return true;
+}
+
+static bool importPlyFaces(PlyReader &reader, const PlyElement &element, SurfaceShape* shape, std::string &error)
+{
+	int indexProperty = -1;
+	for (int i = 0; i < (int)element.properties.size(); i++)
+	{
+		const PlyProperty &property = element.properties[i];
+		if (property.isList && (property.name == "vertex_indices" || property.name == "vertex_index"))
+		{
+			indexProperty = i;
+		}
+	}
+	if (indexProperty < 0)
+	{
+		error = "faces have no vertex_indices property";
+		return false;
+	}
+
+	std::vector<int> polygon;
+
+	// The common case (binary, native byte order, only a uchar-counted list of ints) is read without conversions.
+	const PlyProperty &indices = element.properties[indexProperty];
+	if (reader.isBinary() && !reader.needsSwap() && element.properties.size() == 1 &&
+		indices.countType == ptUInt8 && (indices.type == ptInt32 || indices.type == ptUInt32))
+	{
+		const char* p = reader.position();
+		const char* end = p + reader.remaining();
+		int numPoints = shape->numPoints();
+		for (long long i = 0; i < element.count; i++)
+		{
+			int n = (p < end) ? (unsigned char)*p : 0;
+			if (n < 3 || n > PLY_MAX_FACE_POINTS || end - p < 1 + 4 * n)
+			{
+				error = "bad face " + std::to_string(i);
+				return false;
+			}
+			polygon.resize(n);
+			memcpy(polygon.data(), p + 1, 4 * n);
+			p += 1 + 4 * n;
+
+			for (int k = 0; k < n; k++)
+			{
+				if (polygon[k] < 0 || polygon[k] >= numPoints)
+				{
+					error = "bad vertex index in face " + std::to_string(i);
+					return false;
+				}
+				polygon[k]++;
+			}
+			addPolygon(shape, polygon.data(), n);
+		}
+		reader.advance(p - reader.position());
+		return true;
+	}
+
+	for (long long i = 0; i < element.count; i++)
+	{
+		for (int j = 0; j < (int)element.properties.size(); j++)
+		{
+			const PlyProperty &property = element.properties[j];
+			if (j != indexProperty)
+			{
+				if (!reader.skip(property))
+				{
+					error = "bad face " + std::to_string(i);
+					return false;
+				}
+				continue;
+			}
+
+			double n, index;
+			if (!reader.read(property.countType, n) || n < 3 || n > PLY_MAX_FACE_POINTS || !reader.mayHold(n))
+			{
+				error = "bad face " + std::to_string(i);
+				return false;
+			}
+			polygon.resize((int)n);
+			for (int k = 0; k < (int)n; k++)
+			{
+				if (!reader.read(property.type, index) || index < 0 || index >= shape->numPoints())
+				{
+					error = "bad vertex index in face " + std::to_string(i);
+					return false;
+				}
+				// PLY indices start at 0, surface shape indices start at 1.
+				polygon[k] = (int)index + 1;
+			}
+			addPolygon(shape, polygon.data(), polygon.size());
+		}
+	}
+	return true;
+}
+
+static bool importPly(const char* begin, const char* end, size_t memoryLimit, SurfaceShape* shape,
+	std::string &error)
+{
+	std::vector<PlyElement> elements;
+	bool ascii = false;
+	bool swapBytes = false;
+	const char* body = nullptr;
+	if (!readPlyHeader(begin, end, elements, ascii, swapBytes, body, error)) return false;
+
+	// The sizes are in the header, so reserve exactly (most faces are triangles). Every vertex and face takes at
+	// least a byte, so a damaged header can't make it reserve more than the file could hold.
+	long long numVertices = 0, numFaces = 0;
+	for (int i = 0; i < (int)elements.size(); i++)
+	{
+		if (elements[i].name == "vertex") numVertices = elements[i].count;
+		if (elements[i].name == "face") numFaces = elements[i].count;
+	}
+	if (numVertices > INT32_MAX || numFaces > INT32_MAX)
+	{
+		error = "too many vertices or faces";
+		return false;
+	}
+	if (!fitsMemoryLimit(numVertices, numFaces, memoryLimit, error)) return false;
+	shape->reserve(std::min(numVertices, (long long)(end - body)), std::min(numFaces, (long long)(end - body)));
+
+	PlyReader reader(body, end, ascii, swapBytes);
+	for (int i = 0; i < (int)elements.size(); i++)
+	{
+		const PlyElement &element = elements[i];
+		if (element.name == "vertex")
+		{
+			if (!importPlyVertices(reader, element, shape, error)) return false;
+		}
+		else if (element.name == "face")
+		{
+			if (!importPlyFaces(reader, element, shape, error)) return false;
+		}
+		else
+		{
+			for (long long j = 0; j < element.count; j++)
+			{
+				for (int k = 0; k < (int)element.properties.size(); k++)
+				{
+					if (!reader.skip(element.properties[k]))
+					{
+						error = "file is truncated";
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+
+/*** Public Functions ***/
+
+bool isMeshFile(std::string fileName)
+{
+	return hasExtension(fileName, ".obj") || hasExtension(fileName, ".ply");
+}
+
+bool importMesh(std::string fileName, ShapeCollection* shapes, size_t memoryLimit)
+{
+	MappedFile file(fileName, shapes->getMappedFiles());
+	if (!file.isOpen()) return false;
+
+	SurfaceShape* shape = new SurfaceShape();
+	std::string error;
+	const char* begin = file.data();
+	const char* end = file.data() + file.size();
+	bool success = hasExtension(fileName, ".obj") ?
+		importObj(begin, end, memoryLimit, shape, error) :
+		importPly(begin, end, memoryLimit, shape, error);
+
+	if (!success)
+	{
+		std::cout << "Could not import \"" << fileName << "\": " << error << "." << std::endl;
+		delete shape;
+		return false;
+	}
+	// Polygons split into more triangles than reserved make the arrays grow past what they hold.
+	shape->shrinkToFit();
+
+	shapes->add(shape);
+	return true;
+}
@@ -0,0 +1,25 @@
+#ifndef __MESHIMPORT_H__
+#define __MESHIMPORT_H__
+
+/* meshImport.h
+ *
+ * Imports triangle meshes from Wavefront OBJ and PLY (binary or ascii) files as surface shapes.
+ * The file is memory-mapped and streamed into the shape's point and surface arrays, which are sized up front
+ * (from the header of a PLY file, or a quick count of the lines of an OBJ file).
+ * Polygons with more than 3 vertices are split into a fan of triangles. Normals, texture coordinates
+ * and any other per-vertex or per-face data are ignored.
+ *
+ */
+
+#include <stddef.h>
+#include <string>
+
+class ShapeCollection;
+
+// Returns true if the file name has the extension of a mesh format that can be imported (.obj or .ply).
+bool isMeshFile(std::string fileName);
+// Imports the mesh in the file as a single surface shape, and adds it to the collection. If memoryLimit isn't
+// 0, a mesh that would need more bytes than it (with its hierarchy) is rejected before it is read.
+bool importMesh(std::string fileName, ShapeCollection* shapes, size_t memoryLimit = 0);
+
+#endif
@@ -0,0 +1,362 @@
+#include "metrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "connection.h"
+#include "frameCache.h"
+#include "renderServer.h"
+#include "threadPool.h"
+
+// How long a metrics request may take to arrive before the connection is dropped.
+static const int METRICS_REQUEST_TIMEOUT_S = 2;
+
+// Writes the help and type lines of a metric.
+static void writeHeader(std::ostream& s, std::string name, std::string type, std::string help)
+{
+	s << "# HELP " << name << " " << help << std::endl;
+	s << "# TYPE " << name << " " << type << std::endl;
+}
+
+// Writes a metric that has a single value.
+static void writeMetric(std::ostream& s, std::string name, std::string type, std::string help, double value)
+{
+	writeHeader(s, name, type, help);
+	s << name << " " << value << std::endl;
+}
+
+
+/*** Public Member Functions ***/
+
+Metrics::Metrics()
+{
+	pool = nullptr;
+	frameCache = nullptr;
+	server = nullptr;
+
+	framesRendered = 0;
+	framesCached = 0;
+	tilesRendered = 0;
+	primaryRays = 0;
+	secondaryRays = 0;
+	shadowRays = 0;
+	pixelsRefined = 0;
+	pixelsReprojected = 0;
+	tilesKept = 0;
+	tilesResumed = 0;
+	tilesRemote = 0;
+	for (int k = 0; k <= METRICS_FRAME_BUCKETS; k++)
+	{
+		frameBuckets[k] = 0;
+	}
+	frameMsSum = 0.0;
+	lastFrameMs = 0.0;
+	lastRaysPerSecond = 0.0;
+
+	listenFd = -1;
+	port = 0;
+	fileName = "";
+	stopping = false;
+}
+
+Metrics::~Metrics()
+{
+	stop();
+}
+
+void Metrics::setThreadPool(ThreadPool* _pool)
+{
+	pool = _pool;
+}
+
+void Metrics::setFrameCache(FrameCache* _frameCache)
+{
+	frameCache = _frameCache;
+}
+
+void Metrics::setRenderServer(RenderServer* _server)
+{
+	server = _server;
+}
+
+void Metrics::write(std::ostream& s)
+{
+	std::ostringstream text;
+	text.precision(12);
+
+	writeMetric(text, "raytracer_frames_total", "counter", "Frames rendered (including those shown from the cache).",
+		framesRendered);
+	writeMetric(text, "raytracer_frames_cached_total", "counter", "Frames shown from the frame cache.", framesCached);
+	writeMetric(text, "raytracer_tiles_total", "counter", "Tiles in the frames rendered (including those skipped).", tilesRendered);
+	writeHeader(text, "raytracer_rays_total", "counter", "Rays traced, by kind.");
+	text << "raytracer_rays_total{kind=\"primary\"} " << primaryRays << std::endl;
+	text << "raytracer_rays_total{kind=\"secondary\"} " << secondaryRays << std::endl;
+	text << "raytracer_rays_total{kind=\"shadow\"} " << shadowRays << std::endl;
+	writeMetric(text, "raytracer_pixels_refined_total", "counter", "Pixels anti-aliased with extra samples.",
+		pixelsRefined);
+	writeMetric(text, "raytracer_pixels_reprojected_total", "counter", "Pixels reused from the previous frame.",
+		pixelsReprojected);
+	writeHeader(text, "raytracer_tiles_skipped_total", "counter", "Tiles that weren't traced, by reason.");
+	text << "raytracer_tiles_skipped_total{reason=\"kept\"} " << tilesKept << std::endl;
+	text << "raytracer_tiles_skipped_total{reason=\"resumed\"} " << tilesResumed << std::endl;
+	text << "raytracer_tiles_skipped_total{reason=\"remote\"} " << tilesRemote << std::endl;
+
+	{
+		std::unique_lock<std::mutex> lock(frameMutex);
+		writeHeader(text, "raytracer_frame_seconds", "histogram", "The time taken to render each frame.");
+		long long count = 0;
+		for (int k = 0; k <= METRICS_FRAME_BUCKETS; k++)
+		{
+			count += frameBuckets[k];
+			text << "raytracer_frame_seconds_bucket{le=\"";
+			if (k < METRICS_FRAME_BUCKETS)
+			{
+				text << METRICS_FRAME_BUCKETS_MS[k] / 1000.0;
+			}
+			else
+			{
+				text << "+Inf";
+			}
+			text << "\"} " << count << std::endl;
+		}
+		text << "raytracer_frame_seconds_sum " << frameMsSum / 1000.0 << std::endl;
+		text << "raytracer_frame_seconds_count " << count << std::endl;
+		writeMetric(text, "raytracer_last_frame_seconds", "gauge", "The time taken to render the last frame.",
+			lastFrameMs / 1000.0);
+		writeMetric(text, "raytracer_rays_per_second", "gauge", "Rays traced per second in the last frame.",
+			lastRaysPerSecond);
+	}
+
+	if (pool)
+	{
+		writeMetric(text, "raytracer_threads", "gauge", "Render threads.", pool->numThreads());
+		writeMetric(text, "raytracer_queue_depth", "gauge", "Render tasks waiting to be started.", pool->queueDepth());
+		std::vector<double> busyMs = pool->getBusyMs();
+		double uptimeMs = pool->getUptimeMs();
+		writeHeader(text, "raytracer_thread_busy_seconds_total", "counter", "Time each render thread spent running tasks.");
+		for (int i = 0; i < (int)busyMs.size(); i++)
+		{
+			text << "raytracer_thread_busy_seconds_total{thread=\"" << i << "\"} " << busyMs[i] / 1000.0 << std::endl;
+		}
+		writeHeader(text, "raytracer_thread_utilization", "gauge",
+			"The fraction of the time since it started that each render thread has been busy.");
+		for (int i = 0; i < (int)busyMs.size(); i++)
+		{
+			text << "raytracer_thread_utilization{thread=\"" << i << "\"} "
+				<< (uptimeMs > 0.0 ? busyMs[i] / uptimeMs : 0.0) << std::endl;
+		}
+	}
+
+	if (frameCache)
+	{
+		int hits = frameCache->getHits();
+		int misses = frameCache->getMisses();
+		writeMetric(text, "raytracer_frame_cache_hits_total", "counter", "Frame cache lookups that found their frame.",
+			hits);
+		writeMetric(text, "raytracer_frame_cache_misses_total", "counter",
+			"Frame cache lookups that didn't find their frame.", misses);
+		writeMetric(text, "raytracer_frame_cache_hit_ratio", "gauge", "The fraction of frame cache lookups that hit.",
+			(hits + misses > 0) ? (double)hits / (hits + misses) : 0.0);
+		writeMetric(text, "raytracer_frame_cache_bytes", "gauge", "Memory taken by the frames in the cache.",
+			frameCache->memoryUsed());
+	}
+
+	if (server)
+	{
+		int waiting, rendered, failed;
+		server->getJobCounts(waiting, rendered, failed);
+		writeMetric(text, "raytracer_server_jobs_waiting", "gauge", "Render jobs waiting to be started.", waiting);
+		writeHeader(text, "raytracer_server_jobs_total", "counter", "Render jobs finished, by result.");
+		text << "raytracer_server_jobs_total{result=\"rendered\"} " << rendered << std::endl;
+		text << "raytracer_server_jobs_total{result=\"failed\"} " << failed << std::endl;
+	}
+
+	s << text.str();
+}
+
+
+/** Exporting **/
+
+bool Metrics::serve(int _port)
+{
+	stopServing();
+	int fd = Connection::listenTCP(_port, true);
+	if (fd < 0) return false;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	listenFd = fd;
+	port = Connection::localPort(fd);
+	acceptor = std::thread(&Metrics::acceptLoop, this, fd);
+	return true;
+}
+
+bool Metrics::writeToFile(std::string _fileName, int intervalMs)
+{
+	stopWriting();
+	if (!writeFile(_fileName)) return false;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	fileName = _fileName;
+	stopping = false;
+	writer = std::thread(&Metrics::fileLoop, this, _fileName, intervalMs);
+	return true;
+}
+
+void Metrics::stop()
+{
+	stopServing();
+	stopWriting();
+}
+
+void Metrics::printStatus(std::ostream& s)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (listenFd < 0 && fileName == "")
+	{
+		s << "Metrics are not exported." << std::endl;
+		return;
+	}
+	if (listenFd >= 0)
+	{
+		s << "Metrics are served on port " << port << "." << std::endl;
+	}
+	if (fileName != "")
+	{
+		s << "Metrics are written to \"" << fileName << "\"." << std::endl;
+	}
+}
+
+
+/** Counting **/
+
+void Metrics::addFrame(const RenderStats &stats)
+{
+	framesRendered++;
+	if (stats.fromCache) framesCached++;
+	primaryRays += stats.primaryRays;
+	secondaryRays += stats.secondaryRays;
+	shadowRays += stats.shadowRays;
+	tilesRendered += stats.tiles;
+	pixelsRefined += stats.pixelsRefined;
+	pixelsReprojected += stats.pixelsReprojected;
+	tilesKept += stats.tilesKept;
+	tilesResumed += stats.tilesResumed;
+	tilesRemote += stats.tilesRemote;
+
+	std::unique_lock<std::mutex> lock(frameMutex);
+	int bucket = 0;
+	while (bucket < METRICS_FRAME_BUCKETS && stats.renderMs > METRICS_FRAME_BUCKETS_MS[bucket])
+	{
+		bucket++;
+	}
+	frameBuckets[bucket]++;
+	frameMsSum += stats.renderMs;
+	lastFrameMs = stats.renderMs;
+	long long rays = stats.primaryRays + stats.secondaryRays + stats.shadowRays;
+	lastRaysPerSecond = (stats.renderMs > 0.0) ? rays * 1000.0 / stats.renderMs : 0.0;
+}
+
+
+/*** Private Member Functions ***/
+
+void Metrics::stopServing()
+{
+	int fd;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		fd = listenFd;
+		listenFd = -1;
+		port = 0;
+	}
+	if (fd < 0) return;
+
+	shutdown(fd, SHUT_RDWR);
+	acceptor.join();
+	close(fd);
+}
+
+void Metrics::stopWriting()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+		fileName = "";
+	}
+	stopped.notify_all();
+	if (writer.joinable())
+	{
+		writer.join();
+	}
+}
+
+void Metrics::acceptLoop(int fd)
+{
+	while (true)
+	{
+		int clientFd = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (listenFd != fd)
+			{
+				if (clientFd >= 0) close(clientFd);
+				return;
+			}
+		}
+		if (clientFd < 0) continue;
+
+		// Scrapes are answered one at a time, so a client that never finishes its request is cut off.
+		timeval timeout = {METRICS_REQUEST_TIMEOUT_S, 0};
+		setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		Connection connection(clientFd);
+
+		// Whatever is asked for, the metrics are the answer. The request ends with an empty line.
+		std::string line;
+		bool complete = false;
+		while (connection.readLine(line))
+		{
+			if (line.empty())
+			{
+				complete = true;
+				break;
+			}
+		}
+		if (!complete) continue;
+
+		std::ostringstream body;
+		write(body);
+		std::string text = body.str();
+		std::string header = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+			+ std::to_string(text.size()) + "\r\nConnection: close\r\n\r\n";
+		connection.write(header.data(), header.size());
+		connection.write(text.data(), text.size());
+	}
+}
+
+void Metrics::fileLoop(std::string _fileName, int intervalMs)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopped.wait_for(lock, std::chrono::milliseconds(intervalMs), [this]() { return stopping; }))
+	{
+		lock.unlock();
+		writeFile(_fileName);
+		lock.lock();
+	}
+}
+
+bool Metrics::writeFile(std::string _fileName)
+{
+	std::string temporaryName = _fileName + ".tmp";
+	{
+		std::ofstream file(temporaryName);
+		if (!file) return false;
+		write(file);
+		if (!file) return false;
+	}
+	return rename(temporaryName.c_str(), _fileName.c_str()) == 0;
+}
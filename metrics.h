@@ -0,0 +1,123 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+/* metrics.h
+ *
+ * Counters for watching a long-running renderer, in the Prometheus text exposition format. Whatever renders a
+ * frame (a render session, a render server or a batch) adds its statistics once it is done (the same counts the
+ * "stats" command prints). The thread pool, frame cache and render server are read when the metrics are written.
+ *
+ * The metrics can be served over HTTP on a loopback port (any request gets them), or written to a file every few
+ * seconds (replaced at once, so a reader never sees half a file), for a scraper or node exporter to pick up.
+ *
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+#include "renderStats.h"
+
+class FrameCache;
+class RenderServer;
+class ThreadPool;
+
+// The upper bounds, in milliseconds, of the buckets of the frame time histogram (the last bucket is unbounded).
+const double METRICS_FRAME_BUCKETS_MS[] = {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000};
+const int METRICS_FRAME_BUCKETS = sizeof(METRICS_FRAME_BUCKETS_MS) / sizeof(METRICS_FRAME_BUCKETS_MS[0]);
+// How often the metrics file is written by default.
+const int METRICS_FILE_INTERVAL_MS = 5000;
+
+class Metrics
+{
+	public:
+		/*** Public Member Functions ***/
+		Metrics();
+		// Stops serving and writing.
+		~Metrics();
+
+		// Sets the pool, cache and server whose state is reported along with the counters (any may be null).
+		void setThreadPool(ThreadPool* _pool);
+		void setFrameCache(FrameCache* _frameCache);
+		void setRenderServer(RenderServer* _server);
+
+		// Writes every metric in the Prometheus text format.
+		void write(std::ostream& s);
+
+		/** Exporting **/
+		// Serves the metrics over HTTP on the TCP port of the loopback interface (so only this machine can read
+		// them), from a thread of its own, instead of any port they were served on. Returns false if the port
+		// can't be listened on.
+		bool serve(int port);
+		// Writes the metrics to the file now and then every intervalMs, from a thread of its own, instead of any
+		// file they were written to. Returns false if the file can't be written.
+		bool writeToFile(std::string fileName, int intervalMs);
+		// Stops serving and writing.
+		void stop();
+		// Prints where the metrics are served and written.
+		void printStatus(std::ostream& s);
+
+		/** Counting **/
+		// Counts a finished frame, and the rays it traced, from its statistics. Can be called from any thread.
+		void addFrame(const RenderStats &stats);
+
+	private:
+		/*** Private Member Functions ***/
+		// Stops serving/writing (if it was).
+		void stopServing();
+		void stopWriting();
+		// Answers HTTP requests on the listening socket until it is shut down.
+		void acceptLoop(int fd);
+		// Writes the file every interval until stopped.
+		void fileLoop(std::string fileName, int intervalMs);
+		// Writes the metrics to a temporary file, then renames it over the file. Returns false if it can't.
+		bool writeFile(std::string fileName);
+
+		// Exporters can't be copied.
+		Metrics(const Metrics&) = delete;
+		Metrics& operator=(const Metrics&) = delete;
+
+		/*** Private Member Variables ***/
+		ThreadPool* pool;
+		FrameCache* frameCache;
+		RenderServer* server;
+
+		/** Counters **/
+		std::atomic<long long> framesRendered;
+		std::atomic<long long> framesCached;
+		std::atomic<long long> tilesRendered;
+		std::atomic<long long> primaryRays;
+		std::atomic<long long> secondaryRays;
+		std::atomic<long long> shadowRays;
+		std::atomic<long long> pixelsRefined;
+		std::atomic<long long> pixelsReprojected;
+		std::atomic<long long> tilesKept;
+		std::atomic<long long> tilesResumed;
+		std::atomic<long long> tilesRemote;
+		// The frame time histogram (the last bucket is unbounded), and the time and rays per second of the last
+		// frame, guarded by frameMutex.
+		long long frameBuckets[METRICS_FRAME_BUCKETS + 1];
+		double frameMsSum;
+		double lastFrameMs;
+		double lastRaysPerSecond;
+		std::mutex frameMutex;
+
+		// The socket metrics are served on (-1 if they aren't), its port, and the thread that answers it.
+		int listenFd;
+		int port;
+		std::thread acceptor;
+		// The file metrics are written to (empty if they aren't), and the thread that writes it.
+		std::string fileName;
+		std::thread writer;
+		bool stopping;
+
+		// Guards the exporting state.
+		std::mutex mutex;
+		// Signalled when the writer should stop.
+		std::condition_variable stopped;
+};
+
+#endif
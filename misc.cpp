@@ -1,5 +1,6 @@
 #include "misc.h"
 
+#include <chrono>
 #include <math.h>
 
 RGB::RGB()
@@ -321,6 +322,142 @@ void Surface::print()
 }
 
 
+Transform::Transform()
+{
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			m[i][j] = (i == j) ? 1.0 : 0.0;
+		}
+	}
+}
+
+Transform Transform::translation(FCoord3D offset)
+{
+	Transform t;
+	t.m[0][3] = offset.x;
+	t.m[1][3] = offset.y;
+	t.m[2][3] = offset.z;
+	return t;
+}
+
+Transform Transform::scaling(float a, float b, float c)
+{
+	Transform t;
+	t.m[0][0] = a;
+	t.m[1][1] = b;
+	t.m[2][2] = c;
+	return t;
+}
+
+Transform Transform::multiply(Transform other)
+{
+	Transform result;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			float sum = (j == 3) ? m[i][3] : 0.0;
+			for (int k = 0; k < 3; k++)
+			{
+				sum += m[i][k] * other.m[k][j];
+			}
+			result.m[i][j] = sum;
+		}
+	}
+	return result;
+}
+
+bool Transform::isInvertible()
+{
+	double det =
+		(double)m[0][0] * ((double)m[1][1] * m[2][2] - (double)m[1][2] * m[2][1]) -
+		(double)m[0][1] * ((double)m[1][0] * m[2][2] - (double)m[1][2] * m[2][0]) +
+		(double)m[0][2] * ((double)m[1][0] * m[2][1] - (double)m[1][1] * m[2][0]);
+	return det != 0.0 && std::isfinite(det) && std::isfinite(1.0 / det);
+}
+
+Transform Transform::inverse()
+{
+	// The inverse of the linear part is its adjugate over its determinant.
+	double a[3][3];
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			a[i][j] = m[i][j];
+		}
+	}
+	double adj[3][3] = {
+		{a[1][1] * a[2][2] - a[1][2] * a[2][1], a[0][2] * a[2][1] - a[0][1] * a[2][2], a[0][1] * a[1][2] - a[0][2] * a[1][1]},
+		{a[1][2] * a[2][0] - a[1][0] * a[2][2], a[0][0] * a[2][2] - a[0][2] * a[2][0], a[0][2] * a[1][0] - a[0][0] * a[1][2]},
+		{a[1][0] * a[2][1] - a[1][1] * a[2][0], a[0][1] * a[2][0] - a[0][0] * a[2][1], a[0][0] * a[1][1] - a[0][1] * a[1][0]}
+	};
+	double det = a[0][0] * adj[0][0] + a[0][1] * adj[1][0] + a[0][2] * adj[2][0];
+	
+	// The translation is undone after the linear part is.
+	Transform result;
+	for (int i = 0; i < 3; i++)
+	{
+		double translation = 0.0;
+		for (int j = 0; j < 3; j++)
+		{
+			result.m[i][j] = adj[i][j] / det;
+			translation -= adj[i][j] / det * m[j][3];
+		}
+		result.m[i][3] = translation;
+	}
+	return result;
+}
+
+FCoord3D Transform::applyPoint(FCoord3D p)
+{
+	return FCoord3D(
+		m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+		m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+		m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]
+	);
+}
+
+FCoord3D Transform::applyVector(FCoord3D v)
+{
+	return FCoord3D(
+		m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+		m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+		m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z
+	);
+}
+
+FCoord3D Transform::applyTransposed(FCoord3D v)
+{
+	return FCoord3D(
+		m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+		m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+		m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z
+	);
+}
+
+void Transform::read(std::istream& s)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			s >> m[i][j];
+		}
+	}
+}
+
+void Transform::write(std::ostream& s)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		s << m[i][0] << " " << m[i][1] << " " << m[i][2] << " " << m[i][3] << std::endl;
+	}
+}
+
+
 PhongData::PhongData()
 {
 	fromPoint = FCoord3D(0.5, -5.0, 0.5);
@@ -637,6 +774,39 @@ Direction directionStringToEnum(std::string s)
 	return dBackward;
 }
 
+uint64_t hashBytes(const void* data, size_t length, uint64_t hash)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+uint64_t hashString(std::string s)
+{
+	return hashBytes(s.data(), s.length());
+}
+
+std::string hashToString(uint64_t hash)
+{
+	const char* digits = "0123456789abcdef";
+	std::string result(16, '0');
+	for (int i = 15; i >= 0; i--)
+	{
+		result.at(i) = digits[hash & 0xf];
+		hash >>= 4;
+	}
+	return result;
+}
+
+double nowMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 FCoord3D rotateVector(FCoord3D vect, FCoord3D linePt, float degAngle)
 {
 	std::cout << "vect = ";
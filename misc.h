@@ -9,6 +9,8 @@
 
 #include <assert.h>
 #include <iostream>
+#include <stdint.h>
+#include <string>
 #include <vector>
 
 struct FCoord;
@@ -79,6 +81,15 @@ struct Coord
 	FCoord toFCoord();
 };
 
+// The rectangle [x0, x1) x [y0, y1) of a tile of a frame.
+struct TileRect
+{
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+};
+
 struct FCoord
 {
 	float x;
@@ -145,6 +156,37 @@ struct Surface
 	void print();
 };
 
+// An affine transformation of 3D space: a linear part followed by a translation.
+struct Transform
+{
+	// Row i maps a point (x, y, z) to m[i][0] * x + m[i][1] * y + m[i][2] * z + m[i][3].
+	float m[3][4];
+	
+	// The identity transformation.
+	Transform();
+	
+	static Transform translation(FCoord3D offset);
+	static Transform scaling(float a, float b, float c);
+	
+	// Returns the transformation that applies other, then this one.
+	Transform multiply(Transform other);
+	// Returns true if the transformation can be inverted (it doesn't flatten space).
+	bool isInvertible();
+	// Returns the inverse transformation. Only meaningful if isInvertible() is true.
+	Transform inverse();
+	
+	// Transform a point, or a direction (which ignores the translation).
+	FCoord3D applyPoint(FCoord3D p);
+	FCoord3D applyVector(FCoord3D v);
+	// Transforms a direction by the transpose of the linear part. Applied by the inverse of a transformation,
+	// this maps surface normals the way the transformation maps surfaces.
+	FCoord3D applyTransposed(FCoord3D v);
+	
+	// Read/write the 12 values, row by row.
+	void read(std::istream& s);
+	void write(std::ostream& s);
+};
+
 struct PhongData
 {
 	PhongData();
@@ -210,6 +252,15 @@ bool lineSegmentIntersectsSurface(FCoord3D p0, FCoord3D p1, Surface surface);
 // Returns a direction, interpreted from the passed string.
 Direction directionStringToEnum(std::string s);
 
+// Returns the 64-bit FNV-1a hash of the passed bytes. A previous hash can be passed to continue hashing.
+uint64_t hashBytes(const void* data, size_t length, uint64_t hash = 14695981039346656037ULL);
+uint64_t hashString(std::string s);
+// Returns the hash as a 16 digit hexadecimal string.
+std::string hashToString(uint64_t hash);
+
+// Returns the current time in milliseconds (only useful for measuring intervals).
+double nowMs();
+
 // Returns the vector, rotated about the line defined by the origin and the line points.
 FCoord3D rotateVector(FCoord3D vect, FCoord3D linePt, float degAngle);
 FCoord3D rotateVectorIntoZ(FCoord3D vect, FCoord3D linePt);
@@ -0,0 +1,90 @@
+#include "numaBenchmark.h"
+
+#include <iomanip>
+
+#include "frameBuffer.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+#include "viewport.h"
+
+
+std::vector<NumaBenchmarkResult> benchmarkNuma(Viewport* scene, ShapeCollection* shapes,
+	const std::vector<NumaNode> &nodes, int frames)
+{
+	const char* modes[] = {"shared", "pinned", "replicated"};
+	int width = scene->getWidth();
+	int height = scene->getHeight();
+	int threads = scene->getThreadPool() ? scene->getThreadPool()->numThreads() : 0;
+	bool replication = shapes->getReplication();
+	if (frames < 1) frames = 1;
+
+	std::vector<NumaBenchmarkResult> results;
+	std::vector<float> firstPixels;
+	for (int mode = 0; mode < 3; mode++)
+	{
+		ThreadPool* pool = (mode == 0) ? new ThreadPool(threads) : new ThreadPool(threads, nodes);
+		shapes->setReplication(mode == 2);
+
+		// Each way gets a frame buffer of its own, so that its memory is placed the way it would place it.
+		FrameBuffer* buffer = new FrameBuffer(width, height);
+		Viewport* viewport = new Viewport(Coord(0, 0), width, height, shapes);
+		viewport->setThreadPool(pool);
+		viewport->setFrameBuffer(buffer);
+		viewport->copySceneFrom(scene);
+		viewport->setCamera(scene->getCamera());
+		viewport->setBudget(0.0);
+		viewport->fillBackground();
+		viewport->redraw(false);
+
+		double startMs = nowMs();
+		for (int k = 0; k < frames; k++)
+		{
+			viewport->redraw(false);
+		}
+		NumaBenchmarkResult result;
+		result.mode = modes[mode];
+		result.msPerFrame = (nowMs() - startMs) / frames;
+
+		std::vector<float> pixels;
+		viewport->readPixels(0, 0, width, height, pixels);
+		if (mode == 0)
+		{
+			firstPixels = pixels;
+		}
+		result.matches = (pixels == firstPixels);
+		results.push_back(result);
+
+		delete viewport;
+		delete buffer;
+		// The copies were made by the pool's workers, so they go with it (the scene's own pool makes its own).
+		shapes->setReplication(false);
+		shapes->prepareReplicas(nullptr);
+		delete pool;
+	}
+
+	shapes->setReplication(replication);
+	return results;
+}
+
+void printNumaBenchmark(const std::vector<NumaBenchmarkResult> &results, std::ostream& s)
+{
+	if (results.empty()) return;
+
+	std::ios_base::fmtflags flags = s.flags();
+	std::streamsize precision = s.precision();
+	s << std::fixed << std::setprecision(1);
+	for (int k = 0; k < (int)results.size(); k++)
+	{
+		const NumaBenchmarkResult &result = results[k];
+		s << std::left << std::setw(12) << result.mode << std::right << std::setw(10) << result.msPerFrame
+			<< " ms per frame  " << std::setprecision(2) << results[0].msPerFrame / result.msPerFrame << "x"
+			<< std::setprecision(1);
+		if (!result.matches)
+		{
+			s << "  (frames differ)";
+		}
+		s << std::endl;
+	}
+	s.flags(flags);
+	s.precision(precision);
+}
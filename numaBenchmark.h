@@ -0,0 +1,42 @@
+#ifndef __NUMABENCHMARK_H__
+#define __NUMABENCHMARK_H__
+
+/* numaBenchmark.h
+ *
+ * Compares the ways render threads and their memory can be placed on a NUMA machine, by rendering the same
+ * frames with each:
+ *
+ *   shared      A plain thread pool: threads run, and memory is placed, wherever the kernel puts them.
+ *   pinned      A NUMA-aware pool: workers are pinned to the nodes, and each node renders (and first touches
+ *               the frame buffer of) its own band of tiles.
+ *   replicated  As pinned, with a copy of the shapes and their hierarchies in each node's memory.
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "numaTopology.h"
+
+class ShapeCollection;
+class Viewport;
+
+// How one of the ways fared.
+struct NumaBenchmarkResult
+{
+	std::string mode;
+	// The average time of a frame.
+	double msPerFrame;
+	// True if the frames matched those of the first way, pixel for pixel.
+	bool matches;
+};
+
+// Renders the viewport's scene from its camera, at its size, in each of the ways: one frame to warm up (placing
+// the memory), then the timed frames. The pools have as many threads as the viewport's, spread over the nodes.
+std::vector<NumaBenchmarkResult> benchmarkNuma(Viewport* scene, ShapeCollection* shapes,
+	const std::vector<NumaNode> &nodes, int frames);
+// Prints the results as a table, with the speed of each way relative to the first.
+void printNumaBenchmark(const std::vector<NumaBenchmarkResult> &results, std::ostream& s);
+
+#endif
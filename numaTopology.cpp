@@ -0,0 +1,131 @@
+#include "numaTopology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <thread>
+
+
+std::vector<NumaNode> detectNumaNodes(int emulate)
+{
+	std::vector<NumaNode> nodes;
+	for (int id = 0; ; id++)
+	{
+		std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+		if (!file)
+		{
+			// Node numbers can have gaps (after CPUs are taken offline), so a few more are tried.
+			if (id >= 64 || (id > 0 && nodes.empty())) break;
+			continue;
+		}
+		std::string list;
+		std::getline(file, list);
+		NumaNode node;
+		node.id = id;
+		node.cpus = parseCpuList(list);
+		// Nodes with only memory have no CPUs to run workers on.
+		if (!node.cpus.empty())
+		{
+			nodes.push_back(node);
+		}
+	}
+
+	if (nodes.empty())
+	{
+		NumaNode node;
+		node.id = 0;
+		int numCpus = std::max(1, (int)std::thread::hardware_concurrency());
+		for (int cpu = 0; cpu < numCpus; cpu++)
+		{
+			node.cpus.push_back(cpu);
+		}
+		nodes.push_back(node);
+	}
+
+	if (emulate > 0)
+	{
+		std::vector<int> cpus;
+		for (int k = 0; k < (int)nodes.size(); k++)
+		{
+			cpus.insert(cpus.end(), nodes[k].cpus.begin(), nodes[k].cpus.end());
+		}
+		// Each node gets a run of consecutive CPUs, as real nodes usually do.
+		int numCpus = cpus.size();
+		nodes.assign(emulate, NumaNode());
+		for (int k = 0; k < emulate; k++)
+		{
+			nodes[k].id = k;
+			for (int i = k * numCpus / emulate; i < (k + 1) * numCpus / emulate; i++)
+			{
+				nodes[k].cpus.push_back(cpus[i]);
+			}
+			if (nodes[k].cpus.empty())
+			{
+				nodes[k].cpus.push_back(cpus[k % numCpus]);
+			}
+		}
+	}
+	return nodes;
+}
+
+std::vector<int> parseCpuList(std::string list)
+{
+	std::vector<int> cpus;
+	std::istringstream s(list);
+	std::string range;
+	while (std::getline(s, range, ','))
+	{
+		int first, last;
+		char dash;
+		std::istringstream r(range);
+		if (!(r >> first)) continue;
+		if (!(r >> dash >> last) || dash != '-')
+		{
+			last = first;
+		}
+		for (int cpu = first; cpu <= last; cpu++)
+		{
+			cpus.push_back(cpu);
+		}
+	}
+	return cpus;
+}
+
+bool pinThreadToNode(const NumaNode &node)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int k = 0; k < (int)node.cpus.size(); k++)
+	{
+		if (node.cpus[k] < CPU_SETSIZE)
+		{
+			CPU_SET(node.cpus[k], &set);
+		}
+	}
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+std::string describeNumaNodes(const std::vector<NumaNode> &nodes)
+{
+	std::ostringstream s;
+	for (int k = 0; k < (int)nodes.size(); k++)
+	{
+		if (k > 0) s << ", ";
+		s << "node " << nodes[k].id << ": cpus ";
+
+		// Runs of consecutive CPUs are written as ranges.
+		const std::vector<int> &cpus = nodes[k].cpus;
+		for (int i = 0; i < (int)cpus.size(); )
+		{
+			int j = i;
+			while (j + 1 < (int)cpus.size() && cpus[j + 1] == cpus[j] + 1) j++;
+			if (i > 0) s << ",";
+			s << cpus[i];
+			if (j > i) s << "-" << cpus[j];
+			i = j + 1;
+		}
+	}
+	return s.str();
+}
@@ -0,0 +1,33 @@
+#ifndef __NUMATOPOLOGY_H__
+#define __NUMATOPOLOGY_H__
+
+/* numaTopology.h
+ *
+ * The NUMA nodes of the machine: groups of CPUs that share a memory controller. Memory is placed on the node of
+ * the thread that first writes to it, and is slower to reach from the other nodes, so a NUMA-aware thread pool
+ * (see ThreadPool) keeps each worker on one node and gives it work whose memory lives there.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+struct NumaNode
+{
+	// The node's number (as the kernel numbers them), and the CPUs that belong to it.
+	int id;
+	std::vector<int> cpus;
+};
+
+// Returns the nodes of the machine, read from /sys/devices/system/node. A machine without NUMA (or without that
+// directory) has a single node with every CPU. If emulate is above 0, the CPUs are instead dealt out among that
+// many nodes (shared if there are fewer CPUs than nodes), so the NUMA paths can be tried on any machine.
+std::vector<NumaNode> detectNumaNodes(int emulate = 0);
+// Parses a list of CPUs in the kernel's format (such as "0-3,8-11").
+std::vector<int> parseCpuList(std::string list);
+// Restricts the calling thread to the CPUs of the node. Returns false if that wasn't possible.
+bool pinThreadToNode(const NumaNode &node);
+// Returns the nodes in a human readable form (such as "node 0: cpus 0-3").
+std::string describeNumaNodes(const std::vector<NumaNode> &nodes);
+
+#endif
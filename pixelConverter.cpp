@@ -0,0 +1,82 @@
+#include "pixelConverter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/*** Public Member Functions ***/
+
+PixelConverter::PixelConverter(float _gamma)
+{
+	gamma = (_gamma > 0.0) ? _gamma : 1.0;
+	linear = (gamma == 1.0f);
+	if (!linear)
+	{
+		for (int k = 0; k < GAMMA_TABLE_SIZE; k++)
+		{
+			double f = std::pow((double)k / (GAMMA_TABLE_SIZE - 1), 1.0 / gamma);
+			table[k] = (unsigned char)(f * 255.0 + 0.5);
+		}
+	}
+}
+
+float PixelConverter::getGamma()
+{
+	return gamma;
+}
+
+void PixelConverter::convert(const float* in, unsigned char* out, size_t n) const
+{
+	// Linear values are scaled straight to 8 bits; gamma-encoded ones to an index into the table.
+	const float scale = linear ? 255.0f : (float)(GAMMA_TABLE_SIZE - 1);
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale4 = _mm_set1_ps(scale);
+	const __m128 half = _mm_set1_ps(0.5f);
+	for (; i + 16 <= n; i += 16)
+	{
+		// The max comes first so that NaNs become 0.
+		__m128i q[4];
+		for (int k = 0; k < 4; k++)
+		{
+			__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + k * 4), zero), one);
+			q[k] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale4), half));
+		}
+
+		if (linear)
+		{
+			__m128i low = _mm_packs_epi32(q[0], q[1]);
+			__m128i high = _mm_packs_epi32(q[2], q[3]);
+			_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(low, high));
+		}
+		else
+		{
+			alignas(16) int32_t index[16];
+			for (int k = 0; k < 4; k++)
+			{
+				_mm_store_si128((__m128i*)(index + k * 4), q[k]);
+			}
+			for (int k = 0; k < 16; k++)
+			{
+				out[i + k] = table[index[k]];
+			}
+		}
+	}
+#endif
+
+	// The remaining values, with the same arithmetic.
+	for (; i < n; i++)
+	{
+		float f = std::min(1.0f, std::max(0.0f, in[i]));
+		int q = (int)(f * scale + 0.5f);
+		out[i] = linear ? (unsigned char)q : table[q];
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef __PIXELCONVERTER_H__
+#define __PIXELCONVERTER_H__
+
+/* pixelConverter.h
+ *
+ * Converts the float color values of the frame buffer to the 8-bit values of the window and of image files.
+ * Values are clamped to [0, 1], optionally gamma-encoded, and rounded. Four values are converted at a time
+ * with SSE2 when it is available; gamma is applied through a lookup table indexed by the converted values.
+ *
+ */
+
+#include <stddef.h>
+
+// The number of entries in the gamma table (the resolution gamma-encoded values are looked up at).
+const int GAMMA_TABLE_SIZE = 16384;
+
+class PixelConverter
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates a converter that encodes with the gamma (1 leaves values linear).
+		PixelConverter(float _gamma = 1.0);
+
+		float getGamma();
+		// Converts n float values (not pixels) to 8-bit values.
+		void convert(const float* in, unsigned char* out, size_t n) const;
+
+	private:
+		/*** Private Member Variables ***/
+		float gamma;
+		// True if values are converted without the gamma table.
+		bool linear;
+		// The 8-bit value of each step of [0, 1] (only filled in when not linear).
+		unsigned char table[GAMMA_TABLE_SIZE];
+};
+
+#endif
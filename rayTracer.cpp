@@ -0,0 +1,139 @@
+#include "rayTracer.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "frameBuffer.h"
+#include "pixelConverter.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+#include "viewport.h"
+
+
+/*** RenderSettings ***/
+
+RenderSettings::RenderSettings()
+{
+	width = 0;
+	height = 0;
+	antiAliasingSamples = 1;
+	antiAliasingThreshold = 0.1;
+	budgetMs = 0.0;
+}
+
+
+/*** Public Member Functions ***/
+
+RayTracer::RayTracer(int threads)
+{
+	pool = new ThreadPool(threads);
+	shapes = new ShapeCollection();
+	sceneViewport = new Viewport(Coord(0, 0), 1, 1, shapes);
+	shapes->setViewport(sceneViewport);
+}
+
+RayTracer::~RayTracer()
+{
+	std::unique_lock<std::shared_mutex> lock(sceneMutex);
+	delete shapes;
+	delete sceneViewport;
+	delete pool;
+}
+
+bool RayTracer::loadScene(std::string fileName)
+{
+	ShapeCollection* loaded = new ShapeCollection();
+	Viewport* loadedViewport = new Viewport(Coord(0, 0), 1, 1, loaded);
+	loaded->setViewport(loadedViewport);
+	if (!loaded->loadFromFile(fileName))
+	{
+		delete loaded;
+		delete loadedViewport;
+		return false;
+	}
+	replaceScene(loaded, loadedViewport);
+	return true;
+}
+
+bool RayTracer::setScene(std::string scene)
+{
+	ShapeCollection* loaded = new ShapeCollection();
+	Viewport* loadedViewport = new Viewport(Coord(0, 0), 1, 1, loaded);
+	loaded->setViewport(loadedViewport);
+	if (!loaded->deserialize(scene))
+	{
+		delete loaded;
+		delete loadedViewport;
+		return false;
+	}
+	replaceScene(loaded, loadedViewport);
+	return true;
+}
+
+std::string RayTracer::getScene()
+{
+	std::shared_lock<std::shared_mutex> lock(sceneMutex);
+	return shapes->serialize();
+}
+
+Camera RayTracer::getSceneCamera()
+{
+	std::shared_lock<std::shared_mutex> lock(sceneMutex);
+	return sceneViewport->getCamera();
+}
+
+bool RayTracer::render(const RenderSettings &settings, float* pixels, RenderStats* stats)
+{
+	if (settings.width <= 0 || settings.height <= 0) return false;
+
+	std::shared_lock<std::shared_mutex> lock(sceneMutex);
+	FrameBuffer* buffer = new FrameBuffer(settings.width, settings.height);
+	Viewport* viewport = new Viewport(Coord(0, 0), settings.width, settings.height, shapes);
+	viewport->setThreadPool(pool);
+	viewport->setFrameBuffer(buffer);
+	viewport->copySceneFrom(sceneViewport);
+	viewport->setCamera(settings.camera);
+	viewport->setAntiAliasing(settings.antiAliasingSamples, settings.antiAliasingThreshold);
+	viewport->setBudget(settings.budgetMs);
+
+	viewport->redraw(false);
+	viewport->readPixels(0, 0, settings.width, settings.height, pixels);
+	if (stats)
+	{
+		*stats = viewport->getStats();
+	}
+	delete viewport;
+	delete buffer;
+	return true;
+}
+
+bool RayTracer::render(const RenderSettings &settings, unsigned char* pixels, RenderStats* stats)
+{
+	std::vector<float> colors((size_t)std::max(settings.width, 0) * std::max(settings.height, 0) * 3);
+	if (!render(settings, colors.data(), stats)) return false;
+
+	// The rows are flipped, since the frame buffer starts with the bottom one.
+	PixelConverter converter;
+	size_t rowValues = (size_t)settings.width * 3;
+	for (int j = 0; j < settings.height; j++)
+	{
+		converter.convert(colors.data() + j * rowValues, pixels + (settings.height - 1 - j) * rowValues, rowValues);
+	}
+	return true;
+}
+
+
+/*** Private Member Functions ***/
+
+void RayTracer::replaceScene(ShapeCollection* _shapes, Viewport* _sceneViewport)
+{
+	// The hierarchies are built before the renders in progress are waited for.
+	_shapes->prepare();
+
+	std::unique_lock<std::shared_mutex> lock(sceneMutex);
+	delete shapes;
+	delete sceneViewport;
+	shapes = _shapes;
+	sceneViewport = _sceneViewport;
+}
@@ -0,0 +1,92 @@
+#ifndef __RAYTRACER_H__
+#define __RAYTRACER_H__
+
+/* rayTracer.h
+ *
+ * The renderer as a library (libraytracer.a, built with "make libraytracer.a" and linked with -lz -pthread).
+ * A ray tracer holds a scene and the threads it renders with, and renders the scene from any camera into
+ * buffers that the caller provides. It has no global state, so any number of ray tracers can be used in one
+ * process, and each can render from several threads at once: every render has a viewport and frame buffer of
+ * its own, and they share the shapes (and their bounding volume hierarchies) read-only. Loading a scene waits
+ * for the renders in progress to finish.
+ *
+ * project5 is a thin front end on top of the same library: the command line, the render service and
+ * distributed rendering are all in a RenderSession (see renderSession.h), and only the window is its own.
+ *
+ */
+
+#include <shared_mutex>
+#include <string>
+
+#include "camera.h"
+#include "renderStats.h"
+
+class ShapeCollection;
+class ThreadPool;
+class Viewport;
+
+// What a render produces.
+struct RenderSettings
+{
+	RenderSettings();
+
+	// The size of the image in pixels.
+	int width;
+	int height;
+	// The camera the scene is rendered from.
+	Camera camera;
+	// Adaptive anti-aliasing (see Viewport::setAntiAliasing). Fewer than 4 samples disables it.
+	int antiAliasingSamples;
+	float antiAliasingThreshold;
+	// The time the render may take in milliseconds, 0 for no limit (see Viewport::setBudget). The quality that
+	// was reached is in the render's statistics.
+	double budgetMs;
+};
+
+class RayTracer
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates a ray tracer with an empty scene, which renders with the number of threads (0 uses one per
+		// hardware thread).
+		RayTracer(int threads);
+		// Waits for the renders in progress, then destroys the scene and stops the threads.
+		~RayTracer();
+
+		// Replaces the scene with the one in the file (a text or binary scene file, or a mesh). Returns false, and
+		// keeps the current scene, if the file can't be loaded.
+		bool loadScene(std::string fileName);
+		// Replaces the scene with one in the scene file format. Returns false, and keeps the current scene, if it
+		// can't be read.
+		bool setScene(std::string scene);
+		// Returns the scene in the scene file format.
+		std::string getScene();
+		// Returns the camera the scene was saved with.
+		Camera getSceneCamera();
+
+		// Renders the scene into width * height RGB floats, bottom row first. Returns false if the size isn't
+		// positive. If stats is given, it is filled with the statistics of the render.
+		bool render(const RenderSettings &settings, float* pixels, RenderStats* stats = nullptr);
+		// Renders the scene into width * height 8-bit RGB pixels, top row first (as images are stored).
+		bool render(const RenderSettings &settings, unsigned char* pixels, RenderStats* stats = nullptr);
+
+	private:
+		/*** Private Member Functions ***/
+		// Makes the loaded shapes and their viewport the scene, once their hierarchies are built.
+		void replaceScene(ShapeCollection* _shapes, Viewport* _sceneViewport);
+
+		// Ray tracers can't be copied.
+		RayTracer(const RayTracer&) = delete;
+		RayTracer& operator=(const RayTracer&) = delete;
+
+		/*** Private Member Variables ***/
+		ThreadPool* pool;
+		// The shapes of the scene, and a viewport that holds its lights and attributes.
+		ShapeCollection* shapes;
+		Viewport* sceneViewport;
+
+		// Held shared while rendering, and exclusively while the scene is replaced.
+		std::shared_mutex sceneMutex;
+};
+
+#endif
@@ -0,0 +1,486 @@
+#include "renderCluster.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "connection.h"
+
+
+/*** ClusterFrame ***/
+
+ClusterFrame::ClusterFrame()
+{
+	key = 0;
+	shapesKey = 0;
+	width = 0;
+	height = 0;
+	antiAliasingSamples = 1;
+	antiAliasingThreshold = 0.0;
+	reprojection = false;
+	attributes = "";
+}
+
+
+/*** Public Member Functions ***/
+
+RenderCluster::RenderCluster()
+{
+	listenFd = -1;
+	port = 0;
+	tileTimeoutMs = CLUSTER_TILE_TIMEOUT_MS;
+	workers = new std::vector<WorkerLink*>();
+
+	frameTiles = nullptr;
+	tileDone = nullptr;
+	finished = new std::vector<bool>();
+	queued = new std::deque<int>();
+	tilesLeft = 0;
+	tilesInProgress = 0;
+	tilesRedispatched = 0;
+}
+
+RenderCluster::~RenderCluster()
+{
+	stop();
+
+	delete workers;
+	delete finished;
+	delete queued;
+}
+
+bool RenderCluster::listen(int _port)
+{
+	stop();
+
+	int fd = Connection::listenTCP(_port);
+	if (fd < 0) return false;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	listenFd = fd;
+	port = Connection::localPort(fd);
+	acceptor = std::thread(&RenderCluster::acceptLoop, this, fd);
+	return true;
+}
+
+void RenderCluster::stop()
+{
+	int fd;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		fd = listenFd;
+		listenFd = -1;
+		port = 0;
+		for (int i = 0; i < (int)workers->size(); i++)
+		{
+			workers->at(i)->connection->shutdown();
+		}
+	}
+
+	if (fd >= 0)
+	{
+		shutdown(fd, SHUT_RDWR);
+		acceptor.join();
+		close(fd);
+	}
+
+	// The readers finish once their connections are shut down.
+	for (int i = 0; i < (int)workers->size(); i++)
+	{
+		workers->at(i)->reader.join();
+	}
+	std::unique_lock<std::mutex> lock(mutex);
+	removeLostWorkers();
+}
+
+int RenderCluster::getPort()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return port;
+}
+
+int RenderCluster::numWorkers()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return countWorkers();
+}
+
+int RenderCluster::waitForWorkers(int n, int timeoutMs)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this, n]() { return countWorkers() >= n; });
+	return countWorkers();
+}
+
+void RenderCluster::setTileTimeout(int ms)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	tileTimeoutMs = std::max(ms, 1);
+	for (int i = 0; i < (int)workers->size(); i++)
+	{
+		workers->at(i)->connection->setWriteTimeout(tileTimeoutMs);
+	}
+}
+
+int RenderCluster::getTileTimeout()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return tileTimeoutMs;
+}
+
+void RenderCluster::renderTiles(const ClusterFrame &frame, std::vector<TileRect> &tiles, ClusterTileFunction done)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	removeLostWorkers();
+
+	frameTiles = &tiles;
+	tileDone = done;
+	finished->assign(tiles.size(), false);
+	queued->clear();
+	for (int i = 0; i < (int)tiles.size(); i++)
+	{
+		queued->push_back(i);
+	}
+	tilesLeft = tiles.size();
+	tilesInProgress = 0;
+
+	while (tilesLeft > 0)
+	{
+		// Each worker is topped up to its share of tiles. The tiles are sent without the lock, so that the readers
+		// can take finished tiles in the meantime (a worker may be waiting for its results to be read). Workers
+		// that haven't said hello yet can't be given any, and workers that have gone too long without finishing
+		// theirs are dropped.
+		bool anyAlive = false;
+		std::vector<std::pair<WorkerLink*, std::vector<TileRect> > > sends;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		for (int i = 0; i < (int)workers->size(); i++)
+		{
+			WorkerLink* link = workers->at(i);
+			if (!link->alive || link->stalled || link->threads == 0) continue;
+
+			std::chrono::steady_clock::time_point linkDeadline = link->lastProgress
+				+ std::chrono::milliseconds(tileTimeoutMs);
+			if (!link->assigned.empty() && linkDeadline <= now)
+			{
+				// The reader finds the connection gone, and puts the worker's tiles back.
+				std::cout << "Render worker " << link->name << " hasn't finished a tile in " << tileTimeoutMs
+					<< " ms, so it is dropped." << std::endl;
+				link->stalled = true;
+				link->connection->shutdown();
+				continue;
+			}
+			anyAlive = true;
+
+			if (link->assigned.empty())
+			{
+				link->lastProgress = now;
+			}
+			std::vector<TileRect> batch;
+			while ((int)link->assigned.size() < link->threads * CLUSTER_TILES_PER_THREAD && !queued->empty())
+			{
+				link->assigned.push_back(queued->front());
+				batch.push_back(tiles.at(queued->front()));
+				queued->pop_front();
+			}
+			if (!batch.empty())
+			{
+				sends.push_back(std::make_pair(link, batch));
+			}
+			if (!link->assigned.empty())
+			{
+				deadline = std::min(deadline, link->lastProgress + std::chrono::milliseconds(tileTimeoutMs));
+			}
+		}
+		if (!anyAlive) break;
+
+		if (sends.empty())
+		{
+			if (deadline == std::chrono::steady_clock::time_point::max())
+			{
+				changed.wait(lock);
+			}
+			else
+			{
+				changed.wait_until(lock, deadline);
+			}
+			continue;
+		}
+
+		lock.unlock();
+		for (int i = 0; i < (int)sends.size(); i++)
+		{
+			if (!sendTiles(sends[i].first, frame, sends[i].second))
+			{
+				// The worker's reader notices that the connection is gone, and puts its tiles back.
+				sends[i].first->connection->shutdown();
+			}
+		}
+		lock.lock();
+	}
+
+	// Tiles that are being passed on can't be given back.
+	changed.wait(lock, [this]() { return tilesInProgress == 0; });
+
+	std::vector<TileRect> left;
+	for (int i = 0; i < (int)tiles.size(); i++)
+	{
+		if (!finished->at(i))
+		{
+			left.push_back(tiles.at(i));
+		}
+	}
+	for (int i = 0; i < (int)workers->size(); i++)
+	{
+		workers->at(i)->assigned.clear();
+	}
+	frameTiles = nullptr;
+	tileDone = nullptr;
+	queued->clear();
+	tiles = left;
+}
+
+void RenderCluster::printStatus(std::ostream& s)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (listenFd < 0)
+	{
+		s << "Not listening for render workers." << std::endl;
+		return;
+	}
+
+	s << "Listening for render workers on port " << port << ": " << countWorkers() << " connected";
+	if (tilesRedispatched > 0)
+	{
+		s << ", " << tilesRedispatched << " tiles handed on from workers that were lost";
+	}
+	s << "." << std::endl;
+	for (int i = 0; i < (int)workers->size(); i++)
+	{
+		WorkerLink* link = workers->at(i);
+		if (!link->alive) continue;
+		s << "  " << link->name << ": " << link->threads << " threads, " << link->tilesRendered << " tiles rendered."
+			<< std::endl;
+	}
+}
+
+
+/*** Private Member Functions ***/
+
+void RenderCluster::acceptLoop(int fd)
+{
+	while (true)
+	{
+		sockaddr_in6 address = {};
+		socklen_t length = sizeof(address);
+		int workerFd = accept4(fd, (sockaddr*)&address, &length, SOCK_CLOEXEC);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		if (listenFd != fd)
+		{
+			if (workerFd >= 0) close(workerFd);
+			return;
+		}
+		if (workerFd < 0) continue;
+
+		int one = 1;
+		setsockopt(workerFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		setsockopt(workerFd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+
+		char host[INET6_ADDRSTRLEN] = "";
+		inet_ntop(AF_INET6, &address.sin6_addr, host, sizeof(host));
+		std::string name = host;
+		if (name.compare(0, 7, "::ffff:") == 0)
+		{
+			name = name.substr(7);
+		}
+
+		WorkerLink* link = new WorkerLink();
+		link->connection = new Connection(workerFd);
+		link->name = name + ":" + std::to_string(ntohs(address.sin6_port));
+		link->threads = 0;
+		link->alive = true;
+		link->stalled = false;
+		link->frameKey = 0;
+		link->shapesKey = 0;
+		link->tilesRendered = 0;
+		link->connection->setWriteTimeout(tileTimeoutMs);
+		workers->push_back(link);
+		link->reader = std::thread(&RenderCluster::readerLoop, this, link);
+	}
+}
+
+void RenderCluster::readerLoop(WorkerLink* link)
+{
+	std::string line;
+	while (link->connection->readLine(line))
+	{
+		std::istringstream s(line);
+		std::string message;
+		s >> message;
+
+		if (message == "HELLO")
+		{
+			int threads = 0;
+			s >> threads;
+			std::unique_lock<std::mutex> lock(mutex);
+			link->threads = std::max(threads, 1);
+			std::cout << "Render worker " << link->name << " joined with " << link->threads << " threads." << std::endl;
+			changed.notify_all();
+			continue;
+		}
+		if (message != "DONE") break;
+
+		TileRect tile;
+		size_t count = 0;
+		s >> tile.x0 >> tile.y0 >> tile.x1 >> tile.y1 >> count;
+		if (s.fail() || tile.x1 < tile.x0 || tile.y1 < tile.y0
+			|| count > (size_t)(tile.x1 - tile.x0) * (tile.y1 - tile.y0) * CLUSTER_MAX_FLOATS_PER_PIXEL)
+		{
+			break;
+		}
+		std::vector<float> data(count);
+		if (!link->connection->read(data.data(), count * sizeof(float))) break;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		int index = -1;
+		for (int k = 0; k < (int)link->assigned.size() && frameTiles; k++)
+		{
+			const TileRect& t = frameTiles->at(link->assigned[k]);
+			if (t.x0 == tile.x0 && t.y0 == tile.y0 && t.x1 == tile.x1 && t.y1 == tile.y1)
+			{
+				index = link->assigned[k];
+				link->assigned.erase(link->assigned.begin() + k);
+				break;
+			}
+		}
+		// Tiles of an earlier frame are ignored.
+		if (index < 0 || finished->at(index)) continue;
+
+		finished->at(index) = true;
+		tilesInProgress++;
+		lock.unlock();
+		bool used = tileDone(tile, data);
+		lock.lock();
+		tilesInProgress--;
+		changed.notify_all();
+		if (!used)
+		{
+			finished->at(index) = false;
+			link->assigned.push_back(index);
+			std::cout << "Render worker " << link->name << " sent a tile that doesn't fit the frame." << std::endl;
+			break;
+		}
+		tilesLeft--;
+		link->tilesRendered++;
+		link->lastProgress = std::chrono::steady_clock::now();
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	loseWorker(link);
+}
+
+void RenderCluster::loseWorker(WorkerLink* link)
+{
+	if (!link->alive) return;
+	link->alive = false;
+
+	int handedOn = 0;
+	for (int k = (int)link->assigned.size() - 1; k >= 0; k--)
+	{
+		if (frameTiles && !finished->at(link->assigned[k]))
+		{
+			queued->push_front(link->assigned[k]);
+			handedOn++;
+		}
+	}
+	link->assigned.clear();
+	tilesRedispatched += handedOn;
+
+	// Workers are only disconnected on purpose when the cluster stops.
+	if (listenFd >= 0)
+	{
+		std::cout << "Render worker " << link->name << " was lost";
+		if (handedOn > 0)
+		{
+			std::cout << "; its " << handedOn << " tiles are handed to the others";
+		}
+		std::cout << "." << std::endl;
+	}
+	changed.notify_all();
+}
+
+bool RenderCluster::sendTiles(WorkerLink* link, const ClusterFrame &frame, const std::vector<TileRect> &tiles)
+{
+	// Loading a scene replaces its attributes, so the frame is always sent after it.
+	if (link->shapesKey != frame.shapesKey)
+	{
+		const std::string& scene = *frame.scene;
+		std::string header = "SCENE " + std::to_string(frame.shapesKey) + " " + std::to_string(scene.size());
+		if (!link->connection->writeLine(header) || !link->connection->write(scene.data(), scene.size()))
+		{
+			return false;
+		}
+		link->shapesKey = frame.shapesKey;
+		link->frameKey = 0;
+	}
+
+	if (link->frameKey != frame.key)
+	{
+		std::ostringstream s;
+		s.precision(std::numeric_limits<float>::max_digits10);
+		s << "FRAME " << frame.key << " " << frame.width << " " << frame.height << " " << frame.antiAliasingSamples
+			<< " " << frame.antiAliasingThreshold << " " << (frame.reprojection ? 1 : 0) << " "
+			<< frame.attributes.size();
+		if (!link->connection->writeLine(s.str())
+			|| !link->connection->write(frame.attributes.data(), frame.attributes.size()))
+		{
+			return false;
+		}
+		link->frameKey = frame.key;
+	}
+
+	std::string requests;
+	for (int i = 0; i < (int)tiles.size(); i++)
+	{
+		const TileRect& t = tiles[i];
+		requests += "TILE " + std::to_string(t.x0) + " " + std::to_string(t.y0) + " " + std::to_string(t.x1) + " "
+			+ std::to_string(t.y1) + "\n";
+	}
+	return link->connection->write(requests.data(), requests.size());
+}
+
+void RenderCluster::removeLostWorkers()
+{
+	for (int i = (int)workers->size() - 1; i >= 0; i--)
+	{
+		WorkerLink* link = workers->at(i);
+		if (link->alive) continue;
+
+		// A lost worker's reader has already returned (or is about to).
+		if (link->reader.joinable())
+		{
+			link->reader.join();
+		}
+		delete link->connection;
+		delete link;
+		workers->erase(workers->begin() + i);
+	}
+}
+
+int RenderCluster::countWorkers()
+{
+	int n = 0;
+	for (int i = 0; i < (int)workers->size(); i++)
+	{
+		if (workers->at(i)->alive && workers->at(i)->threads > 0) n++;
+	}
+	return n;
+}
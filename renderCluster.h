@@ -0,0 +1,189 @@
+#ifndef __RENDERCLUSTER_H__
+#define __RENDERCLUSTER_H__
+
+/* renderCluster.h
+ *
+ * The coordinator side of distributed rendering. Render workers (other project5 processes, started with
+ * "-worker host:port") connect to the cluster over TCP, and the viewport hands the tiles of each redraw out
+ * to them. Every worker is sent the frame (the camera, lights and render settings) before its first tile of
+ * it, and the whole scene only when its shapes have changed, so moving the camera doesn't make the workers
+ * load the scene and build its hierarchies again. Each worker keeps a few tiles queued so it is never idle.
+ * Finished tiles are sent back in the same encoding as checkpoint tiles, along with their primary hits when
+ * those are recorded.
+ *
+ * When a worker disconnects (or dies), or goes longer than the tile timeout without finishing any of the tiles it
+ * was given (it may be hung, or its machine unreachable), it is dropped, and the tiles it had not finished are
+ * handed to the other workers. Tiles that no worker is left for are left to the caller.
+ *
+ * Messages are lines of text, some followed by a block of binary data:
+ *
+ *   worker -> cluster  HELLO <threads>
+ *   cluster -> worker  SCENE <shapes key> <bytes>, followed by the scene
+ *   cluster -> worker  FRAME <key> <width> <height> <anti-aliasing samples> <threshold> <reprojection> <bytes>
+ *                      followed by the scene attributes
+ *   cluster -> worker  TILE <x0> <y0> <x1> <y1>
+ *   worker -> cluster  DONE <x0> <y0> <x1> <y1> <floats>, followed by the floats (in the native byte order)
+ *
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "misc.h"
+
+class Connection;
+
+// The tiles each worker thread is given at once (so it can start the next while the last is on its way back).
+const int CLUSTER_TILES_PER_THREAD = 2;
+// The most values each pixel of a finished tile may be sent with.
+const int CLUSTER_MAX_FLOATS_PER_PIXEL = 11;
+// How long to wait for workers to join when asked to (see waitForWorkers).
+const int CLUSTER_JOIN_TIMEOUT_MS = 30000;
+// How long a worker may go without finishing any of the tiles it was given (or taking what it is sent) before it
+// is dropped, by default (see setTileTimeout).
+const int CLUSTER_TILE_TIMEOUT_MS = 30000;
+// The largest scene, and scene attributes, that are sent to workers (bigger scenes are rendered locally).
+const size_t CLUSTER_MAX_SCENE_BYTES = (size_t)1 << 30;
+const size_t CLUSTER_MAX_ATTRIBUTE_BYTES = (size_t)16 << 20;
+
+// A frame as the workers render it.
+struct ClusterFrame
+{
+	ClusterFrame();
+
+	// Identifies the scene attributes and settings, and the shapes (see ShapeCollection::shapesHash).
+	// Workers are only sent the scene again when the shapes change.
+	uint64_t key;
+	uint64_t shapesKey;
+	// The size of the viewport.
+	int width;
+	int height;
+	// The settings that decide whether primary hits are recorded (see Viewport::setAntiAliasing/setReprojection).
+	int antiAliasingSamples;
+	float antiAliasingThreshold;
+	bool reprojection;
+	// The scene attributes (the camera, background and lights) as written by Viewport::writeSceneAttributes.
+	std::string attributes;
+	// The scene, as returned by ShapeCollection::serialize(). It is shared between frames with the same shapes.
+	std::shared_ptr<const std::string> scene;
+};
+
+// Called (from the cluster's threads) with each tile that a worker has finished, and its data. Returns false if
+// the data can't be used, in which case the worker is dropped and the tile given to another.
+typedef std::function<bool(const TileRect&, const std::vector<float>&)> ClusterTileFunction;
+
+class RenderCluster
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates a cluster that isn't listening.
+		RenderCluster();
+		// Disconnects every worker.
+		~RenderCluster();
+
+		// Listens for workers on the TCP port (instead of any other), on a thread of its own.
+		// Returns false if the port can't be listened on.
+		bool listen(int port);
+		// Stops listening, and disconnects every worker.
+		void stop();
+		// Returns the port being listened on (0 if not listening).
+		int getPort();
+		// Returns the number of workers connected.
+		int numWorkers();
+		// Blocks until there are at least n workers, or the time runs out. Returns the number of workers.
+		int waitForWorkers(int n, int timeoutMs);
+		// Sets how long a worker may go without finishing any of the tiles it was given before it is dropped.
+		void setTileTimeout(int ms);
+		int getTileTimeout();
+
+		// Renders the tiles on the workers, calling done with each as it finishes. Tiles of workers that
+		// disconnect are given to the others. Returns once every tile is done, or no workers are left; the
+		// tiles that weren't done are left in the vector (and the others removed).
+		void renderTiles(const ClusterFrame &frame, std::vector<TileRect> &tiles, ClusterTileFunction done);
+
+		// Prints the port, and each worker with the tiles it has rendered.
+		void printStatus(std::ostream& s);
+
+	private:
+		// A connected worker.
+		struct WorkerLink
+		{
+			Connection* connection;
+			// The peer's address.
+			std::string name;
+			// The number of threads the worker renders with (0 until it has said).
+			int threads;
+			// False once the connection has been lost.
+			bool alive;
+			// True once the worker has been dropped for going too long without finishing a tile (its reader then
+			// finds the connection gone).
+			bool stalled;
+			// When the worker last finished a tile, or was given tiles while it had none.
+			std::chrono::steady_clock::time_point lastProgress;
+			// The keys of the last frame and shapes the worker was sent.
+			uint64_t frameKey;
+			uint64_t shapesKey;
+			// The tiles (indices into the frame's tiles) it has been given but not returned.
+			std::vector<int> assigned;
+			int tilesRendered;
+			// Reads the worker's messages.
+			std::thread reader;
+		};
+
+		/*** Private Member Functions ***/
+		// The loop the listening thread runs, accepting workers on the socket until the cluster stops.
+		void acceptLoop(int fd);
+		// The loop each worker's reader thread runs until the connection is lost.
+		void readerLoop(WorkerLink* link);
+		// Marks the worker as lost, and puts its tiles back in the queue. The mutex must be held.
+		void loseWorker(WorkerLink* link);
+		// Sends the worker the scene and the frame (if it hasn't got them) and the tiles. Returns false if the
+		// worker is lost.
+		bool sendTiles(WorkerLink* link, const ClusterFrame &frame, const std::vector<TileRect> &tiles);
+		// Joins and destroys the workers that have been lost. The mutex must be held.
+		void removeLostWorkers();
+		// Returns the number of workers that are connected and have said hello. The mutex must be held.
+		int countWorkers();
+
+		// Clusters can't be copied.
+		RenderCluster(const RenderCluster&) = delete;
+		RenderCluster& operator=(const RenderCluster&) = delete;
+
+		/*** Private Member Variables ***/
+		// The listening socket (-1 if not listening), and its port.
+		int listenFd;
+		int port;
+		int tileTimeoutMs;
+		std::thread acceptor;
+		std::vector<WorkerLink*>* workers;
+
+		/** The frame being rendered **/
+		// The tiles of the frame (null between frames), and the function finished tiles are passed to.
+		const std::vector<TileRect>* frameTiles;
+		ClusterTileFunction tileDone;
+		// True for each tile that is finished (or being passed to tileDone).
+		std::vector<bool>* finished;
+		// Tiles waiting to be given to a worker.
+		std::deque<int>* queued;
+		// The number of tiles that are not finished, and the number being passed to tileDone.
+		int tilesLeft;
+		int tilesInProgress;
+		// The number of tiles that were given to another worker after theirs was lost.
+		int tilesRedispatched;
+
+		// Guards everything above.
+		std::mutex mutex;
+		// Signalled when a tile is finished, or a worker connects, says hello, or is lost.
+		std::condition_variable changed;
+};
+
+#endif
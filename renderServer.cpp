@@ -0,0 +1,421 @@
+#include "renderServer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "connection.h"
+#include "frameBuffer.h"
+#include "frameCache.h"
+#include "mappedFile.h"
+#include "metrics.h"
+#include "pixelConverter.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+#include "viewport.h"
+
+
+/*** Public Member Functions ***/
+
+RenderServer::RenderServer(ThreadPool* _pool, FrameCache* _frameCache)
+{
+	pool = _pool;
+	frameCache = _frameCache;
+	metrics = nullptr;
+	memoryBudget = 0;
+	mappedFiles = std::make_shared<MappedFiles>();
+	listenFd = -1;
+	socketPath = "";
+
+	scenes = new std::map<std::string, ResidentScene>();
+	jobs = new std::deque<std::shared_ptr<RenderJob> >();
+	nextJobId = 1;
+	jobsRendered = 0;
+	jobsFailed = 0;
+	scenesLoaded = 0;
+}
+
+RenderServer::~RenderServer()
+{
+	if (listenFd >= 0)
+	{
+		close(listenFd);
+		unlink(socketPath.c_str());
+	}
+
+	for (auto it = scenes->begin(); it != scenes->end(); it++)
+	{
+		destroyScene(it->second);
+	}
+	delete scenes;
+	delete jobs;
+}
+
+bool RenderServer::listen(std::string _socketPath)
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (_socketPath == "" || _socketPath.size() >= sizeof(address.sun_path)) return false;
+	std::copy(_socketPath.begin(), _socketPath.end(), address.sun_path);
+
+	// A socket left behind by a server that was interrupted is replaced, but nothing else is.
+	struct stat info;
+	if (stat(_socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+	{
+		unlink(_socketPath.c_str());
+	}
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listenFd < 0) return false;
+	if (bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listenFd, SOMAXCONN) != 0)
+	{
+		close(listenFd);
+		listenFd = -1;
+		return false;
+	}
+
+	socketPath = _socketPath;
+	return true;
+}
+
+void RenderServer::run()
+{
+	renderThread = std::thread(&RenderServer::renderLoop, this);
+	std::cout << "Serving render jobs on \"" << socketPath << "\" with " << (pool ? pool->numThreads() : 1)
+		<< " threads." << std::endl;
+
+	while (true)
+	{
+		int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0) continue;
+
+		std::thread connection(&RenderServer::serveConnection, this, fd);
+		connection.detach();
+	}
+}
+
+void RenderServer::setMemoryBudget(size_t bytes)
+{
+	memoryBudget = bytes;
+}
+
+void RenderServer::setMetrics(Metrics* _metrics)
+{
+	metrics = _metrics;
+}
+
+void RenderServer::printStatus(std::ostream& s)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	s << "Serving on \"" << socketPath << "\": " << scenesLoaded << " scenes loaded, " << jobs->size()
+		<< " jobs waiting, " << jobsRendered << " rendered";
+	if (jobsFailed > 0)
+	{
+		s << ", " << jobsFailed << " failed";
+	}
+	s << "." << std::endl;
+}
+
+void RenderServer::getJobCounts(int &waiting, int &rendered, int &failed)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	waiting = jobs->size();
+	rendered = jobsRendered;
+	failed = jobsFailed;
+}
+
+
+/*** Private Member Functions ***/
+
+void RenderServer::renderLoop()
+{
+	while (true)
+	{
+		std::shared_ptr<RenderJob> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return !jobs->empty(); });
+			job = jobs->front();
+			jobs->pop_front();
+		}
+
+		renderJob(*job);
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job->done = true;
+			scenesLoaded = scenes->size();
+		}
+		jobDone.notify_all();
+	}
+}
+
+void RenderServer::serveConnection(int fd)
+{
+	Connection* connection = new Connection(fd);
+	std::string line;
+	while (connection->readLine(line))
+	{
+		if (line.find_first_not_of(" \t") == std::string::npos) continue;
+
+		std::shared_ptr<RenderJob> job = std::make_shared<RenderJob>();
+		std::string reply = parseRequest(line, *job);
+		if (reply == "")
+		{
+			runJob(job);
+			reply = job->reply;
+		}
+
+		if (!connection->writeLine(reply)) break;
+		if (!job->data.empty() && !connection->write(job->data.data(), job->data.size())) break;
+	}
+	delete connection;
+}
+
+std::string RenderServer::parseRequest(std::string line, RenderJob &job)
+{
+	std::istringstream s(line);
+	std::string request;
+	s >> request;
+	std::transform(request.begin(), request.end(), request.begin(), ::toupper);
+
+	if (request == "STATUS")
+	{
+		std::ostringstream status;
+		printStatus(status);
+		std::string text = status.str();
+		return "OK " + text.substr(0, text.find('\n'));
+	}
+
+	job.done = false;
+	job.width = 0;
+	job.height = 0;
+	job.priority = 0;
+	job.format = jfRGB8;
+	job.budgetMs = 0.0;
+
+	if (request == "LOAD")
+	{
+		job.type = jtLoad;
+		if (!(s >> job.sceneFileName)) return "ERROR LOAD needs a scene file.";
+		return "";
+	}
+	if (request != "RENDER")
+	{
+		return "ERROR Unknown request \"" + request + "\".";
+	}
+
+	job.type = jtRender;
+	s >> job.sceneFileName >> job.width >> job.height;
+	job.camera.read(s);
+	if (s.fail())
+	{
+		return "ERROR RENDER needs a scene file, a size, the from, at and up points, and a viewing angle.";
+	}
+	if (job.width <= 0 || job.height <= 0 || job.width > RENDER_SERVER_MAX_SIZE || job.height > RENDER_SERVER_MAX_SIZE)
+	{
+		return "ERROR The width and height must be between 1 and " + std::to_string(RENDER_SERVER_MAX_SIZE) + ".";
+	}
+
+	std::string format;
+	if (s >> job.priority >> format)
+	{
+		std::transform(format.begin(), format.end(), format.begin(), ::tolower);
+		if (format == "float")
+		{
+			job.format = jfFloat;
+		}
+		else if (format != "rgb8")
+		{
+			return "ERROR Unknown format \"" + format + "\".";
+		}
+		if (s >> job.budgetMs && job.budgetMs < 0.0)
+		{
+			return "ERROR The budget can't be negative.";
+		}
+	}
+	return "";
+}
+
+void RenderServer::runJob(std::shared_ptr<RenderJob> job)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	job->id = nextJobId++;
+
+	// The job goes after every job with the same or a higher priority.
+	auto position = jobs->end();
+	while (position != jobs->begin() && (*(position - 1))->priority < job->priority)
+	{
+		position--;
+	}
+	jobs->insert(position, job);
+	jobAvailable.notify_one();
+
+	jobDone.wait(lock, [&job]() { return job->done; });
+}
+
+void RenderServer::renderJob(RenderJob &job)
+{
+	std::string error;
+	ResidentScene* scene = findScene(job.sceneFileName, job.type == jtLoad, error);
+	if (!scene)
+	{
+		job.reply = "ERROR " + error;
+		std::unique_lock<std::mutex> lock(mutex);
+		jobsFailed++;
+		return;
+	}
+	if (job.type == jtLoad)
+	{
+		job.reply = "OK " + std::to_string(scene->shapes->numShapes()) + " shapes";
+		return;
+	}
+
+	// The frame buffer is held to the budget before it is allocated.
+	size_t frameBytes = (size_t)job.width * job.height * 3 * sizeof(float);
+	if (!fitMemoryBudget(memoryUsage(), frameBytes, frameCache, mappedFiles.get()))
+	{
+		job.reply = "ERROR A " + std::to_string(job.width) + "x" + std::to_string(job.height)
+			+ " frame doesn't fit in the memory budget.";
+		std::unique_lock<std::mutex> lock(mutex);
+		jobsFailed++;
+		return;
+	}
+
+	double startMs = nowMs();
+
+	// The job is rendered by a viewport of its own size, with the scene's attributes and lights and the job's
+	// camera. The scene is attached to it while it renders, so that the frame is cached under the job's camera.
+	FrameBuffer* buffer = new FrameBuffer(job.width, job.height);
+	Viewport* viewport = new Viewport(Coord(0, 0), job.width, job.height, scene->shapes);
+	viewport->setThreadPool(pool);
+	viewport->setFrameCache(frameCache);
+	viewport->setFrameBuffer(buffer);
+	viewport->copySceneFrom(scene->viewport);
+	viewport->setCamera(job.camera);
+	viewport->setBudget(job.budgetMs);
+
+	scene->shapes->setViewport(viewport);
+	viewport->redraw(false);
+	scene->shapes->setViewport(scene->viewport);
+
+	std::vector<float> pixels;
+	viewport->readPixels(0, 0, job.width, job.height, pixels);
+	RenderStats stats = viewport->getStats();
+	bool fromCache = stats.fromCache;
+	if (metrics)
+	{
+		metrics->addFrame(stats);
+	}
+	delete viewport;
+	delete buffer;
+
+	std::string formatName;
+	if (job.format == jfFloat)
+	{
+		formatName = "float";
+		job.data.resize(pixels.size() * sizeof(float));
+		std::copy((const unsigned char*)pixels.data(), (const unsigned char*)(pixels.data() + pixels.size()), job.data.begin());
+	}
+	else
+	{
+		// 8-bit images start with the top row, which is the last one in the frame.
+		formatName = "rgb8";
+		PixelConverter converter;
+		int rowBytes = job.width * 3;
+		job.data.resize((size_t)rowBytes * job.height);
+		for (int j = 0; j < job.height; j++)
+		{
+			converter.convert(pixels.data() + (size_t)j * rowBytes, job.data.data() + (size_t)(job.height - 1 - j) * rowBytes, rowBytes);
+		}
+	}
+	job.reply = "OK " + std::to_string(job.width) + " " + std::to_string(job.height) + " " + formatName + " "
+		+ std::to_string(job.data.size());
+	if (job.budgetMs > 0.0)
+	{
+		job.reply += " " + std::to_string(stats.budgetStep) + " " + std::to_string(stats.budgetLayers) + " "
+			+ std::to_string(stats.budgetSamples) + " " + std::to_string(stats.budgetTilesDropped);
+	}
+
+	std::cout << "Job " << job.id << " (priority " << job.priority << "): " << job.width << "x" << job.height
+		<< " of \"" << job.sceneFileName << "\" in " << nowMs() - startMs << " ms" << (fromCache ? " (cached)" : "")
+		<< "." << std::endl;
+	std::unique_lock<std::mutex> lock(mutex);
+	jobsRendered++;
+}
+
+RenderServer::ResidentScene* RenderServer::findScene(std::string fileName, bool reload, std::string &error)
+{
+	auto found = scenes->find(fileName);
+	if (found != scenes->end())
+	{
+		if (!reload) return &found->second;
+
+		destroyScene(found->second);
+		scenes->erase(found);
+	}
+
+	ResidentScene scene;
+	scene.shapes = new ShapeCollection();
+	scene.viewport = new Viewport(Coord(0, 0), 1, 1, scene.shapes);
+	scene.shapes->setViewport(scene.viewport);
+	scene.shapes->setMappedFiles(mappedFiles);
+
+	// The scene may use what the other scenes don't (the caches can be emptied), and loading stops as soon as
+	// it is known not to fit.
+	size_t memoryLimit = 0;
+	if (memoryBudget > 0)
+	{
+		MemoryUsage before = memoryUsage();
+		size_t kept = before.total() - before.frameCache - before.mapped;
+		memoryLimit = (kept < memoryBudget) ? memoryBudget - kept : 1;
+	}
+	if (!scene.shapes->loadFromFile(fileName, memoryLimit))
+	{
+		destroyScene(scene);
+		error = "Could not load \"" + fileName + "\".";
+		return nullptr;
+	}
+
+	// The hierarchies are built once, when the scene is loaded, rather than by the first job.
+	scene.shapes->prepare();
+
+	// A scene that doesn't fit in the memory budget, even once the caches are emptied, isn't kept.
+	MemoryUsage usage = memoryUsage();
+	scene.shapes->addMemoryUsage(usage);
+	if (!fitMemoryBudget(usage, 0, frameCache, mappedFiles.get()))
+	{
+		destroyScene(scene);
+		error = "\"" + fileName + "\" doesn't fit in the memory budget.";
+		return nullptr;
+	}
+	(*scenes)[fileName] = scene;
+	return &scenes->at(fileName);
+}
+
+void RenderServer::destroyScene(ResidentScene &scene)
+{
+	delete scene.shapes;
+	delete scene.viewport;
+}
+
+MemoryUsage RenderServer::memoryUsage()
+{
+	MemoryUsage usage;
+	for (auto it = scenes->begin(); it != scenes->end(); it++)
+	{
+		it->second.shapes->addMemoryUsage(usage);
+	}
+	if (frameCache)
+	{
+		usage.frameCache = frameCache->memoryUsed();
+	}
+	usage.mapped = mappedFiles->residentTotal();
+	usage.budget = memoryBudget;
+	return usage;
+}
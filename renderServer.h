@@ -0,0 +1,173 @@
+#ifndef __RENDERSERVER_H__
+#define __RENDERSERVER_H__
+
+/* renderServer.h
+ *
+ * A long-running render service. Scenes stay loaded (with their bounding volume hierarchies built) between jobs,
+ * and clients send jobs over a Unix domain socket. Jobs are queued by priority and rendered one at a time on
+ * the shared thread pool, each into a frame buffer of its own size; the pixels are sent back to the client.
+ *
+ * Each request is a line of text, and each reply starts with a line of text:
+ *
+ *   RENDER <scene> <width> <height> <from x y z> <at x y z> <up x y z> <viewing angle>
+ *          [<priority> [rgb8|float [<budget>]]]
+ *       Renders the scene (loading it first if it isn't loaded) from the camera. Jobs with a higher priority
+ *       (0 by default) are rendered first, and jobs with the same priority in the order they were received.
+ *       Replies "OK <width> <height> <format> <bytes>", followed by the pixels: 8-bit RGB top row first (rgb8,
+ *       the default), or RGB floats bottom row first as in the frame buffer (float). A job with a budget (in
+ *       milliseconds, see Viewport::setBudget) is rendered at whatever quality fits in it, and the reply line
+ *       goes on with the quality reached: "<resolution step> <reflection layers> <samples> <tiles left out>".
+ *   LOAD <scene>
+ *       Loads the scene again from its file (it is queued like a job). Replies "OK <shapes> shapes".
+ *   STATUS
+ *       Replies "OK" with the number of scenes loaded, jobs waiting, and jobs rendered.
+ *
+ * Requests that fail are answered with "ERROR <reason>". A connection can send any number of requests.
+ * With a memory budget (see setMemoryBudget), scenes and frames that wouldn't fit in it are refused.
+ *
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera.h"
+#include "memoryUsage.h"
+#include "misc.h"
+
+class FrameCache;
+class MappedFiles;
+class Metrics;
+class ShapeCollection;
+class ThreadPool;
+class Viewport;
+
+enum JobType {
+	jtRender,
+	jtLoad
+};
+
+enum JobFormat {
+	jfRGB8,
+	jfFloat
+};
+
+// The largest width or height a job may ask for.
+const int RENDER_SERVER_MAX_SIZE = 8192;
+
+class RenderServer
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates a server that renders on the pool, and looks up and stores frames in the cache (may be null).
+		RenderServer(ThreadPool* _pool, FrameCache* _frameCache);
+		// Stops listening and removes the socket. Scenes are destroyed.
+		~RenderServer();
+
+		// Listens on a Unix domain socket at the path (replacing a socket that is already there).
+		// Returns false if it can't.
+		bool listen(std::string _socketPath);
+		// Starts the render thread, then accepts connections (each served on a thread of its own) until the
+		// program is interrupted.
+		void run();
+
+		// Sets the hard memory budget in bytes (0 for none, the default; see memoryUsage.h).
+		void setMemoryBudget(size_t bytes);
+		// Sets the exporter the jobs' render metrics are counted by (may be null).
+		void setMetrics(Metrics* _metrics);
+
+		// Prints the socket, the scenes loaded, and the number of jobs waiting and rendered.
+		void printStatus(std::ostream& s);
+		// Returns the number of jobs waiting, rendered, and that failed.
+		void getJobCounts(int &waiting, int &rendered, int &failed);
+
+	private:
+		// A request that is rendered (or loaded) on the render thread.
+		struct RenderJob
+		{
+			JobType type;
+			int id;
+			std::string sceneFileName;
+			int width;
+			int height;
+			Camera camera;
+			int priority;
+			JobFormat format;
+			// The time the render may take in milliseconds (0 for no limit).
+			double budgetMs;
+
+			// Set by the render thread once the job is finished.
+			bool done;
+			// The reply line, and the pixels that follow it.
+			std::string reply;
+			std::vector<unsigned char> data;
+		};
+
+		// A scene kept loaded between jobs. The attributes and lights are held by its viewport.
+		struct ResidentScene
+		{
+			ShapeCollection* shapes;
+			Viewport* viewport;
+		};
+
+		/*** Private Member Functions ***/
+		// The loop the render thread runs, taking the job with the highest priority each time.
+		void renderLoop();
+		// Reads requests from the connection and answers them until it is closed. Closes the connection.
+		void serveConnection(int fd);
+		// Parses a request. Returns the reply to it, or an empty string if it is a job (which is then filled in).
+		std::string parseRequest(std::string line, RenderJob &job);
+		// Queues the job, and blocks until it has been rendered.
+		void runJob(std::shared_ptr<RenderJob> job);
+		// Renders the job (on the render thread), and fills in its reply.
+		void renderJob(RenderJob &job);
+		// Returns the scene, loading it first if it isn't loaded (or if reload is set). Returns null (with the
+		// reason) if it can't be loaded.
+		ResidentScene* findScene(std::string fileName, bool reload, std::string &error);
+		// Destroys a resident scene.
+		static void destroyScene(ResidentScene &scene);
+		// Returns the memory used by the resident scenes, the frame cache and the mapped files.
+		MemoryUsage memoryUsage();
+
+		// Servers can't be copied.
+		RenderServer(const RenderServer&) = delete;
+		RenderServer& operator=(const RenderServer&) = delete;
+
+		/*** Private Member Variables ***/
+		ThreadPool* pool;
+		FrameCache* frameCache;
+		Metrics* metrics;
+		// The hard memory budget in bytes (0 for none).
+		size_t memoryBudget;
+		// The files the scenes map, which are released together when the budget needs their pages.
+		std::shared_ptr<MappedFiles> mappedFiles;
+		// The listening socket (-1 if not listening), and where it is.
+		int listenFd;
+		std::string socketPath;
+
+		// Scenes by file name. Only used by the render thread.
+		std::map<std::string, ResidentScene>* scenes;
+		// Jobs that have not yet been started, highest priority first.
+		std::deque<std::shared_ptr<RenderJob> >* jobs;
+		// The number given to the next job, and the number of jobs rendered (and that failed).
+		int nextJobId;
+		int jobsRendered;
+		int jobsFailed;
+
+		std::thread renderThread;
+		// Guards the queue and counters (and the number of scenes, which is read by printStatus).
+		std::mutex mutex;
+		int scenesLoaded;
+		// Signalled when a job is queued.
+		std::condition_variable jobAvailable;
+		// Signalled when a job has been finished.
+		std::condition_variable jobDone;
+};
+
+#endif
@@ -0,0 +1,381 @@
+#include "renderSession.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <signal.h>
+#include <thread>
+
+#include "animation.h"
+#include "checkpoint.h"
+#include "commandHandler.h"
+#include "fileWatcher.h"
+#include "frameBuffer.h"
+#include "frameCache.h"
+#include "imageWriter.h"
+#include "mappedFile.h"
+#include "memoryUsage.h"
+#include "metrics.h"
+#include "numaTopology.h"
+#include "renderCluster.h"
+#include "renderServer.h"
+#include "renderWorker.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+
+// Set when the program is interrupted while it watches a scene file after its commands.
+static volatile sig_atomic_t watchInterrupted = 0;
+
+static void interruptWatch(int)
+{
+	watchInterrupted = 1;
+}
+
+RenderSession::RenderSession(int width, int height, bool _headless, bool numa, int numaNodes)
+{
+	headless = _headless;
+	outputFileName = "";
+	memoryFileName = "";
+	tileListener = nullptr;
+	framesRendered = 0;
+
+	// The frame buffer is black until drawn on. Its tiles are only allocated once they are drawn on.
+	frameBuffer = new FrameBuffer(width, height);
+
+	shapes = new ShapeCollection();
+	if (headless)
+	{
+		viewport = new Viewport(Coord(0, 0), width, height, shapes);
+	}
+	else
+	{
+		viewport = new Viewport(Coord(10, 10), width - 20, height - 20, shapes);
+	}
+	shapes->setViewport(viewport);
+	viewport->setFrameBuffer(frameBuffer);
+	if (numa)
+	{
+		// Memory is placed on the node of the thread that first writes to it, so the pool is started before
+		// anything is drawn.
+		threadPool = new ThreadPool(0, detectNumaNodes(numaNodes));
+	}
+	else
+	{
+		threadPool = new ThreadPool(0);
+	}
+	viewport->setThreadPool(threadPool);
+	frameCache = new FrameCache(FRAME_CACHE_MB);
+	viewport->setFrameCache(frameCache);
+	checkpoint = new Checkpoint();
+	viewport->setCheckpoint(checkpoint);
+	renderCluster = new RenderCluster();
+	viewport->setCluster(renderCluster);
+	imageWriter = new ImageWriter();
+	fileWatcher = new FileWatcher();
+	fileWatcher->setListener([this](std::string fileName) { sceneFileChanged(fileName); });
+	metrics = new Metrics();
+	metrics->setThreadPool(threadPool);
+	metrics->setFrameCache(frameCache);
+	animation = new Animation(threadPool, imageWriter, metrics);
+
+	// Commands work with the rest.
+	commandHandler = new CommandHandler();
+	commandHandler->setAnimation(animation);
+	commandHandler->setCheckpoint(checkpoint);
+	commandHandler->setCluster(renderCluster);
+	commandHandler->setFileWatcher(fileWatcher);
+	commandHandler->setImageWriter(imageWriter);
+	commandHandler->setMetrics(metrics);
+}
+
+RenderSession::~RenderSession()
+{
+	// Everything that runs threads of its own is stopped before what those threads use is destroyed.
+	delete fileWatcher;
+	delete metrics;
+	delete renderCluster;
+	imageWriter->wait();
+	delete commandHandler;
+	delete animation;
+	delete viewport;
+	delete shapes;
+	delete imageWriter;
+	delete checkpoint;
+	delete frameCache;
+	delete threadPool;
+	delete frameBuffer;
+}
+
+FrameBuffer* RenderSession::getFrameBuffer()
+{
+	return frameBuffer;
+}
+
+Viewport* RenderSession::getViewport()
+{
+	return viewport;
+}
+
+ShapeCollection* RenderSession::getShapes()
+{
+	return shapes;
+}
+
+ThreadPool* RenderSession::getThreadPool()
+{
+	return threadPool;
+}
+
+Metrics* RenderSession::getMetrics()
+{
+	return metrics;
+}
+
+void RenderSession::setOutputFile(std::string fileName)
+{
+	outputFileName = fileName;
+	setTileListener(tileListener);
+}
+
+void RenderSession::setMemoryFile(std::string fileName)
+{
+	memoryFileName = fileName;
+}
+
+void RenderSession::setMemoryBudget(size_t bytes)
+{
+	commandHandler->setMemoryBudget(bytes);
+}
+
+void RenderSession::setTileListener(TileListener listener)
+{
+	tileListener = listener;
+	if (headless && outputFileName != "" && !writesWholeFrames(outputFileName))
+	{
+		// Streamed tiles are dropped once written, so they can't be passed on.
+		viewport->setKeepFrame(false);
+		FrameBuffer* buffer = frameBuffer;
+		viewport->setTileListener([buffer](int x, int y, int width, int height)
+		{
+			buffer->tileFinished(x, y, width, height);
+		});
+		if (viewport->getAntiAliasingSamples() > 1)
+		{
+			std::cout << "Frames streamed to a file are written as their tiles finish, so they are not"
+				<< " anti-aliased (PNG and PFM files are written whole)." << std::endl;
+		}
+		if (viewport->getBudget() > 0.0)
+		{
+			std::cout << "Frames streamed to a file are written as their tiles finish, so they have no time"
+				<< " budget (PNG and PFM files are written whole)." << std::endl;
+		}
+	}
+	else
+	{
+		viewport->setKeepFrame(true);
+		viewport->setTileListener(tileListener);
+	}
+}
+
+void RenderSession::runCommands()
+{
+	// Draw the initial viewport
+	{
+		std::unique_lock<std::mutex> lock(sceneMutex);
+		renderFrame(false);
+	}
+
+	while (commandHandler->getUserInput())
+	{
+		std::unique_lock<std::mutex> lock(sceneMutex);
+
+		// Execute the command.
+		bool redraw = true;
+		Command command = commandHandler->execute(shapes, viewport, redraw);
+
+		// Redraw the viewport.
+		if (redraw)
+		{
+			renderFrame(CommandHandler::isCameraCommand(command));
+		}
+	}
+
+	// While a scene file is watched, frames keep being rendered as it changes until the program is interrupted
+	// (or terminated), after which the frames being written are finished.
+	std::string watchedFileName = fileWatcher->getFileName();
+	if (watchedFileName != "")
+	{
+		std::cout << "Watching \"" << watchedFileName << "\" until interrupted." << std::endl;
+		watchInterrupted = 0;
+		struct sigaction action = {};
+		struct sigaction previousInt, previousTerm;
+		action.sa_handler = interruptWatch;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGINT, &action, &previousInt);
+		sigaction(SIGTERM, &action, &previousTerm);
+		while (!watchInterrupted)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(SESSION_INTERRUPT_POLL_MS));
+		}
+		sigaction(SIGINT, &previousInt, nullptr);
+		sigaction(SIGTERM, &previousTerm, nullptr);
+		// A reload that has already started is finished first.
+		fileWatcher->stop();
+		std::unique_lock<std::mutex> lock(sceneMutex);
+		std::cout << "Stopped watching \"" << watchedFileName << "\"." << std::endl;
+	}
+
+	// Files still being written would be cut short.
+	imageWriter->wait();
+}
+
+bool RenderSession::runWorker(std::string address)
+{
+	RenderWorker worker(threadPool);
+	if (!worker.connect(address))
+	{
+		std::cout << "Could not connect to \"" << address << "\"." << std::endl;
+		return false;
+	}
+	std::cout << "Rendering tiles for \"" << address << "\" with " << threadPool->numThreads()
+		<< " threads." << std::endl;
+	int tiles = worker.run();
+	std::cout << "Rendered " << tiles << " tiles before the coordinator disconnected." << std::endl;
+	return true;
+}
+
+bool RenderSession::runServer(std::string socketPath)
+{
+	// Jobs are rendered with the pool and frame cache, into frame buffers of their own, under the same budget.
+	RenderServer* server = new RenderServer(threadPool, frameCache);
+	server->setMemoryBudget(commandHandler->getMemoryBudget());
+	server->setMetrics(metrics);
+	if (!server->listen(socketPath))
+	{
+		std::cout << "Could not listen on \"" << socketPath << "\"." << std::endl;
+		delete server;
+		return false;
+	}
+	metrics->setRenderServer(server);
+	server->run();
+	return true;
+}
+
+void RenderSession::renderFrame(bool cameraMove, const SceneChanges* changes)
+{
+	std::string fileName = (outputFileName == "") ? "" : frameFileName(outputFileName, framesRendered);
+	framesRendered++;
+	int x0, y0, x1, y1;
+	viewport->getRegion(x0, y0, x1, y1);
+
+	bool streaming = false;
+	if (fileName != "" && !writesWholeFrames(fileName))
+	{
+		streaming = frameBuffer->beginStream(fileName, x0, y0, x1, y1, imageWriter->getGamma());
+		if (!streaming)
+		{
+			std::cout << "Could not open \"" << fileName << "\" for writing." << std::endl;
+		}
+	}
+
+	if (changes)
+	{
+		viewport->redrawChanges(true, *changes);
+	}
+	else if (cameraMove)
+	{
+		viewport->redrawCameraMove(true);
+	}
+	else
+	{
+		viewport->redraw(true);
+	}
+	RenderStats stats = viewport->getStats();
+	metrics->addFrame(stats);
+
+	if (streaming)
+	{
+		if (frameBuffer->endStream())
+		{
+			std::cout << "Wrote " << stats.width << "x" << stats.height << " image to \"" << fileName
+				<< "\" (at most " << frameBuffer->peakAllocatedBytes() / 1024 << " KB of pixels held)." << std::endl;
+		}
+		else
+		{
+			std::cout << "Could not write \"" << fileName << "\"." << std::endl;
+		}
+	}
+	else if (fileName != "")
+	{
+		// The writer encodes its own copy of the frame, so the next one can start rendering straight away.
+		std::vector<float> pixels;
+		viewport->readPixels(x0, y0, x1, y1, pixels);
+		imageWriter->write(fileName, x1 - x0, y1 - y0, std::move(pixels));
+		std::cout << "Writing " << (x1 - x0) << "x" << (y1 - y0) << " image to \"" << fileName << "\"." << std::endl;
+	}
+
+	// The frame may have filled the frame cache past the budget (or a reloaded scene may not fit in it).
+	MemoryUsage usage = viewport->getMemoryUsage();
+	usage.budget = commandHandler->getMemoryBudget();
+	if (usage.budget > 0)
+	{
+		if (!fitMemoryBudget(usage, 0, frameCache, shapes->getMappedFiles().get()))
+		{
+			std::cout << "The renderer uses " << usage.total() / (1024 * 1024) << " MB, which is over the memory budget of "
+				<< usage.budget / (1024 * 1024) << " MB." << std::endl;
+		}
+	}
+	if (memoryFileName != "")
+	{
+		std::ofstream memoryFile(memoryFileName);
+		usage = viewport->getMemoryUsage();
+		usage.budget = commandHandler->getMemoryBudget();
+		usage.printJson(memoryFile);
+	}
+}
+
+void RenderSession::sceneFileChanged(std::string fileName)
+{
+	std::unique_lock<std::mutex> lock(sceneMutex);
+
+	SceneChanges changes;
+	if (!commandHandler->updateScene(shapes, viewport, fileName, changes))
+	{
+		std::cout << "Could not reload \"" << fileName << "\"." << std::endl;
+		return;
+	}
+	if (changes.isEmpty())
+	{
+		std::cout << "\"" << fileName << "\" changed, but the scene is the same." << std::endl;
+		return;
+	}
+
+	std::cout << "Reloaded \"" << fileName << "\": " << changes.shapesAdded << " shapes added, "
+		<< changes.shapesRemoved << " removed";
+	if (changes.lightsChanged) std::cout << ", lights changed";
+	if (changes.attributesChanged) std::cout << ", scene attributes changed";
+	std::cout << "." << std::endl;
+	renderFrame(false, &changes);
+}
+
+bool RenderSession::writesWholeFrames(std::string fileName)
+{
+	ImageFormat format = ImageWriter::formatOf(fileName);
+	return format == ifPNG || format == ifPFM;
+}
+
+std::string RenderSession::frameFileName(std::string pattern, int frame)
+{
+	size_t start = pattern.find('#');
+	if (start == std::string::npos) return pattern;
+
+	size_t end = pattern.find_first_not_of('#', start);
+	if (end == std::string::npos) end = pattern.size();
+
+	std::string number = std::to_string(frame);
+	if (number.size() < end - start)
+	{
+		number.insert(0, end - start - number.size(), '0');
+	}
+	return pattern.substr(0, start) + number + pattern.substr(end);
+}
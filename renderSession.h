@@ -0,0 +1,125 @@
+#ifndef __RENDERSESSION_H__
+#define __RENDERSESSION_H__
+
+/* renderSession.h
+ *
+ * The renderer as project5 runs it: a scene, the viewport it is seen through, the frame buffer the viewport
+ * draws into, everything the viewport renders with (the thread pool, frame cache, checkpoint and render
+ * cluster), and the parts that commands work with besides (the image writer, file watcher, animation and
+ * metrics). A session reads commands, and renders a frame after each one that changes what is seen, and whenever
+ * the watched scene file changes. Each frame is counted by the metrics, and can be written to a file.
+ *
+ * A session can instead render tiles for a coordinator (see renderWorker.h), or serve render jobs (see
+ * renderServer.h). Nothing in a session is global, so main.cpp only parses the command line and, unless headless,
+ * shows the session's frame buffer in a window.
+ *
+ */
+
+#include <mutex>
+#include <string>
+
+#include "viewport.h"
+
+class Animation;
+class Checkpoint;
+class CommandHandler;
+class FileWatcher;
+class FrameBuffer;
+class FrameCache;
+class ImageWriter;
+class Metrics;
+class RenderCluster;
+class ShapeCollection;
+class ThreadPool;
+
+// How much memory finished frames may use by default.
+const int FRAME_CACHE_MB = 256;
+// How often a session watching a scene file after its commands checks whether it has been interrupted.
+const int SESSION_INTERRUPT_POLL_MS = 100;
+
+class RenderSession
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates a session with an empty scene, rendering frames of the size. When headless, the viewport covers the
+		// whole frame, otherwise it leaves a margin around it for its outline. If numa is set, the render threads are
+		// NUMA-aware, emulating the number of nodes given (0 uses the machine's).
+		RenderSession(int width, int height, bool headless, bool numa = false, int numaNodes = 0);
+		~RenderSession();
+
+		// Return the parts of the session.
+		FrameBuffer* getFrameBuffer();
+		Viewport* getViewport();
+		ShapeCollection* getShapes();
+		ThreadPool* getThreadPool();
+		Metrics* getMetrics();
+
+		// Sets the file each frame is written to (empty for none, the default). A run of '#' characters in the
+		// name is replaced by the number of the frame. PNG and PFM files are written whole by the image writer,
+		// while the next frame renders. Other files are streamed as PPM when headless: each tile is written out
+		// and dropped as soon as the scanlines it completes can be written, so the frame can't be anti-aliased
+		// afterwards.
+		void setOutputFile(std::string fileName);
+		// Sets the file the memory usage is written to (as JSON) after each frame (empty for none, the default).
+		void setMemoryFile(std::string fileName);
+		// Sets the hard memory budget in bytes (0 for none, the default; see memoryUsage.h).
+		void setMemoryBudget(size_t bytes);
+		// Sets the function called from the render threads when a tile has finished (see Viewport::setTileListener).
+		// It isn't called while frames are streamed to a file.
+		void setTileListener(TileListener listener);
+
+		// Renders a frame, then reads and executes commands until the input ends, rendering a frame after each
+		// one that changes it. While a scene file is watched, frames then keep being rendered as it changes until
+		// the program is interrupted (SIGINT) or terminated (SIGTERM). It returns once the image writer has finished.
+		void runCommands();
+		// Renders tiles for the coordinator at "host:port" until it disconnects.
+		// Returns false if it can't connect.
+		bool runWorker(std::string address);
+		// Renders the jobs sent to the Unix domain socket until interrupted. Returns false if it can't listen.
+		bool runServer(std::string socketPath);
+
+	private:
+		/*** Private Member Functions ***/
+		// Redraws the viewport, and writes the frame (or its region) to the output file. If the changes to the
+		// scene are given, only the tiles they may affect are rendered again. The scene mutex must be held.
+		void renderFrame(bool cameraMove, const SceneChanges* changes = nullptr);
+		// Called from the file watcher's thread when the watched scene file has changed. Only what changed is
+		// applied, and only the tiles it may affect are rendered again.
+		void sceneFileChanged(std::string fileName);
+		// Returns true if frames are written to the file by the image writer once they are finished (rather than
+		// being streamed to it as they render).
+		static bool writesWholeFrames(std::string fileName);
+		// Returns the pattern with its first run of '#' characters replaced by the frame number, padded with zeros
+		// to the length of the run.
+		static std::string frameFileName(std::string pattern, int frame);
+
+		// Sessions can't be copied.
+		RenderSession(const RenderSession&) = delete;
+		RenderSession& operator=(const RenderSession&) = delete;
+
+		/*** Private Member Variables ***/
+		bool headless;
+		FrameBuffer* frameBuffer;
+		ShapeCollection* shapes;
+		Viewport* viewport;
+		ThreadPool* threadPool;
+		FrameCache* frameCache;
+		Checkpoint* checkpoint;
+		ImageWriter* imageWriter;
+		FileWatcher* fileWatcher;
+		RenderCluster* renderCluster;
+		Animation* animation;
+		Metrics* metrics;
+		CommandHandler* commandHandler;
+
+		std::string outputFileName;
+		std::string memoryFileName;
+		// The function tiles are passed to when frames aren't streamed (may be null).
+		TileListener tileListener;
+		// The number of frames rendered so far.
+		int framesRendered;
+		// Held while the scene is changed or rendered, by commands or by the file watcher.
+		std::mutex sceneMutex;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include "renderStats.h"
+
+RenderStats::RenderStats()
+{
+	width = 0;
+	height = 0;
+	tiles = 0;
+	tilesResumed = 0;
+	tilesKept = 0;
+	tilesRemote = 0;
+
+	primaryRays = 0;
+	secondaryRays = 0;
+	shadowRays = 0;
+
+	pixelsRefined = 0;
+	pixelsReprojected = 0;
+	fromCache = false;
+
+	renderMs = 0.0;
+
+	budgetMs = 0.0;
+	budgetStep = 1;
+	budgetLayers = 0;
+	budgetSamples = 1;
+	budgetTilesDropped = 0;
+}
+
+void RenderStats::print(std::ostream& s)
+{
+	s << "Frame: " << width << " x " << height << " pixels in " << tiles << " tiles";
+	if (fromCache)
+	{
+		s << " (shown from the frame cache)";
+	}
+	else if (tilesResumed > 0)
+	{
+		s << " (" << tilesResumed << " resumed from a checkpoint)";
+	}
+	else if (tilesKept > 0)
+	{
+		s << " (" << tilesKept << " kept from the last frame)";
+	}
+	if (tilesRemote > 0)
+	{
+		s << " (" << tilesRemote << " rendered by workers)";
+	}
+	s << std::endl;
+
+	s << "Time: " << renderMs << " ms";
+	long long totalRays = primaryRays + secondaryRays + shadowRays;
+	if (renderMs > 0.0)
+	{
+		s << " (" << (long long)(totalRays / (renderMs / 1000.0)) << " rays/s)";
+	}
+	s << std::endl;
+
+	s << "Rays: " << primaryRays << " primary, " << secondaryRays << " secondary, "
+		<< shadowRays << " shadow" << std::endl;
+	s << "Pixels: " << pixelsRefined << " refined by anti-aliasing, "
+		<< pixelsReprojected << " reprojected" << std::endl;
+	printBudget(s);
+}
+
+void RenderStats::printBudget(std::ostream& s)
+{
+	if (budgetMs <= 0.0) return;
+
+	s << "Budget: " << budgetMs << " ms" << (renderMs > budgetMs ? " (missed)" : "") << ", rendered at ";
+	if (budgetStep == 1)
+	{
+		s << "full resolution";
+	}
+	else
+	{
+		s << "1/" << budgetStep << " resolution";
+	}
+	s << " with " << budgetLayers << " reflection layers and " << budgetSamples << " samples per pixel";
+	if (budgetTilesDropped > 0)
+	{
+		s << " (" << budgetTilesDropped << " tiles left at a lower quality)";
+	}
+	s << std::endl;
+}
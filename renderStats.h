@@ -0,0 +1,62 @@
+#ifndef __RENDERSTATS_H__
+#define __RENDERSTATS_H__
+
+/* renderStats.h
+ *
+ * Counters describing how a frame was rendered (rays traced, pixels refined, time taken).
+ * Filled in by the viewport during each redraw.
+ *
+ */
+
+#include <iostream>
+
+struct RenderStats
+{
+	RenderStats();
+
+	// Prints the statistics in a human readable form.
+	void print(std::ostream& s);
+	// Prints the time budget of the frame and the quality reached within it (nothing if it had no budget).
+	void printBudget(std::ostream& s);
+
+	// The size of the rendered frame in pixels.
+	int width;
+	int height;
+	// The number of tiles the frame was split into.
+	int tiles;
+	// Tiles that were restored from a checkpoint instead of being rendered.
+	int tilesResumed;
+	// Tiles that were kept from the last frame, because no change to the scene reached them.
+	int tilesKept;
+	// Tiles that were rendered by render workers.
+	int tilesRemote;
+
+	// Rays fired through pixels (one per pixel, plus any extra anti-aliasing samples).
+	long long primaryRays;
+	// Reflected and refracted rays.
+	long long secondaryRays;
+	// Rays fired towards light sources to test for shadows.
+	long long shadowRays;
+
+	// Pixels that were anti-aliased with extra samples.
+	int pixelsRefined;
+	// Pixels that were reused from the previous frame by reprojection.
+	int pixelsReprojected;
+	// True if the frame was shown from the frame cache.
+	bool fromCache;
+
+	// Wall clock time taken to render the frame.
+	double renderMs;
+
+	// The time budget of the frame in milliseconds (0 if it had none; see Viewport::setBudget), and the quality
+	// reached within it: one pixel traced for each block of budgetStep x budgetStep pixels, budgetLayers layers of
+	// reflection and refraction, and budgetSamples samples per anti-aliased pixel.
+	double budgetMs;
+	int budgetStep;
+	int budgetLayers;
+	int budgetSamples;
+	// Tiles that were left at a lower quality than that, because they couldn't be finished by the deadline.
+	int budgetTilesDropped;
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include "renderWorker.h"
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "connection.h"
+#include "frameBuffer.h"
+#include "renderCluster.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+#include "viewport.h"
+
+
+/*** Public Member Functions ***/
+
+RenderWorker::RenderWorker(ThreadPool* _pool)
+{
+	pool = _pool;
+	connection = nullptr;
+	frameKey = 0;
+	shapes = new ShapeCollection();
+	viewport = nullptr;
+	frameBuffer = nullptr;
+	tilesRendered = 0;
+}
+
+RenderWorker::~RenderWorker()
+{
+	if (pool)
+	{
+		pool->wait();
+	}
+	delete connection;
+	delete shapes;
+	delete viewport;
+	delete frameBuffer;
+}
+
+bool RenderWorker::connect(std::string address)
+{
+	delete connection;
+	connection = Connection::connectTCP(address);
+	if (!connection) return false;
+
+	return connection->writeLine("HELLO " + std::to_string(pool ? pool->numThreads() : 1));
+}
+
+int RenderWorker::run()
+{
+	std::string line;
+	while (connection && connection->readLine(line))
+	{
+		std::istringstream s(line);
+		std::string message;
+		s >> message;
+
+		if (message == "SCENE")
+		{
+			if (!readScene(s)) break;
+		}
+		else if (message == "FRAME")
+		{
+			if (!readFrame(s)) break;
+		}
+		else if (message == "TILE" && frameKey != 0)
+		{
+			int x0, y0, x1, y1;
+			s >> x0 >> y0 >> x1 >> y1;
+			if (s.fail()) break;
+
+			if (pool)
+			{
+				pool->enqueue([this, x0, y0, x1, y1]() { renderTile(x0, y0, x1, y1); });
+			}
+			else
+			{
+				renderTile(x0, y0, x1, y1);
+			}
+		}
+		else
+		{
+			std::cout << "Unexpected message from the coordinator: \"" << line << "\"." << std::endl;
+			break;
+		}
+	}
+
+	if (pool)
+	{
+		pool->wait();
+	}
+	return tilesRendered;
+}
+
+
+/*** Private Member Functions ***/
+
+bool RenderWorker::readScene(std::istream& s)
+{
+	uint64_t shapesKey;
+	size_t sceneBytes;
+	s >> shapesKey >> sceneBytes;
+	if (s.fail() || sceneBytes > CLUSTER_MAX_SCENE_BYTES) return false;
+
+	std::string scene(sceneBytes, '\0');
+	if (!connection->read(&scene[0], sceneBytes)) return false;
+
+	// Tiles of the last frame must finish before its scene is replaced. The frame that follows sets the camera
+	// and lights again.
+	if (pool)
+	{
+		pool->wait();
+	}
+	frameKey = 0;
+
+	sizeViewport(viewport ? viewport->getWidth() : 1, viewport ? viewport->getHeight() : 1);
+	if (!shapes->deserialize(scene))
+	{
+		std::cout << "Could not load the scene sent by the coordinator." << std::endl;
+		return false;
+	}
+	std::cout << "Loaded the scene sent by the coordinator: " << shapes->numShapes() << " shapes." << std::endl;
+	return true;
+}
+
+bool RenderWorker::readFrame(std::istream& s)
+{
+	uint64_t key;
+	int width, height, antiAliasingSamples, reprojection;
+	float antiAliasingThreshold;
+	size_t attributeBytes;
+	s >> key >> width >> height >> antiAliasingSamples >> antiAliasingThreshold >> reprojection >> attributeBytes;
+	if (s.fail() || width <= 0 || height <= 0 || attributeBytes > CLUSTER_MAX_ATTRIBUTE_BYTES) return false;
+
+	std::string attributes(attributeBytes, '\0');
+	if (!connection->read(&attributes[0], attributeBytes)) return false;
+
+	// Tiles of the last frame must finish before its camera is moved.
+	if (pool)
+	{
+		pool->wait();
+	}
+
+	sizeViewport(width, height);
+	viewport->setAntiAliasing(antiAliasingSamples, antiAliasingThreshold);
+	viewport->setReprojection(reprojection != 0, viewport->getReprojectionThreshold());
+
+	std::istringstream attributeStream(attributes);
+	viewport->clearLights();
+	viewport->readSceneAttributes(attributeStream);
+	if (attributeStream.fail())
+	{
+		std::cout << "Could not read the frame sent by the coordinator." << std::endl;
+		return false;
+	}
+	viewport->prepareTiles();
+	frameKey = key;
+	return true;
+}
+
+void RenderWorker::sizeViewport(int width, int height)
+{
+	if (viewport && viewport->getWidth() == width && viewport->getHeight() == height) return;
+
+	delete viewport;
+	delete frameBuffer;
+	frameBuffer = new FrameBuffer(width, height);
+	viewport = new Viewport(Coord(0, 0), width, height, shapes);
+	viewport->setFrameBuffer(frameBuffer);
+	shapes->setViewport(viewport);
+}
+
+void RenderWorker::renderTile(int x0, int y0, int x1, int y1)
+{
+	viewport->renderTile(x0, y0, x1, y1);
+	std::vector<float> data;
+	viewport->readTile(x0, y0, x1, y1, data);
+
+	std::string header = "DONE " + std::to_string(x0) + " " + std::to_string(y0) + " " + std::to_string(x1) + " "
+		+ std::to_string(y1) + " " + std::to_string(data.size());
+	std::unique_lock<std::mutex> lock(sendMutex);
+	if (connection->writeLine(header) && connection->write(data.data(), data.size() * sizeof(float)))
+	{
+		tilesRendered++;
+	}
+	else
+	{
+		// The coordinator is gone; the main loop finds out when it next reads.
+		connection->shutdown();
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef __RENDERWORKER_H__
+#define __RENDERWORKER_H__
+
+/* renderWorker.h
+ *
+ * The worker side of distributed rendering (see renderCluster.h). A worker connects to a coordinator, loads
+ * the scene it is sent into a scene of its own, sets the camera and lights of each frame on it, and renders
+ * the tiles it is given on its thread pool, sending each back as soon as it is finished.
+ *
+ */
+
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+class Connection;
+class FrameBuffer;
+class ShapeCollection;
+class ThreadPool;
+class Viewport;
+
+class RenderWorker
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates a worker that renders tiles on the pool (or on its own thread if the pool is null).
+		RenderWorker(ThreadPool* _pool);
+		// Disconnects, and destroys the scene.
+		~RenderWorker();
+
+		// Connects to the coordinator at "host:port". Returns false if it can't.
+		bool connect(std::string address);
+		// Renders the tiles the coordinator sends until it disconnects. Returns the number of tiles rendered.
+		int run();
+
+	private:
+		/*** Private Member Functions ***/
+		// Reads a scene from the coordinator (after its SCENE line), and loads it. Returns false if the
+		// connection is lost or the scene can't be loaded.
+		bool readScene(std::istream& s);
+		// Reads a frame from the coordinator (after its FRAME line), and sets it up on the scene. Returns false if
+		// the connection is lost or the frame is malformed.
+		bool readFrame(std::istream& s);
+		// Makes the viewport the size of the frame. The scene attributes are lost if it is replaced.
+		void sizeViewport(int width, int height);
+		// Renders a tile, and sends it to the coordinator.
+		void renderTile(int x0, int y0, int x1, int y1);
+
+		// Workers can't be copied.
+		RenderWorker(const RenderWorker&) = delete;
+		RenderWorker& operator=(const RenderWorker&) = delete;
+
+		/*** Private Member Variables ***/
+		ThreadPool* pool;
+		Connection* connection;
+		// The frame being rendered: its key, scene, the viewport it is rendered through and the pixels it is
+		// rendered into (null until the first scene or frame arrives).
+		uint64_t frameKey;
+		ShapeCollection* shapes;
+		Viewport* viewport;
+		FrameBuffer* frameBuffer;
+		// The number of tiles sent back.
+		int tilesRendered;
+		// Guards writes to the connection, which are made by each pool thread as it finishes a tile.
+		std::mutex sendMutex;
+};
+
+#endif
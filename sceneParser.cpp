@@ -0,0 +1,357 @@
+#include "sceneParser.h"
+
+#include <algorithm>
+#include <charconv>
+
+#include "implicitShape.h"
+#include "instanceShape.h"
+#include "phongLightSource.h"
+#include "shape.h"
+#include "shapeCollection.h"
+#include "surfaceShape.h"
+#include "viewport.h"
+
+// The fewest characters a point or surface can take up ("0 0 0" and a separator).
+const int MIN_ELEMENT_BYTES = 6;
+// The fewest characters a light can take up (7 numbers and separators).
+const int MIN_LIGHT_BYTES = 14;
+
+
+/*** Public Member Functions ***/
+
+SceneParser::SceneParser(const char* _begin, const char* _end)
+{
+	begin = _begin;
+	cursor = _begin;
+	end = _end;
+	error = "";
+	memoryLimit = 0;
+	memoryNeeded = 0;
+}
+
+void SceneParser::setMemoryLimit(size_t bytes)
+{
+	memoryLimit = bytes;
+}
+
+bool SceneParser::parse(ShapeCollection* shapes, Viewport* viewport)
+{
+	// Scene attributes.
+	RGB backgroundColor;
+	FCoord3D fromPoint, atPoint, upVector;
+	float viewingAngleDeg, ambientIntensity;
+	int numLights;
+	if (!readRGB(backgroundColor) ||
+		!readCoord(fromPoint) || !readCoord(atPoint) || !readCoord(upVector) ||
+		!readFloat(viewingAngleDeg) || !readFloat(ambientIntensity) ||
+		!readCount(numLights, MIN_LIGHT_BYTES))
+	{
+		return false;
+	}
+
+	std::vector<PhongLightSource> lights(numLights);
+	for (int i = 0; i < numLights; i++)
+	{
+		if (!readRGB(lights[i].color) || !readFloat(lights[i].intensity) || !readCoord(lights[i].position))
+		{
+			return false;
+		}
+	}
+
+	// Shapes.
+	int numShapes;
+	if (!readCount(numShapes, MIN_ELEMENT_BYTES)) return false;
+
+	// MESH entries are counted with the shapes, but only define meshes for the instance shapes after them.
+	std::vector<Shape*> parsed;
+	parsed.reserve(numShapes);
+	MeshMap meshes;
+	std::string shapeType;
+	for (int i = 0; i < numShapes; i++)
+	{
+		Shape* shape = nullptr;
+		if (readWord(shapeType))
+		{
+			if (shapeType == "IMPLICIT_SHAPE")
+			{
+				shape = readImplicitShape();
+			}
+			else if (shapeType == "SURFACE_SHAPE")
+			{
+				shape = readSurfaceShape();
+			}
+			else if (shapeType == "INSTANCE_SHAPE")
+			{
+				shape = readInstanceShape(meshes);
+			}
+			else if (shapeType == "MESH")
+			{
+				if (readMesh(meshes)) continue;
+			}
+			else
+			{
+				fail("unknown shape type \"" + shapeType + "\"");
+			}
+		}
+
+		if (!shape)
+		{
+			for (int j = 0; j < (int)parsed.size(); j++)
+			{
+				delete parsed[j];
+			}
+			return false;
+		}
+		parsed.push_back(shape);
+	}
+
+	// The whole scene parsed, so it can be applied.
+	viewport->setBackgroundColor(backgroundColor);
+	viewport->setFromPoint(fromPoint);
+	viewport->setAtPoint(atPoint);
+	viewport->setUpVector(upVector);
+	viewport->setViewingAngle(viewingAngleDeg);
+	viewport->setAmbientIntensity(ambientIntensity);
+	for (int i = 0; i < numLights; i++)
+	{
+		viewport->addLight(new PhongLightSource(lights[i]));
+	}
+
+	for (int i = 0; i < (int)parsed.size(); i++)
+	{
+		shapes->add(parsed[i]);
+	}
+	return true;
+}
+
+std::string SceneParser::getError()
+{
+	return error;
+}
+
+
+/*** Private Member Functions ***/
+
+/** Tokens **/
+
+bool SceneParser::skipWhitespace()
+{
+	// The same characters as isspace() in the "C" locale.
+	while (cursor < end &&
+		(*cursor == ' ' || *cursor == '\n' || *cursor == '\t' || *cursor == '\r' || *cursor == '\v' || *cursor == '\f'))
+	{
+		cursor++;
+	}
+	return cursor < end;
+}
+
+bool SceneParser::readFloat(float &f)
+{
+	if (!skipWhitespace()) return fail("unexpected end of file");
+
+	// Stream extraction accepts a leading '+', but from_chars doesn't.
+	if (*cursor == '+' && cursor + 1 < end && *(cursor + 1) != '-') cursor++;
+
+	std::from_chars_result result = std::from_chars(cursor, end, f);
+	if (result.ec != std::errc()) return fail("expected a number");
+
+	cursor = result.ptr;
+	return true;
+}
+
+bool SceneParser::readInt(int &i)
+{
+	if (!skipWhitespace()) return fail("unexpected end of file");
+
+	if (*cursor == '+' && cursor + 1 < end && *(cursor + 1) != '-') cursor++;
+
+	std::from_chars_result result = std::from_chars(cursor, end, i);
+	if (result.ec != std::errc()) return fail("expected an integer");
+
+	cursor = result.ptr;
+	return true;
+}
+
+bool SceneParser::readWord(std::string &word)
+{
+	if (!skipWhitespace()) return fail("unexpected end of file");
+
+	const char* start = cursor;
+	while (cursor < end && !(*cursor == ' ' || *cursor == '\n' || *cursor == '\t' ||
+		*cursor == '\r' || *cursor == '\v' || *cursor == '\f'))
+	{
+		cursor++;
+	}
+	word.assign(start, cursor - start);
+	return true;
+}
+
+bool SceneParser::readRGB(RGB &c)
+{
+	return readFloat(c.red) && readFloat(c.green) && readFloat(c.blue);
+}
+
+bool SceneParser::readCoord(FCoord3D &c)
+{
+	return readFloat(c.x) && readFloat(c.y) && readFloat(c.z);
+}
+
+bool SceneParser::readCount(int &n, int minBytes)
+{
+	if (!readInt(n)) return false;
+
+	// Reject counts the rest of the file couldn't possibly hold, before anything is reserved for them.
+	if (n < 0 || n > (end - cursor) / minBytes + 1)
+	{
+		return fail("invalid count " + std::to_string(n));
+	}
+	return true;
+}
+
+
+/** Shapes **/
+
+bool SceneParser::readAttributes(Shape* shape)
+{
+	RGB c;
+	float refl, refr, refractiveIndex;
+	int phongExponent;
+	if (!readRGB(c) || !readFloat(refl) || !readFloat(refr) || !readFloat(refractiveIndex) || !readInt(phongExponent))
+	{
+		return false;
+	}
+
+	shape->setColor(c);
+	shape->setRefl(refl);
+	shape->setRefr(refr);
+	shape->setRefractiveIndex(refractiveIndex);
+	shape->setPhongExponent(phongExponent);
+	return true;
+}
+
+Shape* SceneParser::readImplicitShape()
+{
+	ImplicitShape* shape = new ImplicitShape();
+	if (!readAttributes(shape))
+	{
+		delete shape;
+		return nullptr;
+	}
+
+	// Scene files hold 11 numbers, with c020 written twice (ImplicitShape::read keeps the second one).
+	float c[11];
+	for (int i = 0; i < 11; i++)
+	{
+		if (!readFloat(c[i]))
+		{
+			delete shape;
+			return nullptr;
+		}
+	}
+	shape->setCoefficients(c[0], c[2], c[3], c[4], c[5], c[6], c[7], c[8], c[9], c[10]);
+	return shape;
+}
+
+Shape* SceneParser::readSurfaceShape()
+{
+	SurfaceShape* shape = new SurfaceShape();
+	if (!readAttributes(shape) || !readGeometry(shape))
+	{
+		delete shape;
+		return nullptr;
+	}
+	return shape;
+}
+
+Shape* SceneParser::readInstanceShape(MeshMap &meshes)
+{
+	InstanceShape* shape = new InstanceShape();
+	std::string meshName;
+	if (!readAttributes(shape) || !readWord(meshName))
+	{
+		delete shape;
+		return nullptr;
+	}
+
+	auto found = meshes.find(meshName);
+	if (found == meshes.end())
+	{
+		fail("unknown mesh \"" + meshName + "\"");
+		delete shape;
+		return nullptr;
+	}
+
+	Transform transform;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			if (!readFloat(transform.m[i][j]))
+			{
+				delete shape;
+				return nullptr;
+			}
+		}
+	}
+	if (!transform.isInvertible())
+	{
+		fail("the transformation of an instance of \"" + meshName + "\" can't be inverted");
+		delete shape;
+		return nullptr;
+	}
+
+	shape->setMesh(found->second, meshName);
+	shape->setTransform(transform);
+	return shape;
+}
+
+bool SceneParser::readMesh(MeshMap &meshes)
+{
+	std::string name;
+	if (!readWord(name)) return false;
+	if (meshes.count(name) > 0) return fail("mesh \"" + name + "\" is defined twice");
+
+	std::shared_ptr<SurfaceShape> mesh = std::make_shared<SurfaceShape>();
+	if (!readGeometry(mesh.get())) return false;
+
+	meshes[name] = mesh;
+	return true;
+}
+
+bool SceneParser::readGeometry(SurfaceShape* shape)
+{
+	int n;
+	FCoord3D p;
+	if (!readCount(n, MIN_ELEMENT_BYTES) || !needMemory(n, 0)) return false;
+	shape->reserve(n, 0);
+	for (int i = 0; i < n; i++)
+	{
+		if (!readCoord(p)) return false;
+		shape->addPoint(p);
+	}
+
+	int a, b, c;
+	if (!readCount(n, MIN_ELEMENT_BYTES) || !needMemory(0, n)) return false;
+	shape->reserve(shape->numPoints(), n);
+	for (int i = 0; i < n; i++)
+	{
+		if (!readInt(a) || !readInt(b) || !readInt(c)) return false;
+		shape->addSurfaceByIndices(a, b, c);
+	}
+	return true;
+}
+
+bool SceneParser::needMemory(int numPoints, int numSurfaces)
+{
+	memoryNeeded += SurfaceShape::estimateBytes(numPoints, numSurfaces);
+	if (memoryLimit == 0 || memoryNeeded <= memoryLimit) return true;
+	return fail("the scene needs more than the " + std::to_string(memoryLimit / (1024 * 1024)) +
+		" MB of memory it may use");
+}
+
+bool SceneParser::fail(std::string message)
+{
+	int line = 1 + std::count(begin, cursor, '\n');
+	error = message + " on line " + std::to_string(line);
+	return false;
+}
@@ -0,0 +1,85 @@
+#ifndef __SCENEPARSER_H__
+#define __SCENEPARSER_H__
+
+/* sceneParser.h
+ *
+ * A fast parser for the .data text scene format. It works directly on a block of memory (usually a
+ * memory-mapped file), converting numbers with std::from_chars rather than stream extraction, and
+ * reserves each surface shape's arrays from the point and surface counts that precede them.
+ *
+ * The accepted format is exactly the one read by ShapeCollection::read.
+ *
+ */
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "misc.h"
+
+class Shape;
+class ShapeCollection;
+class SurfaceShape;
+class Viewport;
+
+class SceneParser
+{
+	public:
+		/*** Public Member Functions ***/
+		// Parses the characters from begin up to (not including) end.
+		SceneParser(const char* _begin, const char* _end);
+
+		// Sets the most bytes the parsed shapes may need once prepared (0 for no limit, the default). The point
+		// and surface counts are checked against it before the points and surfaces are read, so parsing stops as
+		// soon as the scene is known not to fit.
+		void setMemoryLimit(size_t bytes);
+		// Parses the whole scene. The scene attributes and lights are set on the viewport, and the shapes are
+		// added to the collection. If the text is malformed nothing is changed and false is returned.
+		bool parse(ShapeCollection* shapes, Viewport* viewport);
+		// Returns a description of why parse() failed.
+		std::string getError();
+
+	private:
+		// The meshes defined so far, by name.
+		typedef std::map<std::string, std::shared_ptr<SurfaceShape> > MeshMap;
+
+		/*** Private Member Functions ***/
+		/** Tokens **/
+		// Skips whitespace, returning false if the end of the text was reached.
+		bool skipWhitespace();
+		// Read the next token. Return false (and set the error) if it is missing or malformed.
+		bool readFloat(float &f);
+		bool readInt(int &i);
+		bool readWord(std::string &word);
+		bool readRGB(RGB &c);
+		bool readCoord(FCoord3D &c);
+		// Reads a count that precedes a list of elements that each take at least minBytes characters.
+		bool readCount(int &n, int minBytes);
+
+		/** Shapes **/
+		bool readAttributes(Shape* shape);
+		Shape* readImplicitShape();
+		Shape* readSurfaceShape();
+		Shape* readInstanceShape(MeshMap &meshes);
+		// Reads a MESH entry into meshes. Returns false if it is malformed or the name is already defined.
+		bool readMesh(MeshMap &meshes);
+		// Reads the points and surfaces of a surface shape or mesh.
+		bool readGeometry(SurfaceShape* shape);
+		// Adds the estimated bytes of that many points and surfaces to the total, failing if it passes the limit.
+		bool needMemory(int numPoints, int numSurfaces);
+
+		// Records the error, with the line the parser stopped on.
+		bool fail(std::string message);
+
+		/*** Private Member Variables ***/
+		const char* begin;
+		const char* cursor;
+		const char* end;
+		std::string error;
+		// The memory limit, and the estimated bytes of the shapes read so far.
+		size_t memoryLimit;
+		size_t memoryNeeded;
+};
+
+#endif
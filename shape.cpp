@@ -3,6 +3,7 @@
 #include <math.h>
 
 #include "implicitShape.h"
+#include "instanceShape.h"
 #include "surfaceShape.h"
 
 
@@ -45,6 +46,21 @@ void Shape::writeAttributes(std::ostream& s)
 	s << getPhongExponent() << std::endl;
 }
 
+bool Shape::prepare()
+{
+	return false;
+}
+
+bool Shape::getBounds(FCoord3D &min, FCoord3D &max)
+{
+	return false;
+}
+
+size_t Shape::memoryBytes()
+{
+	return sizeof(Shape);
+}
+
 RGB Shape::getColor()
 {
 	return color;
@@ -100,37 +116,42 @@ void Shape::setPhongExponent(int i)
 
 Shape* Shape::createCube(FCoord3D origin, float sideLen, RGB color, float refl, float refr, float refrIndex, int phongE)
 {
-	float halfSide = sideLen / 2.0;
-	
-	SurfaceShape* shape = new SurfaceShape();
-	shape->addPoint(origin.x - halfSide, origin.y - halfSide, origin.z - halfSide);
-	shape->addPoint(origin.x - halfSide, origin.y + halfSide, origin.z - halfSide);
-	shape->addPoint(origin.x + halfSide, origin.y - halfSide, origin.z - halfSide);
-	shape->addPoint(origin.x + halfSide, origin.y + halfSide, origin.z - halfSide);
-	
-	shape->addPoint(origin.x - halfSide, origin.y - halfSide, origin.z + halfSide);
-	shape->addPoint(origin.x - halfSide, origin.y + halfSide, origin.z + halfSide);
-	shape->addPoint(origin.x + halfSide, origin.y - halfSide, origin.z + halfSide);
-	shape->addPoint(origin.x + halfSide, origin.y + halfSide, origin.z + halfSide);
-	
-	shape->addSurfaceByIndices(1, 3, 2);
-	shape->addSurfaceByIndices(3, 4, 2);
-	
-	shape->addSurfaceByIndices(5, 6, 8);
-	shape->addSurfaceByIndices(8, 7, 5);
-	
-	shape->addSurfaceByIndices(1, 5, 3);
-	shape->addSurfaceByIndices(5, 7, 3);
-	
-	shape->addSurfaceByIndices(4, 6, 2);
-	shape->addSurfaceByIndices(4, 8, 6);
-	
-	shape->addSurfaceByIndices(2, 6, 1);
-	shape->addSurfaceByIndices(5, 1, 6);
-	
-	shape->addSurfaceByIndices(4, 3, 8);
-	shape->addSurfaceByIndices(3, 7, 8);
+	// The unit cube is built the first time it is needed, and shared from then on.
+	static std::shared_ptr<SurfaceShape> unitCube;
+	if (!unitCube)
+	{
+		unitCube = std::make_shared<SurfaceShape>();
+		unitCube->addPoint(-0.5, -0.5, -0.5);
+		unitCube->addPoint(-0.5, 0.5, -0.5);
+		unitCube->addPoint(0.5, -0.5, -0.5);
+		unitCube->addPoint(0.5, 0.5, -0.5);
+		
+		unitCube->addPoint(-0.5, -0.5, 0.5);
+		unitCube->addPoint(-0.5, 0.5, 0.5);
+		unitCube->addPoint(0.5, -0.5, 0.5);
+		unitCube->addPoint(0.5, 0.5, 0.5);
+		
+		unitCube->addSurfaceByIndices(1, 3, 2);
+		unitCube->addSurfaceByIndices(3, 4, 2);
+		
+		unitCube->addSurfaceByIndices(5, 6, 8);
+		unitCube->addSurfaceByIndices(8, 7, 5);
+		
+		unitCube->addSurfaceByIndices(1, 5, 3);
+		unitCube->addSurfaceByIndices(5, 7, 3);
+		
+		unitCube->addSurfaceByIndices(4, 6, 2);
+		unitCube->addSurfaceByIndices(4, 8, 6);
+		
+		unitCube->addSurfaceByIndices(2, 6, 1);
+		unitCube->addSurfaceByIndices(5, 1, 6);
+		
+		unitCube->addSurfaceByIndices(4, 3, 8);
+		unitCube->addSurfaceByIndices(3, 7, 8);
+	}
 	
+	Transform transform = Transform::translation(origin).multiply(Transform::scaling(sideLen, sideLen, sideLen));
+	InstanceShape* shape = new InstanceShape(unitCube, UNIT_CUBE_MESH_NAME, transform);
 	shape->setColor(color);
 	shape->setRefl(refl);
 	shape->setRefr(refr);
@@ -34,6 +34,15 @@ class Shape
 		//
 		virtual void readAttributes(std::istream& s);
 		virtual void writeAttributes(std::ostream& s);
+		// Builds anything that speeds up intersection tests. Called before rendering, from a single thread.
+		// Returns true if anything was built.
+		virtual bool prepare();
+		// Returns the corners of an axis-aligned box that contains the shape.
+		// Returns false if the shape is unbounded (or its bounds aren't known).
+		virtual bool getBounds(FCoord3D &min, FCoord3D &max);
+		// Returns the bytes of memory the shape owns. Memory shared with other shapes (such as the mesh of an
+		// instance), mapped from a file, or held by a bounding volume hierarchy is left out.
+		virtual size_t memoryBytes();
 		
 		// Material property setters and getters.
 		virtual RGB getColor();
@@ -49,6 +58,7 @@ class Shape
 		
 		/** Static **/
 		// Returns a cube of the specified dimensions and material properties.
+		// Every cube is an instance of the same unit cube mesh.
 		static Shape* createCube(FCoord3D origin, float sideLen, RGB color, float refl, float refr, float refrIndex, int phongE);
 		// Returns a sphere of the specified dimensions and material properties.
 		static Shape* createSphere(FCoord3D origin, float radius, RGB color, float refl, float refr, float refrIndex, int phongE);
@@ -1,18 +1,140 @@
 #include "shapeCollection.h"
 
+#include <filesystem>
 #include <fstream>
+#include <limits>
+#include <set>
+#include <sstream>
 
+#include "binaryScene.h"
+#include "bvh.h"
+#include "bvhCache.h"
 #include "implicitShape.h"
+#include "instanceShape.h"
+#include "mappedFile.h"
+#include "meshImport.h"
+#include "phongLightSource.h"
+#include "sceneParser.h"
 #include "shape.h"
 #include "surfaceShape.h"
+#include "threadPool.h"
+
+SceneChanges::SceneChanges()
+{
+	shapesAdded = 0;
+	shapesRemoved = 0;
+	unbounded = false;
+	lightsChanged = false;
+	attributesChanged = false;
+}
+
+bool SceneChanges::isEmpty() const
+{
+	return shapesAdded == 0 && shapesRemoved == 0 && !lightsChanged && !attributesChanged;
+}
+
+bool SceneChanges::affectsEverything() const
+{
+	return unbounded || lightsChanged || attributesChanged;
+}
+
+SceneSnapshot::SceneSnapshot()
+{
+	cameraOnly = false;
+	ambientIntensity = 0.0;
+}
+
+
+/*** Helper Functions ***/
+
+// Returns text that is the same for two shapes exactly when they are the same. Surface shapes (and the meshes of
+// instance shapes) are represented by the hash of their geometry, so that large meshes aren't written out.
+static std::string shapeSignature(Shape* shape)
+{
+	std::ostringstream s;
+	s.precision(std::numeric_limits<float>::max_digits10);
+	
+	SurfaceShape* surface = dynamic_cast<SurfaceShape*>(shape);
+	InstanceShape* instance = dynamic_cast<InstanceShape*>(shape);
+	if (surface)
+	{
+		s << "SURFACE_SHAPE" << std::endl;
+		surface->writeAttributes(s);
+		s << surface->geometryHash() << std::endl;
+	}
+	else
+	{
+		shape->write(s);
+		if (instance && instance->getMesh())
+		{
+			s << instance->getMesh()->geometryHash() << std::endl;
+		}
+	}
+	return s.str();
+}
+
+// Returns the camera of the viewport, its other scene attributes (the background and ambient light), or its lights,
+// as text.
+static std::string cameraText(Viewport* viewport)
+{
+	std::ostringstream s;
+	s.precision(std::numeric_limits<float>::max_digits10);
+	viewport->getCamera().write(s);
+	return s.str();
+}
+
+static std::string attributeText(Viewport* viewport)
+{
+	std::ostringstream s;
+	s.precision(std::numeric_limits<float>::max_digits10);
+	viewport->getBackgroundColor().write(s);
+	s << viewport->getAmbientIntensity() << std::endl;
+	return s.str();
+}
+
+static std::string lightText(Viewport* viewport)
+{
+	std::ostringstream s;
+	s.precision(std::numeric_limits<float>::max_digits10);
+	for (int i = 0; i < viewport->numLights(); i++)
+	{
+		viewport->getLight(i)->write(s);
+	}
+	return s.str();
+}
 
 
 /*** Public Member Functions ***/
 
 ShapeCollection::ShapeCollection()
 {
-	shapes = new std::vector<Shape*>();
+	shapes = new std::vector<std::shared_ptr<Shape> >();
 	viewport = nullptr;
+	bvhCacheFileName = "";
+	mappedFiles = std::make_shared<MappedFiles>();
+	meshes = new std::map<std::string, std::shared_ptr<SurfaceShape> >();
+	shapeBVH = new BVH();
+	boundedShapes = new std::vector<int>();
+	unboundedShapes = new std::vector<int>();
+	shapeBVHValid = false;
+	replication = false;
+	replicas = new std::vector<ShapeCollection*>();
+	replicaViewports = new std::vector<Viewport*>();
+	replicaKey = 0;
+	undoStates = new std::vector<SceneSnapshot>();
+}
+
+ShapeCollection::~ShapeCollection()
+{
+	delete undoStates;
+	delete shapes;
+	delete meshes;
+	delete shapeBVH;
+	delete boundedShapes;
+	delete unboundedShapes;
+	clearReplicas();
+	delete replicas;
+	delete replicaViewports;
 }
 
 void ShapeCollection::setViewport(Viewport* _viewport)
@@ -20,21 +142,38 @@ void ShapeCollection::setViewport(Viewport* _viewport)
 	viewport = _viewport;
 }
 
+void ShapeCollection::setMappedFiles(std::shared_ptr<MappedFiles> _mappedFiles)
+{
+	mappedFiles = _mappedFiles;
+}
+
+std::shared_ptr<MappedFiles> ShapeCollection::getMappedFiles()
+{
+	return mappedFiles;
+}
+
 void ShapeCollection::add(Shape* shape)
 {
-	shapes->push_back(shape);
+	InstanceShape* instance = dynamic_cast<InstanceShape*>(shape);
+	if (instance)
+	{
+		addMesh(instance);
+	}
+	shapes->push_back(std::shared_ptr<Shape>(shape));
+	shapeBVHValid = false;
 }
 
 Shape* ShapeCollection::get(int index)
 {
 	if (index < 0 || index >= numShapes()) return nullptr;
-	return shapes->at(index);
+	return shapes->at(index).get();
 }
 
 void ShapeCollection::remove(int index)
 {
 	if (index < 0 || index >= numShapes()) return;
 	shapes->erase(shapes->begin() + index);
+	shapeBVHValid = false;
 }
 
 int ShapeCollection::numShapes()
@@ -42,6 +181,96 @@ int ShapeCollection::numShapes()
 	return shapes->size();
 }
 
+void ShapeCollection::clear()
+{
+	shapes->clear();
+	meshes->clear();
+	shapeBVHValid = false;
+	
+	if (viewport)
+	{
+		viewport->clearLights();
+	}
+}
+
+std::shared_ptr<SurfaceShape> ShapeCollection::getMesh(std::string name)
+{
+	auto found = meshes->find(name);
+	return (found == meshes->end()) ? nullptr : found->second;
+}
+
+void ShapeCollection::prepare()
+{
+	std::unique_lock<std::mutex> lock(prepareMutex);
+	std::vector<SurfaceShape*> surfaces = surfaceShapes();
+	
+	// Hierarchies that were built for the same geometry before are mapped from the cache.
+	double startMs = nowMs();
+	if (bvhCacheFileName != "")
+	{
+		int loaded = loadBVHCache(bvhCacheFileName, surfaces, mappedFiles);
+		if (loaded > 0)
+		{
+			std::cout << "Mapped bounding volume hierarchies for " << loaded << " shapes from \""
+				<< bvhCacheFileName << "\" in " << (nowMs() - startMs) << " ms." << std::endl;
+		}
+	}
+	
+	startMs = nowMs();
+	int prepared = 0;
+	bool cacheable = false;
+	for (int i = 0; i < (int)surfaces.size(); i++)
+	{
+		if (surfaces[i]->prepare())
+		{
+			prepared++;
+			cacheable = cacheable || surfaces[i]->numSurfaces() >= BVH_CACHE_MIN_SURFACES;
+		}
+	}
+	// Instances share the hierarchies of their meshes, so they only report whether they have moved.
+	bool moved = false;
+	for (int i = 0; i < numShapes(); i++)
+	{
+		if (!dynamic_cast<SurfaceShape*>(get(i)) && get(i)->prepare())
+		{
+			moved = true;
+		}
+	}
+	
+	// A shape whose hierarchy was rebuilt may have changed its bounds.
+	if (prepared > 0 || moved || !shapeBVHValid)
+	{
+		std::vector<AABB> boxes;
+		boundedShapes->clear();
+		unboundedShapes->clear();
+		for (int i = 0; i < numShapes(); i++)
+		{
+			AABB box;
+			if (get(i)->getBounds(box.min, box.max))
+			{
+				boxes.push_back(box);
+				boundedShapes->push_back(i);
+			}
+			else
+			{
+				unboundedShapes->push_back(i);
+			}
+		}
+		shapeBVH->build(boxes);
+		shapeBVHValid = true;
+	}
+	
+	if (prepared > 0)
+	{
+		std::cout << "Built bounding volume hierarchies for " << prepared << " shapes in "
+			<< (nowMs() - startMs) << " ms." << std::endl;
+	}
+	if (cacheable && bvhCacheFileName != "" && saveBVHCache(bvhCacheFileName, surfaces))
+	{
+		std::cout << "Saved bounding volume hierarchies to \"" << bvhCacheFileName << "\"." << std::endl;
+	}
+}
+
 bool ShapeCollection::rayIntersects(FCoord3D p0, FCoord3D d, float &t, FCoord3D &normal, int &shapeIndex)
 {
 	float bestT = 0.0;
@@ -53,25 +282,46 @@ bool ShapeCollection::rayIntersects(FCoord3D p0, FCoord3D d, float &t, FCoord3D
 	
 	bool intersected = false;
 	
-	for (int i = 0; i < numShapes(); i++)
+	// Keeps the nearest hit. Of hits at the same t, the first shape's is kept.
+	auto consider = [&](int i, float currT, FCoord3D currNormal)
 	{
-		if(get(i)->rayIntersects(p0, d, currT, currNormal))
+		if (!intersected || currT < bestT || (currT == bestT && i < bestShape))
+		{
+			intersected = true;
+			bestT = currT;
+			bestNormal = currNormal;
+			bestShape = i;
+		}
+	};
+	
+	if (shapeBVHValid)
+	{
+		// Hits are kept by the same rule in any order, so the result matches testing every shape.
+		float hitT;
+		int hitIndex;
+		shapeBVH->closestHit(p0, d, hitT, hitIndex, [&](int k, float &primT)
+		{
+			int i = boundedShapes->at(k);
+			if (!get(i)->rayIntersects(p0, d, primT, currNormal)) return false;
+			consider(i, primT, currNormal);
+			return true;
+		});
+		for (int k = 0; k < (int)unboundedShapes->size(); k++)
 		{
-			if (intersected)
+			int i = unboundedShapes->at(k);
+			if (get(i)->rayIntersects(p0, d, currT, currNormal))
 			{
-				if (currT < bestT)
-				{
-					bestT = currT;
-					bestNormal = currNormal;
-					bestShape = i;
-				}
+				consider(i, currT, currNormal);
 			}
-			else
+		}
+	}
+	else
+	{
+		for (int i = 0; i < numShapes(); i++)
+		{
+			if (get(i)->rayIntersects(p0, d, currT, currNormal))
 			{
-				intersected = true;
-				bestT = currT;
-				bestNormal = currNormal;
-				bestShape = i;
+				consider(i, currT, currNormal);
 			}
 		}
 	}
@@ -87,6 +337,19 @@ bool ShapeCollection::rayIntersects(FCoord3D p0, FCoord3D d, float &t, FCoord3D
 
 bool ShapeCollection::lineSegmentIntersects(FCoord3D p0, FCoord3D p1)
 {
+	if (shapeBVHValid)
+	{
+		bool hit = shapeBVH->anyHit(p0, p1, [&](int k)
+		{
+			return get(boundedShapes->at(k))->lineSegmentIntersects(p0, p1);
+		});
+		for (int k = 0; k < (int)unboundedShapes->size() && !hit; k++)
+		{
+			hit = get(unboundedShapes->at(k))->lineSegmentIntersects(p0, p1);
+		}
+		return hit;
+	}
+	
 	for (int i = 0; i < numShapes(); i++)
 	{
 		if (get(i)->lineSegmentIntersects(p0, p1))
@@ -97,22 +360,419 @@ bool ShapeCollection::lineSegmentIntersects(FCoord3D p0, FCoord3D p1)
 	return false;
 }
 
+void ShapeCollection::addMemoryUsage(MemoryUsage &usage)
+{
+	usage.shapes += shapes->capacity() * sizeof(std::shared_ptr<Shape>);
+	for (int i = 0; i < numShapes(); i++)
+	{
+		usage.shapes += get(i)->memoryBytes();
+		SurfaceShape* surface = dynamic_cast<SurfaceShape*>(get(i));
+		if (surface)
+		{
+			usage.hierarchies += surface->getBVH()->memoryBytes();
+		}
+	}
+	
+	std::vector<InstanceShape*> instances = firstInstances();
+	for (int i = 0; i < (int)instances.size(); i++)
+	{
+		usage.meshes += instances[i]->getMesh()->memoryBytes();
+		usage.hierarchies += instances[i]->getMesh()->getBVH()->memoryBytes();
+	}
+	usage.hierarchies += shapeBVH->memoryBytes()
+		+ (boundedShapes->capacity() + unboundedShapes->capacity()) * sizeof(int);
+	
+	// Shapes and meshes the scene no longer uses are kept alive by the undo states that hold them.
+	std::set<Shape*> counted;
+	for (int i = 0; i < numShapes(); i++)
+	{
+		counted.insert(get(i));
+	}
+	for (auto i = meshes->begin(); i != meshes->end(); i++)
+	{
+		counted.insert(i->second.get());
+	}
+	usage.undo += undoStates->capacity() * sizeof(SceneSnapshot);
+	for (int k = 0; k < (int)undoStates->size(); k++)
+	{
+		const SceneSnapshot &state = undoStates->at(k);
+		usage.undo += state.shapes.capacity() * sizeof(std::shared_ptr<Shape>);
+		std::vector<Shape*> held;
+		for (int i = 0; i < (int)state.shapes.size(); i++)
+		{
+			held.push_back(state.shapes[i].get());
+		}
+		for (auto i = state.meshes.begin(); i != state.meshes.end(); i++)
+		{
+			held.push_back(i->second.get());
+		}
+		for (int i = 0; i < (int)held.size(); i++)
+		{
+			if (!counted.insert(held[i]).second) continue;
+			usage.undo += held[i]->memoryBytes();
+			SurfaceShape* surface = dynamic_cast<SurfaceShape*>(held[i]);
+			if (surface)
+			{
+				usage.undo += surface->getBVH()->memoryBytes();
+			}
+		}
+	}
+	
+	std::unique_lock<std::mutex> lock(replicaMutex);
+	for (int k = 0; k < (int)replicas->size(); k++)
+	{
+		MemoryUsage replica;
+		replicas->at(k)->addMemoryUsage(replica);
+		usage.replicas += replica.total();
+	}
+}
+
+uint64_t ShapeCollection::shapesHash()
+{
+	// The geometry hashes are kept by the shapes, so viewports that render the collection at once take turns.
+	std::unique_lock<std::mutex> lock(prepareMutex);
+	uint64_t hash = hashBytes(nullptr, 0);
+	for (int i = 0; i < numShapes(); i++)
+	{
+		std::string signature = shapeSignature(get(i));
+		hash = hashBytes(signature.data(), signature.size(), hash);
+	}
+	return hash;
+}
+
+
+/** Undo **/
+SceneSnapshot ShapeCollection::snapshot(bool cameraOnly)
+{
+	SceneSnapshot state;
+	state.cameraOnly = cameraOnly;
+	state.camera = viewport->getCamera();
+	if (cameraOnly) return state;
+	
+	state.backgroundColor = viewport->getBackgroundColor();
+	state.ambientIntensity = viewport->getAmbientIntensity();
+	for (int i = 0; i < viewport->numLights(); i++)
+	{
+		state.lights.push_back(*viewport->getLight(i));
+	}
+	state.shapes = *shapes;
+	state.meshes = *meshes;
+	state.bvhCacheFileName = bvhCacheFileName;
+	state.fileCameraText = fileCameraText;
+	return state;
+}
+
+void ShapeCollection::restore(const SceneSnapshot &state)
+{
+	viewport->setCamera(state.camera);
+	if (state.cameraOnly) return;
+	
+	viewport->setBackgroundColor(state.backgroundColor);
+	viewport->setAmbientIntensity(state.ambientIntensity);
+	viewport->clearLights();
+	for (int i = 0; i < (int)state.lights.size(); i++)
+	{
+		viewport->addLight(new PhongLightSource(state.lights.at(i)));
+	}
+	*shapes = state.shapes;
+	*meshes = state.meshes;
+	bvhCacheFileName = state.bvhCacheFileName;
+	fileCameraText = state.fileCameraText;
+	shapeBVHValid = false;
+}
+
+void ShapeCollection::pushUndoState(const SceneSnapshot &state)
+{
+	undoStates->push_back(state);
+	if ((int)undoStates->size() > MAX_UNDO_STATES)
+	{
+		undoStates->erase(undoStates->begin());
+	}
+}
+
+bool ShapeCollection::undo()
+{
+	if (undoStates->empty()) return false;
+	
+	restore(undoStates->back());
+	undoStates->pop_back();
+	return true;
+}
+
+
+/** Replication **/
+void ShapeCollection::setReplication(bool _replication)
+{
+	replication = _replication;
+}
+
+bool ShapeCollection::getReplication()
+{
+	return replication;
+}
+
+void ShapeCollection::prepareReplicas(ThreadPool* pool)
+{
+	std::unique_lock<std::mutex> lock(replicaMutex);
+	int numNodes = pool ? pool->numNodes() : 0;
+	if (!replication || numNodes == 0)
+	{
+		clearReplicas();
+		return;
+	}
+	
+	// Only the shapes are compared (the lights and the rest of the scene live in the viewport).
+	uint64_t key = shapesHash();
+	if ((int)replicas->size() == numNodes && key == replicaKey) return;
+	
+	clearReplicas();
+	double startMs = nowMs();
+	std::string scene = serialize();
+	replicas->assign(numNodes, nullptr);
+	replicaViewports->assign(numNodes, nullptr);
+	TaskGroup tasks(pool);
+	for (int node = 0; node < numNodes; node++)
+	{
+		tasks.enqueue([this, node, &scene]()
+		{
+			ShapeCollection* replica = new ShapeCollection();
+			Viewport* replicaViewport = new Viewport(Coord(0, 0), 1, 1, replica);
+			replica->setViewport(replicaViewport);
+			replica->deserialize(scene);
+			replica->prepare();
+			replicas->at(node) = replica;
+			replicaViewports->at(node) = replicaViewport;
+		}, node);
+	}
+	tasks.wait();
+	replicaKey = key;
+	std::cout << "Copied the scene to " << numNodes << " NUMA nodes in " << (nowMs() - startMs) << " ms."
+		<< std::endl;
+}
+
+ShapeCollection* ShapeCollection::getReplica(int node)
+{
+	if (node < 0 || node >= (int)replicas->size()) return this;
+	return replicas->at(node);
+}
+
 
 /** File I/O **/
-bool ShapeCollection::loadFromFile(std::string fileName)
+bool ShapeCollection::loadFromFile(std::string fileName, size_t memoryLimit)
+{
+	if (isBinarySceneFile(fileName))
+	{
+		double startMs = nowMs();
+		int firstShape = numShapes();
+		if (!loadBinaryScene(fileName, this, viewport)) return false;
+		
+		long long vertices = 0, triangles = 0;
+		std::set<SurfaceShape*> meshesCounted;
+		for (int i = firstShape; i < numShapes(); i++)
+		{
+			SurfaceShape* surface = dynamic_cast<SurfaceShape*>(get(i));
+			InstanceShape* instance = dynamic_cast<InstanceShape*>(get(i));
+			if (instance && meshesCounted.insert(instance->getMesh().get()).second)
+			{
+				surface = instance->getMesh().get();
+			}
+			if (surface)
+			{
+				vertices += surface->numPoints();
+				triangles += surface->numSurfaces();
+			}
+		}
+		std::cout << "Mapped binary scene: " << (numShapes() - firstShape) << " shapes, "
+			<< vertices << " vertices, " << triangles << " triangles in "
+			<< (nowMs() - startMs) << " ms." << std::endl;
+		bvhCacheFileName = fileName + BVH_CACHE_EXTENSION;
+		fileCameraText = cameraText(viewport);
+		return true;
+	}
+	
+	if (isMeshFile(fileName))
+	{
+		double startMs = nowMs();
+		if (!importMesh(fileName, this, memoryLimit)) return false;
+		
+		double ms = nowMs() - startMs;
+		SurfaceShape* mesh = (SurfaceShape*)get(numShapes() - 1);
+		std::cout << "Imported mesh: " << mesh->numPoints() << " vertices, "
+			<< mesh->numSurfaces() << " triangles in " << ms << " ms";
+		if (ms > 0.0)
+		{
+			std::cout << " (" << (std::filesystem::file_size(fileName) / (1024.0 * 1024.0)) / (ms / 1000.0) << " MB/s)";
+		}
+		std::cout << "." << std::endl;
+		bvhCacheFileName = fileName + BVH_CACHE_EXTENSION;
+		return true;
+	}
+	
+	MappedFile file(fileName, mappedFiles);
+	if (!file.isOpen()) return false;
+	
+	double startMs = nowMs();
+	SceneParser parser(file.data(), file.data() + file.size());
+	parser.setMemoryLimit(memoryLimit);
+	if (!parser.parse(this, viewport))
+	{
+		std::cout << "Could not parse \"" << fileName << "\": " << parser.getError() << "." << std::endl;
+		return false;
+	}
+	
+	double ms = nowMs() - startMs;
+	std::cout << "Parsed " << file.size() << " bytes in " << ms << " ms";
+	if (ms > 0.0)
+	{
+		std::cout << " (" << (file.size() / (1024.0 * 1024.0)) / (ms / 1000.0) << " MB/s)";
+	}
+	std::cout << "." << std::endl;
+	bvhCacheFileName = fileName + BVH_CACHE_EXTENSION;
+	fileCameraText = cameraText(viewport);
+	return true;
+}
+
+bool ShapeCollection::saveToFile(std::string fileName)
 {
-	std::ifstream file(fileName.c_str());
+	if (hasBinarySceneExtension(fileName))
+	{
+		return saveBinaryScene(fileName, this, viewport);
+	}
+	
+	std::ofstream file(fileName.c_str());
 	if (!file.is_open()) return false;
 	
-	readSceneAttributes(file);
+	write(file);
+	
+	file.close();
+	return true;
+}
+
+bool ShapeCollection::convertFile(std::string inFileName, std::string outFileName)
+{
+	// The scene attributes live in the viewport, so a scratch one is needed to carry them across.
+	ShapeCollection* scene = new ShapeCollection();
+	Viewport* sceneViewport = new Viewport(Coord(0, 0), 1, 1, scene);
+	scene->setViewport(sceneViewport);
+	
+	bool success = scene->loadFromFile(inFileName) && scene->saveToFile(outFileName);
+	
+	delete scene;
+	delete sceneViewport;
+	return success;
+}
+
+bool ShapeCollection::update(std::string fileName, SceneChanges &changes, size_t memoryLimit)
+{
+	changes = SceneChanges();
+	
+	ShapeCollection* scene = new ShapeCollection();
+	Viewport* sceneViewport = new Viewport(Coord(0, 0), 1, 1, scene);
+	scene->setViewport(sceneViewport);
+	if (!scene->loadFromFile(fileName, memoryLimit))
+	{
+		delete scene;
+		delete sceneViewport;
+		return false;
+	}
+	
+	// The camera may have been moved since the file was loaded, and is only replaced if the file's own changed.
+	std::string fileCamera = cameraText(sceneViewport);
+	if (fileCamera != fileCameraText)
+	{
+		if (cameraText(viewport) != fileCamera)
+		{
+			changes.attributesChanged = true;
+			viewport->setCamera(sceneViewport->getCamera());
+		}
+		fileCameraText = fileCamera;
+	}
+	if (attributeText(viewport) != attributeText(sceneViewport))
+	{
+		changes.attributesChanged = true;
+		viewport->setBackgroundColor(sceneViewport->getBackgroundColor());
+		viewport->setAmbientIntensity(sceneViewport->getAmbientIntensity());
+	}
+	if (lightText(viewport) != lightText(sceneViewport))
+	{
+		changes.lightsChanged = true;
+		viewport->clearLights();
+		for (int i = 0; i < sceneViewport->numLights(); i++)
+		{
+			viewport->addLight(new PhongLightSource(*sceneViewport->getLight(i)));
+		}
+	}
+	
+	// Shapes are matched by their contents rather than their position, so inserting a shape only adds that shape.
+	std::map<std::string, std::vector<int> > unmatched;
+	for (int i = numShapes() - 1; i >= 0; i--)
+	{
+		unmatched[shapeSignature(get(i))].push_back(i);
+	}
+	
+	std::vector<std::shared_ptr<Shape> > updated;
+	for (int i = 0; i < scene->numShapes(); i++)
+	{
+		Shape* shape = scene->get(i);
+		auto found = unmatched.find(shapeSignature(shape));
+		if (found != unmatched.end() && !found->second.empty())
+		{
+			updated.push_back(shapes->at(found->second.back()));
+			found->second.pop_back();
+			continue;
+		}
+		
+		AABB box;
+		if (shape->getBounds(box.min, box.max)) changes.bounds.push_back(box);
+		else changes.unbounded = true;
+		changes.shapesAdded++;
+		updated.push_back(scene->shapes->at(i));
+	}
+	
+	for (auto it = unmatched.begin(); it != unmatched.end(); it++)
+	{
+		for (int i = 0; i < (int)it->second.size(); i++)
+		{
+			Shape* shape = get(it->second[i]);
+			AABB box;
+			if (shape->getBounds(box.min, box.max)) changes.bounds.push_back(box);
+			else changes.unbounded = true;
+			changes.shapesRemoved++;
+		}
+	}
+	
+	// The collection now holds the shapes, in the order of the file. Meshes are registered again in that order,
+	// so instances that were added share the meshes of those that were kept.
+	*shapes = updated;
+	scene->shapes->clear();
+	meshes->clear();
+	for (int i = 0; i < numShapes(); i++)
+	{
+		InstanceShape* instance = dynamic_cast<InstanceShape*>(get(i));
+		if (instance) addMesh(instance);
+	}
+	shapeBVHValid = false;
+	bvhCacheFileName = fileName + BVH_CACHE_EXTENSION;
+	
+	delete scene;
+	delete sceneViewport;
+	return true;
+}
+
+bool ShapeCollection::read(std::istream& s)
+{
+	readSceneAttributes(s);
 	
 	int n = 0;
-	file >> n;
+	s >> n;
+	
+	// Meshes are listed before the instance shapes that use them.
+	std::map<std::string, std::shared_ptr<SurfaceShape> > meshesRead;
 	
 	std::string shapeType;
 	for (int i = 0; i < n; i++)
 	{
-		file >> shapeType;
+		s >> shapeType;
 		
 		Shape* shape;
 		if (shapeType.compare("IMPLICIT_SHAPE") == 0)
@@ -123,44 +783,166 @@ bool ShapeCollection::loadFromFile(std::string fileName)
 		{
 			shape = new SurfaceShape();
 		}
+		else if (shapeType.compare("INSTANCE_SHAPE") == 0)
+		{
+			shape = new InstanceShape();
+		}
+		else if (shapeType.compare("MESH") == 0)
+		{
+			std::string name;
+			s >> name;
+			
+			std::shared_ptr<SurfaceShape> mesh = std::make_shared<SurfaceShape>();
+			mesh->readGeometry(s);
+			meshesRead[name] = mesh;
+			continue;
+		}
 		else
 		{
-			file.close();
 			return false;
 		}
 		
-		shape->read(file);
+		shape->read(s);
+		
+		InstanceShape* instance = dynamic_cast<InstanceShape*>(shape);
+		if (instance)
+		{
+			auto found = meshesRead.find(instance->getMeshName());
+			if (found == meshesRead.end())
+			{
+				delete shape;
+				return false;
+			}
+			instance->setMesh(found->second, found->first);
+		}
 		add(shape);
 	}
 	
-	file.close();
 	return true;
 }
 
-bool ShapeCollection::saveToFile(std::string fileName)
+void ShapeCollection::write(std::ostream& s)
 {
-	std::ofstream file(fileName.c_str());
-	if (!file.is_open()) return false;
+	writeSceneAttributes(s);
+	writeShapes(s);
+}
+
+std::string ShapeCollection::serialize()
+{
+	std::ostringstream s;
+	s.precision(std::numeric_limits<float>::max_digits10);
+	write(s);
+	return s.str();
+}
+
+bool ShapeCollection::deserialize(std::string scene)
+{
+	clear();
 	
-	writeSceneAttributes(file);
+	SceneParser parser(scene.data(), scene.data() + scene.size());
+	return parser.parse(this, viewport);
+}
+
+void ShapeCollection::readSceneAttributes(std::istream& s)
+{
+	viewport->readSceneAttributes(s);
+}
+
+void ShapeCollection::writeSceneAttributes(std::ostream& s)
+{
+	viewport->writeSceneAttributes(s);
+}
+
+
+/*** Private Member Functions ***/
+
+void ShapeCollection::addMesh(InstanceShape* instance)
+{
+	std::shared_ptr<SurfaceShape> mesh = instance->getMesh();
+	if (!mesh) return;
 	
-	file << numShapes() << std::endl << std::endl;
+	// A mesh with the same name and geometry as a registered one is replaced by it, so that only one copy is kept.
+	// A different mesh with the name is renamed, since instances are matched to their meshes by name when saved.
+	std::string name = instance->getMeshName();
+	for (int suffix = 2; ; suffix++)
+	{
+		auto found = meshes->find(name);
+		if (found == meshes->end())
+		{
+			(*meshes)[name] = mesh;
+			break;
+		}
+		if (found->second == mesh || found->second->geometryHash() == mesh->geometryHash())
+		{
+			mesh = found->second;
+			break;
+		}
+		name = instance->getMeshName() + "_" + std::to_string(suffix);
+	}
+	
+	if (mesh != instance->getMesh() || name != instance->getMeshName())
+	{
+		instance->setMesh(mesh, name);
+	}
+}
+
+std::vector<SurfaceShape*> ShapeCollection::surfaceShapes()
+{
+	std::vector<SurfaceShape*> surfaces;
 	for (int i = 0; i < numShapes(); i++)
 	{
-		get(i)->write(file);
-		file << std::endl;
+		SurfaceShape* surface = dynamic_cast<SurfaceShape*>(get(i));
+		if (surface) surfaces.push_back(surface);
 	}
 	
-	file.close();
-	return true;
+	std::vector<InstanceShape*> instances = firstInstances();
+	for (int i = 0; i < (int)instances.size(); i++)
+	{
+		surfaces.push_back(instances[i]->getMesh().get());
+	}
+	return surfaces;
 }
 
-void ShapeCollection::readSceneAttributes(std::istream& s)
+std::vector<InstanceShape*> ShapeCollection::firstInstances()
 {
-	viewport->readSceneAttributes(s);
+	std::vector<InstanceShape*> instances;
+	std::set<SurfaceShape*> seen;
+	for (int i = 0; i < numShapes(); i++)
+	{
+		InstanceShape* instance = dynamic_cast<InstanceShape*>(get(i));
+		if (instance && instance->getMesh() && seen.insert(instance->getMesh().get()).second)
+		{
+			instances.push_back(instance);
+		}
+	}
+	return instances;
 }
 
-void ShapeCollection::writeSceneAttributes(std::ostream& s)
+void ShapeCollection::writeShapes(std::ostream& s)
 {
-	viewport->writeSceneAttributes(s);
-}
\ No newline at end of file
+	// The meshes instance shapes use are written first, and are counted with the shapes.
+	std::vector<InstanceShape*> instances = firstInstances();
+	s << (instances.size() + numShapes()) << std::endl << std::endl;
+	for (int i = 0; i < (int)instances.size(); i++)
+	{
+		s << "MESH" << std::endl << instances[i]->getMeshName() << std::endl;
+		instances[i]->getMesh()->writeGeometry(s);
+		s << std::endl;
+	}
+	for (int i = 0; i < numShapes(); i++)
+	{
+		get(i)->write(s);
+		s << std::endl;
+	}
+}
+
+void ShapeCollection::clearReplicas()
+{
+	for (int k = 0; k < (int)replicas->size(); k++)
+	{
+		delete replicas->at(k);
+		delete replicaViewports->at(k);
+	}
+	replicas->clear();
+	replicaViewports->clear();
+}
@@ -5,34 +5,110 @@
  * 
  * Defines a collection of shapes that can be attached to a viewport for displaying.
  * Has functions to determine if any shape in the collection is intersected by a ray.
+ * Also keeps the meshes that instance shapes share, by name.
  * 
  */
 
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "bvh.h"
+#include "camera.h"
 #include "misc.h"
+#include "phongLightSource.h"
 #include "viewport.h"
 
+class InstanceShape;
+class MappedFiles;
 class Shape;
+class SurfaceShape;
+class ThreadPool;
+
+// What changed when a collection was updated from a file (see ShapeCollection::update).
+struct SceneChanges
+{
+	SceneChanges();
+	
+	// Returns true if nothing changed.
+	bool isEmpty() const;
+	// Returns true if the change may affect every pixel (so there is no point in looking for the ones it doesn't).
+	bool affectsEverything() const;
+	
+	// The number of shapes that were added and removed. A shape that changed was removed and added.
+	int shapesAdded;
+	int shapesRemoved;
+	// The bounds of every shape that was added or removed.
+	std::vector<AABB> bounds;
+	// True if a shape without bounds (such as an implicit shape) was added or removed.
+	bool unbounded;
+	// True if the lights changed, or the other scene attributes (the camera, background and ambient light).
+	bool lightsChanged;
+	bool attributesChanged;
+};
+
+// The most scene states kept for undo.
+const int MAX_UNDO_STATES = 50;
+
+// A scene as it was at some point, which can be restored (see ShapeCollection::snapshot). Shapes aren't changed
+// once the command that added them has finished (they are only added and removed), so the snapshot shares them
+// and the meshes with the collection instead of copying them, and costs little more than a list of pointers.
+struct SceneSnapshot
+{
+	SceneSnapshot();
+	
+	// True if only the camera was kept (for commands that only move the camera).
+	bool cameraOnly;
+	Camera camera;
+	RGB backgroundColor;
+	float ambientIntensity;
+	std::vector<PhongLightSource> lights;
+	std::vector<std::shared_ptr<Shape> > shapes;
+	std::map<std::string, std::shared_ptr<SurfaceShape> > meshes;
+	std::string bvhCacheFileName;
+	std::string fileCameraText;
+};
 
 class ShapeCollection
 {
 	public:
 		/*** Public Member Functions ***/
 		ShapeCollection();
+		// Destroys all shapes in the collection.
+		~ShapeCollection();
 		
 		// Sets the attached viewport.
 		void setViewport(Viewport* _viewport);
+		// Sets/returns the set the files the collection maps (binary scenes and hierarchy caches) are added to,
+		// which the resident limit is applied across. Each collection starts with a set of its own; collections
+		// can share one (it must be set before anything is loaded).
+		void setMappedFiles(std::shared_ptr<MappedFiles> _mappedFiles);
+		std::shared_ptr<MappedFiles> getMappedFiles();
 		
-		// Adds a shape to the collection.
+		// Adds a shape to the collection. The mesh of an instance shape is registered under its name; if another
+		// mesh already has the name, the instance uses that mesh when the geometry is the same, and its mesh is
+		// renamed otherwise.
 		void add(Shape* shape);
 		// Returns a shape from the collection.
 		Shape* get(int index);
-		// Removes a shape from the collection (the shape is destroyed).
+		// Removes a shape from the collection (the shape is destroyed, unless an undo state still holds it).
 		void remove(int index);
 		// Returns the number of shapes in the collection.
 		int numShapes();
+		// Removes (and destroys) all shapes and meshes, and removes all lights from the attached viewport.
+		void clear();
+		
+		// Returns the mesh registered under the name (null if there isn't one).
+		std::shared_ptr<SurfaceShape> getMesh(std::string name);
+		
+		// Prepares every shape for rendering (building bounding volume hierarchies that are out of date),
+		// then builds the hierarchy over the bounds of the shapes.
+		// Hierarchies of large surface shapes and meshes are kept in a cache file next to the last loaded
+		// scene file, and mapped from it (instead of being built) when the geometry hasn't changed.
+		// Viewports that render the collection at once (such as the frames of an animation) take turns.
+		void prepare();
 		
 		// Returns true iff the ray defined by the point and dirction vector intersects a shape in the collection.
 		// If it does, the t-value, surface normal, and the shape index of the first intersection are returned.
@@ -40,18 +116,109 @@ class ShapeCollection
 		// Returns true iff the line segment defined by the points intersects a shape.
 		bool lineSegmentIntersects(FCoord3D p0, FCoord3D p1);
 		
+		// Adds the memory taken by the shapes, the meshes, the hierarchies, the copies for the NUMA nodes and the
+		// shapes only undo states still hold to the usage.
+		void addMemoryUsage(MemoryUsage &usage);
+		// Returns a hash of the shapes, for telling whether they have changed. It is cheap to recompute: surface
+		// shapes and meshes are represented by the hashes of their geometry, which are kept until it changes.
+		uint64_t shapesHash();
+		
+		/** Undo **/
+		// Returns the scene as it is now (or only its camera).
+		SceneSnapshot snapshot(bool cameraOnly = false);
+		// Makes the scene match the snapshot.
+		void restore(const SceneSnapshot &state);
+		// Keeps the snapshot as the state the next undo returns to. Past MAX_UNDO_STATES, the oldest is dropped.
+		void pushUndoState(const SceneSnapshot &state);
+		// Restores the state from before the last change that was kept. Returns false if there is none.
+		bool undo();
+		
+		/** Replication **/
+		// Sets/returns whether the collection is copied to each node of a NUMA-aware pool (off by default).
+		void setReplication(bool _replication);
+		bool getReplication();
+		// Makes a copy of the collection for each node of the pool, read in and prepared by a worker of the node,
+		// so that the copy's shapes and hierarchies are in the node's memory. The copies are only remade when the
+		// shapes have changed since, and are destroyed if replication is off or the pool isn't NUMA-aware.
+		void prepareReplicas(ThreadPool* pool);
+		// Returns the copy for the node (see ThreadPool::currentNode), or the collection itself if there is none.
+		// The copies have the same shapes at the same indices.
+		ShapeCollection* getReplica(int node);
+		
 		/** File I/O **/
 		// Load/save the collection to/from a file.
-		bool loadFromFile(std::string fileName);
+		// Binary scene files are recognised by their contents when loading, and by their extension when saving.
+		// If memoryLimit isn't 0, loading a text scene or mesh stops (and false is returned) as soon as the shapes
+		// are known to need more bytes than it once prepared. Binary scenes are mapped rather than read, so their
+		// pages count as mapped files, which can always be released.
+		bool loadFromFile(std::string fileName, size_t memoryLimit = 0);
 		bool saveToFile(std::string fileName);
+		// Loads a scene from one file and saves it to another, converting between the text and binary formats.
+		static bool convertFile(std::string inFileName, std::string outFileName);
+		// Makes the scene match the file, changing only what differs: shapes that are in the file exactly as they
+		// are in the collection are kept (with their hierarchies), the rest are removed or added, and the lights
+		// and scene attributes are replaced if they differ. The camera is only replaced if the file's camera
+		// differs from the one last loaded from a file, so a camera that was moved since is kept. The changes are
+		// returned. If the file can't be loaded (or its shapes need more than memoryLimit bytes, as for
+		// loadFromFile), false is returned and nothing is changed.
+		bool update(std::string fileName, SceneChanges &changes, size_t memoryLimit = 0);
+		// Read/write the scene attributes and all shapes to/from a stream (in the scene file format).
+		bool read(std::istream& s);
+		void write(std::ostream& s);
+		// Returns the whole scene in the scene file format, with enough precision to restore it exactly.
+		std::string serialize();
+		// Replaces the scene with one previously returned by serialize().
+		bool deserialize(std::string scene);
 		// Read/write the scene attributes to/from a stream.
 		void readSceneAttributes(std::istream& s);
 		void writeSceneAttributes(std::ostream& s);
 		
 	private:
+		/*** Private Member Functions ***/
+		// Registers the mesh of the instance (see add).
+		void addMesh(InstanceShape* instance);
+		// Returns the surface shapes, and the meshes of the instance shapes (each once).
+		std::vector<SurfaceShape*> surfaceShapes();
+		// Returns the first instance shape of each mesh that is in use.
+		std::vector<InstanceShape*> firstInstances();
+		// Writes the meshes and shapes (everything write() does but the scene attributes).
+		void writeShapes(std::ostream& s);
+		// Destroys the copies made by prepareReplicas.
+		void clearReplicas();
+		
 		/*** Private Member Variables ***/
-		std::vector<Shape*>* shapes;
+		std::vector<std::shared_ptr<Shape> >* shapes;
 		Viewport* viewport;
+		// The meshes shared by instance shapes, by name.
+		std::map<std::string, std::shared_ptr<SurfaceShape> >* meshes;
+		// The hierarchy over the bounds of the bounded shapes, whose indices are in boundedShapes.
+		// Shapes without bounds (such as implicit shapes) are in unboundedShapes, and are tested one by one.
+		// The hierarchy is only used while it is valid: from prepare() until the shapes next change.
+		BVH* shapeBVH;
+		std::vector<int>* boundedShapes;
+		std::vector<int>* unboundedShapes;
+		bool shapeBVHValid;
+		// The file hierarchies are cached in (empty until a scene file has been loaded).
+		std::string bvhCacheFileName;
+		// The camera of the scene file last loaded (or updated from), as text, for telling whether the file's
+		// camera has changed (see update).
+		std::string fileCameraText;
+		// The files that are mapped.
+		std::shared_ptr<MappedFiles> mappedFiles;
+		// Held while the collection is being prepared.
+		std::mutex prepareMutex;
+		
+		// The copies of the collection for each node (see prepareReplicas), the scratch viewports that hold their
+		// scene attributes, and a hash of the shapes they were made from.
+		bool replication;
+		std::vector<ShapeCollection*>* replicas;
+		std::vector<Viewport*>* replicaViewports;
+		uint64_t replicaKey;
+		// Held while the copies are being made.
+		std::mutex replicaMutex;
+		
+		// The states undo returns to, most recent last.
+		std::vector<SceneSnapshot>* undoStates;
 };
 
 
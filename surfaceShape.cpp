@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <math.h>
 
+#include "bvh.h"
+#include "mappedFile.h"
 #include "shape.h"
 
 
@@ -12,6 +14,16 @@ SurfaceShape::SurfaceShape()
 {
 	points = new std::vector<FCoord3D>();
 	surfaceIndices = new std::vector<SurfaceIndices>();
+	bvh = new BVH();
+	geometryHashValid = false;
+	cachedGeometryHash = 0;
+	boundsValid = false;
+	
+	mapping = nullptr;
+	mappedPoints = nullptr;
+	mappedNumPoints = 0;
+	mappedSurfaces = nullptr;
+	mappedNumSurfaces = 0;
 	
 	color = RGB(0.5, 0.5, 0.5);
 	reflectionCoefficient = 0.25;
@@ -24,6 +36,7 @@ SurfaceShape::~SurfaceShape()
 {
 	delete points;
 	delete surfaceIndices;
+	delete bvh;
 }
 
 
@@ -31,6 +44,22 @@ SurfaceShape::~SurfaceShape()
 
 bool SurfaceShape::rayIntersects(FCoord3D p0, FCoord3D d, float &t, FCoord3D &normal)
 {
+	if (bvh->isBuilt())
+	{
+		float hitT;
+		int hitSurface;
+		bool hit = bvh->closestHit(p0, d, hitT, hitSurface, [&](int i, float &currT)
+		{
+			return rayIntersectsSurface(p0, d, getSurface(i), currT);
+		});
+		if (hit)
+		{
+			t = hitT;
+			normal = getSurface(hitSurface).getNormal();
+		}
+		return hit;
+	}
+	
 	float lowestT = 0.0;
 	int lowestTSurface = -1;
 	float currT = 0.0;
@@ -66,6 +95,14 @@ bool SurfaceShape::rayIntersects(FCoord3D p0, FCoord3D d, float &t, FCoord3D &no
 
 bool SurfaceShape::lineSegmentIntersects(FCoord3D p0, FCoord3D p1)
 {
+	if (bvh->isBuilt())
+	{
+		return bvh->anyHit(p0, p1, [&](int i)
+		{
+			return lineSegmentIntersectsSurface(p0, p1, getSurface(i));
+		});
+	}
+	
 	for (int i = 0; i < numSurfaces(); i++)
 	{
 		if (lineSegmentIntersectsSurface(p0, p1, getSurface(i)))
@@ -79,7 +116,70 @@ bool SurfaceShape::lineSegmentIntersects(FCoord3D p0, FCoord3D p1)
 void SurfaceShape::read(std::istream& s)
 {
 	readAttributes(s);
+	readGeometry(s);
+}
+
+void SurfaceShape::write(std::ostream& s)
+{
+	s << "SURFACE_SHAPE" << std::endl;
+	writeAttributes(s);
+	writeGeometry(s);
+}
+
+
+/** Overridden from Shape **/
+
+bool SurfaceShape::prepare()
+{
+	if (bvh->isBuilt() || numSurfaces() == 0) return false;
 	
+	std::vector<AABB> boxes(numSurfaces());
+	for (int i = 0; i < numSurfaces(); i++)
+	{
+		Surface surface = getSurface(i);
+		boxes[i].extend(surface.a);
+		boxes[i].extend(surface.b);
+		boxes[i].extend(surface.c);
+	}
+	bvh->build(boxes);
+	return true;
+}
+
+bool SurfaceShape::getBounds(FCoord3D &min, FCoord3D &max)
+{
+	if (!boundsValid)
+	{
+		cachedMin = cachedMax = FCoord3D();
+		for (int i = 0; i < numPoints(); i++)
+		{
+			FCoord3D p = getPoint(i);
+			if (i == 0 || p.x < cachedMin.x) cachedMin.x = p.x;
+			if (i == 0 || p.y < cachedMin.y) cachedMin.y = p.y;
+			if (i == 0 || p.z < cachedMin.z) cachedMin.z = p.z;
+			if (i == 0 || p.x > cachedMax.x) cachedMax.x = p.x;
+			if (i == 0 || p.y > cachedMax.y) cachedMax.y = p.y;
+			if (i == 0 || p.z > cachedMax.z) cachedMax.z = p.z;
+		}
+		boundsValid = true;
+	}
+	min = cachedMin;
+	max = cachedMax;
+	return numPoints() > 0;
+}
+
+size_t SurfaceShape::memoryBytes()
+{
+	return sizeof(SurfaceShape) + points->capacity() * sizeof(FCoord3D)
+		+ surfaceIndices->capacity() * sizeof(SurfaceIndices);
+}
+
+size_t SurfaceShape::estimateBytes(long long numPoints, long long numSurfaces)
+{
+	return numPoints * sizeof(FCoord3D) + numSurfaces * sizeof(SurfaceIndices) + BVH::estimateBytes(numSurfaces);
+}
+
+void SurfaceShape::readGeometry(std::istream& s)
+{
 	int n;
 	float x, y, z;
 	int s1, s2, s3;
@@ -99,11 +199,8 @@ void SurfaceShape::read(std::istream& s)
 	}
 }
 
-void SurfaceShape::write(std::ostream& s)
+void SurfaceShape::writeGeometry(std::ostream& s)
 {
-	s << "SURFACE_SHAPE" << std::endl;
-	writeAttributes(s);
-	
 	s << numPoints() << std::endl;
 	for (int i = 0; i < numPoints(); i++)
 	{
@@ -122,6 +219,7 @@ void SurfaceShape::write(std::ostream& s)
 
 void SurfaceShape::addPoint(FCoord3D coord)
 {
+	changed();
 	points->push_back(coord);
 }
 
@@ -132,12 +230,17 @@ void SurfaceShape::addPoint(float x, float y, float z)
 
 FCoord3D SurfaceShape::getPoint(int index)
 {
+	if (mapping)
+	{
+		assert(index >= 0 && index < mappedNumPoints);
+		return mappedPoints[index];
+	}
 	return points->at(index);
 }
 
 int SurfaceShape::numPoints()
 {
-	return points->size();
+	return mapping ? mappedNumPoints : points->size();
 }
 
 FCoord3D SurfaceShape::getPointNormal(int pointIndex)
@@ -167,30 +270,40 @@ FCoord3D SurfaceShape::getPointNormal(int pointIndex)
 
 void SurfaceShape::addSurfaceByIndices(SurfaceIndices s)
 {
+	changed();
 	surfaceIndices->push_back(s);
 }
 
 void SurfaceShape::addSurfaceByIndices(int a, int b, int c)
 {
+	changed();
 	surfaceIndices->push_back(SurfaceIndices(a, b, c));
 }
 
 SurfaceIndices SurfaceShape::getSurfaceByIndices(int index)
 {
+	if (mapping)
+	{
+		assert(index >= 0 && index < mappedNumSurfaces);
+		return mappedSurfaces[index];
+	}
 	return surfaceIndices->at(index);
 }
 
 Surface SurfaceShape::getSurface(int index)
 {
-	if (!isValid()) return Surface();
-	
 	SurfaceIndices si = getSurfaceByIndices(index);
+	if (si.a <= 0 || si.b <= 0 || si.c <= 0 || si.a > numPoints() || si.b > numPoints() || si.c > numPoints())
+	{
+		return Surface();
+	}
+	
 	return Surface(getPoint(si.a - 1), getPoint(si.b - 1), getPoint(si.c - 1));
 }
 
 int SurfaceShape::numSurfaces()
 {
-	return surfaceIndices->size();
+	return mapping ? mappedNumSurfaces : surfaceIndices->size();
 }
 
 FCoord3D SurfaceShape::getSurfaceNormal(int surfaceIndex)
@@ -199,6 +312,66 @@ FCoord3D SurfaceShape::getSurfaceNormal(int surfaceIndex)
 }
 
 
+/** Raw Data **/
+
+void SurfaceShape::setMappedData(std::shared_ptr<MappedFile> _mapping,
+	const FCoord3D* _points, int _numPoints,
+	const SurfaceIndices* _surfaces, int _numSurfaces)
+{
+	points->clear();
+	surfaceIndices->clear();
+	bvh->clear();
+	geometryHashValid = false;
+	
+	mapping = _mapping;
+	mappedPoints = _points;
+	mappedNumPoints = _numPoints;
+	mappedSurfaces = _surfaces;
+	mappedNumSurfaces = _numSurfaces;
+	boundsValid = false;
+}
+
+bool SurfaceShape::isMapped()
+{
+	return mapping != nullptr;
+}
+
+const FCoord3D* SurfaceShape::pointData()
+{
+	return mapping ? mappedPoints : points->data();
+}
+
+const SurfaceIndices* SurfaceShape::surfaceData()
+{
+	return mapping ? mappedSurfaces : surfaceIndices->data();
+}
+
+void SurfaceShape::reserve(int _numPoints, int _numSurfaces)
+{
+	detach();
+	points->reserve(_numPoints);
+	surfaceIndices->reserve(_numSurfaces);
+}
+
+void SurfaceShape::shrinkToFit()
+{
+	if (mapping) return;
+	points->shrink_to_fit();
+	surfaceIndices->shrink_to_fit();
+}
+
+void SurfaceShape::setMappedBVH(std::shared_ptr<MappedFile> _mapping, const BVHNode* nodes, int numNodes,
+	const uint32_t* order)
+{
+	bvh->setMappedData(_mapping, nodes, numNodes, order, numSurfaces());
+}
+
+BVH* SurfaceShape::getBVH()
+{
+	return bvh;
+}
+
+
 /** Misc. **/
 
 bool SurfaceShape::isValid()
@@ -218,6 +391,19 @@ bool SurfaceShape::isValid()
 	return true;
 }
 
+uint64_t SurfaceShape::geometryHash()
+{
+	if (!geometryHashValid)
+	{
+		int counts[2] = {numPoints(), numSurfaces()};
+		uint64_t hash = hashBytes(counts, sizeof(counts));
+		hash = hashBytes(pointData(), numPoints() * sizeof(FCoord3D), hash);
+		cachedGeometryHash = hashBytes(surfaceData(), numSurfaces() * sizeof(SurfaceIndices), hash);
+		geometryHashValid = true;
+	}
+	return cachedGeometryHash;
+}
+
 FCoord3D SurfaceShape::centroid()
 {
 	float x = 0.0;
@@ -225,9 +411,9 @@ FCoord3D SurfaceShape::centroid()
 	float z = 0.0;
 	for (int i = 0; i < numPoints(); i++)
 	{
-		x += points->at(i).x;
-		y += points->at(i).y;
-		z += points->at(i).z;
+		x += getPoint(i).x;
+		y += getPoint(i).y;
+		z += getPoint(i).z;
 	}
 	return FCoord3D(x / (float)numPoints(), y / (float)numPoints(), z / (float)numPoints());
 }
@@ -236,6 +422,8 @@ FCoord3D SurfaceShape::centroid()
 
 void SurfaceShape::translate(float x, float y, float z)
 {
+	changed();
+	
 	for (int i = 0; i < numPoints(); i++)
 	{
 		points->at(i).x += x;
@@ -255,6 +443,8 @@ void SurfaceShape::scale(float a, float b, float c)
 
 void SurfaceShape::scaleOrigin(float a, float b, float c)
 {
+	changed();
+	
 	for (int i = 0; i < numPoints(); i++)
 	{
 		points->at(i).x *= a;
@@ -285,6 +475,8 @@ void SurfaceShape::rotate(FCoord3D p1, FCoord3D p2, float angle)
 
 void SurfaceShape::rotateDIntoZ(FCoord3D d)
 {
+	changed();
+	
 	float l = sqrt(pow(d.y, 2.0) + pow(d.z, 2.0));
 	
 	for (int i = 0; i < numPoints(); i++)
@@ -298,6 +490,8 @@ void SurfaceShape::rotateDIntoZ(FCoord3D d)
 
 void SurfaceShape::rotateDOutOfZ(FCoord3D d)
 {
+	changed();
+	
 	float l = sqrt(pow(d.y, 2.0) + pow(d.z, 2.0));
 	float lsqxsq = pow(d.x, 2.0) + pow(d.y, 2.0) + pow(d.z, 2.0);
 	float ysqzsq = pow(d.y, 2.0) + pow(d.z, 2.0);
@@ -323,6 +517,8 @@ void SurfaceShape::rotateDegX(float angle)
 
 void SurfaceShape::rotateRadX(float angle)
 {
+	changed();
+	
 	float ca = cos(angle);
 	float sa = sin(angle);
 	float newY, newZ;
@@ -345,6 +541,8 @@ void SurfaceShape::rotateDegZ(float angle)
 
 void SurfaceShape::rotateRadZ(float angle)
 {
+	changed();
+	
 	float ca = cos(angle);
 	float sa = sin(angle);
 	float newX, newY;
@@ -358,4 +556,32 @@ void SurfaceShape::rotateRadZ(float angle)
 		points->at(i).x = newX;
 		points->at(i).y = newY;
 	}
-}
\ No newline at end of file
+}
+
+
+/*** Private Member Functions ***/
+
+void SurfaceShape::changed()
+{
+	detach();
+	geometryHashValid = false;
+	boundsValid = false;
+	if (bvh->isBuilt())
+	{
+		bvh->clear();
+	}
+}
+
+void SurfaceShape::detach()
+{
+	if (!mapping) return;
+	
+	points->assign(mappedPoints, mappedPoints + mappedNumPoints);
+	surfaceIndices->assign(mappedSurfaces, mappedSurfaces + mappedNumSurfaces);
+	
+	mapping = nullptr;
+	mappedPoints = nullptr;
+	mappedNumPoints = 0;
+	mappedSurfaces = nullptr;
+	mappedNumSurfaces = 0;
+}
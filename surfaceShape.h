@@ -5,12 +5,21 @@
  * 
  * A shape defined by a number of flat triangular surfaces (inherits from shape).
  * A surface is defined in terms of the indicies of the points it contains.
+ * The points and surfaces are either owned by the shape, or used in place from a memory-mapped file
+ * (in which case they are copied the first time the shape is modified).
  * 
  */
 
+#include <memory>
+#include <stdint.h>
+
 #include "misc.h"
 #include "shape.h"
 
+class BVH;
+struct BVHNode;
+class MappedFile;
+
 class SurfaceShape: public Shape
 {
 	public:
@@ -26,6 +35,22 @@ class SurfaceShape: public Shape
 		void read(std::istream& s);
 		void write(std::ostream& s);
 		
+		/** Overridden from Shape **/
+		// Builds the bounding volume hierarchy over the surfaces, if it isn't already built.
+		bool prepare();
+		// Returns the corners of the axis-aligned box that contains every point (false if there are no points).
+		// The box is kept until the points change.
+		bool getBounds(FCoord3D &min, FCoord3D &max);
+		// Counts the points and surfaces the shape owns (not those used in place from a mapped file).
+		size_t memoryBytes();
+		// Returns about how many bytes a shape with that many points and surfaces takes once it is prepared (with
+		// its hierarchy), so that a load can be checked against the memory budget before the shape is read.
+		static size_t estimateBytes(long long numPoints, long long numSurfaces);
+		
+		// Read/write the points and surfaces alone (without the shape type or attributes).
+		void readGeometry(std::istream& s);
+		void writeGeometry(std::ostream& s);
+		
 		/** Points **/
 		// Adds a point to the list of shape points.
 		void addPoint(FCoord3D coord);
@@ -50,9 +75,33 @@ class SurfaceShape: public Shape
 		// Returns the outward unit normal vector for the surface.
 		FCoord3D getSurfaceNormal(int index);
 		
+		/** Raw Data **/
+		// Uses the passed arrays (which live in the mapped file) as the points and surfaces of this shape.
+		// The arrays are not copied; the mapping is kept alive for as long as the shape uses them.
+		void setMappedData(std::shared_ptr<MappedFile> _mapping,
+			const FCoord3D* _points, int _numPoints,
+			const SurfaceIndices* _surfaces, int _numSurfaces);
+		// Returns true if the points and surfaces are used in place from a mapped file.
+		bool isMapped();
+		// Returns the contiguous arrays of points and surfaces.
+		const FCoord3D* pointData();
+		const SurfaceIndices* surfaceData();
+		// Reserves space for the specified number of points/surfaces.
+		void reserve(int _numPoints, int _numSurfaces);
+		// Frees the space reserved beyond the points/surfaces that have been added.
+		void shrinkToFit();
+		// Uses a bounding volume hierarchy that lives in the mapped file. If order is null, its leaves refer to the
+		// surfaces directly; otherwise order holds the surface index at each position in the hierarchy.
+		void setMappedBVH(std::shared_ptr<MappedFile> _mapping, const BVHNode* nodes, int numNodes,
+			const uint32_t* order = nullptr);
+		// Returns the bounding volume hierarchy over the surfaces (empty until prepare() is called).
+		BVH* getBVH();
+		
 		/** Misc. **/
 		// Returns true iff all defined surfaces are valid.
 		bool isValid();
+		// Returns a hash of the points and surfaces. It is kept until they change.
+		uint64_t geometryHash();
 		// Returns the centroid of this shape.
 		FCoord3D centroid();
 		
@@ -70,11 +119,33 @@ class SurfaceShape: public Shape
 		void rotateRadZ(float angle);
 		
 	private:
+		/*** Private Member Functions ***/
+		// Copies mapped points and surfaces into the shape's own arrays, so that they can be modified.
+		void detach();
+		// Called before the points or surfaces change. Detaches the shape and throws away the hierarchy.
+		void changed();
+		
 		/*** Private Member Variables ***/
 		// The points this shape contains.
 		std::vector<FCoord3D>* points;
 		// The surfaces this shape contains. SurfaceIndices holds the indices of 3 points in the shape, which defines the surface.
 		std::vector<SurfaceIndices>* surfaceIndices;
+		// Speeds up finding the surfaces a ray hits. Built by prepare().
+		BVH* bvh;
+		// The hash of the points and surfaces, if it has been computed since they last changed.
+		bool geometryHashValid;
+		uint64_t cachedGeometryHash;
+		// The bounds of the points, if they have been computed since the points last changed.
+		bool boundsValid;
+		FCoord3D cachedMin;
+		FCoord3D cachedMax;
+		
+		// The file that mapped points and surfaces live in (null if the shape owns its data).
+		std::shared_ptr<MappedFile> mapping;
+		const FCoord3D* mappedPoints;
+		int mappedNumPoints;
+		const SurfaceIndices* mappedSurfaces;
+		int mappedNumSurfaces;
 };
 
 #endif
\ No newline at end of file
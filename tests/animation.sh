@@ -0,0 +1,49 @@
+#!/bin/sh
+# animation.sh
+#
+# Records three camera keyframes, renders the animation one frame at a time and four frames at once, and checks
+# that both give the same frames, that the camera moves between the keyframes, and that the frames at the
+# keyframes match the frames rendered from the same cameras.
+#
+# usage: tests/animation.sh (from the directory with project5)
+
+. tests/common.sh
+
+# Frames 1 to 3 of single#.pfm are rendered from the cameras of the keyframes at 0, 6 and 12.
+printf 'load scene2.data
+animate key 0
+mv left 1
+animate key 6
+mv up 0.5
+animate key 12
+animate render serial.pfm 13 1
+animate render parallel.pfm 13 4
+' | "$PROJECT5" -headless 120 90 -o 'single#.pfm' > animation.txt 2>&1
+
+failed=0
+frame=0
+while [ $frame -le 12 ]; do
+	name=$(printf '%04d.pfm' $frame)
+	if [ ! -s serial$name ] || ! cmp -s serial$name parallel$name; then
+		echo "FAIL: frame $frame differs when four frames are rendered at once."
+		failed=1
+	fi
+	frame=$((frame + 1))
+done
+if cmp -s serial0000.pfm serial0003.pfm || cmp -s serial0006.pfm serial0009.pfm; then
+	echo "FAIL: the camera doesn't move between the keyframes."
+	failed=1
+fi
+for key in 0:1 6:2 12:3; do
+	name=$(printf '%04d.pfm' ${key%:*})
+	if ! cmp -s serial$name single${key#*:}.pfm; then
+		echo "FAIL: the frame at keyframe ${key%:*} differs from a single render from its camera."
+		failed=1
+	fi
+done
+
+if [ $failed -ne 0 ]; then
+	cat animation.txt
+	exit 1
+fi
+passed "13 frames rendered one and four at a time match, and match single renders at the keyframes"
@@ -0,0 +1,136 @@
+/* antiAliasing.cpp
+ *
+ * Renders a scene without anti-aliasing, with it (4 samples per pixel), and at twice the size. Checks that only
+ * some pixels were refined, within the sample limit, that no other pixel changed, and that the refined pixels are
+ * closer to the twice-as-large frame scaled down (which averages 4 samples per pixel) than the plain ones.
+ *
+ * usage: tests/antiAliasing <scene file>
+ *
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include "frameBuffer.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+#include "viewport.h"
+
+const int WIDTH = 160;
+const int HEIGHT = 120;
+const int SAMPLES = 4;
+const float THRESHOLD = 0.1;
+
+// Renders the scene at the size into pixels, with up to the number of samples per pixel. Returns the stats of
+// the frame.
+RenderStats render(std::string sceneFile, ThreadPool* pool, int width, int height, int samples,
+	std::vector<float> &pixels)
+{
+	ShapeCollection shapes;
+	Viewport viewport(Coord(0, 0), width, height, &shapes);
+	shapes.setViewport(&viewport);
+	FrameBuffer buffer(width, height);
+	viewport.setThreadPool(pool);
+	viewport.setFrameBuffer(&buffer);
+	viewport.setKeepFrame(true);
+	if (!shapes.loadFromFile(sceneFile)) return RenderStats();
+
+	viewport.setAntiAliasing(samples, THRESHOLD);
+	viewport.redraw(false);
+	viewport.readPixels(0, 0, width, height, pixels);
+	return viewport.getStats();
+}
+
+// Returns the largest difference of a color channel of pixel k of a from that of b.
+float difference(const std::vector<float> &a, const std::vector<float> &b, int k)
+{
+	float d = 0.0;
+	for (int c = 0; c < 3; c++)
+	{
+		d = std::max(d, fabsf(a[k * 3 + c] - b[k * 3 + c]));
+	}
+	return d;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		std::cout << "usage: " << argv[0] << " <scene file>" << std::endl;
+		return 2;
+	}
+
+	ThreadPool pool(0);
+	std::vector<float> plain, smooth, large;
+	render(argv[1], &pool, WIDTH, HEIGHT, 1, plain);
+	RenderStats stats = render(argv[1], &pool, WIDTH, HEIGHT, SAMPLES, smooth);
+	render(argv[1], &pool, WIDTH * 2, HEIGHT * 2, 1, large);
+	const int n = WIDTH * HEIGHT;
+	if (plain.size() != (size_t)n * 3 || smooth.size() != plain.size() || large.size() != plain.size() * 4)
+	{
+		std::cout << "FAIL: could not render \"" << argv[1] << "\"." << std::endl;
+		return 1;
+	}
+
+	// Each pixel of the reference averages the 2 x 2 pixels of the large frame that cover it.
+	std::vector<float> reference(n * 3);
+	for (int j = 0; j < HEIGHT; j++)
+	{
+		for (int i = 0; i < WIDTH; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				float sum = 0.0;
+				for (int k = 0; k < 4; k++)
+				{
+					sum += large[((j * 2 + k / 2) * WIDTH * 2 + i * 2 + k % 2) * 3 + c];
+				}
+				reference[(j * WIDTH + i) * 3 + c] = sum / 4.0;
+			}
+		}
+	}
+
+	// The pixels anti-aliasing changed, and how far they, and the same pixels without it, are from the reference.
+	int changed = 0;
+	double plainError = 0.0, smoothError = 0.0;
+	for (int k = 0; k < n; k++)
+	{
+		if (difference(plain, smooth, k) == 0.0) continue;
+		changed++;
+		plainError += difference(plain, reference, k);
+		smoothError += difference(smooth, reference, k);
+	}
+
+	bool failed = false;
+	if (stats.pixelsRefined <= 0 || stats.pixelsRefined >= n)
+	{
+		std::cout << "FAIL: " << stats.pixelsRefined << " of " << n << " pixels were refined." << std::endl;
+		failed = true;
+	}
+	if (stats.primaryRays > n + (long long)stats.pixelsRefined * SAMPLES)
+	{
+		std::cout << "FAIL: " << stats.primaryRays << " primary rays were fired, more than " << SAMPLES
+			<< " samples for each refined pixel allow." << std::endl;
+		failed = true;
+	}
+	if (changed > stats.pixelsRefined)
+	{
+		std::cout << "FAIL: " << changed << " pixels changed, but only " << stats.pixelsRefined << " were refined."
+			<< std::endl;
+		failed = true;
+	}
+	if (changed == 0 || smoothError >= plainError)
+	{
+		std::cout << "FAIL: the refined pixels are no closer to the frame rendered at twice the size (off by "
+			<< smoothError << " against " << plainError << ")." << std::endl;
+		failed = true;
+	}
+	if (failed) return 1;
+
+	std::cout << stats.pixelsRefined << " of " << n << " pixels refined, off the frame twice the size by "
+		<< (int)(100.0 * smoothError / plainError + 0.5) << "% as much as without anti-aliasing" << std::endl;
+	return 0;
+}
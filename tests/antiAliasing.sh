@@ -0,0 +1,16 @@
+#!/bin/sh
+# antiAliasing.sh
+#
+# Checks with tests/antiAliasing that anti-aliasing refines only some pixels, within its sample limit, and brings
+# them closer to a frame rendered with more samples.
+#
+# usage: tests/antiAliasing.sh (from the directory with project5 and tests/antiAliasing)
+
+. tests/common.sh
+CHECK="$TESTS/antiAliasing"
+
+if ! "$CHECK" scene2.data > logs 2>&1; then
+	cat logs
+	exit 1
+fi
+passed "$(tail -n 1 logs)"
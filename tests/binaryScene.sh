@@ -0,0 +1,42 @@
+#!/bin/sh
+# binaryScene.sh
+#
+# Converts the shipped scenes to binary scenes, and checks that each one loads back to the same frame as the text
+# scene. A scene with a triangle corner that isn't one of its shape's vertices can't be converted, and leaves no
+# binary scene behind.
+#
+# usage: tests/binaryScene.sh (from the directory with project5)
+
+. tests/common.sh
+
+cp "$(dirname "$PROJECT5")/scene1.data" "$(dirname "$PROJECT5")/scene3.data" .
+# The first triangle of scene2's first surface shape, with its last corner past the shape's 8 vertices.
+awk '!done && $0 == "1 3 2" { $0 = "1 3 9"; done = 1 } 1' scene2.data > damaged.data
+
+printf 'convert scene1.data scene1.rtscene\nconvert scene2.data scene2.rtscene\nconvert scene3.data scene3.rtscene
+convert damaged.data damaged.rtscene\n' | "$PROJECT5" -headless 160 120 > logs 2>&1
+
+failed=0
+for scene in scene1 scene2 scene3; do
+	printf 'load %s.data\n' $scene | "$PROJECT5" -headless 160 120 -o text.pfm > text.txt 2>&1
+	printf 'load %s.rtscene\n' $scene | "$PROJECT5" -headless 160 120 -o binary.pfm > binary.txt 2>&1
+	if ! grep -q "Converted \"$scene.data\" to \"$scene.rtscene\"" logs || ! grep -q 'successfully' binary.txt; then
+		echo "FAIL: $scene couldn't be converted and loaded back."
+		cat text.txt binary.txt
+		failed=1
+	elif ! cmp -s text.pfm binary.pfm; then
+		echo "FAIL: $scene renders differently once converted."
+		failed=1
+	fi
+done
+if ! grep -q "Shape 3 has a triangle corner that isn't one of its vertices" logs \
+	|| ! grep -q 'Failed to convert "damaged.data"' logs || [ -e damaged.rtscene ] || [ -e damaged.rtscene.tmp ]; then
+	echo "FAIL: the scene with a bad triangle corner was converted."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat logs
+	exit 1
+fi
+passed "the 3 shipped scenes render the same once converted, and a scene with a bad corner wasn't"
@@ -0,0 +1,52 @@
+#!/bin/sh
+# budget.sh
+#
+# Checks that time budgets leave frames unchanged when they aren't needed: a frame rendered with a budget it fits
+# in, and one rendered after the budget is turned off, match the frame rendered without ever setting one. Also
+# checks that a frame with a tight budget is returned in not much more than its budget.
+#
+# usage: tests/budget.sh (from the directory with project5)
+
+. tests/common.sh
+
+# The tight budget, and how much longer than it the frame may take (both in milliseconds).
+BUDGET_MS=100
+SLACK_MS=100
+
+# Budgeted frames aren't kept in the frame cache, so moving back to a camera renders it again.
+printf 'load scene2.data\nmv left 1\n' | "$PROJECT5" -headless 300 200 -o 'plain#.pfm' > plain.txt 2>&1
+printf 'load scene2.data
+budget 100000
+mv left 1
+mv right 1
+budget off
+mv left 1
+' | "$PROJECT5" -headless 300 200 -o 'budgeted#.pfm' > budgeted.txt 2>&1
+printf 'load scene2.data\nbudget %d\nmv left 1\nstats\n' $BUDGET_MS \
+	| "$PROJECT5" -headless 800 600 > tight.txt 2>&1
+
+failed=0
+# Frame 3 is rendered with the large budget, and frame 6 after it is turned off (frames 2, 4 and 5 are shown from
+# the frame cache).
+for frame in 1:1 2:3 2:6; do
+	if ! cmp -s plain${frame%:*}.pfm budgeted${frame#*:}.pfm; then
+		echo "FAIL: frame ${frame#*:} with a budget set or turned off differs from the frame rendered without one."
+		failed=1
+	fi
+done
+if ! grep -q "^Budget: 100000 ms, rendered at full resolution" budgeted.txt; then
+	echo "FAIL: the frame with the large budget wasn't rendered at full quality."
+	failed=1
+fi
+ms=$(awk '/^Time:/ { print int($2) }' tight.txt)
+if [ -z "$ms" ] || [ "$ms" -gt $((BUDGET_MS + SLACK_MS)) ]; then
+	echo "FAIL: the frame with a budget of $BUDGET_MS ms took ${ms:-?} ms."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat budgeted.txt tight.txt
+	exit 1
+fi
+passed "frames with an unneeded budget are unchanged, and an 800x600 frame with a $BUDGET_MS ms budget" \
+	"took $ms ms"
@@ -0,0 +1,82 @@
+#!/bin/sh
+# bvhCache.sh
+#
+# Loads a scene with a mesh big enough for its hierarchy to be cached, and checks that loading it again maps the
+# hierarchy from the cache and renders the same frame. Then the mesh in the scene file is changed, and a damaged
+# cache is put next to another copy of the scene: checks that neither cache is used, that the hierarchy is built
+# again, and that the frames match those rendered without a cache.
+#
+# usage: tests/bvhCache.sh (from the directory with project5)
+
+. tests/common.sh
+
+# A 50 x 50 grid of vertices (4802 triangles, more than the fewest that are cached), and the same grid with one
+# vertex raised.
+for raised in 0 1; do
+	awk -v n=50 -v raised=$raised 'BEGIN {
+		for (j = 0; j < n; j++) for (i = 0; i < n; i++) {
+			printf "v %d %d %.3f\n", i, j, ((i * 7 + j * 13) % 17) / 17.0 + (raised && i == 25 && j == 25 ? 5 : 0);
+		}
+		for (j = 0; j < n - 1; j++) for (i = 0; i < n - 1; i++) {
+			a = j * n + i + 1;
+			printf "f %d %d %d\nf %d %d %d\n", a, a + 1, a + n, a + 1, a + n + 1, a + n;
+		}
+	}' > grid$raised.obj
+	printf 'load scene2.data\nload grid%s.obj 0 0 0 100\nsave grid%s.data\n' $raised $raised \
+		| "$PROJECT5" -headless 160 120 > save$raised.txt 2>&1
+done
+
+# Renders the scene file into <name>.ppm (the last frame is the one left in the file).
+render()
+{
+	printf 'load %s\n' "$2" | "$PROJECT5" -headless 160 120 -o "$1.ppm" > "$1.txt" 2>&1
+}
+
+# The frames without a cache are rendered from copies of the scenes that have none.
+cp grid0.data plain0.data
+cp grid1.data plain1.data
+render plain0 plain0.data
+render plain1 plain1.data
+render first grid0.data
+render cached grid0.data
+cp grid1.data grid0.data
+render changed grid0.data
+cp plain1.data damaged.data
+head -c 4096 /dev/urandom > damaged.data.bvhcache
+render damaged damaged.data
+
+failed=0
+if [ ! -s grid0.data.bvhcache ] \
+	|| ! grep -q 'Saved bounding volume hierarchies to "grid0.data.bvhcache"' first.txt; then
+	echo "FAIL: the hierarchy wasn't cached."
+	failed=1
+fi
+if ! grep -q 'Mapped bounding volume hierarchies for 1 shapes from "grid0.data.bvhcache"' cached.txt; then
+	echo "FAIL: the cached hierarchy wasn't used."
+	failed=1
+fi
+if ! cmp -s plain0.ppm first.ppm || ! cmp -s plain0.ppm cached.ppm; then
+	echo "FAIL: the frames rendered with the cache differ from the one rendered without."
+	failed=1
+fi
+for name in changed damaged; do
+	if grep -q 'Mapped bounding volume hierarchies' $name.txt \
+		|| ! grep -q 'Built bounding volume hierarchies for 3 shapes' $name.txt; then
+		echo "FAIL: the hierarchy of the $name scene wasn't built again."
+		failed=1
+	fi
+	if [ ! -s $name.ppm ] || ! cmp -s plain1.ppm $name.ppm; then
+		echo "FAIL: the frame of the $name scene differs from the one rendered without a cache."
+		failed=1
+	fi
+done
+if cmp -s plain0.ppm plain1.ppm; then
+	echo "FAIL: the raised vertex can't be seen, so the frames don't test it."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat first.txt cached.txt changed.txt damaged.txt
+	exit 1
+fi
+passed "a cached hierarchy was used, and hierarchies were built again for a changed mesh and a damaged cache"
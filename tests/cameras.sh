@@ -0,0 +1,62 @@
+#!/bin/sh
+# cameras.sh
+#
+# Renders a multi-view batch (four cameras orbiting the scene) one view at a time and three at once, and from the
+# cameras saved and loaded again, and checks that every view matches a render of the scene set to its camera. A
+# camera file claiming more cameras than it holds is refused.
+#
+# usage: tests/cameras.sh (from the directory with project5)
+
+. tests/common.sh
+
+printf 'load scene2.data
+cameras orbit 4
+cameras save cameras.txt
+cameras render serial.pfm 1
+cameras render parallel.pfm 3
+' | "$PROJECT5" -headless 120 90 > batch.txt 2>&1
+printf 'load scene2.data\ncameras load cameras.txt\ncameras render loaded.pfm 2\n' \
+	| "$PROJECT5" -headless 120 90 > loaded.txt 2>&1
+# A file claiming far more cameras than it holds is refused, and leaves no cameras to render from.
+printf '2000000000\n0 0 0\n' > damaged.txt
+printf 'load scene2.data\ncameras load damaged.txt\ncameras render damaged.pfm\n' \
+	| "$PROJECT5" -headless 120 90 > damaged.log 2>&1
+
+failed=0
+if [ "$(head -n 1 cameras.txt 2>/dev/null)" != "4" ]; then
+	echo "FAIL: the four cameras weren't saved."
+	cat batch.txt
+	exit 1
+fi
+# Each camera is saved as its from point, at point, up vector and viewing angle, on lines of their own. The up
+# vector can't be set by a command, but the orbit keeps it.
+view=0
+while [ $view -lt 4 ]; do
+	name=$(printf '%04d.pfm' $view)
+	awk -v first=$((view * 4 + 2)) 'NR == first { print "from " $0 } NR == first + 1 { print "at " $0 }
+		NR == first + 3 { print "alpha " $0 }' cameras.txt > camera.txt
+	printf 'load scene2.data\n' | cat - camera.txt | "$PROJECT5" -headless 120 90 -o single.pfm > single.txt 2>&1
+	for batch in serial parallel loaded; do
+		if [ ! -s $batch$name ] || ! cmp -s $batch$name single.pfm; then
+			echo "FAIL: view $view of the $batch batch differs from a render from its camera."
+			failed=1
+		fi
+	done
+	view=$((view + 1))
+done
+if ! grep -q 'Failed to load cameras from "damaged.txt"' damaged.log \
+	|| ! grep -q 'There are no cameras to render from' damaged.log; then
+	echo "FAIL: the cameras of a damaged file weren't refused."
+	cat damaged.log
+	failed=1
+fi
+if cmp -s serial0000.pfm serial0002.pfm; then
+	echo "FAIL: the views are the same, so the cameras didn't orbit."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat batch.txt loaded.txt
+	exit 1
+fi
+passed "4 views rendered one and three at a time, and from saved cameras, match single renders, and a damaged camera file was refused"
@@ -0,0 +1,55 @@
+#!/bin/sh
+# checkpoint.sh
+#
+# Starts a render with checkpoints, and kills it once some of its tiles are in the checkpoint. Renders the frame
+# again with the same checkpoint, and checks that it resumed tiles from it, that it is the same as a render without
+# checkpoints, and that the checkpoint is removed once the frame is finished.
+#
+# usage: tests/checkpoint.sh (from the directory with project5)
+
+. tests/common.sh
+
+# The frame is large enough to take a few seconds. Frame 0 of each run is of the empty scene, and frame 1 of scene2.
+SIZE="600 450"
+printf 'load scene2.data\n' | "$PROJECT5" -headless $SIZE -o 'plain#.ppm' > plain.txt 2>&1
+
+# Checkpoints are flushed after every tile. The process is killed as soon as the file holds more than its header
+# (and is killed anyway after 30 seconds).
+printf 'checkpoint frame.ckpt 0\nload scene2.data\n' | "$PROJECT5" -headless $SIZE -o 'killed#.ppm' > killed.txt 2>&1 &
+echo $! > killed.pid
+tries=0
+while [ "$(cat frame.ckpt 2>/dev/null | wc -c)" -lt 4096 ] && [ $tries -lt 300 ]; do
+	sleep 0.1
+	tries=$((tries + 1))
+done
+kill -9 $(cat killed.pid) 2>/dev/null
+wait 2>/dev/null
+rm -f killed.pid
+
+printf 'checkpoint frame.ckpt 0\nload scene2.data\nstats\n' | "$PROJECT5" -headless $SIZE -o 'resumed#.ppm' \
+	> resumed.txt 2>&1
+
+failed=0
+if grep -q 'Wrote .* image to "killed1.ppm"' killed.txt; then
+	echo "FAIL: the render finished before it could be killed, so nothing was resumed."
+	failed=1
+fi
+resumed=$(sed -n 's/.*(\([0-9]*\) resumed from a checkpoint).*/\1/p' resumed.txt)
+if [ -z "$resumed" ]; then
+	echo "FAIL: no tiles were resumed from the checkpoint."
+	failed=1
+fi
+if [ ! -s resumed1.ppm ] || ! cmp -s plain1.ppm resumed1.ppm; then
+	echo "FAIL: the resumed frame differs from one rendered without checkpoints."
+	failed=1
+fi
+if [ -e frame.ckpt ]; then
+	echo "FAIL: the checkpoint was kept after the frame finished."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat killed.txt resumed.txt
+	exit 1
+fi
+passed "$resumed tiles of a killed render were resumed, and the frame matches one rendered without checkpoints"
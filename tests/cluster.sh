@@ -0,0 +1,114 @@
+#!/bin/sh
+# cluster.sh
+#
+# Renders a scene, then moves the camera, on three render workers on this machine, and checks that the frames
+# match the same frames rendered without workers, and that each worker was only sent the scene once. Then renders
+# them again on a worker that hangs (it is stopped) once it has joined, next to a connection that never says hello
+# (when curl is there to make one), and checks that the hung worker is dropped and the frames are still finished,
+# and match.
+#
+# usage: tests/cluster.sh (from the directory with project5)
+
+. tests/common.sh
+PORT=$((20000 + $$ % 20000))
+
+COMMANDS='load scene2.data
+mv left 1
+mv up 0.5
+'
+
+# Without workers.
+printf '%s' "$COMMANDS" | "$PROJECT5" -headless 200 150 -o local.pfm > local.txt 2>&1
+
+# With three workers. The coordinator waits for them to join before it renders.
+mkfifo commands
+"$PROJECT5" -headless 200 150 -o cluster.pfm < commands > coordinator.txt 2>&1 &
+echo $! > coordinator.pid
+exec 3> commands
+echo "cluster $PORT 3" >&3
+sleep 0.5
+for w in 1 2 3; do
+	"$PROJECT5" -worker "localhost:$PORT" > worker$w.txt 2>&1 3>&- &
+	echo $! > worker$w.pid
+done
+printf '%s' "$COMMANDS" >&3
+echo "cluster" >&3
+exec 3>&-
+wait $(cat coordinator.pid)
+for w in 1 2 3; do wait $(cat worker$w.pid); done
+rm -f *.pid
+
+# With a worker that hangs, and a connection that never says hello. The coordinator is killed if it doesn't finish.
+mkfifo hung.commands silent
+"$PROJECT5" -headless 200 150 -o hung.pfm < hung.commands > hung.txt 2>&1 &
+echo $! > coordinator.pid
+exec 3> hung.commands
+echo "cluster timeout 1000" >&3
+echo "cluster $((PORT + 1)) 1" >&3
+sleep 0.5
+if command -v curl > /dev/null; then
+	curl -s "telnet://localhost:$((PORT + 1))" < silent > /dev/null 2>&1 3>&- &
+	echo $! > silent.pid
+	exec 4> silent
+	sleep 0.5
+fi
+"$PROJECT5" -worker "localhost:$((PORT + 1))" > hung.worker.txt 2>&1 3>&- 4>&- &
+echo $! > worker.pid
+tries=0
+while ! grep -q "render workers joined" hung.txt && [ $tries -lt 100 ]; do
+	sleep 0.1
+	tries=$((tries + 1))
+done
+kill -STOP $(cat worker.pid)
+(sleep 30 && touch hung.killed && kill $(cat coordinator.pid)) > /dev/null 2>&1 3>&- 4>&- &
+echo $! > watchdog.pid
+printf '%s' "$COMMANDS" >&3
+exec 3>&-
+wait $(cat coordinator.pid)
+kill $(cat watchdog.pid) 2>/dev/null
+kill $(cat worker.pid) 2>/dev/null
+kill -CONT $(cat worker.pid) 2>/dev/null
+exec 4>&-
+rm -f *.pid
+
+failed=0
+if ! grep -q "3 of 3 render workers joined" coordinator.txt; then
+	echo "FAIL: the workers didn't join."
+	failed=1
+fi
+if ! cmp -s local.pfm cluster.pfm; then
+	echo "FAIL: the frame rendered by the workers differs from the local one."
+	failed=1
+fi
+for w in 1 2 3; do
+	loads=$(grep -c "Loaded the scene sent by the coordinator" worker$w.txt)
+	if [ "$loads" != "1" ]; then
+		echo "FAIL: worker $w was sent the scene $loads times (moving the camera shouldn't resend it)."
+		failed=1
+	fi
+	if grep -q "^Rendered 0 tiles" worker$w.txt; then
+		echo "FAIL: worker $w rendered no tiles."
+		failed=1
+	fi
+done
+if ! grep -q "1 of 1 render workers joined" hung.txt; then
+	echo "FAIL: the worker that was to hang didn't join (or the connection that never says hello was counted)."
+	failed=1
+elif [ -e hung.killed ]; then
+	echo "FAIL: the frames weren't finished with a hung worker."
+	failed=1
+elif ! grep -q "hasn't finished a tile in 1000 ms, so it is dropped" hung.txt; then
+	echo "FAIL: the hung worker wasn't dropped."
+	failed=1
+elif ! cmp -s local.pfm hung.pfm; then
+	echo "FAIL: the frame finished without the hung worker differs from the local one."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat coordinator.txt worker1.txt hung.txt
+	exit 1
+fi
+passed "frames rendered on three workers match those rendered without, each worker got the scene once, and" \
+	"frames are finished, the same, when a worker hangs$(command -v curl > /dev/null &&
+	echo " next to a connection that never says hello")"
@@ -0,0 +1,22 @@
+# common.sh
+#
+# The setup the tests share. Sets PROJECT5 (project5) and TESTS (the directory with the test programs), makes a
+# temporary directory WORK with a copy of scene2.data in it, and moves to it to run the test. When the test exits,
+# the processes whose ids it left in *.pid files in WORK are killed, and WORK is removed.
+#
+# usage: . tests/common.sh (from the directory with project5, at the top of a test)
+
+TEST=$(basename "$0" .sh)
+PROJECT5="$(pwd)/project5"
+TESTS="$(pwd)/tests"
+WORK=$(mktemp -d)
+trap 'kill $(cat "$WORK"/*.pid 2>/dev/null) 2>/dev/null; rm -rf "$WORK"' EXIT
+
+cp scene2.data "$WORK/"
+cd "$WORK" || exit 1
+
+# Says that the test passed, and what it checked (the arguments, joined by spaces).
+passed()
+{
+	echo "$TEST: passed ($*)"
+}
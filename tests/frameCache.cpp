@@ -0,0 +1,121 @@
+/* frameCache.cpp
+ *
+ * Runs commands on a scene as project5 does, rendering a frame after each one that changes it: shapes are added
+ * and deleted, and each change is undone. Checks that every frame after an undo is the frame from before the
+ * undone command, shown from the frame cache, and that every other frame is traced.
+ *
+ * usage: tests/frameCache <scene file>
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "commandHandler.h"
+#include "frameBuffer.h"
+#include "frameCache.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+#include "viewport.h"
+
+const int WIDTH = 120;
+const int HEIGHT = 90;
+const int CACHE_MB = 16;
+
+// The commands run after the scene is loaded. An undo is expected to show the frame from before the command it
+// undoes.
+const std::vector<std::string> COMMANDS = {
+	"cube 0 -20 0 10 1 0 0 0.5 0.2 0 3",
+	"undo",
+	"delete 0",
+	"sphere 20 0 -10 8 0 1 0 0.5 0 0 3",
+	"undo",
+	"undo",
+};
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		std::cout << "usage: " << argv[0] << " <scene file>" << std::endl;
+		return 2;
+	}
+
+	ThreadPool pool(0);
+	ShapeCollection shapes;
+	Viewport viewport(Coord(0, 0), WIDTH, HEIGHT, &shapes);
+	shapes.setViewport(&viewport);
+	FrameBuffer buffer(WIDTH, HEIGHT);
+	FrameCache cache(CACHE_MB);
+	viewport.setThreadPool(&pool);
+	viewport.setFrameBuffer(&buffer);
+	viewport.setKeepFrame(true);
+	viewport.setFrameCache(&cache);
+	CommandHandler handler;
+
+	std::stringstream input;
+	input << "load " << argv[1] << "\n";
+	for (int i = 0; i < (int)COMMANDS.size(); i++)
+	{
+		input << COMMANDS[i] << "\n";
+	}
+	std::cin.rdbuf(input.rdbuf());
+
+	// The frames rendered, and whether each was shown from the cache (which the viewport says).
+	std::vector<std::vector<float>> frames;
+	std::vector<bool> cached;
+	// The frames from before each command that can still be undone.
+	std::vector<int> undoFrames;
+	int undone = 0;
+	bool failed = false;
+	for (int i = -1; handler.getUserInput(); i++)
+	{
+		std::string command = (i < 0) ? "load" : COMMANDS[i];
+		bool redraw = true;
+		handler.execute(&shapes, &viewport, redraw);
+		if (!redraw)
+		{
+			std::cout << "FAIL: \"" << command << "\" didn't render a frame." << std::endl;
+			return 1;
+		}
+
+		std::stringstream output;
+		std::streambuf* standardOutput = std::cout.rdbuf(output.rdbuf());
+		viewport.redraw(true);
+		std::cout.rdbuf(standardOutput);
+
+		std::vector<float> pixels;
+		viewport.readPixels(0, 0, WIDTH, HEIGHT, pixels);
+		frames.push_back(pixels);
+		cached.push_back(output.str().find("shown from the frame cache") != std::string::npos);
+
+		int frame = frames.size() - 1;
+		if (command == "undo")
+		{
+			int before = undoFrames.back();
+			undoFrames.pop_back();
+			undone++;
+			if (frames[frame] != frames[before] || !cached[frame])
+			{
+				std::cout << "FAIL: frame " << frame << " (after an undo) isn't frame " << before
+					<< " from the frame cache." << std::endl;
+				failed = true;
+			}
+		}
+		else
+		{
+			if (frame > 0) undoFrames.push_back(frame - 1);
+			if (cached[frame] || (frame > 0 && frames[frame] == frames[frame - 1]))
+			{
+				std::cout << "FAIL: frame " << frame << " (after \"" << command << "\") wasn't traced." << std::endl;
+				failed = true;
+			}
+		}
+	}
+	if (failed) return 1;
+
+	std::cout << frames.size() << " frames, " << undone << " of them undone from the frame cache" << std::endl;
+	return 0;
+}
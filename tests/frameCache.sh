@@ -0,0 +1,16 @@
+#!/bin/sh
+# frameCache.sh
+#
+# Checks with tests/frameCache that undoing a change to the scene shows the frame from before it, from the frame
+# cache.
+#
+# usage: tests/frameCache.sh (from the directory with project5 and tests/frameCache)
+
+. tests/common.sh
+CHECK="$TESTS/frameCache"
+
+if ! "$CHECK" scene2.data > logs 2>&1; then
+	cat logs
+	exit 1
+fi
+passed "$(tail -n 1 logs)"
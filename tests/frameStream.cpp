@@ -0,0 +1,72 @@
+/* frameStream.cpp
+ *
+ * Renders a scene at a size that isn't square twice: once streamed to a PPM file as its tiles finish, and once
+ * kept whole in the frame buffer, which is then written to a PPM file. The files are compared by the caller. Checks
+ * that the streamed frame held only part of its pixels at once.
+ *
+ * usage: tests/frameStream <scene file> <streamed .ppm> <kept .ppm>
+ *
+ */
+
+#include <iostream>
+#include <string>
+
+#include "frameBuffer.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+#include "viewport.h"
+
+const int WIDTH = 400;
+const int HEIGHT = 250;
+
+// Renders the scene into the PPM file, streamed, or kept whole and written afterwards. Returns the most bytes of
+// pixels held at once (0 if it can't be rendered).
+size_t render(std::string sceneFile, ThreadPool* pool, bool streamed, std::string fileName)
+{
+	ShapeCollection shapes;
+	Viewport viewport(Coord(0, 0), WIDTH, HEIGHT, &shapes);
+	shapes.setViewport(&viewport);
+	FrameBuffer buffer(WIDTH, HEIGHT);
+	viewport.setThreadPool(pool);
+	viewport.setFrameBuffer(&buffer);
+	viewport.setKeepFrame(!streamed);
+	viewport.setTileListener([&](int x, int y, int width, int height)
+	{
+		buffer.tileFinished(x, y, width, height);
+	});
+	if (!shapes.loadFromFile(sceneFile)) return 0;
+
+	if (streamed && !buffer.beginStream(fileName, 0, 0, WIDTH, HEIGHT)) return 0;
+	viewport.redraw(false);
+	if (!streamed && !buffer.beginStream(fileName, 0, 0, WIDTH, HEIGHT)) return 0;
+	if (!buffer.endStream()) return 0;
+	return buffer.peakAllocatedBytes();
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 4)
+	{
+		std::cout << "usage: " << argv[0] << " <scene file> <streamed .ppm> <kept .ppm>" << std::endl;
+		return 2;
+	}
+
+	ThreadPool pool(0);
+	size_t streamedBytes = render(argv[1], &pool, true, argv[2]);
+	size_t keptBytes = render(argv[1], &pool, false, argv[3]);
+	if (streamedBytes == 0 || keptBytes == 0)
+	{
+		std::cout << "FAIL: could not render \"" << argv[1] << "\" to a file." << std::endl;
+		return 1;
+	}
+	if (streamedBytes >= keptBytes)
+	{
+		std::cout << "FAIL: the streamed frame held " << streamedBytes / 1024 << " KB of pixels at once, as much as "
+			<< "the kept frame (" << keptBytes / 1024 << " KB)." << std::endl;
+		return 1;
+	}
+
+	std::cout << "streaming held at most " << streamedBytes / 1024 << " KB of pixels at once, against "
+		<< keptBytes / 1024 << " KB kept" << std::endl;
+	return 0;
+}
@@ -0,0 +1,21 @@
+#!/bin/sh
+# frameStream.sh
+#
+# Checks with tests/frameStream that a frame streamed to a file as its tiles finish is byte-identical to the same
+# frame kept whole and written afterwards, and that streaming holds fewer pixels at once.
+#
+# usage: tests/frameStream.sh (from the directory with project5 and tests/frameStream)
+
+. tests/common.sh
+CHECK="$TESTS/frameStream"
+
+if ! "$CHECK" scene2.data streamed.ppm kept.ppm > logs 2>&1; then
+	cat logs
+	exit 1
+fi
+if [ ! -s streamed.ppm ] || ! cmp -s streamed.ppm kept.ppm; then
+	echo "FAIL: the streamed frame differs from the kept one."
+	cat logs
+	exit 1
+fi
+passed "the streamed and kept frames are the same, and $(tail -n 1 logs)"
@@ -0,0 +1,230 @@
+/* imageWriter.cpp
+ *
+ * Checks that image files written by project5 hold the same frame: decodes a PNG (checking its chunk CRCs and
+ * undoing its row filters) and a PFM (converting it to 8 bits with the gamma given), and compares both with a
+ * PPM of the frame.
+ *
+ * usage: tests/imageWriter <.ppm> <.png> <.pfm> [gamma]
+ *
+ */
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "pixelConverter.h"
+
+// Reads the whole file. Returns false if it can't be read.
+bool readFile(std::string fileName, std::vector<unsigned char> &data)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	if (!file.is_open()) return false;
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+// Reads the header of a PPM or PFM file, and returns the offset of its pixels (0 if the header isn't valid).
+size_t readHeader(const std::vector<unsigned char> &data, std::string magic, int &width, int &height)
+{
+	// The header is four whitespace-separated fields, followed by a single whitespace character.
+	std::vector<std::string> fields;
+	size_t i = 0;
+	while (fields.size() < 4 && i < data.size())
+	{
+		while (i < data.size() && isspace(data[i])) i++;
+		size_t start = i;
+		while (i < data.size() && !isspace(data[i])) i++;
+		fields.push_back(std::string(data.begin() + start, data.begin() + i));
+	}
+	if (fields.size() < 4 || fields[0] != magic || i >= data.size()) return 0;
+	width = atoi(fields[1].c_str());
+	height = atoi(fields[2].c_str());
+	return (width > 0 && height > 0) ? i + 1 : 0;
+}
+
+// Reads a binary PPM file into 8-bit RGB pixels, top row first.
+bool readPPM(std::string fileName, int &width, int &height, std::vector<unsigned char> &pixels)
+{
+	std::vector<unsigned char> data;
+	if (!readFile(fileName, data)) return false;
+	size_t offset = readHeader(data, "P6", width, height);
+	if (offset == 0 || data.size() - offset != (size_t)width * height * 3) return false;
+	pixels.assign(data.begin() + offset, data.end());
+	return true;
+}
+
+// Reads a PFM file, and converts it to 8-bit RGB pixels, top row first, with the gamma.
+bool readPFM(std::string fileName, float gamma, int &width, int &height, std::vector<unsigned char> &pixels)
+{
+	std::vector<unsigned char> data;
+	if (!readFile(fileName, data)) return false;
+	size_t offset = readHeader(data, "PF", width, height);
+	size_t rowValues = (size_t)width * 3;
+	if (offset == 0 || data.size() - offset != rowValues * height * sizeof(float)) return false;
+
+	// PFM files start with the bottom row.
+	std::vector<float> values(rowValues * height);
+	std::copy(data.begin() + offset, data.end(), (unsigned char*)values.data());
+	PixelConverter converter(gamma);
+	pixels.resize(values.size());
+	for (int j = 0; j < height; j++)
+	{
+		converter.convert(values.data() + j * rowValues, pixels.data() + (height - 1 - j) * rowValues, rowValues);
+	}
+	return true;
+}
+
+// Returns the byte the PNG Paeth filter predicts from the bytes to the left, above, and above left.
+unsigned char paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	if (pa <= pb && pa <= pc) return a;
+	return (pb <= pc) ? b : c;
+}
+
+// Reads an 8-bit RGB PNG file into pixels, top row first. Prints what is wrong with it if it can't be read.
+bool readPNG(std::string fileName, int &width, int &height, std::vector<unsigned char> &pixels)
+{
+	static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+	std::vector<unsigned char> data;
+	if (!readFile(fileName, data) || data.size() < 8 || !std::equal(signature, signature + 8, data.begin()))
+	{
+		std::cout << "\"" << fileName << "\" isn't a PNG file." << std::endl;
+		return false;
+	}
+
+	// Gather the image data from the IDAT chunks, checking the CRC of every chunk.
+	std::vector<unsigned char> compressed;
+	bool ended = false;
+	width = 0;
+	height = 0;
+	size_t i = 8;
+	while (!ended && i + 12 <= data.size())
+	{
+		uint32_t length = (data[i] << 24) | (data[i + 1] << 16) | (data[i + 2] << 8) | data[i + 3];
+		if (i + 12 + length > data.size()) break;
+		std::string type(data.begin() + i + 4, data.begin() + i + 8);
+		const unsigned char* body = data.data() + i + 8;
+		const unsigned char* end = body + length;
+		uint32_t crc = (end[0] << 24) | (end[1] << 16) | (end[2] << 8) | end[3];
+		if (crc32(0, data.data() + i + 4, length + 4) != crc)
+		{
+			std::cout << "The CRC of the " << type << " chunk of \"" << fileName << "\" is wrong." << std::endl;
+			return false;
+		}
+
+		if (type == "IHDR" && length == 13)
+		{
+			width = (body[0] << 24) | (body[1] << 16) | (body[2] << 8) | body[3];
+			height = (body[4] << 24) | (body[5] << 16) | (body[6] << 8) | body[7];
+			if (body[8] != 8 || body[9] != 2 || body[12] != 0)
+			{
+				std::cout << "\"" << fileName << "\" isn't 8-bit RGB without interlacing." << std::endl;
+				return false;
+			}
+		}
+		else if (type == "IDAT")
+		{
+			compressed.insert(compressed.end(), body, end);
+		}
+		ended = (type == "IEND");
+		i += 12 + length;
+	}
+	if (!ended || width <= 0 || height <= 0)
+	{
+		std::cout << "\"" << fileName << "\" is cut short." << std::endl;
+		return false;
+	}
+
+	// Every row starts with the filter it was written with.
+	size_t rowBytes = (size_t)width * 3;
+	std::vector<unsigned char> filtered((rowBytes + 1) * height);
+	uLongf size = filtered.size();
+	if (uncompress(filtered.data(), &size, compressed.data(), compressed.size()) != Z_OK || size != filtered.size())
+	{
+		std::cout << "The image data of \"" << fileName << "\" can't be inflated." << std::endl;
+		return false;
+	}
+
+	pixels.assign(rowBytes * height, 0);
+	for (int j = 0; j < height; j++)
+	{
+		const unsigned char* in = filtered.data() + j * (rowBytes + 1);
+		unsigned char* row = pixels.data() + j * rowBytes;
+		const unsigned char* above = (j > 0) ? row - rowBytes : nullptr;
+		for (size_t k = 0; k < rowBytes; k++)
+		{
+			int a = (k >= 3) ? row[k - 3] : 0;
+			int b = above ? above[k] : 0;
+			int c = (above && k >= 3) ? above[k - 3] : 0;
+			int predicted;
+			switch (in[0])
+			{
+				case 0: predicted = 0; break;
+				case 1: predicted = a; break;
+				case 2: predicted = b; break;
+				case 3: predicted = (a + b) / 2; break;
+				case 4: predicted = paeth(a, b, c); break;
+				default:
+					std::cout << "Row " << j << " of \"" << fileName << "\" has an unknown filter." << std::endl;
+					return false;
+			}
+			row[k] = in[k + 1] + predicted;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 4 && argc != 5)
+	{
+		std::cout << "usage: " << argv[0] << " <.ppm> <.png> <.pfm> [gamma]" << std::endl;
+		return 2;
+	}
+	float gamma = (argc == 5) ? atof(argv[4]) : 1.0;
+
+	int width, height;
+	std::vector<unsigned char> ppm;
+	if (!readPPM(argv[1], width, height, ppm))
+	{
+		std::cout << "FAIL: \"" << argv[1] << "\" isn't a binary PPM file." << std::endl;
+		return 1;
+	}
+
+	int pngWidth, pngHeight;
+	std::vector<unsigned char> png;
+	if (!readPNG(argv[2], pngWidth, pngHeight, png))
+	{
+		std::cout << "FAIL: \"" << argv[2] << "\" can't be decoded." << std::endl;
+		return 1;
+	}
+	if (pngWidth != width || pngHeight != height || png != ppm)
+	{
+		std::cout << "FAIL: \"" << argv[2] << "\" differs from \"" << argv[1] << "\"." << std::endl;
+		return 1;
+	}
+
+	int pfmWidth, pfmHeight;
+	std::vector<unsigned char> pfm;
+	if (!readPFM(argv[3], gamma, pfmWidth, pfmHeight, pfm))
+	{
+		std::cout << "FAIL: \"" << argv[3] << "\" isn't a PFM file." << std::endl;
+		return 1;
+	}
+	if (pfmWidth != width || pfmHeight != height || pfm != ppm)
+	{
+		std::cout << "FAIL: \"" << argv[3] << "\" differs from \"" << argv[1] << "\" (with a gamma of " << gamma << ")."
+			<< std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+# imageWriter.sh
+#
+# Renders a scene into a streamed PPM file, and into numbered PFM files and "image" snapshots (PPM and PNG, with
+# and without gamma) through the image writer, and checks that they all hold the same frame. Also loads the scene
+# from, and writes snapshots to, absolute paths in mixed case, and checks that the files are where they were named.
+#
+# usage: tests/imageWriter.sh (from the directory with project5 and tests/imageWriter)
+
+. tests/common.sh
+CHECK="$TESTS/imageWriter"
+printf 'load scene2.data\n' | "$PROJECT5" -headless 200 150 -o stream.ppm > stream.txt 2>&1
+printf 'load scene2.data\nimage shot.ppm\nimage shot.png\nimage gamma 2.2\nimage gamma.ppm\nimage gamma.png\n' \
+	| "$PROJECT5" -headless 200 150 -o 'frame##.pfm' > writer.txt 2>&1
+mkdir Shots
+cp scene2.data Shots/Scene2.data
+printf 'load %s/Shots/Scene2.data\nimage %s/Shots/Shot.PPM\nimage %s/Shots/Shot.png\n' "$WORK" "$WORK" "$WORK" \
+	| "$PROJECT5" -headless 200 150 > paths.txt 2>&1
+
+failed=0
+# The first frame (before the scene is loaded) is frame00.pfm.
+if [ ! -s frame00.pfm ] || [ ! -s frame01.pfm ] || [ -e frame02.pfm ]; then
+	echo "FAIL: the frames weren't written to numbered files."
+	failed=1
+fi
+if ! cmp -s stream.ppm shot.ppm; then
+	echo "FAIL: the streamed PPM differs from the one written by the image writer."
+	failed=1
+fi
+"$CHECK" shot.ppm shot.png frame01.pfm || failed=1
+"$CHECK" gamma.ppm gamma.png frame01.pfm 2.2 || failed=1
+if [ ! -s Shots/Shot.PPM ] || [ ! -s Shots/Shot.png ]; then
+	echo "FAIL: the snapshots named by absolute paths in mixed case weren't written there."
+	cat paths.txt
+	failed=1
+else
+	"$CHECK" Shots/Shot.PPM Shots/Shot.png frame01.pfm || failed=1
+fi
+if cmp -s shot.ppm gamma.ppm; then
+	echo "FAIL: the gamma didn't change the image."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat writer.txt
+	exit 1
+fi
+passed "the streamed PPM, and the PPM, PNG and PFM files of the writer hold the same frame, also when named by" \
+	"absolute paths in mixed case"
@@ -0,0 +1,58 @@
+#!/bin/sh
+# instancing.sh
+#
+# Adds cubes (instances of one shared mesh) to a scene, saves it as a text scene and as a binary scene, and checks
+# that both load back to the same frame as the scene they were saved from, and that the mesh is saved once. The
+# binary scene stores meshes in the order of their hierarchies, without their names, so saving it as text doesn't
+# give the text scene back; but from then on, binary and text scenes turn into each other unchanged.
+#
+# usage: tests/instancing.sh (from the directory with project5)
+
+. tests/common.sh
+
+# Renders the commands into <name>.pfm (the last frame is the one left in the file).
+render()
+{
+	printf "$2" | "$PROJECT5" -headless 160 120 -o "$1.pfm" > "$1.txt" 2>&1
+}
+
+render plain 'load scene2.data\n'
+render added 'load scene2.data
+cube 0 -20 0 10 1 0 0 0.5 0.2 0 3
+cube 0 20 0 15 0 1 0 0.5 0 0 3
+cube 20 0 -10 5 0 0 1 0.5 0 0 3
+save cubes.data
+save cubes.rtscene
+'
+render text 'load cubes.data\n'
+render binary 'load cubes.rtscene\nsave resaved.data\n'
+render resaved 'load resaved.data\nsave resaved.rtscene\n'
+render again 'load resaved.rtscene\nsave again.data\n'
+
+failed=0
+for name in cubes resaved; do
+	if [ "$(grep -c '^MESH$' $name.data)" -ne 1 ] || [ "$(grep -c '^INSTANCE_SHAPE$' $name.data)" -ne 3 ]; then
+		echo "FAIL: $name.data doesn't have the cube mesh once, and three instances of it."
+		failed=1
+	fi
+done
+if cmp -s plain.pfm added.pfm; then
+	echo "FAIL: the cubes can't be seen, so the frames don't test them."
+	failed=1
+fi
+for name in text binary resaved again; do
+	if ! cmp -s added.pfm $name.pfm; then
+		echo "FAIL: the frame of the $name scene differs from that of the scene it was saved from."
+		failed=1
+	fi
+done
+if ! cmp -s resaved.data again.data; then
+	echo "FAIL: the scene changed when saved as a binary scene and back as text."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat added.txt binary.txt
+	exit 1
+fi
+passed "the text and binary scenes, and each saved as the other, render the same"
@@ -0,0 +1,61 @@
+#!/bin/sh
+# memoryBudget.sh
+#
+# Loads a mesh, and a text scene holding it, under a memory budget they don't fit in, and checks that both loads
+# (and watching the scene) are refused before they are read in whole, that the scene loaded before is kept (and
+# still renders the same), and that the memory used stays within the budget. Without the budget, both load.
+#
+# usage: tests/memoryBudget.sh (from the directory with project5)
+
+. tests/common.sh
+
+# A 200 x 200 grid of vertices (80,000 triangles), which takes about 4 MB with its hierarchy.
+awk -v n=200 'BEGIN {
+	for (j = 0; j < n; j++) for (i = 0; i < n; i++) printf "v %d %d %.3f\n", i, j, ((i * 7 + j * 13) % 17) / 17.0;
+	for (j = 0; j < n - 1; j++) for (i = 0; i < n - 1; i++) {
+		a = j * n + i + 1;
+		printf "f %d %d %d\nf %d %d %d\n", a, a + 1, a + n, a + 1, a + n + 1, a + n;
+	}
+}' > grid.obj
+printf 'load scene2.data\nload grid.obj 0 0 0 100\nsave grid.data\n' | "$PROJECT5" -headless 100 80 > unbudgeted.txt 2>&1
+if ! grep -q 'Imported "grid.obj" successfully' unbudgeted.txt || [ ! -s grid.data ]; then
+	echo "FAIL: the mesh couldn't be loaded without a budget."
+	cat unbudgeted.txt
+	exit 1
+fi
+
+# Frames 1 to 3 are of scene2: after it is loaded, and after each load that is refused. Watching the scene is
+# refused too.
+printf 'load scene2.data\nload grid.obj 0 0 0 100\nload grid.data\nwatch grid.data\n' \
+	| "$PROJECT5" -headless 100 80 -mem-budget 2 -mem-json memory.json -o 'budgeted#.pfm' > budgeted.txt 2>&1
+
+failed=0
+if ! grep -q 'Could not import "grid.obj": the mesh needs about' budgeted.txt; then
+	echo "FAIL: the mesh wasn't refused from its size."
+	failed=1
+fi
+if ! grep -q 'Could not parse "grid.data": the scene needs more than .* on line' budgeted.txt; then
+	echo "FAIL: the text scene wasn't refused while it was parsed."
+	failed=1
+fi
+if [ "$(grep -c 'Could not parse "grid.data": the scene needs more than' budgeted.txt)" != 2 ] \
+	|| ! grep -q 'Failed to load from file "grid.data"' budgeted.txt; then
+	echo "FAIL: watching the text scene wasn't refused."
+	failed=1
+fi
+if ! cmp -s budgeted1.pfm budgeted2.pfm || ! cmp -s budgeted1.pfm budgeted3.pfm; then
+	echo "FAIL: the scene changed when a load was refused."
+	failed=1
+fi
+total=$(sed 's/.*"total": \([0-9]*\).*/\1/' memory.json)
+budget=$(sed 's/.*"budget": \([0-9]*\).*/\1/' memory.json)
+if [ "$budget" != $((2 * 1024 * 1024)) ] || [ "$total" -gt "$budget" ]; then
+	echo "FAIL: the renderer uses $total bytes, with a budget of $budget."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat budgeted.txt memory.json
+	exit 1
+fi
+passed "a mesh and a scene (loaded or watched) over a 2 MB budget were refused, using $((total / 1024)) KB"
@@ -0,0 +1,69 @@
+#!/bin/sh
+# meshImport.sh
+#
+# Imports the same grid as an OBJ mesh and as an ascii PLY mesh, and checks that both render the same. Then imports
+# binary PLY meshes whose face counts are damaged (one far larger than the file), and checks that they are refused
+# without reading past the file, and that the scene loaded before is kept.
+#
+# usage: tests/meshImport.sh (from the directory with project5)
+
+. tests/common.sh
+
+# A 20 x 20 grid of vertices (722 triangles), written in both formats.
+awk -v n=20 'BEGIN {
+	for (j = 0; j < n; j++) for (i = 0; i < n; i++) printf "v %d %d %.3f\n", i, j, ((i * 7 + j * 13) % 17) / 17.0;
+	for (j = 0; j < n - 1; j++) for (i = 0; i < n - 1; i++) {
+		a = j * n + i + 1;
+		printf "f %d %d %d\nf %d %d %d\n", a, a + 1, a + n, a + 1, a + n + 1, a + n;
+	}
+}' > grid.obj
+awk -v n=20 'BEGIN {
+	printf "ply\nformat ascii 1.0\nelement vertex %d\nproperty float x\nproperty float y\nproperty float z\n", n * n;
+	printf "element face %d\nproperty list uchar int vertex_indices\nend_header\n", 2 * (n - 1) * (n - 1);
+	for (j = 0; j < n; j++) for (i = 0; i < n; i++) printf "%d %d %.3f\n", i, j, ((i * 7 + j * 13) % 17) / 17.0;
+	for (j = 0; j < n - 1; j++) for (i = 0; i < n - 1; i++) {
+		a = j * n + i;
+		printf "3 %d %d %d\n3 %d %d %d\n", a, a + 1, a + n, a + 1, a + n + 1, a + n;
+	}
+}' > grid.ply
+
+# A triangle, then a face that claims 2^31 - 1 points (with a uint count), and one that claims 255 points (with the
+# uchar count of the fast path), in files of a few dozen bytes.
+header() {
+	printf 'ply\nformat binary_little_endian 1.0\nelement vertex 3\nproperty float x\nproperty float y\nproperty float z\n'
+	printf 'element face 2\nproperty list %s int vertex_indices\nend_header\n' "$1"
+	# (0, 0, 0), (1, 0, 0) and (0, 1, 0) as little-endian floats.
+	printf '\000\000\000\000\000\000\000\000\000\000\000\000'
+	printf '\000\000\200\077\000\000\000\000\000\000\000\000'
+	printf '\000\000\000\000\000\000\200\077\000\000\000\000'
+}
+{ header uint; printf '\003\000\000\000\000\000\000\000\001\000\000\000\002\000\000\000\377\377\377\177'; } > huge.ply
+{ header uchar; printf '\003\000\000\000\000\001\000\000\000\002\000\000\000\377\000\000\000\000'; } > long.ply
+
+printf 'load scene2.data\nload grid.obj 0 0 0 20\n' | "$PROJECT5" -headless 100 80 -o 'obj#.pfm' > logs 2>&1
+printf 'load scene2.data\nload grid.ply 0 0 0 20\nload huge.ply 0 0 0 20\nload long.ply 0 0 0 20\n' \
+	| "$PROJECT5" -headless 100 80 -o 'ply#.pfm' >> logs 2>&1
+
+failed=0
+if ! grep -q 'Imported "grid.obj" successfully' logs || ! grep -q 'Imported "grid.ply" successfully' logs; then
+	echo "FAIL: the grid couldn't be imported."
+	failed=1
+fi
+if ! cmp -s obj2.pfm ply2.pfm; then
+	echo "FAIL: the PLY grid renders differently from the OBJ grid."
+	failed=1
+fi
+if ! grep -q 'Could not import "huge.ply": bad face 1' logs || ! grep -q 'Could not import "long.ply": bad face 1' logs; then
+	echo "FAIL: the damaged faces weren't refused."
+	failed=1
+fi
+if ! cmp -s ply2.pfm ply3.pfm || ! cmp -s ply2.pfm ply4.pfm; then
+	echo "FAIL: the scene changed when a damaged mesh was refused."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat logs
+	exit 1
+fi
+passed "an OBJ and a PLY grid rendered the same, and 2 PLY meshes with damaged face sizes were refused"
@@ -0,0 +1,85 @@
+#!/bin/sh
+# metrics.sh
+#
+# Renders a few frames (one of them from the frame cache) and checks the metrics the "metrics" command prints
+# against them, and that the metrics file and the HTTP endpoint (when curl is there to fetch it) count the same
+# frames.
+#
+# usage: tests/metrics.sh (from the directory with project5)
+
+. tests/common.sh
+PORT=$((20000 + ($$ + 7) % 20000))
+
+# The size of the frames, which are rendered without anti-aliasing (so with a primary ray per pixel).
+WIDTH=100
+HEIGHT=80
+
+# Returns the value of the metric in the file.
+metric()
+{
+	awk -v name="$2" '$1 == name { print $2 }' "$1" | tail -n 1
+}
+
+# Waits until the file has the line (or gives up after 20 s).
+waitFor()
+{
+	tries=0
+	while ! grep -q "$2" "$1" && [ $tries -lt 400 ]; do
+		sleep 0.05
+		tries=$((tries + 1))
+	done
+}
+
+# Waits until the metric in the file has the value (or gives up after 20 s).
+waitForMetric()
+{
+	tries=0
+	while [ "$(metric "$1" "$2" 2>/dev/null)" != "$3" ] && [ $tries -lt 400 ]; do
+		sleep 0.05
+		tries=$((tries + 1))
+	done
+}
+
+# Frame 0 is of the empty scene, 1 of the loaded scene, 2 after the camera moves, and 3 (from the frame cache)
+# after it moves back.
+mkfifo commands
+"$PROJECT5" -headless $WIDTH $HEIGHT -metrics-port $PORT < commands > output.txt 2>&1 &
+echo $! > project5.pid
+exec 3> commands
+printf 'metrics file metrics.prom 1\nload scene2.data\nmv left 1\nmv right 1\nmetrics\n' >&3
+waitFor output.txt "^raytracer_frame_cache_bytes"
+waitForMetric metrics.prom raytracer_frames_total 4
+if command -v curl > /dev/null; then
+	curl -s "http://127.0.0.1:$PORT/metrics" > served.txt
+fi
+exec 3>&-
+wait $(cat project5.pid)
+rm -f project5.pid
+
+failed=0
+# Checks that the metric in the file has the value.
+expect()
+{
+	value=$(metric "$1" "$2")
+	if [ "$value" != "$3" ]; then
+		echo "FAIL: $2 is ${value:-missing} in $1, rather than $3."
+		failed=1
+	fi
+}
+expect output.txt raytracer_frames_total 4
+expect output.txt raytracer_frames_cached_total 1
+expect output.txt raytracer_frame_cache_hits_total 1
+expect output.txt 'raytracer_rays_total{kind="primary"}' $((3 * WIDTH * HEIGHT))
+expect output.txt raytracer_frame_seconds_count 4
+expect output.txt 'raytracer_frame_seconds_bucket{le="+Inf"}' 4
+expect metrics.prom raytracer_frames_total 4
+if [ -e served.txt ]; then
+	expect served.txt raytracer_frames_total 4
+fi
+
+if [ $failed -ne 0 ]; then
+	cat output.txt
+	exit 1
+fi
+passed "the printed metrics count the frames and rays rendered, as do the file" \
+	"$([ -e served.txt ] && echo "and the HTTP endpoint" || echo "(the HTTP endpoint wasn't checked: there is no curl)")"
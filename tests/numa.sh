@@ -0,0 +1,51 @@
+#!/bin/sh
+# numa.sh
+#
+# Renders a scene with NUMA-aware render threads on emulated nodes (this works on machines with a single node),
+# with and without a copy of the scene on each node, into PFM files and streamed PPM files, and checks that every
+# frame matches the one rendered without NUMA. Also checks that the NUMA benchmark finds its frames the same.
+#
+# usage: tests/numa.sh (from the directory with project5)
+
+. tests/common.sh
+
+# The last frame is rendered after a camera move, so replicas are made for one frame and used for the next.
+COMMANDS='load scene2.data
+mv left 1
+'
+for format in pfm ppm; do
+	printf '%s' "$COMMANDS" | "$PROJECT5" -headless 200 150 -o plain.$format > plain.$format.txt 2>&1
+done
+
+failed=0
+for nodes in 2 3; do
+	for replicate in off on; do
+		for format in pfm ppm; do
+			name=numa$nodes-$replicate.$format
+			printf 'numa replicate %s\n%s' $replicate "$COMMANDS" \
+				| "$PROJECT5" -headless 200 150 -numa-nodes $nodes -o $name > $name.txt 2>&1
+			if [ ! -s $name ] || ! cmp -s plain.$format $name; then
+				echo "FAIL: the $format frame rendered on $nodes nodes (with replicas $replicate) differs from the" \
+					"one rendered without NUMA."
+				cat $name.txt
+				failed=1
+			fi
+			if [ $replicate = on ] && ! grep -q "^Copied the scene to $nodes NUMA nodes" $name.txt; then
+				echo "FAIL: the scene wasn't copied to the $nodes nodes."
+				failed=1
+			fi
+		done
+	done
+done
+
+printf '%snuma bench 2\n' "$COMMANDS" | "$PROJECT5" -headless 200 150 -numa-nodes 2 > bench.txt 2>&1
+if [ "$(grep -c 'ms per frame' bench.txt)" -ne 3 ] || grep -q "frames differ" bench.txt; then
+	echo "FAIL: the frames of the NUMA benchmark differ."
+	cat bench.txt
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	exit 1
+fi
+passed "frames rendered on 2 and 3 emulated nodes, with and without replicas, match"
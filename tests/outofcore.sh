@@ -0,0 +1,91 @@
+#!/bin/sh
+# outofcore.sh
+#
+# Renders a binary scene with a mesh several times bigger than a resident limit on its mapped file, and checks
+# that the frame matches the one rendered without the limit, and that the peak resident set of the process
+# (VmHWM) grew by little more than the limit, while without it it grows by most of the file.
+#
+# usage: tests/outofcore.sh (from the directory with project5)
+
+. tests/common.sh
+
+# The resident limit, and how much more the process may grow by (the frame, the hierarchy of the scene and what
+# is read between two checks of the limit), in KB.
+LIMIT_MB=4
+SLACK_KB=8192
+
+# A 500 x 500 grid of vertices (half a million triangles), which maps as a 24 MB scene.
+awk -v n=500 'BEGIN {
+	for (j = 0; j < n; j++) for (i = 0; i < n; i++) printf "v %d %d %.3f\n", i, j, ((i * 7 + j * 13) % 17) / 17.0;
+	for (j = 0; j < n - 1; j++) for (i = 0; i < n - 1; i++) {
+		a = j * n + i + 1;
+		printf "f %d %d %d\nf %d %d %d\n", a, a + 1, a + n, a + 1, a + n + 1, a + n;
+	}
+}' > grid.obj
+printf '0 0 0\n126 42 36\n0 0 0\n0 0 1\n30\n0.2\n\n1\n1 1 1\n500\n-200 200 200\n\n0\n' > camera.data
+printf 'load camera.data\nload grid.obj 0 0 0 100\nsave grid.rtscene\n' \
+	| "$PROJECT5" -headless 100 100 -o import.pfm > import.txt 2>&1
+if [ ! -s grid.rtscene ]; then
+	echo "FAIL: the mesh couldn't be imported and saved."
+	cat import.txt
+	exit 1
+fi
+FILE_KB=$(( $(wc -c < grid.rtscene) / 1024 ))
+
+# Waits until the output file has the status of the mapped files n times (or gives up after 60 s).
+waitForStatus()
+{
+	tries=0
+	while [ "$(grep -c "Mapped files:" "$1")" -lt "$2" ] && [ $tries -lt 1200 ]; do
+		sleep 0.05
+		tries=$((tries + 1))
+	done
+}
+
+# Renders the scene with the resident limit given ("off" for none) into <name>.pfm, and sets GROWTH_KB to how
+# much the peak resident set grew by from before the scene was loaded to after it was rendered.
+render()
+{
+	rm -f commands
+	mkfifo commands
+	"$PROJECT5" -headless 256 192 -o "$1.pfm" < commands > "$1.txt" 2>&1 &
+	pid=$!
+	echo $pid > "$1.pid"
+	exec 3> commands
+	printf 'outofcore %s\noutofcore\n' "$2" >&3
+	waitForStatus "$1.txt" 1
+	before=$(awk '/^VmHWM:/ { print $2 }' /proc/$pid/status)
+	printf 'load grid.rtscene\noutofcore\n' >&3
+	waitForStatus "$1.txt" 2
+	after=$(awk '/^VmHWM:/ { print $2 }' /proc/$pid/status)
+	exec 3>&-
+	wait $pid
+	rm -f "$1.pid"
+	GROWTH_KB=$((after - before))
+}
+
+render incore off
+INCORE_KB=$GROWTH_KB
+render outofcore $LIMIT_MB
+OUTOFCORE_KB=$GROWTH_KB
+
+failed=0
+if ! cmp -s incore.pfm outofcore.pfm; then
+	echo "FAIL: the frame rendered with a resident limit differs from the one rendered without."
+	failed=1
+fi
+if [ $INCORE_KB -le $((LIMIT_MB * 1024 + SLACK_KB)) ]; then
+	echo "FAIL: without a limit the process only grew by $INCORE_KB KB, so the mesh doesn't test the limit."
+	failed=1
+fi
+if [ $OUTOFCORE_KB -gt $((LIMIT_MB * 1024 + SLACK_KB)) ]; then
+	echo "FAIL: with a limit of $LIMIT_MB MB the process grew by $OUTOFCORE_KB KB."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat outofcore.txt
+	exit 1
+fi
+passed "a $FILE_KB KB scene grew the process by $INCORE_KB KB, and by $OUTOFCORE_KB KB with a" \
+	"$LIMIT_MB MB limit"
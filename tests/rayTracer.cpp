@@ -0,0 +1,106 @@
+/* rayTracer.cpp
+ *
+ * Uses the renderer as a library: loads a scene into two ray tracers, renders it from three threads at once
+ * (two of them sharing a ray tracer), and checks that every render matches the frame project5 rendered of the
+ * same scene (a PFM file).
+ *
+ * usage: tests/rayTracer <scene file> <reference .pfm>
+ *
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rayTracer.h"
+
+// The ray tracers, and the threads they render with.
+const int TRACERS = 2;
+const int THREADS_PER_TRACER = 2;
+// The threads that render at once, and the renders each does.
+const int RENDER_THREADS = 3;
+const int RENDERS_PER_THREAD = 4;
+
+// Reads a PFM file written by project5. Returns false if it can't be read.
+bool readPFM(std::string fileName, int &width, int &height, std::vector<float> &pixels)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	std::string magic;
+	float scale;
+	if (!(file >> magic >> width >> height >> scale) || magic != "PF" || width <= 0 || height <= 0) return false;
+	file.get();
+
+	pixels.resize((size_t)width * height * 3);
+	file.read((char*)pixels.data(), pixels.size() * sizeof(float));
+	return (size_t)file.gcount() == pixels.size() * sizeof(float);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3)
+	{
+		std::cout << "usage: " << argv[0] << " <scene file> <reference .pfm>" << std::endl;
+		return 2;
+	}
+
+	RenderSettings settings;
+	std::vector<float> reference;
+	if (!readPFM(argv[2], settings.width, settings.height, reference))
+	{
+		std::cout << "FAIL: could not read \"" << argv[2] << "\"." << std::endl;
+		return 1;
+	}
+
+	std::vector<RayTracer*> tracers;
+	for (int i = 0; i < TRACERS; i++)
+	{
+		tracers.push_back(new RayTracer(THREADS_PER_TRACER));
+		if (!tracers.back()->loadScene(argv[1]))
+		{
+			std::cout << "FAIL: could not load \"" << argv[1] << "\"." << std::endl;
+			return 1;
+		}
+	}
+	settings.camera = tracers.front()->getSceneCamera();
+
+	// Every thread renders into buffers of its own, and counts the renders that differ from the reference.
+	std::vector<int> mismatches(RENDER_THREADS, 0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < RENDER_THREADS; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			RayTracer* tracer = tracers.at(t % TRACERS);
+			std::vector<float> pixels(reference.size());
+			for (int i = 0; i < RENDERS_PER_THREAD; i++)
+			{
+				if (!tracer->render(settings, pixels.data()) || pixels != reference) mismatches.at(t)++;
+			}
+		});
+	}
+	for (int t = 0; t < RENDER_THREADS; t++)
+	{
+		threads.at(t).join();
+	}
+	for (int i = 0; i < TRACERS; i++)
+	{
+		delete tracers.at(i);
+	}
+
+	int failed = 0;
+	for (int t = 0; t < RENDER_THREADS; t++)
+	{
+		failed += mismatches.at(t);
+	}
+	if (failed > 0)
+	{
+		std::cout << "FAIL: " << failed << " of " << RENDER_THREADS * RENDERS_PER_THREAD
+			<< " renders differ from the frame project5 rendered." << std::endl;
+		return 1;
+	}
+	std::cout << "rayTracer: passed (" << RENDER_THREADS * RENDERS_PER_THREAD << " renders on " << RENDER_THREADS
+		<< " threads with " << TRACERS << " ray tracers matched project5)" << std::endl;
+	return 0;
+}
@@ -0,0 +1,17 @@
+#!/bin/sh
+# rayTracer.sh
+#
+# Renders a scene with project5, and checks that tests/rayTracer (the renderer used as a library, from several
+# threads and ray tracers at once) renders the same frame.
+#
+# usage: tests/rayTracer.sh (from the directory with project5 and tests/rayTracer)
+
+. tests/common.sh
+RAYTRACER="$TESTS/rayTracer"
+printf 'load scene2.data\n' | "$PROJECT5" -headless 160 120 -o project5.pfm > project5.txt 2>&1
+if [ ! -s project5.pfm ]; then
+	echo "FAIL: project5 didn't render the scene."
+	cat project5.txt
+	exit 1
+fi
+"$RAYTRACER" scene2.data project5.pfm
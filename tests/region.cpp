@@ -0,0 +1,123 @@
+/* region.cpp
+ *
+ * Renders a scene, limits redraws to a region, moves the camera and redraws. Checks that the pixels in the region
+ * match a full render from the moved camera, that every pixel outside it is left as it was, and that only the
+ * tiles the region touches were rendered.
+ *
+ * usage: tests/region <scene file>
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "frameBuffer.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+#include "viewport.h"
+
+const int WIDTH = 160;
+const int HEIGHT = 120;
+// The region, which doesn't start or end on the edge of a tile.
+const int REGION_X0 = 40;
+const int REGION_Y0 = 20;
+const int REGION_X1 = 110;
+const int REGION_Y1 = 75;
+// How far the camera moves to the left.
+const float MOVE = 20.0;
+// The size of the tiles the viewport renders.
+const int TILE_SIZE = 32;
+
+// Renders the scene into pixels, after the camera has moved if moved is set. If a region is given, the scene is
+// first rendered whole from where the camera was, and only the region is rendered from where it moved to. Returns
+// the stats of the last frame.
+RenderStats render(std::string sceneFile, ThreadPool* pool, bool moved, bool region, std::vector<float> &pixels)
+{
+	ShapeCollection shapes;
+	Viewport viewport(Coord(0, 0), WIDTH, HEIGHT, &shapes);
+	shapes.setViewport(&viewport);
+	FrameBuffer buffer(WIDTH, HEIGHT);
+	viewport.setThreadPool(pool);
+	viewport.setFrameBuffer(&buffer);
+	viewport.setKeepFrame(true);
+	if (!shapes.loadFromFile(sceneFile)) return RenderStats();
+
+	if (region)
+	{
+		viewport.redraw(false);
+		viewport.setRegion(REGION_X0, REGION_Y0, REGION_X1, REGION_Y1);
+	}
+	if (moved)
+	{
+		viewport.moveCamera(dLeft, MOVE);
+	}
+	viewport.redraw(false);
+	viewport.readPixels(0, 0, WIDTH, HEIGHT, pixels);
+	return viewport.getStats();
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		std::cout << "usage: " << argv[0] << " <scene file>" << std::endl;
+		return 2;
+	}
+
+	ThreadPool pool(0);
+	std::vector<float> before, after, region;
+	render(argv[1], &pool, false, false, before);
+	render(argv[1], &pool, true, false, after);
+	RenderStats stats = render(argv[1], &pool, true, true, region);
+	if (before.size() != (size_t)WIDTH * HEIGHT * 3 || after.size() != before.size() || region.size() != before.size())
+	{
+		std::cout << "FAIL: could not render \"" << argv[1] << "\"." << std::endl;
+		return 1;
+	}
+
+	// Pixels in the region are from the frame after the move, and the rest from the one before.
+	int wrong = 0, changed = 0;
+	for (int j = 0; j < HEIGHT; j++)
+	{
+		for (int i = 0; i < WIDTH; i++)
+		{
+			bool inside = (i >= REGION_X0 && i < REGION_X1 && j >= REGION_Y0 && j < REGION_Y1);
+			const std::vector<float> &expected = inside ? after : before;
+			for (int c = 0; c < 3; c++)
+			{
+				int k = (j * WIDTH + i) * 3 + c;
+				if (region[k] != expected[k]) wrong++;
+				if (inside && before[k] != after[k]) changed++;
+			}
+		}
+	}
+
+	// The tiles the region touches (cut to the region).
+	int tiles = ((REGION_X1 - 1) / TILE_SIZE - REGION_X0 / TILE_SIZE + 1) *
+		((REGION_Y1 - 1) / TILE_SIZE - REGION_Y0 / TILE_SIZE + 1);
+
+	bool failed = false;
+	if (changed == 0)
+	{
+		std::cout << "FAIL: the camera move doesn't change the region, so the frames don't test it." << std::endl;
+		failed = true;
+	}
+	if (wrong > 0)
+	{
+		std::cout << "FAIL: " << wrong << " color values differ from a full render in the region, or from the frame "
+			<< "before outside it." << std::endl;
+		failed = true;
+	}
+	if (stats.width != REGION_X1 - REGION_X0 || stats.height != REGION_Y1 - REGION_Y0 || stats.tiles != tiles)
+	{
+		std::cout << "FAIL: a " << stats.width << "x" << stats.height << " frame of " << stats.tiles
+			<< " tiles was rendered, not the " << tiles << " tiles of the region." << std::endl;
+		failed = true;
+	}
+	if (failed) return 1;
+
+	std::cout << "a " << stats.width << "x" << stats.height << " region of " << stats.tiles
+		<< " tiles was rendered again, and the rest kept" << std::endl;
+	return 0;
+}
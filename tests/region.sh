@@ -0,0 +1,16 @@
+#!/bin/sh
+# region.sh
+#
+# Checks with tests/region that a redraw limited to a region renders only its tiles, as a full render would, and
+# leaves the rest of the frame as it was.
+#
+# usage: tests/region.sh (from the directory with project5 and tests/region)
+
+. tests/common.sh
+CHECK="$TESTS/region"
+
+if ! "$CHECK" scene2.data > logs 2>&1; then
+	cat logs
+	exit 1
+fi
+passed "$(tail -n 1 logs)"
@@ -0,0 +1,239 @@
+/* renderServer.cpp
+ *
+ * A client of the render server (see renderServer.h), which checks that:
+ *   - the frames it renders match the frames project5 rendered of the same scene (a PPM and a PFM file), in both
+ *     reply formats, and again when the frame is answered from the frame cache;
+ *   - jobs waiting for the server are rendered in order of priority;
+ *   - requests that can't be rendered are answered with errors, and the connection can still be used.
+ *
+ * usage: tests/renderServer <socket> <scene file> <reference .ppm> <reference .pfm>
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "connection.h"
+#include "rayTracer.h"
+
+// How long the job that keeps the server busy while the others are queued should take, and how long it is given
+// to start before they are sent (both in milliseconds).
+const double BUSY_MS = 1500.0;
+const int BUSY_START_MS = 200;
+
+// Connects to the server's socket. Returns null if it can't.
+Connection* connectTo(std::string socketPath)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return nullptr;
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+	if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+	{
+		close(fd);
+		return nullptr;
+	}
+	return new Connection(fd);
+}
+
+// Sends the request, and reads the reply line, and the pixels that follow an OK reply to a RENDER request.
+// Returns the reply line (empty if the connection was lost).
+std::string request(Connection* connection, std::string line, std::vector<unsigned char>* pixels = nullptr)
+{
+	std::string reply;
+	if (!connection->writeLine(line) || !connection->readLine(reply)) return "";
+
+	if (pixels && reply.compare(0, 3, "OK ") == 0)
+	{
+		std::istringstream s(reply.substr(3));
+		int width, height;
+		std::string format;
+		size_t bytes;
+		if (!(s >> width >> height >> format >> bytes)) return "";
+		pixels->resize(bytes);
+		if (!connection->read(pixels->data(), bytes)) return "";
+	}
+	return reply;
+}
+
+// Returns a RENDER request for the scene from the camera.
+std::string renderRequest(std::string scene, int width, int height, Camera camera, std::string options)
+{
+	std::ostringstream s;
+	s.precision(9);
+	s << "RENDER " << scene << " " << width << " " << height;
+	FCoord3D points[3] = { camera.fromPoint, camera.atPoint, camera.upVector };
+	for (int i = 0; i < 3; i++)
+	{
+		s << " " << points[i].x << " " << points[i].y << " " << points[i].z;
+	}
+	s << " " << camera.viewingAngleDeg << " " << options;
+	return s.str();
+}
+
+// Reads the pixels of a PPM or PFM file written by project5 (the header is three lines). Returns false if it can't
+// be read.
+bool readImage(std::string fileName, int &width, int &height, std::vector<unsigned char> &pixels)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	std::string magic, maximum;
+	if (!(file >> magic >> width >> height >> maximum)) return false;
+	file.get();
+	pixels.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 5)
+	{
+		std::cout << "usage: " << argv[0] << " <socket> <scene file> <reference .ppm> <reference .pfm>" << std::endl;
+		return 2;
+	}
+	std::string socketPath = argv[1];
+	std::string scene = argv[2];
+
+	int width, height, floatWidth, floatHeight;
+	std::vector<unsigned char> rgb8, floats;
+	if (!readImage(argv[3], width, height, rgb8) || !readImage(argv[4], floatWidth, floatHeight, floats)
+		|| floatWidth != width || floatHeight != height)
+	{
+		std::cout << "FAIL: could not read the reference frames." << std::endl;
+		return 1;
+	}
+	RayTracer tracer(1);
+	if (!tracer.loadScene(scene))
+	{
+		std::cout << "FAIL: could not load \"" << scene << "\"." << std::endl;
+		return 1;
+	}
+	Camera camera = tracer.getSceneCamera();
+
+	Connection* connection = connectTo(socketPath);
+	if (!connection)
+	{
+		std::cout << "FAIL: could not connect to \"" << socketPath << "\"." << std::endl;
+		return 1;
+	}
+
+	int failed = 0;
+	std::vector<unsigned char> pixels;
+	auto start = std::chrono::steady_clock::now();
+	std::string reply = request(connection, renderRequest(scene, width, height, camera, "0 rgb8"), &pixels);
+	double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (reply.compare(0, 3, "OK ") != 0 || pixels != rgb8)
+	{
+		std::cout << "FAIL: the rgb8 frame differs from the PPM file (the reply was \"" << reply << "\")." << std::endl;
+		failed++;
+	}
+	// The first render of each format is rendered, and the second answered from the frame cache.
+	for (int i = 0; i < 2; i++)
+	{
+		reply = request(connection, renderRequest(scene, width, height, camera, "0 float"), &pixels);
+		if (reply.compare(0, 3, "OK ") != 0 || pixels != floats)
+		{
+			std::cout << "FAIL: float frame " << i << " differs from the PFM file (the reply was \"" << reply << "\")."
+				<< std::endl;
+			failed++;
+		}
+	}
+
+	// Requests that can't be rendered are answered with errors.
+	const char* badRequests[] = {
+		"RENDER",
+		"RENDER missing.data 10 10 1 1 1 0 0 0 0 0 1 30",
+		"RENDER scene 0 10 1 1 1 0 0 0 0 0 1 30",
+		"RENDER scene 10 10 1 1 1 0 0 0 0 0 1 30 0 jpeg",
+		"DRAW",
+	};
+	for (const char* bad : badRequests)
+	{
+		std::string line = bad;
+		size_t at = line.find(" scene ");
+		if (at != std::string::npos) line.replace(at + 1, 5, scene);
+		reply = request(connection, line, &pixels);
+		if (reply.compare(0, 6, "ERROR ") != 0)
+		{
+			std::cout << "FAIL: \"" << line << "\" was answered with \"" << reply << "\"." << std::endl;
+			failed++;
+		}
+	}
+
+	// A big job keeps the server busy while two small ones are queued, the second with a higher priority. It is
+	// scaled from the time the first frame took. Every job has a camera of its own, so none is answered from the
+	// frame cache.
+	double scale = std::min(std::max(sqrt(BUSY_MS / std::max(frameMs, 1.0)), 1.0), 8192.0 / std::max(width, height));
+	int busyWidth = width * scale;
+	int busyHeight = height * scale;
+	std::vector<std::string> finished;
+	std::mutex finishedMutex;
+	std::vector<std::thread> clients;
+	const int priorities[3] = { 0, 0, 5 };
+	for (int i = 0; i < 3; i++)
+	{
+		Connection* client = connectTo(socketPath);
+		if (!client)
+		{
+			std::cout << "FAIL: could not connect to \"" << socketPath << "\" again." << std::endl;
+			return 1;
+		}
+		Camera jobCamera = camera;
+		jobCamera.orbit(10.0 * (i + 1));
+		bool busy = (i == 0);
+		std::string line = renderRequest(scene, busy ? busyWidth : 16, busy ? busyHeight : 16, jobCamera,
+			std::to_string(priorities[i]) + " rgb8");
+		clients.emplace_back([&, client, line, i]()
+		{
+			std::vector<unsigned char> jobPixels;
+			std::string jobReply = request(client, line, &jobPixels);
+			std::unique_lock<std::mutex> lock(finishedMutex);
+			finished.push_back(std::to_string(i) + (jobReply.compare(0, 3, "OK ") == 0 ? "" : " (" + jobReply + ")"));
+			delete client;
+		});
+		// The big job must have started before the others are queued.
+		if (busy) std::this_thread::sleep_for(std::chrono::milliseconds(BUSY_START_MS));
+	}
+	for (std::thread& client : clients)
+	{
+		client.join();
+	}
+	// The busy job's reply is the longest, so it may arrive after the next job's; only the two queued jobs are
+	// compared.
+	finished.erase(std::remove(finished.begin(), finished.end(), "0"), finished.end());
+	std::string order = finished.at(0) + ", " + finished.at(1);
+	if (order != "2, 1")
+	{
+		std::cout << "FAIL: the queued jobs finished in the order " << order << ", rather than 2, 1." << std::endl;
+		failed++;
+	}
+
+	reply = request(connection, "STATUS");
+	if (reply.compare(0, 3, "OK ") != 0)
+	{
+		std::cout << "FAIL: STATUS was answered with \"" << reply << "\"." << std::endl;
+		failed++;
+	}
+	delete connection;
+
+	if (failed > 0) return 1;
+	std::cout << "renderServer: passed (frames match project5 in both formats and from the cache, jobs ran by "
+		"priority, and bad requests got errors; " << reply << ")" << std::endl;
+	return 0;
+}
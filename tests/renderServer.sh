@@ -0,0 +1,24 @@
+#!/bin/sh
+# renderServer.sh
+#
+# Renders a scene with project5, then starts a render server and checks it with tests/renderServer (a client that
+# compares the frames the server renders with those of project5, and checks the order jobs run in, and errors).
+#
+# usage: tests/renderServer.sh (from the directory with project5 and tests/renderServer)
+
+. tests/common.sh
+CLIENT="$TESTS/renderServer"
+printf 'load scene2.data\nimage project5.ppm\n' | "$PROJECT5" -headless 200 150 -o project5.pfm > project5.txt 2>&1
+
+"$PROJECT5" -serve "$WORK/server.sock" > server.txt 2>&1 &
+echo $! > server.pid
+tries=0
+while [ ! -S server.sock ] && [ $tries -lt 100 ]; do
+	sleep 0.05
+	tries=$((tries + 1))
+done
+
+if ! "$CLIENT" "$WORK/server.sock" "$WORK/scene2.data" project5.ppm project5.pfm; then
+	cat server.txt
+	exit 1
+fi
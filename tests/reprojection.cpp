@@ -0,0 +1,108 @@
+/* reprojection.cpp
+ *
+ * Renders a scene, moves the camera a little, and redraws it by reprojecting the frame before. Checks that the
+ * reprojected frame reused pixels, and that it matches a full render from the moved camera within a tolerance
+ * (diffuse light is rescaled for the move, so reused pixels are close to, but not exactly, the traced ones).
+ *
+ * usage: tests/reprojection <scene file>
+ *
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include "frameBuffer.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+#include "viewport.h"
+
+const int WIDTH = 160;
+const int HEIGHT = 120;
+// How far the camera moves to the left.
+const float MOVE = 1.0;
+// The largest difference a color channel of a reused pixel may have from the traced one.
+const float TOLERANCE = 0.02;
+// The largest fraction of pixels that may differ by more than the tolerance.
+const float MAX_OFF_FRACTION = 0.005;
+
+// Renders the scene into pixels. If reprojected, it is rendered, then the camera is moved and the frame is
+// redrawn from the last one; otherwise it is rendered from the moved camera. Returns the stats of the last frame.
+RenderStats render(std::string sceneFile, ThreadPool* pool, bool reprojected, std::vector<float> &pixels)
+{
+	ShapeCollection shapes;
+	Viewport viewport(Coord(0, 0), WIDTH, HEIGHT, &shapes);
+	shapes.setViewport(&viewport);
+	FrameBuffer buffer(WIDTH, HEIGHT);
+	viewport.setThreadPool(pool);
+	viewport.setFrameBuffer(&buffer);
+	viewport.setKeepFrame(true);
+	if (!shapes.loadFromFile(sceneFile)) return RenderStats();
+
+	if (reprojected)
+	{
+		viewport.setReprojection(true, 1.0);
+		viewport.redraw(false);
+		viewport.moveCamera(dLeft, MOVE);
+		viewport.redrawCameraMove(false);
+	}
+	else
+	{
+		viewport.moveCamera(dLeft, MOVE);
+		viewport.redraw(false);
+	}
+	viewport.readPixels(0, 0, WIDTH, HEIGHT, pixels);
+	return viewport.getStats();
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		std::cout << "usage: " << argv[0] << " <scene file>" << std::endl;
+		return 2;
+	}
+
+	ThreadPool pool(0);
+	std::vector<float> traced, reprojected;
+	render(argv[1], &pool, false, traced);
+	RenderStats stats = render(argv[1], &pool, true, reprojected);
+	if (traced.size() != (size_t)WIDTH * HEIGHT * 3 || reprojected.size() != traced.size())
+	{
+		std::cout << "FAIL: could not render \"" << argv[1] << "\"." << std::endl;
+		return 1;
+	}
+
+	int off = 0;
+	float largest = 0.0;
+	for (int k = 0; k < WIDTH * HEIGHT; k++)
+	{
+		float difference = 0.0;
+		for (int c = 0; c < 3; c++)
+		{
+			difference = std::max(difference, fabsf(traced[k * 3 + c] - reprojected[k * 3 + c]));
+		}
+		if (difference > TOLERANCE) off++;
+		largest = std::max(largest, difference);
+	}
+
+	bool failed = false;
+	if (stats.pixelsReprojected <= 0)
+	{
+		std::cout << "FAIL: no pixels were reprojected, so the frame was rendered in full." << std::endl;
+		failed = true;
+	}
+	if (off > MAX_OFF_FRACTION * WIDTH * HEIGHT)
+	{
+		std::cout << "FAIL: " << off << " reprojected pixels differ from a full render by more than " << TOLERANCE
+			<< " (by up to " << largest << ")." << std::endl;
+		failed = true;
+	}
+	if (failed) return 1;
+
+	std::cout << stats.pixelsReprojected << " of " << WIDTH * HEIGHT << " pixels reprojected, and " << off
+		<< " more than " << TOLERANCE << " off a full render" << std::endl;
+	return 0;
+}
@@ -0,0 +1,19 @@
+#!/bin/sh
+# reprojection.sh
+#
+# Checks with tests/reprojection that a frame reprojected after a small camera move matches a full render within a
+# tolerance. Reflective and refractive shapes are always traced again, so they are made matte first.
+#
+# usage: tests/reprojection.sh (from the directory with project5 and tests/reprojection)
+
+. tests/common.sh
+CHECK="$TESTS/reprojection"
+
+# Every shape's reflection and refraction (the 2 lines after its color) are set to 0.
+awk 'line > 0 { line++ } /_SHAPE$/ { line = 1 } line == 3 || line == 4 { $0 = "0" } line == 4 { line = 0 } 1' \
+	scene2.data > matte.data
+if ! "$CHECK" matte.data > logs 2>&1; then
+	cat logs
+	exit 1
+fi
+passed "$(tail -n 1 logs)"
@@ -0,0 +1,79 @@
+/* sceneParser.cpp
+ *
+ * Loads scenes with the fast parser (see sceneParser.h), and reads them with the stream parser they replaced.
+ * Checks that both give the same scene (as serialized) and render the same frame.
+ *
+ * usage: tests/sceneParser <scene file>...
+ *
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "frameBuffer.h"
+#include "shapeCollection.h"
+#include "threadPool.h"
+#include "viewport.h"
+
+const int WIDTH = 120;
+const int HEIGHT = 90;
+
+// Reads the scene with the fast parser (or the stream parser if streamed), renders it into pixels, and returns it
+// serialized (or "" if it couldn't be read).
+std::string render(std::string sceneFile, ThreadPool* pool, bool streamed, std::vector<float> &pixels)
+{
+	ShapeCollection shapes;
+	Viewport viewport(Coord(0, 0), WIDTH, HEIGHT, &shapes);
+	shapes.setViewport(&viewport);
+	FrameBuffer buffer(WIDTH, HEIGHT);
+	viewport.setThreadPool(pool);
+	viewport.setFrameBuffer(&buffer);
+	viewport.setKeepFrame(true);
+
+	std::ifstream file(sceneFile);
+	if (streamed ? !(file && shapes.read(file)) : !shapes.loadFromFile(sceneFile)) return "";
+
+	viewport.redraw(false);
+	viewport.readPixels(0, 0, WIDTH, HEIGHT, pixels);
+	return shapes.serialize();
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "usage: " << argv[0] << " <scene file>..." << std::endl;
+		return 2;
+	}
+
+	ThreadPool pool(0);
+	bool failed = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::vector<float> parsed, streamed;
+		std::string parsedScene = render(argv[i], &pool, false, parsed);
+		std::string streamedScene = render(argv[i], &pool, true, streamed);
+		if (parsedScene == "" || streamedScene == "")
+		{
+			std::cout << "FAIL: \"" << argv[i] << "\" couldn't be read by the "
+				<< (parsedScene == "" ? "fast" : "stream") << " parser." << std::endl;
+			failed = true;
+		}
+		else if (parsedScene != streamedScene)
+		{
+			std::cout << "FAIL: the parsers read \"" << argv[i] << "\" differently." << std::endl;
+			failed = true;
+		}
+		else if (parsed != streamed)
+		{
+			std::cout << "FAIL: \"" << argv[i] << "\" renders differently as read by the two parsers." << std::endl;
+			failed = true;
+		}
+	}
+	if (failed) return 1;
+
+	std::cout << argc - 1 << " scenes read and rendered the same by both parsers" << std::endl;
+	return 0;
+}
@@ -0,0 +1,20 @@
+#!/bin/sh
+# sceneParser.sh
+#
+# Checks with tests/sceneParser that the shipped scenes, and scene2 laid out differently (on one line, and with
+# extra blank lines and indents), are read the same by the fast parser as by the stream parser.
+#
+# usage: tests/sceneParser.sh (from the directory with project5 and tests/sceneParser)
+
+. tests/common.sh
+CHECK="$TESTS/sceneParser"
+
+cp "$(dirname "$PROJECT5")/scene1.data" "$(dirname "$PROJECT5")/scene3.data" .
+tr '\n' ' ' < scene2.data > oneLine.data
+awk '{ print "\t " $0 "\n" }' scene2.data > spaced.data
+
+if ! "$CHECK" scene1.data scene2.data scene3.data oneLine.data spaced.data > logs 2>&1; then
+	cat logs
+	exit 1
+fi
+passed "$(tail -n 1 logs)"
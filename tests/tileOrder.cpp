@@ -0,0 +1,157 @@
+/* tileOrder.cpp
+ *
+ * Checks the tile orders (see tileOrder.h) on a grid of tiles: that each lists every tile once, that the
+ * spirals start at their point and work outwards ring by ring, that the Z-order curve is followed, and that
+ * the costliest tiles come first, with tiles of the same cost in scanline order.
+ *
+ * usage: tests/tileOrder
+ *
+ */
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "tileOrder.h"
+
+// The grid the tiles are on. The right column and top row are cut short, as at the edges of a frame.
+const int TILE_SIZE = 16;
+const int FRAME_WIDTH = 10 * TILE_SIZE - 5;
+const int FRAME_HEIGHT = 7 * TILE_SIZE - 9;
+// The point the focus order spirals out from.
+const int FOCUS_X = 20;
+const int FOCUS_Y = 90;
+
+// Returns a tile as "(x0, y0)".
+std::string name(const TileRect &t)
+{
+	return "(" + std::to_string(t.x0) + ", " + std::to_string(t.y0) + ")";
+}
+
+bool operator==(const TileRect &a, const TileRect &b)
+{
+	return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1;
+}
+
+// Returns the ring of tiles around the point that the tile is in (0 for the tile nearest to it).
+int ring(const TileRect &t, float x, float y)
+{
+	int rx = (int)floor(((t.x0 + t.x1) / 2.0 - x) / TILE_SIZE + 0.5);
+	int ry = (int)floor(((t.y0 + t.y1) / 2.0 - y) / TILE_SIZE + 0.5);
+	return std::max(abs(rx), abs(ry));
+}
+
+// Returns the position of the tile along the Z-order curve.
+uint32_t morton(const TileRect &t)
+{
+	uint32_t code = 0;
+	for (int bit = 0; bit < 16; bit++)
+	{
+		code |= ((t.x0 / TILE_SIZE >> bit) & 1) << (2 * bit);
+		code |= ((t.y0 / TILE_SIZE >> bit) & 1) << (2 * bit + 1);
+	}
+	return code;
+}
+
+// The cost of a tile: a few values, so that many tiles cost the same.
+float cost(const TileRect &t)
+{
+	return (t.x0 / TILE_SIZE * 7 + t.y0 / TILE_SIZE * 3) % 5;
+}
+
+int main()
+{
+	// Tiles are listed in scanline order: from the top row down, each row from the left.
+	std::vector<TileRect> scanline;
+	for (int y = (FRAME_HEIGHT - 1) / TILE_SIZE * TILE_SIZE; y >= 0; y -= TILE_SIZE)
+	{
+		for (int x = 0; x < FRAME_WIDTH; x += TILE_SIZE)
+		{
+			TileRect t;
+			t.x0 = x;
+			t.y0 = y;
+			t.x1 = std::min(x + TILE_SIZE, FRAME_WIDTH);
+			t.y1 = std::min(y + TILE_SIZE, FRAME_HEIGHT);
+			scanline.push_back(t);
+		}
+	}
+
+	int failed = 0;
+	TileOrder orders[] = { toScanline, toCentre, toMorton, toCost, toFocus };
+	for (TileOrder order : orders)
+	{
+		std::vector<TileRect> tiles = scanline;
+		orderTiles(tiles, order, TILE_SIZE, FOCUS_X, FOCUS_Y, cost);
+		std::string orderName = tileOrderName(order);
+
+		// Every tile is listed once.
+		bool complete = (tiles.size() == scanline.size());
+		for (int k = 0; k < (int)scanline.size() && complete; k++)
+		{
+			complete = (std::count(tiles.begin(), tiles.end(), scanline[k]) == 1);
+		}
+		if (!complete)
+		{
+			std::cout << "FAIL: the " << orderName << " order doesn't list every tile once." << std::endl;
+			failed++;
+			continue;
+		}
+
+		// Returns true if the test holds for every tile and the one after it.
+		auto follows = [&tiles](std::function<bool(const TileRect&, const TileRect&)> test, int &at)
+		{
+			for (at = 1; at < (int)tiles.size(); at++)
+			{
+				if (!test(tiles[at - 1], tiles[at])) return false;
+			}
+			return true;
+		};
+		int at = 0;
+		bool ordered = true;
+		switch (order)
+		{
+			case toScanline:
+				ordered = (tiles == scanline);
+				break;
+			case toCentre:
+			case toFocus:
+			{
+				float x = (order == toFocus) ? FOCUS_X : FRAME_WIDTH / 2.0;
+				float y = (order == toFocus) ? FOCUS_Y : FRAME_HEIGHT / 2.0;
+				ordered = (ring(tiles.front(), x, y) == 0)
+					&& follows([x, y](const TileRect &a, const TileRect &b) { return ring(a, x, y) <= ring(b, x, y); }, at);
+				break;
+			}
+			case toMorton:
+				ordered = follows([](const TileRect &a, const TileRect &b) { return morton(a) < morton(b); }, at);
+				break;
+			case toCost:
+			{
+				// Tiles of the same cost keep their scanline order.
+				auto before = [&scanline](const TileRect &a, const TileRect &b)
+				{
+					return std::find(scanline.begin(), scanline.end(), a) < std::find(scanline.begin(), scanline.end(), b);
+				};
+				ordered = follows([&before](const TileRect &a, const TileRect &b)
+				{
+					return cost(a) > cost(b) || (cost(a) == cost(b) && before(a, b));
+				}, at);
+				break;
+			}
+		}
+		if (!ordered)
+		{
+			std::cout << "FAIL: the " << orderName << " order is broken at tile " << at << " " << name(tiles[at])
+				<< " (the first tile is " << name(tiles.front()) << ")." << std::endl;
+			failed++;
+		}
+	}
+
+	if (failed > 0) return 1;
+	return 0;
+}
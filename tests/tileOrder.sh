@@ -0,0 +1,29 @@
+#!/bin/sh
+# tileOrder.sh
+#
+# Checks the tile orders with tests/tileOrder, then renders a scene in each order and checks that every order gives
+# the same frame. The frame is rendered after a camera move, so that the cost order has the times of the tiles of
+# the frame before.
+#
+# usage: tests/tileOrder.sh (from the directory with project5 and tests/tileOrder)
+
+. tests/common.sh
+CHECK="$TESTS/tileOrder"
+
+failed=0
+"$CHECK" || failed=1
+for order in scanline centre morton cost "focus 30 40"; do
+	name=$(echo $order | cut -d ' ' -f 1)
+	printf 'load scene2.data\norder %s\nmv left 1\n' "$order" \
+		| "$PROJECT5" -headless 200 150 -o $name.pfm > $name.txt 2>&1
+	if [ ! -s $name.pfm ] || ! cmp -s scanline.pfm $name.pfm; then
+		echo "FAIL: the frame rendered in $name order differs from the one rendered in scanline order."
+		cat $name.txt
+		failed=1
+	fi
+done
+
+if [ $failed -ne 0 ]; then
+	exit 1
+fi
+passed "every order lists the tiles as it should, and renders the same frame"
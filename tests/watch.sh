@@ -0,0 +1,91 @@
+#!/bin/sh
+# watch.sh
+#
+# Watches a scene file while it is edited (a cube recolored, then another moved), with anti-aliasing and the camera
+# moved away from the file's, and checks that each frame rendered after a change, of which only the tiles the change
+# may affect are traced again, matches a fresh render of the edited file from the moved camera. Also checks that
+# interrupting the watch finishes writing the frames.
+#
+# usage: tests/watch.sh (from the directory with project5)
+
+. tests/common.sh
+
+# A reflective scene with cubes, and the two edits of it.
+printf 'load scene2.data
+cube 0 -20 0 10 1 0 0 0.5 0.2 0 3
+cube 0 20 0 15 0 1 0 0.5 0 0 3
+cube 20 0 -10 5 0 0 1 0.5 0 0 3
+save original.data
+' | "$PROJECT5" -headless 50 50 > setup.txt 2>&1
+awk '/^INSTANCE_SHAPE$/ { n++ } { if (n == 1 && $0 == "1 0 0") print "1 1 0"; else print }' original.data > recolored.data
+sed 's/^0 15 0 20$/0 15 0 24/' recolored.data > moved.data
+if cmp -s original.data recolored.data || cmp -s recolored.data moved.data; then
+	echo "FAIL: the scene couldn't be edited."
+	cat setup.txt
+	exit 1
+fi
+
+# Waits until the output file has the line n times (or gives up after 60 s).
+waitFor()
+{
+	tries=0
+	while [ "$(grep -c "$2" "$1")" -lt "$3" ] && [ $tries -lt 1200 ]; do
+		sleep 0.05
+		tries=$((tries + 1))
+	done
+}
+
+# Frame 0 is of the empty scene, frame 1 with anti-aliasing, frame 2 of the original, frame 3 after the camera is
+# moved, and frames 4 and 5 of the edits (which keep the moved camera, since the camera in the file stays the same).
+# Once its commands end, the watching process is interrupted, and should finish writing its frames and exit.
+cp original.data scene.data
+mkfifo commands
+"$PROJECT5" -headless 200 150 -o 'watched#.png' < commands > watched.txt 2>&1 &
+echo $! > watched.pid
+exec 3> commands
+printf 'ss 4\nwatch scene.data\nmv left 1\n' >&3
+waitFor watched.txt "Writing .*watched3.png" 1
+count=0
+for edit in recolored moved; do
+	# Editors often save by writing a new file and renaming it over the old one.
+	cp $edit.data scene.tmp
+	mv scene.tmp scene.data
+	count=$((count + 1))
+	waitFor watched.txt "^Re-traced" $count
+done
+exec 3>&-
+waitFor watched.txt "until interrupted" 1
+kill -INT $(cat watched.pid)
+(sleep 30 && touch watched.killed && kill $(cat watched.pid)) > /dev/null 2>&1 &
+echo $! > watchdog.pid
+wait $(cat watched.pid)
+kill $(cat watchdog.pid) 2>/dev/null
+rm -f watched.pid watchdog.pid
+
+printf 'ss 4\nload recolored.data\nmv left 1\n' | "$PROJECT5" -headless 200 150 -o fresh4.png > fresh4.txt 2>&1
+printf 'ss 4\nload moved.data\nmv left 1\n' | "$PROJECT5" -headless 200 150 -o fresh5.png > fresh5.txt 2>&1
+
+failed=0
+if [ -e watched.killed ] || ! grep -q "Stopped watching" watched.txt; then
+	echo "FAIL: the watching process didn't stop when it was interrupted."
+	failed=1
+fi
+for frame in 4 5; do
+	if ! cmp -s watched$frame.png fresh$frame.png; then
+		echo "FAIL: frame $frame, rendered after the file changed, differs from a fresh render of the file."
+		failed=1
+	fi
+done
+# Every change is to a cube, so some tiles must have been kept.
+retraced=$(grep "^Re-traced" watched.txt)
+if [ "$(echo "$retraced" | awk '$2 < $4' | wc -l)" -ne 2 ]; then
+	echo "FAIL: the whole frame was traced again after a change."
+	failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+	cat watched.txt
+	exit 1
+fi
+passed "anti-aliased frames re-rendered after each change match fresh renders from the moved camera, with" \
+	$(echo "$retraced" | awk '{ printf "%s%d", (NR > 1) ? " and " : "", $2 } END { print " of " $4 }') "tiles traced again"
@@ -0,0 +1,265 @@
+#include "threadPool.h"
+
+#include "misc.h"
+
+// The node of the pool whose worker the current thread is (-1 for other threads).
+static thread_local int workerNode = -1;
+
+/*** Public Member Functions ***/
+
+ThreadPool::ThreadPool(int _numThreads)
+{
+	if (_numThreads <= 0)
+	{
+		_numThreads = std::thread::hardware_concurrency();
+	}
+	if (_numThreads <= 0) _numThreads = 1;
+
+	nodes = new std::vector<NumaNode>();
+	start(_numThreads);
+}
+
+ThreadPool::ThreadPool(int _numThreads, const std::vector<NumaNode> &_nodes)
+{
+	if (_numThreads <= 0)
+	{
+		_numThreads = 0;
+		for (int k = 0; k < (int)_nodes.size(); k++)
+		{
+			_numThreads += _nodes[k].cpus.size();
+		}
+	}
+	if (_numThreads <= 0) _numThreads = 1;
+
+	nodes = new std::vector<NumaNode>(_nodes);
+	start(_numThreads);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (int i = 0; i < (int)workers->size(); i++)
+	{
+		workers->at(i).join();
+	}
+
+	delete workers;
+	delete tasks;
+	delete nodeTasks;
+	delete nodes;
+	delete busyMs;
+}
+
+void ThreadPool::enqueue(std::function<void()> task, int node)
+{
+	bool forNode = (node >= 0 && node < (int)nodeTasks->size());
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (forNode)
+		{
+			nodeTasks->at(node).push_back(task);
+		}
+		else
+		{
+			tasks->push_back(task);
+		}
+		queuedTasks++;
+	}
+	// Any worker would take a task from the shared queue, but one of the node's should get the chance to take a
+	// task queued for it.
+	if (forNode)
+	{
+		taskAvailable.notify_all();
+	}
+	else
+	{
+		taskAvailable.notify_one();
+	}
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	allDone.wait(lock, [this] { return queuedTasks == 0 && activeTasks == 0; });
+}
+
+int ThreadPool::numThreads()
+{
+	return workers->size();
+}
+
+int ThreadPool::queueDepth()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return queuedTasks;
+}
+
+std::vector<double> ThreadPool::getBusyMs()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return *busyMs;
+}
+
+double ThreadPool::getUptimeMs()
+{
+	return nowMs() - startMs;
+}
+
+int ThreadPool::numNodes()
+{
+	return nodes->size();
+}
+
+std::vector<NumaNode> ThreadPool::getNodes()
+{
+	return *nodes;
+}
+
+int ThreadPool::currentNode()
+{
+	return workerNode;
+}
+
+
+/*** TaskGroup ***/
+
+TaskGroup::TaskGroup(ThreadPool* _pool)
+{
+	pool = _pool;
+	pending = 0;
+}
+
+TaskGroup::~TaskGroup()
+{
+	wait();
+}
+
+void TaskGroup::enqueue(std::function<void()> task, int node)
+{
+	if (!pool)
+	{
+		task();
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		pending++;
+	}
+	pool->enqueue([this, task]()
+	{
+		task();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		pending--;
+		if (pending == 0)
+		{
+			allDone.notify_all();
+		}
+	}, node);
+}
+
+void TaskGroup::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	allDone.wait(lock, [this] { return pending == 0; });
+}
+
+
+/*** Private Member Functions ***/
+
+void ThreadPool::start(int _numThreads)
+{
+	workers = new std::vector<std::thread>();
+	tasks = new std::deque<std::function<void()> >();
+	nodeTasks = new std::vector<std::deque<std::function<void()> > >(nodes->size());
+	queuedTasks = 0;
+	activeTasks = 0;
+	stopping = false;
+	busyMs = new std::vector<double>(_numThreads, 0.0);
+	startMs = nowMs();
+
+	// Workers are dealt out among the nodes in turn.
+	for (int i = 0; i < _numThreads; i++)
+	{
+		int node = nodes->empty() ? -1 : i % nodes->size();
+		workers->push_back(std::thread(&ThreadPool::workerLoop, this, i, node));
+	}
+}
+
+void ThreadPool::workerLoop(int index, int node)
+{
+	if (node >= 0)
+	{
+		workerNode = node;
+		pinThreadToNode(nodes->at(node));
+	}
+
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			taskAvailable.wait(lock, [this] { return stopping || queuedTasks > 0; });
+
+			if (!takeTask(node, task))
+			{ // Only reached when stopping.
+				return;
+			}
+			queuedTasks--;
+			activeTasks++;
+		}
+
+		double taskStartMs = nowMs();
+		task();
+		double taskMs = nowMs() - taskStartMs;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			busyMs->at(index) += taskMs;
+			activeTasks--;
+			if (activeTasks == 0 && queuedTasks == 0)
+			{
+				allDone.notify_all();
+			}
+		}
+	}
+}
+
+bool ThreadPool::takeTask(int node, std::function<void()> &task)
+{
+	// The node's own tasks come first, then the shared ones.
+	std::deque<std::function<void()> >* queue = nullptr;
+	if (node >= 0 && !nodeTasks->at(node).empty())
+	{
+		queue = &nodeTasks->at(node);
+	}
+	else if (!tasks->empty())
+	{
+		queue = tasks;
+	}
+	if (queue)
+	{
+		task = queue->front();
+		queue->pop_front();
+		return true;
+	}
+
+	// Tasks of the other nodes are taken from the back of their queues, since those are the ones their own
+	// workers would get to last.
+	for (int k = 0; k < (int)nodeTasks->size(); k++)
+	{
+		if (!nodeTasks->at(k).empty())
+		{
+			task = nodeTasks->at(k).back();
+			nodeTasks->at(k).pop_back();
+			return true;
+		}
+	}
+	return false;
+}
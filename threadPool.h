@@ -0,0 +1,124 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+/* threadPool.h
+ *
+ * A fixed set of worker threads that execute queued tasks.
+ * Used by the viewport to render tiles of the scene in parallel. Several viewports (such as the frames of an
+ * animation) can share a pool, each waiting only for its own tasks through a task group.
+ * A NUMA-aware pool spreads its workers over the NUMA nodes, pinning each to its node, and has a queue per node:
+ * tasks queued for a node are run by that node's workers while they have any (idle workers of other nodes take
+ * them after that), so memory the tasks first write is placed on the node, and is local to it afterwards.
+ *
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "numaTopology.h"
+
+class ThreadPool
+{
+	public:
+		/*** Public Member Functions ***/
+		// Starts the specified number of worker threads (0 uses one thread per hardware thread).
+		ThreadPool(int _numThreads);
+		// Starts the worker threads NUMA-aware, dealt out among the nodes (0 uses one thread per CPU of the nodes).
+		ThreadPool(int _numThreads, const std::vector<NumaNode> &_nodes);
+		// Finishes all queued tasks, then stops the worker threads.
+		~ThreadPool();
+
+		// Adds a task to the queue. It will be run by the first idle worker. If the pool is NUMA-aware and a node is
+		// given, it is added to the node's queue instead (see above).
+		void enqueue(std::function<void()> task, int node = -1);
+		// Blocks until the queue is empty and no worker is running a task.
+		void wait();
+		// Returns the number of worker threads.
+		int numThreads();
+		// Returns the number of tasks that are waiting to be started.
+		int queueDepth();
+		// Returns the time each worker has spent running tasks, and the time since the pool was started, in
+		// milliseconds.
+		std::vector<double> getBusyMs();
+		double getUptimeMs();
+		// Returns the number of nodes the workers are spread over (0 if the pool isn't NUMA-aware), and the nodes.
+		int numNodes();
+		std::vector<NumaNode> getNodes();
+		// Returns the node of the pool whose worker is calling (-1 if it isn't called by a worker of a NUMA-aware
+		// pool).
+		static int currentNode();
+
+	private:
+		/*** Private Member Functions ***/
+		// Starts the worker threads (see the constructors).
+		void start(int _numThreads);
+		// The loop each worker thread runs until the pool is destroyed. Workers of a NUMA-aware pool are pinned to
+		// the node.
+		void workerLoop(int index, int node);
+		// Takes the next task for a worker of the node. Returns false if every queue is empty.
+		bool takeTask(int node, std::function<void()> &task);
+
+		// Pools can't be copied.
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		/*** Private Member Variables ***/
+		// The worker threads.
+		std::vector<std::thread>* workers;
+		// Tasks that have not yet been started, and those queued for each node (if the pool is NUMA-aware).
+		std::deque<std::function<void()> >* tasks;
+		std::vector<std::deque<std::function<void()> > >* nodeTasks;
+		int queuedTasks;
+		// The nodes the workers are spread over (empty if the pool isn't NUMA-aware).
+		std::vector<NumaNode>* nodes;
+		// The number of tasks currently being run.
+		int activeTasks;
+		// Set when the pool is being destroyed.
+		bool stopping;
+		// The time each worker has spent running tasks, and when the pool was started.
+		std::vector<double>* busyMs;
+		double startMs;
+
+		// Guards the task queue and counters.
+		std::mutex mutex;
+		// Signalled when a task is queued (or the pool is stopping).
+		std::condition_variable taskAvailable;
+		// Signalled when the last running task finishes.
+		std::condition_variable allDone;
+};
+
+class TaskGroup
+{
+	public:
+		/*** Public Member Functions ***/
+		// Creates a group whose tasks run on the pool (or on the calling thread if the pool is null).
+		TaskGroup(ThreadPool* _pool);
+		// Waits for the tasks of the group.
+		~TaskGroup();
+
+		// Adds a task to the pool's queue (or the node's; see ThreadPool::enqueue), counting it in the group.
+		void enqueue(std::function<void()> task, int node = -1);
+		// Blocks until every task of the group has finished (tasks of other groups may still be running).
+		void wait();
+
+	private:
+		// Groups can't be copied.
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+
+		/*** Private Member Variables ***/
+		ThreadPool* pool;
+		// The number of tasks of the group that have not finished.
+		int pending;
+
+		// Guards the count.
+		std::mutex mutex;
+		// Signalled when the last task of the group finishes.
+		std::condition_variable allDone;
+};
+
+#endif
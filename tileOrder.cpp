@@ -0,0 +1,131 @@
+#include "tileOrder.h"
+
+#include <algorithm>
+#include <math.h>
+#include <numeric>
+#include <stdint.h>
+
+
+// Spreads the low 16 bits of n out to the even bits.
+static uint32_t spreadBits(uint32_t n)
+{
+	n &= 0xFFFF;
+	n = (n | (n << 8)) & 0x00FF00FF;
+	n = (n | (n << 4)) & 0x0F0F0F0F;
+	n = (n | (n << 2)) & 0x33333333;
+	n = (n | (n << 1)) & 0x55555555;
+	return n;
+}
+
+// Ranks a tile by the square ring of tiles around the point that it is in, and then by its angle around the point.
+static double spiralKey(const TileRect &tile, int tileSize, float x, float y)
+{
+	int rx = (int)floor(((tile.x0 + tile.x1) / 2.0 - x) / tileSize + 0.5);
+	int ry = (int)floor(((tile.y0 + tile.y1) / 2.0 - y) / tileSize + 0.5);
+	int ring = std::max(abs(rx), abs(ry));
+	double angle = atan2((double)ry, (double)rx);
+	if (angle < 0.0)
+	{
+		angle += 2.0 * M_PI;
+	}
+	// The angle is below 8, so the rings don't overlap.
+	return ring * 8.0 + angle;
+}
+
+std::string tileOrderName(TileOrder order)
+{
+	switch (order)
+	{
+		case toCentre:
+			return "centre";
+		case toMorton:
+			return "morton";
+		case toCost:
+			return "cost";
+		case toFocus:
+			return "focus";
+		default:
+			return "scanline";
+	}
+}
+
+bool tileOrderFromName(std::string name, TileOrder &order)
+{
+	if (name == "scanline" || name == "scan" || name == "rows")
+	{
+		order = toScanline;
+	}
+	else if (name == "centre" || name == "center" || name == "spiral")
+	{
+		order = toCentre;
+	}
+	else if (name == "morton" || name == "z" || name == "zorder")
+	{
+		order = toMorton;
+	}
+	else if (name == "cost" || name == "slowest")
+	{
+		order = toCost;
+	}
+	else if (name == "focus" || name == "mouse")
+	{
+		order = toFocus;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+void orderTiles(std::vector<TileRect> &tiles, TileOrder order, int tileSize, int focusX, int focusY,
+	std::function<float(const TileRect&)> cost)
+{
+	if (order == toScanline || tiles.empty()) return;
+
+	// The centre of the tiles' bounds.
+	int x0 = tiles[0].x0, y0 = tiles[0].y0, x1 = tiles[0].x1, y1 = tiles[0].y1;
+	for (int k = 1; k < (int)tiles.size(); k++)
+	{
+		x0 = std::min(x0, tiles[k].x0);
+		y0 = std::min(y0, tiles[k].y0);
+		x1 = std::max(x1, tiles[k].x1);
+		y1 = std::max(y1, tiles[k].y1);
+	}
+
+	// Tiles are sorted by a key, smallest first.
+	std::vector<double> keys(tiles.size());
+	for (int k = 0; k < (int)tiles.size(); k++)
+	{
+		const TileRect &t = tiles[k];
+		switch (order)
+		{
+			case toCentre:
+				keys[k] = spiralKey(t, tileSize, (x0 + x1) / 2.0, (y0 + y1) / 2.0);
+				break;
+			case toMorton:
+				keys[k] = spreadBits(t.x0 / tileSize) | (spreadBits(t.y0 / tileSize) << 1);
+				break;
+			case toCost:
+				keys[k] = -cost(t);
+				break;
+			case toFocus:
+				keys[k] = spiralKey(t, tileSize, focusX, focusY);
+				break;
+			default:
+				keys[k] = 0.0;
+				break;
+		}
+	}
+
+	std::vector<int> indices(tiles.size());
+	std::iota(indices.begin(), indices.end(), 0);
+	std::stable_sort(indices.begin(), indices.end(), [&keys](int a, int b) { return keys[a] < keys[b]; });
+	std::vector<TileRect> sorted;
+	sorted.reserve(tiles.size());
+	for (int k = 0; k < (int)indices.size(); k++)
+	{
+		sorted.push_back(tiles[indices[k]]);
+	}
+	tiles.swap(sorted);
+}
@@ -0,0 +1,43 @@
+#ifndef __TILEORDER_H__
+#define __TILEORDER_H__
+
+/* tileOrder.h
+ *
+ * The orders the tiles of a frame can be rendered in. The thread pool starts tiles in the order they are
+ * listed, so the order decides which parts of a frame appear first, and which tiles are left for the end:
+ *
+ *   scanline  From the top row of tiles down, each row from the left (the order images are written in).
+ *   centre    Spiralling out from the middle of the frame, where the subject usually is.
+ *   morton    Along a Z-order curve, so that tiles rendered at the same time are close together in the scene.
+ *   cost      The tiles that took longest in the last frame first, so that no long tile is left to finish on
+ *             its own while the other threads are idle.
+ *   focus     Spiralling out from a point of the frame (such as where the mouse was clicked).
+ *
+ */
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "misc.h"
+
+enum TileOrder {
+	toScanline,
+	toCentre,
+	toMorton,
+	toCost,
+	toFocus
+};
+
+// Returns the name of the order.
+std::string tileOrderName(TileOrder order);
+// Finds the order with the name (or one of its abbreviations). Returns false if there is none.
+bool tileOrderFromName(std::string name, TileOrder &order);
+
+// Sorts the tiles, which are in scanline order, into the order. Tiles that the order ranks alike keep their
+// scanline order. tileSize is the size of the grid the tiles are on, (focusX, focusY) the point the focus order
+// spirals out from, and cost returns how long a tile took in the last frame (0 if it isn't known).
+void orderTiles(std::vector<TileRect> &tiles, TileOrder order, int tileSize, int focusX, int focusY,
+	std::function<float(const TileRect&)> cost);
+
+#endif
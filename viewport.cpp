@@ -1,60 +1,185 @@
 #include "viewport.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <limits>
 #include <math.h>
+#include <mutex>
+#include <sstream>
 #include <vector>
 
+#include "checkpoint.h"
+#include "frameBuffer.h"
+#include "frameCache.h"
+#include "mappedFile.h"
 #include "phongLightSource.h"
+#include "renderCluster.h"
 #include "shapeCollection.h"
 #include "surfaceShape.h"
-#include "main.h"
+#include "threadPool.h"
 #include "misc.h"
 
-Viewport::Viewport(Coord _origin, int _size, ShapeCollection* _shapes)
+PrimaryHit::PrimaryHit()
 {
-	assert(_size > 0);
+	point = FCoord3D();
+	shapeIndex = -1;
+	viewDependent = false;
+	diffuse = 0.0;
+	eyeDistance = 0.0;
+	lightDistance = 0.0;
+	color = RGB();
+}
+
+TileReach::TileReach()
+{
+	valid = false;
+}
+
+void TileReach::reset(bool _valid)
+{
+	valid = _valid;
+	segments = AABB();
+	escapeOrigins = AABB();
+	escapeDirections = AABB();
+}
+
+void TileReach::addSegment(FCoord3D p0, FCoord3D p1)
+{
+	segments.extend(p0);
+	segments.extend(p1);
+}
+
+void TileReach::addEscape(FCoord3D p0, FCoord3D d)
+{
+	escapeOrigins.extend(p0);
+	escapeDirections.extend(d);
+}
+
+bool TileReach::mayReach(const AABB &box) const
+{
+	if (segments.overlaps(box)) return true;
+	if (escapeOrigins.isEmpty()) return false;
+	
+	// An escaped ray can only pass through the box if, along every axis, it either starts level with the box or
+	// may head towards it.
+	float originMin[3] = {escapeOrigins.min.x, escapeOrigins.min.y, escapeOrigins.min.z};
+	float originMax[3] = {escapeOrigins.max.x, escapeOrigins.max.y, escapeOrigins.max.z};
+	float dirMin[3] = {escapeDirections.min.x, escapeDirections.min.y, escapeDirections.min.z};
+	float dirMax[3] = {escapeDirections.max.x, escapeDirections.max.y, escapeDirections.max.z};
+	float boxMin[3] = {box.min.x, box.min.y, box.min.z};
+	float boxMax[3] = {box.max.x, box.max.y, box.max.z};
+	for (int a = 0; a < 3; a++)
+	{
+		if (dirMin[a] > 0.0 && boxMax[a] < originMin[a]) return false;
+		if (dirMax[a] < 0.0 && boxMin[a] > originMax[a]) return false;
+	}
+	return true;
+}
+
+// The number of layers of recursion whose rays are counted separately (deeper rays are counted with the last).
+static const int TRACE_LAYERS = 16;
+// Rays traced by the current thread since its counts were last collected.
+struct TraceCounters
+{
+	long long primary;
+	long long secondary;
+	long long shadow;
+	// The rays traced at each layer of recursion, along with their shadow rays.
+	long long layers[TRACE_LAYERS];
+};
+static thread_local TraceCounters traceCounters = {0, 0, 0, {}};
+// Where the rays traced by the current thread go are recorded in this tile's reach (if it isn't null).
+static thread_local TileReach* tileReach = nullptr;
+// The copy of the shapes that the current thread traces rays against (the viewport's own if it is null).
+static thread_local ShapeCollection* traceShapes = nullptr;
+
+Viewport::Viewport(Coord _origin, int _width, int _height, ShapeCollection* _shapes)
+{
+	assert(_width > 0 && _height > 0);
 	
 	origin = _origin;
-	size = _size;
+	width = _width;
+	height = _height;
 	shapes = _shapes;
+	pool = nullptr;
+	tileListener = nullptr;
+	frameCache = nullptr;
+	keepFrame = true;
+	checkpoint = nullptr;
+	frameBuffer = nullptr;
+	cluster = nullptr;
+	clusterShapesKey = 0;
 	
 	outlineColor = OUTLINE_COLOR_DEFAULT();
 	backgroundColor = BACKGROUND_COLOR_DEFAULT();
 	
-	fromPoint = FCoord3D(1000, 100, 1000);
-	atPoint = FCoord3D(0, 0, 0);
-	upVector = FCoord3D(0, 0, 1);
-	viewingAngleDeg = 30.0;
 	
 	lightSources = new std::vector<PhongLightSource*>();
 	// ambientColor = RGB(0, 0, 1);
 	ambientIntensity = 0.2;
 	rayTracingRecursionLayers = 10;
+	
+	reprojection = false;
+	reprojectionThreshold = 0.5;
+	history = new std::vector<PrimaryHit>();
+	historyValid = false;
+	
+	tilesPerRow = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tileReaches = new std::vector<TileReach>(tilesPerRow * ((height + TILE_SIZE - 1) / TILE_SIZE));
+	
+	tileOrder = toScanline;
+	focusX = width / 2;
+	focusY = height / 2;
+	tileCosts = new std::vector<float>(tileReaches->size(), 0.0);
+	
+	antiAliasingSamples = 1;
+	antiAliasingGrid = 1;
+	antiAliasingThreshold = 0.1;
+	
+	budgetMs = 0.0;
+	layerRays = new std::vector<long long>(TRACE_LAYERS, 0);
+	
+	regionActive = false;
+	regionX0 = regionY0 = 0;
+	regionX1 = width;
+	regionY1 = height;
+	
+	statsStartMs = 0.0;
+}
+
+Viewport::~Viewport()
+{
+	clearLights();
+	delete lightSources;
+	delete history;
+	delete tileReaches;
+	delete tileCosts;
+	delete layerRays;
 }
 
 void Viewport::pixelMake(int x, int y, RGB color)
 {
-	if (pixelIn(x, y))
-	{
-		makePix(origin.x + x, origin.y + y, color);
-	}
+	if (!pixelIn(x, y) || !frameBuffer) return;
+	
+	frameBuffer->set(origin.x + x, origin.y + y, color);
 }
 
 RGB Viewport::pixelGet(int x, int y)
 {
-	if (pixelIn(x, y))
+	if (!pixelIn(x, y) || !frameBuffer)
 	{
-		return getPix(origin.x + x, origin.y + y);
+		return RGB();
 	}
 	else
 	{
-		return RGB();
+		return frameBuffer->get(origin.x + x, origin.y + y);
 	}
 }
 
 bool Viewport::pixelIn(int x, int y)
 {
-	if (x < 0 || x >= size || y < 0 || y >= size) return false;
+	if (x < 0 || x >= width || y < 0 || y >= height) return false;
 	else return true;
 }
 
@@ -66,14 +191,9 @@ void Viewport::readSceneAttributes(std::istream& s)
 	backgroundColor.read(s);
 	
 	// CVM Parameters.
-	fromPoint.read(s);
-	atPoint.read(s);
-	upVector.read(s);
+	camera.read(s);
 	
 	float f;
-	s >> f;
-	viewingAngleDeg = f;
-	
 	s >> f;
 	ambientIntensity = f;
 	
@@ -95,10 +215,7 @@ void Viewport::writeSceneAttributes(std::ostream& s)
 	backgroundColor.write(s);
 		
 	// CVM Parameters.
-	fromPoint.write(s);
-	atPoint.write(s);
-	upVector.write(s);
-	s << viewingAngleDeg << std::endl;
+	camera.write(s);
 	s << ambientIntensity << std::endl;
 	s << std::endl;
 	
@@ -114,149 +231,186 @@ void Viewport::writeSceneAttributes(std::ostream& s)
 
 
 
-int Viewport::getSize()
+Coord Viewport::getOrigin()
+{
+	return origin;
+}
+
+int Viewport::getWidth()
+{
+	return width;
+}
+
+int Viewport::getHeight()
+{
+	return height;
+}
+
+void Viewport::setThreadPool(ThreadPool* _pool)
+{
+	pool = _pool;
+}
+
+ThreadPool* Viewport::getThreadPool()
+{
+	return pool;
+}
+
+void Viewport::setTileListener(TileListener _listener)
+{
+	tileListener = _listener;
+}
+
+void Viewport::setTileOrder(TileOrder order)
+{
+	tileOrder = order;
+}
+
+TileOrder Viewport::getTileOrder()
+{
+	return tileOrder;
+}
+
+void Viewport::setTileFocus(int x, int y)
+{
+	focusX = x;
+	focusY = y;
+}
+
+void Viewport::getTileFocus(int &x, int &y)
+{
+	x = focusX;
+	y = focusY;
+}
+
+void Viewport::setFrameCache(FrameCache* _cache)
+{
+	frameCache = _cache;
+}
+
+FrameCache* Viewport::getFrameCache()
+{
+	return frameCache;
+}
+
+void Viewport::setKeepFrame(bool _keepFrame)
+{
+	keepFrame = _keepFrame;
+	if (!keepFrame)
+	{
+		history->clear();
+		historyValid = false;
+	}
+}
+
+bool Viewport::getKeepFrame()
+{
+	return keepFrame;
+}
+
+void Viewport::setCheckpoint(Checkpoint* _checkpoint)
+{
+	checkpoint = _checkpoint;
+}
+
+void Viewport::setFrameBuffer(FrameBuffer* _frameBuffer)
+{
+	frameBuffer = _frameBuffer;
+}
+
+FrameBuffer* Viewport::getFrameBuffer()
+{
+	return frameBuffer;
+}
+
+void Viewport::setCluster(RenderCluster* _cluster)
 {
-	return size;
+	cluster = _cluster;
 }
 
 void Viewport::setFromPoint(FCoord3D ff)
 {
-	fromPoint = ff;
+	camera.fromPoint = ff;
 }
 
 FCoord3D Viewport::getFromPoint()
 {
-	return fromPoint;
+	return camera.fromPoint;
 }
 
 void Viewport::setAtPoint(FCoord3D a)
 {
-	atPoint = a;
+	camera.atPoint = a;
 }
 
 FCoord3D Viewport::getAtPoint()
 {
-	return atPoint;
+	return camera.atPoint;
 }
 
 void Viewport::setUpVector(FCoord3D u)
 {
-	upVector = u;
+	camera.upVector = u;
 }
 
 FCoord3D Viewport::getUpVector()
 {
-	return upVector;
+	return camera.upVector;
 }
 
 void Viewport::setViewingAngle(float alphaDeg)
 {
-	viewingAngleDeg = alphaDeg;
+	camera.viewingAngleDeg = alphaDeg;
+}
+
+float Viewport::getViewingAngle()
+{
+	return camera.viewingAngleDeg;
+}
+
+void Viewport::setCamera(Camera _camera)
+{
+	camera = _camera;
+}
+
+Camera Viewport::getCamera()
+{
+	return camera;
+}
+
+void Viewport::setBackgroundColor(RGB c)
+{
+	backgroundColor = c;
+}
+
+RGB Viewport::getBackgroundColor()
+{
+	return backgroundColor;
+}
+
+void Viewport::setAmbientIntensity(float f)
+{
+	ambientIntensity = f;
+}
+
+float Viewport::getAmbientIntensity()
+{
+	return ambientIntensity;
 }
 
 void Viewport::moveCamera(Direction d, float f)
 {
-	FCoord3D vForward = atPoint.minus(fromPoint).makeUnit();
-	FCoord3D vRight = vForward.crossProduct(upVector).makeUnit();
-	FCoord3D vUp = vRight.crossProduct(vForward).makeUnit();
-	
-	
-	float multi = 1.0;
-	
-	switch (d)
-	{
-		case dLeft:
-			multi = -1.0;
-		case dRight:
-			atPoint = atPoint.plus(vRight.multiply(multi * f));
-			fromPoint = fromPoint.plus(vRight.multiply(multi * f));
-			break;
-		
-		case dDown:
-			multi = -1.0;
-		case dUp:
-			atPoint = atPoint.plus(vUp.multiply(multi * f));
-			fromPoint = fromPoint.plus(vUp.multiply(multi * f));
-			break;
-		
-		case dBackward:
-			multi = -1.0;
-		case dForward:
-			atPoint = atPoint.plus(vForward.multiply(multi * f));
-			fromPoint = fromPoint.plus(vForward.multiply(multi * f));
-			break;
-		
-		default:
-			break;
-	}
+	camera.move(d, f);
 }
 
 void Viewport::moveAtPoint(Direction d, float f)
 {
-	FCoord3D vForward = atPoint.minus(fromPoint).makeUnit();
-	FCoord3D vRight = vForward.crossProduct(upVector).makeUnit();
-	FCoord3D vUp = vRight.crossProduct(vForward).makeUnit();
-	
-	
-	float multi = 1.0;
-	
-	switch (d)
-	{
-		case dLeft:
-			multi = -1.0;
-		case dRight:
-			atPoint = atPoint.plus(vRight.multiply(multi * f));
-			break;
-		
-		case dDown:
-			multi = -1.0;
-		case dUp:
-			atPoint = atPoint.plus(vUp.multiply(multi * f));
-			break;
-		
-		case dBackward:
-			multi = -1.0;
-		case dForward:
-			atPoint = atPoint.plus(vForward.multiply(multi * f));
-			break;
-		
-		default:
-			break;
-	}
+	camera.moveAtPoint(d, f);
 }
 
 void Viewport::moveFromPoint(Direction d, float f)
 {
-	FCoord3D vForward = atPoint.minus(fromPoint).makeUnit();
-	FCoord3D vRight = vForward.crossProduct(upVector).makeUnit();
-	FCoord3D vUp = vRight.crossProduct(vForward).makeUnit();
-	
-	
-	float multi = 1.0;
-	
-	switch (d)
-	{
-		case dLeft:
-			multi = -1.0;
-		case dRight:
-			fromPoint = fromPoint.plus(vRight.multiply(multi * f));
-			break;
-		
-		case dDown:
-			multi = -1.0;
-		case dUp:
-			fromPoint = fromPoint.plus(vUp.multiply(multi * f));
-			break;
-		
-		case dBackward:
-			multi = -1.0;
-		case dForward:
-			fromPoint = fromPoint.plus(vForward.multiply(multi * f));
-			break;
-		
-		default:
-			break;
-	}
+	camera.moveFromPoint(d, f);
 }
 
 void Viewport::addLight(PhongLightSource* light)
@@ -270,41 +424,89 @@ void Viewport::deleteLight(int index)
 	lightSources->erase(lightSources->begin() + index);
 }
 
+PhongLightSource* Viewport::getLight(int index)
+{
+	if (index < 0 || index >= (int)lightSources->size()) return nullptr;
+	return lightSources->at(index);
+}
+
+int Viewport::numLights()
+{
+	return lightSources->size();
+}
+
+void Viewport::clearLights()
+{
+	for (int i = 0; i < (int)lightSources->size(); i++)
+	{
+		delete lightSources->at(i);
+	}
+	lightSources->clear();
+}
+
+void Viewport::copySceneFrom(Viewport* scene)
+{
+	clearLights();
+	for (int i = 0; i < scene->numLights(); i++)
+	{
+		addLight(new PhongLightSource(*scene->getLight(i)));
+	}
+	
+	backgroundColor = scene->getBackgroundColor();
+	ambientIntensity = scene->getAmbientIntensity();
+	setAntiAliasing(scene->getAntiAliasingSamples(), scene->getAntiAliasingThreshold());
+	budgetMs = scene->getBudget();
+}
+
 void Viewport::drawOutline()
 {
-	void drawLineBresenham(int x1, int y1, int x2, int y2, RGB color);
-	
-	drawLineBresenham(
-		origin.x - 1, origin.y - 1,
-		origin.x - 1, origin.y + size,
-		outlineColor
-	);
-	drawLineBresenham(
-		origin.x - 1, origin.y + size,
-		origin.x + size, origin.y + size,
-		outlineColor
-	);
-	drawLineBresenham(
-		origin.x + size, origin.y + size,
-		origin.x + size, origin.y - 1,
-		outlineColor
-	);
-	drawLineBresenham(
-		origin.x + size, origin.y - 1,
-		origin.x - 1, origin.y - 1,
-		outlineColor
-	);
+	if (!frameBuffer) return;
+	
+	// The outline is outside the viewport, so it is drawn straight into the frame buffer.
+	for (int i = origin.x - 1; i <= origin.x + width; i++)
+	{
+		frameBuffer->set(i, origin.y - 1, outlineColor);
+		frameBuffer->set(i, origin.y + height, outlineColor);
+	}
+	for (int j = origin.y; j < origin.y + height; j++)
+	{
+		frameBuffer->set(origin.x - 1, j, outlineColor);
+		frameBuffer->set(origin.x + width, j, outlineColor);
+	}
 }
 
 void Viewport::fillBackground()
 {
-	for (int i = 0; i < size; i++)
+	if (tileNode(0) < 0)
+	{
+		for (int i = 0; i < width; i++)
+		{
+			for (int j = 0; j < height; j++)
+			{
+				pixelMake(i, j, backgroundColor);
+			}
+		}
+		return;
+	}
+	
+	TaskGroup tasks(pool);
+	for (int y0 = 0; y0 < height; y0 += TILE_SIZE)
 	{
-		for (int j = 0; j < size; j++)
+		for (int x0 = 0; x0 < width; x0 += TILE_SIZE)
 		{
-			makePix(origin.x + i, origin.y + j, backgroundColor);
+			tasks.enqueue([this, x0, y0]()
+			{
+				for (int j = y0; j < std::min(y0 + TILE_SIZE, height); j++)
+				{
+					for (int i = x0; i < std::min(x0 + TILE_SIZE, width); i++)
+					{
+						pixelMake(i, j, backgroundColor);
+					}
+				}
+			}, tileNode(y0));
 		}
 	}
+	tasks.wait();
 }
 
 void Viewport::drawDiamond(Coord coord, RGB color)
@@ -417,118 +619,543 @@ void Viewport::drawLine(Coord p1, Coord p2, RGB color)
 
 void Viewport::redraw(bool loadingText)
 {
-	const int pixelEvery = size * size / 45;
-	int counter = 0;
+	if (budgetMs > 0.0 && keepFrame)
+	{
+		redrawBudgeted(loadingText);
+		return;
+	}
 	
-	if (loadingText)
+	// A frame with a region only partly belongs to the current scene, so it is not cached.
+	// A frame whose tiles are dropped as they finish can still be shown from the cache, but not stored in it.
+	bool useCache = frameCache && frameCache->isEnabled() && !regionActive;
+	uint64_t key = 0;
+	if (useCache)
 	{
-		std::cout << "|  Please wait while the scene is ray-traced  |" << std::endl << " ";
+		key = frameKey();
+		if (showCachedFrame(key, loadingText)) return;
 	}
 	
-	RGB color;
-	float max;
-	for (int j = 0; j < size; j++)
+	prepareScene();
+	beginStats();
+	if (!recordingHits())
 	{
-		for (int i = 0; i < size; i++)
+		history->clear();
+	}
+	else if (!regionActive || (int)history->size() != width * height)
+	{
+		history->assign(width * height, PrimaryHit());
+	}
+	
+	// Tiles finished by an earlier run of the same frame (that was interrupted) are restored instead of traced.
+	bool useCheckpoint = checkpoint && checkpoint->isEnabled();
+	if (useCheckpoint)
+	{
+		int bounds[4];
+		getRenderBounds(bounds[0], bounds[1], bounds[2], bounds[3]);
+		int restorable = checkpoint->beginFrame(hashBytes(bounds, sizeof(bounds), useCache ? key : frameKey()),
+			tileFloatsPerPixel());
+		if (loadingText && restorable > 0)
 		{
-			color = calculatePixelColor(i, j);
-			
-			max = color.red;
-			if (color.green > max) max = color.green;
-			if (color.blue > max) max = color.blue;
-			
-			if (max > 1.0)
-			{
-				color = color.scale(1.0 / max);
-			}
-			
-			pixelMake(i, j, color);
-			
-			counter++;
-			if (counter == pixelEvery)
-			{
-				if (loadingText)
-				{
-					std::cout << "*" << std::flush;
-				}
-				counter = 0;
-			}
+			std::cout << "Resuming from \"" << checkpoint->getFileName() << "\": " << restorable
+				<< " tiles are already finished." << std::endl;
 		}
 	}
-	if (loadingText)
+	
+	// While the cluster has workers, they are handed the tiles first, and only what they leave is rendered here.
+	std::atomic<int> tilesResumed(0);
+	std::vector<bool> remoteTiles;
+	if (cluster && cluster->numWorkers() > 0)
 	{
-		std::cout << std::endl;
+		renderRemoteTiles(useCheckpoint, tilesResumed, remoteTiles);
 	}
-}
-
-RGB Viewport::calculatePixelColor(int i, int j)
-{
-	std::vector<bool> inShape = std::vector<bool>();
-	for (int i = 0; i < shapes->numShapes(); i++)
+	forEachTile(loadingText, [this, useCheckpoint, &tilesResumed](int x0, int y0, int x1, int y1)
 	{
-		inShape.push_back(false);
+		if (useCheckpoint && restoreCheckpointTile(x0, y0, x1, y1))
+		{
+			// Where the rays of a restored tile went isn't known.
+			getTileReach(x0, y0).reset(false);
+			tilesResumed++;
+			return;
+		}
+		
+		getTileReach(x0, y0).reset(true);
+		renderTile(x0, y0, x1, y1);
+		if (useCheckpoint)
+		{
+			saveCheckpointTile(x0, y0, x1, y1);
+		}
+	}, remoteTiles.empty() ? nullptr : &remoteTiles);
+	stats.tilesResumed = tilesResumed;
+	
+	if (antiAliasingSamples > 1 && keepFrame)
+	{
+		refinePixels(loadingText, nullptr);
+	}
+	if (useCheckpoint)
+	{
+		checkpoint->endFrame();
+	}
+	
+	// Outside a region, the history is from an earlier frame.
+	historyValid = reprojection && !regionActive;
+	endStats();
+	
+	if (useCache && keepFrame)
+	{
+		storeFrame(key);
 	}
-	return calculatePhongColor(fromPoint, getRayDir(i, j), 0, inShape, 1.0);
 }
 
-RGB Viewport::calculatePhongColor(FCoord3D ff, FCoord3D rayDir, int rLayer, std::vector<bool> inShape, float recursiveScaling)
+void Viewport::redrawCameraMove(bool loadingText)
 {
-	const float SURFACE_EPSILON = 0.01;
-	const float MIN_RECURSIVE_SCALING = 0.01;
+	if (frameCache && frameCache->isEnabled() && showCachedFrame(frameKey(), loadingText))
+	{
+		return;
+	}
 	
-	float t = 0.0;
-	FCoord3D normal = FCoord3D();
-	int shapeIndex = -1;
-	if (shapes->rayIntersects(ff, rayDir, t, normal, shapeIndex))
+	if (!reprojection || !historyValid || regionActive || (int)history->size() != width * height || budgetMs > 0.0)
 	{
-		assert(normal.length() != 0.0);
+		redraw(loadingText);
+		return;
+	}
+	
+	prepareScene();
+	const int n = width * height;
+	std::vector<PrimaryHit> previous = *history;
+	
+	// The new camera basis (see getRayDir).
+	FCoord3D b1, b2, b3;
+	camera.getBasis(b1, b2, b3);
+	float focal = camera.getFocalLength();
+	float span = (float)(std::min(width, height) - 1);
+	
+	// Move every hit of the last frame to the pixel where it is seen from the new camera, keeping the nearest.
+	std::vector<float> depth(n, INFINITY);
+	std::vector<int> source(n, -1);
+	for (int k = 0; k < n; k++)
+	{
+		if (previous.at(k).shapeIndex < 0) continue;
 		
-		normal = normal.makeUnit();
+		FCoord3D v = previous.at(k).point.minus(camera.fromPoint);
+		float z = v.dotProduct(b3);
+		if (z <= 0.0) continue;
 		
-		Shape* shape = shapes->get(shapeIndex);
-		FCoord3D point = ff.plus(rayDir.multiply(t));
-		FCoord3D viewVector = ff.minus(point).makeUnit();
-		if (normal.dotProduct(viewVector) < 0)
-		{ // Ensures that the normal points towards the view vector.
-			normal = normal.negate();
-		}
+		int i = std::lround(focal * v.dotProduct(b1) / z * span + 0.5 * (width - 1));
+		int j = std::lround(focal * v.dotProduct(b2) / z * span + 0.5 * (height - 1));
+		if (!pixelIn(i, j)) continue;
 		
-		// Use the average of the light sources as the ambient color.
-		RGB pointColor = RGB(0, 0, 0);
-		if (lightSources->size() == 0)
+		float d = v.length();
+		if (d < depth.at(i + j * width))
 		{
-			pointColor = RGB(0.1, 0.1, 0.1);
+			depth.at(i + j * width) = d;
+			source.at(i + j * width) = k;
 		}
-		else
+	}
+	
+	// Re-trace pixels that nothing landed on (disoccluded), that show view-dependent color, that lie on the
+	// edge of a shape, or that sit behind a much nearer neighbour.
+	std::vector<bool> retrace(n, false);
+	int numRetrace = 0;
+	for (int j = 0; j < height; j++)
+	{
+		for (int i = 0; i < width; i++)
 		{
-			for (int i = 0; i < (int)lightSources->size(); i++)
+			int t = i + j * width;
+			bool r = (source.at(t) < 0 || previous.at(source.at(t)).viewDependent);
+			
+			const int di[4] = {-1, 1, 0, 0};
+			const int dj[4] = {0, 0, -1, 1};
+			for (int m = 0; m < 4 && !r; m++)
 			{
-				pointColor = pointColor.add(lightSources->at(i)->color);
+				if (!pixelIn(i + di[m], j + dj[m])) continue;
+				int nb = (i + di[m]) + (j + dj[m]) * width;
+				r = (source.at(nb) < 0 ||
+					previous.at(source.at(nb)).shapeIndex != previous.at(source.at(t)).shapeIndex ||
+					depth.at(nb) < depth.at(t) * (1.0 - REPROJECTION_DEPTH_TOLERANCE));
 			}
-			pointColor = pointColor.scale(ambientIntensity / (int)lightSources->size());
-		}
-		
-		for (int i = 0; i < (int)lightSources->size(); i++)
-		{
-			PhongLightSource* light = lightSources->at(i);
 			
-			FCoord3D lightVector = light->position.minus(point).makeUnit();
-			if (!shapes->lineSegmentIntersects(point.plus(lightVector.multiply(SURFACE_EPSILON)), light->position))
-			{
-				FCoord3D reflectionVector = lightVector.negate().plus(normal.multiply(2.0 * normal.dotProduct(lightVector)));
+			retrace.at(t) = r;
+			if (r) numRetrace++;
+		}
+	}
+	
+	if ((float)numRetrace / (float)n > reprojectionThreshold)
+	{
+		redraw(loadingText);
+		return;
+	}
+	
+	beginStats();
+	forEachTile(loadingText, [&](int x0, int y0, int x1, int y1)
+	{
+		for (int j = y0; j < y1; j++)
+		{
+			for (int i = x0; i < x1; i++)
+			{
+				int t = i + j * width;
+				if (retrace.at(t))
+				{
+					tracePixel(i, j);
+				}
+				else
+				{
+					// The diffuse light is rescaled to the new distance from the eye.
+					PrimaryHit hit = previous.at(source.at(t));
+					if (hit.diffuse > 0.0)
+					{
+						float diffuse = hit.diffuse * (hit.eyeDistance + hit.lightDistance)
+							/ (depth.at(t) + hit.lightDistance);
+						RGB shapeColor = shapes->get(hit.shapeIndex)->getColor();
+						hit.color = clampColor(hit.color.add(shapeColor.scale(diffuse - hit.diffuse)));
+						hit.diffuse = diffuse;
+						hit.eyeDistance = depth.at(t);
+					}
+					history->at(t) = hit;
+					pixelMake(i, j, hit.color);
+				}
+			}
+		}
+	});
+	
+	if (antiAliasingSamples > 1)
+	{ // Reused pixels keep their anti-aliased colors.
+		refinePixels(loadingText, &retrace);
+	}
+	
+	stats.pixelsReprojected = n - numRetrace;
+	endStats();
+	// The rays of reprojected pixels weren't traced.
+	invalidateTileReaches();
+	
+	if (loadingText)
+	{
+		std::cout << "Reprojected " << (n - numRetrace) << " of " << n << " pixels." << std::endl;
+	}
+}
+
+void Viewport::redrawChanges(bool loadingText, const SceneChanges &changes)
+{
+	int bx0, by0, bx1, by1;
+	getRenderBounds(bx0, by0, bx1, by1);
+	
+	// Tiles can only be kept if the last frame recorded where all of their rays went, and its pixels are still held.
+	// Budgeted frames are always redrawn whole.
+	bool recorded = keepFrame && budgetMs <= 0.0 && !changes.affectsEverything() &&
+		(!recordingHits() || (int)history->size() == width * height);
+	for (int ty = by0 - by0 % TILE_SIZE; ty < by1 && recorded; ty += TILE_SIZE)
+	{
+		for (int tx = bx0 - bx0 % TILE_SIZE; tx < bx1 && recorded; tx += TILE_SIZE)
+		{
+			recorded = getTileReach(tx, ty).valid;
+		}
+	}
+	if (!recorded)
+	{
+		redraw(loadingText);
+		return;
+	}
+	
+	bool useCache = frameCache && frameCache->isEnabled() && !regionActive;
+	uint64_t key = 0;
+	if (useCache)
+	{
+		key = frameKey();
+		if (showCachedFrame(key, loadingText)) return;
+	}
+	
+	prepareScene();
+	
+	// The pixels each changed shape covers (as minI, minJ, maxI, maxJ).
+	bool everywhere = false;
+	std::vector<float> covered;
+	for (int k = 0; k < (int)changes.bounds.size() && !everywhere; k++)
+	{
+		float r[4];
+		everywhere = !projectBounds(changes.bounds.at(k), r[0], r[1], r[2], r[3]);
+		covered.insert(covered.end(), r, r + 4);
+	}
+	
+	beginStats();
+	std::vector<char> retraced(tileReaches->size(), 0);
+	std::atomic<int> tilesKept(0);
+	forEachTile(loadingText, [&](int x0, int y0, int x1, int y1)
+	{
+		TileReach &reach = getTileReach(x0, y0);
+		bool affected = everywhere;
+		for (int k = 0; k < (int)changes.bounds.size() && !affected; k++)
+		{
+			// Anti-aliasing samples reach up to a pixel past the tile.
+			const float* r = &covered.at(k * 4);
+			affected = (r[0] <= x1 && r[2] >= x0 - 1 && r[1] <= y1 && r[3] >= y0 - 1) ||
+				reach.mayReach(changes.bounds.at(k));
+		}
+		if (!affected)
+		{
+			tilesKept++;
+			return;
+		}
+		
+		reach.reset(true);
+		renderTile(x0, y0, x1, y1);
+		retraced.at((y0 / TILE_SIZE) * tilesPerRow + x0 / TILE_SIZE) = 1;
+	});
+	
+	if (antiAliasingSamples > 1)
+	{
+		// Whether a pixel is refined depends on the first samples of its neighbours, so the ring of kept pixels
+		// around the traced tiles is refined again too. Kept pixels only hold their refined colors, so the first
+		// samples of the ring, and of the kept pixels next to it, are traced again to compare; those next to it
+		// get their colors back afterwards.
+		std::vector<char> ring(width * height, 0);
+		for (int j = by0; j < by1; j++)
+		{
+			for (int i = bx0; i < bx1; i++)
+			{
+				if (retraced.at((j / TILE_SIZE) * tilesPerRow + i / TILE_SIZE)) ring.at(i + j * width) = 3;
+			}
+		}
+		const int di[4] = {-1, 1, 0, 0};
+		const int dj[4] = {0, 0, -1, 1};
+		for (int distance = 2; distance >= 1; distance--)
+		{
+			for (int j = by0; j < by1; j++)
+			{
+				for (int i = bx0; i < bx1; i++)
+				{
+					for (int m = 0; m < 4 && ring.at(i + j * width) == 0; m++)
+					{
+						int ni = i + di[m];
+						int nj = j + dj[m];
+						if (ni < bx0 || ni >= bx1 || nj < by0 || nj >= by1) continue;
+						if (ring.at(ni + nj * width) == distance + 1) ring.at(i + j * width) = distance;
+					}
+				}
+			}
+		}
+		
+		std::vector<PrimaryHit> kept(width * height);
+		forEachTile(false, [&](int x0, int y0, int x1, int y1)
+		{
+			if (retraced.at((y0 / TILE_SIZE) * tilesPerRow + x0 / TILE_SIZE)) return;
+			for (int j = y0; j < y1; j++)
+			{
+				for (int i = x0; i < x1; i++)
+				{
+					int t = i + j * width;
+					if (ring.at(t) == 0) continue;
+					kept.at(t) = history->at(t);
+					tracePixel(i, j);
+				}
+			}
+		});
+		
+		std::vector<bool> candidates(width * height, false);
+		for (int t = 0; t < width * height; t++)
+		{
+			candidates.at(t) = (ring.at(t) >= 2);
+		}
+		std::vector<bool> refine;
+		findRefinePixels(&candidates, refine);
+		for (int j = by0; j < by1; j++)
+		{
+			for (int i = bx0; i < bx1; i++)
+			{
+				int t = i + j * width;
+				if (ring.at(t) != 1) continue;
+				history->at(t) = kept.at(t);
+				pixelMake(i, j, kept.at(t).color);
+			}
+		}
+		resamplePixels(loadingText, refine, antiAliasingGrid, 0.0, 0.0);
+	}
+	
+	stats.tilesKept = tilesKept;
+	endStats();
+	
+	if (loadingText)
+	{
+		std::cout << "Re-traced " << (stats.tiles - stats.tilesKept) << " of " << stats.tiles << " tiles." << std::endl;
+	}
+	if (useCache)
+	{
+		storeFrame(key);
+	}
+}
+
+void Viewport::renderTile(int x0, int y0, int x1, int y1)
+{
+	double startMs = nowMs();
+	for (int j = y0; j < y1; j++)
+	{
+		for (int i = x0; i < x1; i++)
+		{
+			tracePixel(i, j);
+		}
+	}
+	tileCosts->at(tileIndex(x0, y0)) = nowMs() - startMs;
+}
+
+void Viewport::renderTileCoarse(int x0, int y0, int x1, int y1, int step)
+{
+	for (int j = y0; j < y1; j += step)
+	{
+		for (int i = x0; i < x1; i += step)
+		{
+			// The pixel in the middle of the block is traced.
+			int bi = std::min(i + step / 2, x1 - 1);
+			int bj = std::min(j + step / 2, y1 - 1);
+			RGB color = clampColor(calculatePixelColor(bi, bj));
+			for (int y = j; y < std::min(j + step, y1); y++)
+			{
+				for (int x = i; x < std::min(i + step, x1); x++)
+				{
+					pixelMake(x, y, color);
+				}
+			}
+		}
+	}
+}
+
+void Viewport::prepareTiles()
+{
+	shapes->prepare();
+	if (recordingHits())
+	{
+		history->assign(width * height, PrimaryHit());
+	}
+	else
+	{
+		history->clear();
+	}
+}
+
+RGB Viewport::calculatePixelColor(int i, int j)
+{
+	return calculatePixelColor(i, j, nullptr);
+}
+
+RGB Viewport::calculatePixelColor(int i, int j, PrimaryHit* hit)
+{
+	return calculateSampleColor((float)i, (float)j, hit);
+}
+
+RGB Viewport::calculateSampleColor(float x, float y, PrimaryHit* hit)
+{
+	std::vector<bool> inShape = std::vector<bool>();
+	for (int i = 0; i < shapes->numShapes(); i++)
+	{
+		inShape.push_back(false);
+	}
+	return calculatePhongColor(camera.fromPoint, getRayDir(x, y), 0, inShape, 1.0, hit);
+}
+
+RGB Viewport::calculatePhongColor(FCoord3D ff, FCoord3D rayDir, int rLayer, std::vector<bool> inShape, float recursiveScaling,
+	PrimaryHit* hit)
+{
+	const float SURFACE_EPSILON = 0.01;
+	const float MIN_RECURSIVE_SCALING = 0.01;
+	
+	float t = 0.0;
+	FCoord3D normal = FCoord3D();
+	int shapeIndex = -1;
+	if (rLayer == 0)
+	{
+		traceCounters.primary++;
+	}
+	else
+	{
+		traceCounters.secondary++;
+	}
+	long long &layerCount = traceCounters.layers[std::min(rLayer, TRACE_LAYERS - 1)];
+	layerCount++;
+	
+	ShapeCollection* scene = traceShapes ? traceShapes : shapes;
+	if (scene->rayIntersects(ff, rayDir, t, normal, shapeIndex))
+	{
+		assert(normal.length() != 0.0);
+		
+		normal = normal.makeUnit();
+		
+		Shape* shape = scene->get(shapeIndex);
+		FCoord3D point = ff.plus(rayDir.multiply(t));
+		if (tileReach && rLayer > 0)
+		{
+			tileReach->addSegment(ff, point);
+		}
+		FCoord3D viewVector = ff.minus(point).makeUnit();
+		if (normal.dotProduct(viewVector) < 0)
+		{ // Ensures that the normal points towards the view vector.
+			normal = normal.negate();
+		}
+		
+		if (hit)
+		{
+			hit->point = point;
+			hit->shapeIndex = shapeIndex;
+			hit->viewDependent = (shape->getRefl() != 0.0 || shape->getRefr() != 0.0);
+		}
+		
+		// Use the average of the light sources as the ambient color.
+		RGB pointColor = RGB(0, 0, 0);
+		if (lightSources->size() == 0)
+		{
+			pointColor = RGB(0.1, 0.1, 0.1);
+		}
+		else
+		{
+			for (int i = 0; i < (int)lightSources->size(); i++)
+			{
+				pointColor = pointColor.add(lightSources->at(i)->color);
+			}
+			pointColor = pointColor.scale(ambientIntensity / (int)lightSources->size());
+		}
+		
+		// For reprojection, the diffuse light and how quickly it falls off with the distance from the eye.
+		float diffuseFalloff = 0.0;
+		for (int i = 0; i < (int)lightSources->size(); i++)
+		{
+			PhongLightSource* light = lightSources->at(i);
+			
+			FCoord3D lightVector = light->position.minus(point).makeUnit();
+			FCoord3D shadowStart = point.plus(lightVector.multiply(SURFACE_EPSILON));
+			traceCounters.shadow++;
+			layerCount++;
+			if (tileReach)
+			{
+				tileReach->addSegment(shadowStart, light->position);
+			}
+			if (!scene->lineSegmentIntersects(shadowStart, light->position))
+			{
+				FCoord3D reflectionVector = lightVector.negate().plus(normal.multiply(2.0 * normal.dotProduct(lightVector)));
 				
-				float scalar = light->intensity / (point.minus(ff).length() + point.minus(light->position).length());
+				float pathLength = point.minus(ff).length() + point.minus(light->position).length();
+				float scalar = light->intensity / pathLength;
 				if (normal.dotProduct(lightVector) > 0)
 				{ // If light and viewer on same side, add diffuse color.
 					pointColor = pointColor.add(shape->getColor().scale(scalar * normal.dotProduct(lightVector)));
+					if (hit)
+					{
+						hit->diffuse += scalar * normal.dotProduct(lightVector);
+						diffuseFalloff += scalar * normal.dotProduct(lightVector) / pathLength;
+					}
 					if (viewVector.dotProduct(reflectionVector) > 0)
 					{ // If view vector is within 90 degrees of reflection vector, add specular color.
-						pointColor = pointColor.add(light->color.scale(scalar * pow(viewVector.dotProduct(reflectionVector), shape->getPhongExponent())));
+						RGB specular = light->color.scale(scalar * pow(viewVector.dotProduct(reflectionVector), shape->getPhongExponent()));
+						pointColor = pointColor.add(specular);
+						if (hit && std::max(specular.red, std::max(specular.green, specular.blue)) > 1.0 / 256.0)
+						{ // A visible highlight moves with the camera.
+							hit->viewDependent = true;
+						}
 					}
 				}
 			}
 			
 		}
+		if (hit && hit->diffuse > 0.0)
+		{
+			hit->eyeDistance = point.minus(ff).length();
+			hit->lightDistance = hit->diffuse / diffuseFalloff - hit->eyeDistance;
+		}
 		
 		if (rLayer == rayTracingRecursionLayers)
 		{
@@ -575,34 +1202,155 @@ RGB Viewport::calculatePhongColor(FCoord3D ff, FCoord3D rayDir, int rLayer, std:
 	}
 	else
 	{
+		if (hit)
+		{
+			hit->shapeIndex = -1;
+		}
+		if (tileReach && rLayer > 0)
+		{
+			tileReach->addEscape(ff, rayDir);
+		}
 		return backgroundColor;
 	}
 }
 
 FCoord3D Viewport::getRayDir(int i, int j)
 {
-	assert(atPoint.minus(fromPoint).length() != 0.0);
-	
-	FCoord3D b3 = atPoint.minus(fromPoint).makeUnit();
-	FCoord3D b1 = b3.crossProduct(upVector).makeUnit();
-	FCoord3D b2 = b1.crossProduct(b3).makeUnit();
-	
-	FCoord3D ptEye = FCoord3D(
-		((float)i / (float)(size - 1)) - 0.5,
-		((float)j / (float)(size - 1)) - 0.5,
-		1.0 / (2.0 * tan(viewingAngleDeg * M_PI / 180.0))
-	);
-	
-	FCoord3D ptWorld = FCoord3D(
-		fromPoint.x + (ptEye.x * b1.x) + (ptEye.y * b2.x) + (ptEye.z * b3.x),
-		fromPoint.y + (ptEye.x * b1.y) + (ptEye.y * b2.y) + (ptEye.z * b3.y),
-		fromPoint.z + (ptEye.x * b1.z) + (ptEye.y * b2.z) + (ptEye.z * b3.z)
-	);
-	
-	return ptWorld.minus(fromPoint).makeUnit();
+	return getRayDir((float)i, (float)j);
+}
+
+FCoord3D Viewport::getRayDir(float i, float j)
+{
+	return camera.getRayDir(i, j, width, height);
 }
 
 
+void Viewport::setReprojection(bool enabled, float threshold)
+{
+	reprojection = enabled;
+	reprojectionThreshold = threshold;
+	if (!reprojection)
+	{
+		history->clear();
+		historyValid = false;
+	}
+}
+
+bool Viewport::getReprojection()
+{
+	return reprojection;
+}
+
+float Viewport::getReprojectionThreshold()
+{
+	return reprojectionThreshold;
+}
+
+void Viewport::setAntiAliasing(int maxSamples, float threshold)
+{
+	// The widest grid whose samples don't pass the most allowed.
+	antiAliasingGrid = 1;
+	while ((antiAliasingGrid + 1) * (antiAliasingGrid + 1) <= maxSamples)
+	{
+		antiAliasingGrid++;
+	}
+	antiAliasingSamples = antiAliasingGrid * antiAliasingGrid;
+	antiAliasingThreshold = threshold;
+}
+
+int Viewport::getAntiAliasingSamples()
+{
+	return antiAliasingSamples;
+}
+
+float Viewport::getAntiAliasingThreshold()
+{
+	return antiAliasingThreshold;
+}
+
+void Viewport::setBudget(double ms)
+{
+	budgetMs = std::max(ms, 0.0);
+}
+
+double Viewport::getBudget()
+{
+	return budgetMs;
+}
+
+RenderStats Viewport::getStats()
+{
+	return stats;
+}
+
+MemoryUsage Viewport::getMemoryUsage()
+{
+	MemoryUsage usage;
+	shapes->addMemoryUsage(usage);
+	if (frameBuffer)
+	{
+		usage.frameBuffers = frameBuffer->allocatedBytes();
+	}
+	if (frameCache)
+	{
+		usage.frameCache = frameCache->memoryUsed();
+	}
+	usage.mapped = shapes->getMappedFiles()->residentTotal();
+	usage.renderBuffers = history->capacity() * sizeof(PrimaryHit) + tileReaches->capacity() * sizeof(TileReach)
+		+ tileCosts->capacity() * sizeof(float) + layerRays->capacity() * sizeof(long long);
+	return usage;
+}
+
+void Viewport::setRegion(int x0, int y0, int x1, int y1)
+{
+	regionX0 = std::max(0, std::min(x0, x1));
+	regionY0 = std::max(0, std::min(y0, y1));
+	regionX1 = std::min(width, std::max(x0, x1));
+	regionY1 = std::min(height, std::max(y0, y1));
+	regionActive = true;
+	historyValid = false;
+}
+
+void Viewport::clearRegion()
+{
+	regionActive = false;
+	regionX0 = regionY0 = 0;
+	regionX1 = width;
+	regionY1 = height;
+}
+
+bool Viewport::getRegion(int &x0, int &y0, int &x1, int &y1)
+{
+	x0 = regionX0;
+	y0 = regionY0;
+	x1 = regionX1;
+	y1 = regionY1;
+	return regionActive;
+}
+
+void Viewport::readPixels(int x0, int y0, int x1, int y1, std::vector<float>& pixels)
+{
+	pixels.resize((size_t)std::max(x1 - x0, 0) * std::max(y1 - y0, 0) * 3);
+	readPixels(x0, y0, x1, y1, pixels.data());
+}
+
+void Viewport::readPixels(int x0, int y0, int x1, int y1, float* pixels)
+{
+	int w = std::max(x1 - x0, 0);
+	int h = std::max(y1 - y0, 0);
+	for (int j = 0; j < h; j++)
+	{
+		for (int i = 0; i < w; i++)
+		{
+			RGB color = pixelGet(x0 + i, y0 + j);
+			size_t index = ((size_t)j * w + i) * 3;
+			pixels[index] = color.red;
+			pixels[index + 1] = color.green;
+			pixels[index + 2] = color.blue;
+		}
+	}
+}
+
 float Viewport::getRefractiveIndex(std::vector<bool> inShape)
 {
 	assert((int)inShape.size() == shapes->numShapes());
@@ -631,3 +1379,806 @@ float Viewport::getRefractiveIndex(std::vector<bool> inShape)
 
 
 /*** Private ***/
+
+void Viewport::forEachTile(bool loadingText, std::function<void(int, int, int, int)> work, const std::vector<bool>* skip)
+{
+	int bx0, by0, bx1, by1;
+	getRenderBounds(bx0, by0, bx1, by1);
+	
+	const int starEvery = (bx1 - bx0) * (by1 - by0) / 45;
+	std::atomic<int> pixelsDone(0);
+	std::mutex tallyMutex;
+	int starsPrinted = 0;
+	std::atomic<long long> primaryRays(0);
+	std::atomic<long long> secondaryRays(0);
+	std::atomic<long long> shadowRays(0);
+	std::vector<long long> layers(TRACE_LAYERS, 0);
+	
+	if (loadingText)
+	{
+		std::cout << "|  Please wait while the scene is ray-traced  |" << std::endl << " ";
+	}
+	
+	std::vector<TileRect> tiles;
+	listTiles(tiles);
+	TaskGroup tasks(pool);
+	for (int k = 0; k < (int)tiles.size(); k++)
+	{
+		int x0 = tiles[k].x0;
+		int y0 = tiles[k].y0;
+		int x1 = tiles[k].x1;
+		int y1 = tiles[k].y1;
+		if (skip && skip->at(tileIndex(x0, y0))) continue;
+		TileReach* reach = &getTileReach(x0, y0);
+		int node = tileNode(y0);
+		
+		auto task = [=, &work, &pixelsDone, &tallyMutex, &starsPrinted, &primaryRays, &secondaryRays, &shadowRays,
+			&layers]()
+		{
+			traceCounters = {0, 0, 0, {}};
+			tileReach = reach;
+			traceShapes = shapes->getReplica(ThreadPool::currentNode());
+			work(x0, y0, x1, y1);
+			tileReach = nullptr;
+			traceShapes = nullptr;
+			shapes->getMappedFiles()->enforceResidentLimit();
+			primaryRays += traceCounters.primary;
+			secondaryRays += traceCounters.secondary;
+			shadowRays += traceCounters.shadow;
+			
+			if (tileListener)
+			{
+				tileListener(origin.x + x0, origin.y + y0, x1 - x0, y1 - y0);
+			}
+			
+			int done = (pixelsDone += (x1 - x0) * (y1 - y0));
+			std::unique_lock<std::mutex> lock(tallyMutex);
+			for (int k = 0; k < TRACE_LAYERS; k++)
+			{
+				layers[k] += traceCounters.layers[k];
+			}
+			if (loadingText && starEvery > 0)
+			{
+				while (starsPrinted < done / starEvery)
+				{
+					std::cout << "*" << std::flush;
+					starsPrinted++;
+				}
+			}
+		};
+		
+		tasks.enqueue(task, node);
+	}
+	
+	// Only the tiles of this frame are waited for, since other viewports may be rendering on the pool.
+	tasks.wait();
+	if (loadingText)
+	{
+		std::cout << std::endl;
+	}
+	
+	stats.primaryRays += primaryRays;
+	stats.secondaryRays += secondaryRays;
+	stats.shadowRays += shadowRays;
+	for (int k = 0; k < TRACE_LAYERS; k++)
+	{
+		layerRays->at(k) += layers[k];
+	}
+}
+
+void Viewport::listTiles(std::vector<TileRect> &tiles)
+{
+	int bx0, by0, bx1, by1;
+	getRenderBounds(bx0, by0, bx1, by1);
+	
+	// Tiles stay on the same grid whatever the bounds are, and are clipped to the bounds. They are listed from the
+	// top of the viewport down, which is the order images are written in.
+	tiles.clear();
+	int topTile = (by1 > by0) ? (by1 - 1) - (by1 - 1) % TILE_SIZE : -1;
+	for (int ty = topTile; ty >= by0 - by0 % TILE_SIZE; ty -= TILE_SIZE)
+	{
+		for (int tx = bx0 - bx0 % TILE_SIZE; tx < bx1; tx += TILE_SIZE)
+		{
+			TileRect tile;
+			tile.x0 = std::max(tx, bx0);
+			tile.y0 = std::max(ty, by0);
+			tile.x1 = std::min(tx + TILE_SIZE, bx1);
+			tile.y1 = std::min(ty + TILE_SIZE, by1);
+			tiles.push_back(tile);
+		}
+	}
+	
+	if (keepFrame)
+	{
+		orderTiles(tiles, tileOrder, TILE_SIZE, focusX, focusY, [this](const TileRect &tile)
+		{
+			return tileCosts->at(tileIndex(tile.x0, tile.y0));
+		});
+	}
+}
+
+int Viewport::tileNode(int y0)
+{
+	// Streamed frames are written out in tile order, so the tiles can't be split between nodes that run at once.
+	int numNodes = pool ? pool->numNodes() : 0;
+	if (numNodes == 0 || !keepFrame) return -1;
+	
+	int numRows = (height + TILE_SIZE - 1) / TILE_SIZE;
+	return std::min((y0 / TILE_SIZE) * numNodes / numRows, numNodes - 1);
+}
+
+void Viewport::prepareScene()
+{
+	shapes->prepare();
+	shapes->prepareReplicas(pool);
+}
+
+void Viewport::renderRemoteTiles(bool useCheckpoint, std::atomic<int> &tilesResumed, std::vector<bool> &done)
+{
+	done.assign(tileReaches->size(), false);
+	
+	// The workers are sent the whole scene, so they render exactly what this viewport would. It is only written
+	// out again when the shapes change; the camera and lights go with each frame.
+	ClusterFrame frame;
+	frame.shapesKey = shapes->shapesHash();
+	if (!clusterScene || frame.shapesKey != clusterShapesKey)
+	{
+		clusterScene = std::make_shared<const std::string>(shapes->serialize());
+		clusterShapesKey = frame.shapesKey;
+	}
+	if (clusterScene->size() > CLUSTER_MAX_SCENE_BYTES)
+	{
+		std::cout << "The scene is too large to send to the render workers, so it is rendered here." << std::endl;
+		return;
+	}
+	
+	std::vector<TileRect> tiles;
+	listTiles(tiles);
+	std::vector<TileRect> remote;
+	for (int k = 0; k < (int)tiles.size(); k++)
+	{
+		const TileRect& t = tiles[k];
+		if (useCheckpoint && restoreCheckpointTile(t.x0, t.y0, t.x1, t.y1))
+		{
+			getTileReach(t.x0, t.y0).reset(false);
+			tilesResumed++;
+			done.at(tileIndex(t.x0, t.y0)) = true;
+			if (tileListener)
+			{
+				tileListener(origin.x + t.x0, origin.y + t.y0, t.x1 - t.x0, t.y1 - t.y0);
+			}
+			continue;
+		}
+		remote.push_back(t);
+	}
+	
+	frame.scene = clusterScene;
+	std::ostringstream attributes;
+	attributes.precision(std::numeric_limits<float>::max_digits10);
+	writeSceneAttributes(attributes);
+	frame.attributes = attributes.str();
+	frame.width = width;
+	frame.height = height;
+	frame.antiAliasingSamples = antiAliasingSamples;
+	frame.antiAliasingThreshold = antiAliasingThreshold;
+	frame.reprojection = reprojection;
+	frame.key = hashBytes(frame.attributes.data(), frame.attributes.size(), frame.shapesKey);
+	frame.key = hashBytes(&width, sizeof(width), frame.key);
+	frame.key = hashBytes(&height, sizeof(height), frame.key);
+	frame.key = hashBytes(&antiAliasingSamples, sizeof(antiAliasingSamples), frame.key);
+	frame.key = hashBytes(&antiAliasingThreshold, sizeof(antiAliasingThreshold), frame.key);
+	frame.key = hashBytes(&reprojection, sizeof(reprojection), frame.key);
+	
+	// Tiles come back on the cluster's threads, each to pixels (and hits) of its own.
+	int sent = remote.size();
+	cluster->renderTiles(frame, remote, [this, useCheckpoint](const TileRect& t, const std::vector<float>& data)
+	{
+		if (!writeTile(t.x0, t.y0, t.x1, t.y1, data)) return false;
+		
+		// Where the rays of a tile rendered elsewhere went isn't known.
+		getTileReach(t.x0, t.y0).reset(false);
+		if (useCheckpoint)
+		{
+			saveCheckpointTile(t.x0, t.y0, t.x1, t.y1);
+		}
+		if (tileListener)
+		{
+			tileListener(origin.x + t.x0, origin.y + t.y0, t.x1 - t.x0, t.y1 - t.y0);
+		}
+		return true;
+	});
+	
+	// Whatever is left in remote wasn't rendered, because the workers were lost.
+	std::vector<bool> left(tileReaches->size(), false);
+	for (int k = 0; k < (int)remote.size(); k++)
+	{
+		left.at(tileIndex(remote[k].x0, remote[k].y0)) = true;
+	}
+	for (int k = 0; k < (int)tiles.size(); k++)
+	{
+		int index = tileIndex(tiles[k].x0, tiles[k].y0);
+		if (!left.at(index)) done.at(index) = true;
+	}
+	stats.tilesRemote = sent - remote.size();
+	if (!remote.empty())
+	{
+		std::cout << remote.size() << " tiles were left by lost render workers, and are rendered here." << std::endl;
+	}
+}
+
+void Viewport::tracePixel(int i, int j)
+{
+	PrimaryHit hit;
+	RGB unclamped = calculatePixelColor(i, j, recordingHits() ? &hit : nullptr);
+	RGB color = clampColor(unclamped);
+	
+	pixelMake(i, j, color);
+	
+	if (recordingHits() && (int)history->size() == width * height)
+	{
+		// Light that was clamped away can't be rescaled when the pixel is reprojected.
+		if (hit.diffuse > 0.0 && std::max(unclamped.red, std::max(unclamped.green, unclamped.blue)) > 1.0)
+		{
+			hit.viewDependent = true;
+		}
+		hit.color = color;
+		history->at(i + j * width) = hit;
+	}
+}
+
+void Viewport::refinePixels(bool loadingText, const std::vector<bool>* candidates)
+{
+	std::vector<bool> refine;
+	if (findRefinePixels(candidates, refine) < 0) return;
+	
+	resamplePixels(loadingText, refine, antiAliasingGrid, 0.0, 0.0);
+}
+
+int Viewport::findRefinePixels(const std::vector<bool>* candidates, std::vector<bool> &refine)
+{
+	if ((int)history->size() != width * height) return -1;
+	
+	int bx0, by0, bx1, by1;
+	getRenderBounds(bx0, by0, bx1, by1);
+	
+	// Find the pixels on shape edges, or with a large color difference to a neighbour (within the bounds,
+	// since the hits outside them may belong to an earlier frame).
+	refine.assign(width * height, false);
+	int count = 0;
+	for (int j = by0; j < by1; j++)
+	{
+		for (int i = bx0; i < bx1; i++)
+		{
+			int t = i + j * width;
+			if (candidates && !candidates->at(t)) continue;
+			
+			PrimaryHit& hit = history->at(t);
+			const int di[4] = {-1, 1, 0, 0};
+			const int dj[4] = {0, 0, -1, 1};
+			for (int m = 0; m < 4 && !refine.at(t); m++)
+			{
+				int ni = i + di[m];
+				int nj = j + dj[m];
+				if (ni < bx0 || ni >= bx1 || nj < by0 || nj >= by1) continue;
+				PrimaryHit& other = history->at((i + di[m]) + (j + dj[m]) * width);
+				
+				float diff = std::max(fabs(hit.color.red - other.color.red),
+					std::max(fabs(hit.color.green - other.color.green), fabs(hit.color.blue - other.color.blue)));
+				refine.at(t) = (hit.shapeIndex != other.shapeIndex || diff > antiAliasingThreshold);
+			}
+			if (refine.at(t)) count++;
+		}
+	}
+	return count;
+}
+
+int Viewport::resamplePixels(bool loadingText, const std::vector<bool> &refine, int grid, double deadlineMs,
+	double sampleMs)
+{
+	// Re-trace the pixels with a grid of samples spread over the pixel.
+	std::atomic<int> numRefined(0);
+	std::atomic<int> tilesLeftOut(0);
+	forEachTile(loadingText, [&](int x0, int y0, int x1, int y1)
+	{
+		if (deadlineMs > 0.0)
+		{
+			int pixels = 0;
+			for (int j = y0; j < y1; j++)
+			{
+				for (int i = x0; i < x1; i++)
+				{
+					if (refine.at(i + j * width)) pixels++;
+				}
+			}
+			if (nowMs() + pixels * grid * grid * sampleMs > deadlineMs)
+			{
+				tilesLeftOut++;
+				return;
+			}
+		}
+		
+		for (int j = y0; j < y1; j++)
+		{
+			for (int i = x0; i < x1; i++)
+			{
+				if (!refine.at(i + j * width)) continue;
+				
+				RGB sum = RGB(0, 0, 0);
+				for (int b = 0; b < grid; b++)
+				{
+					for (int a = 0; a < grid; a++)
+					{
+						float x = i + ((a + 0.5) / grid) - 0.5;
+						float y = j + ((b + 0.5) / grid) - 0.5;
+						sum = sum.add(clampColor(calculateSampleColor(x, y, nullptr)));
+					}
+				}
+				
+				RGB color = sum.scale(1.0 / (grid * grid));
+				history->at(i + j * width).color = color;
+				pixelMake(i, j, color);
+				numRefined++;
+			}
+		}
+	});
+	
+	stats.pixelsRefined += numRefined;
+	return tilesLeftOut;
+}
+
+void Viewport::redrawBudgeted(bool loadingText)
+{
+	// Frames that may be cut short aren't cached, checkpointed or handed to render workers, but a cached frame of
+	// the scene is shown if there is one.
+	if (frameCache && frameCache->isEnabled() && !regionActive && showCachedFrame(frameKey(), loadingText))
+	{
+		return;
+	}
+	
+	prepareScene();
+	beginStats();
+	double deadlineMs = statsStartMs + budgetMs;
+	int threads = pool ? pool->numThreads() : 1;
+	if (!recordingHits())
+	{
+		history->clear();
+	}
+	else if ((int)history->size() != width * height)
+	{
+		history->assign(width * height, PrimaryHit());
+	}
+	
+	// The floor gives a whole frame as early as possible, whatever the budget.
+	const int fullLayers = rayTracingRecursionLayers;
+	rayTracingRecursionLayers = 0;
+	std::atomic<int> floorTiles(0);
+	forEachTile(false, [this, &floorTiles](int x0, int y0, int x1, int y1)
+	{
+		renderTileCoarse(x0, y0, x1, y1, BUDGET_FLOOR_STEP);
+		floorTiles++;
+	});
+	
+	// The preview refines it in its share of the budget. Each tile is only started if it is predicted to finish
+	// (on one thread) in that time; the others keep the floor. Until a tile has finished, a tile is predicted to
+	// take as long as in the floor for each pixel traced.
+	double previewEndMs = statsStartMs + budgetMs * BUDGET_PREVIEW_SHARE;
+	const int tracedPerBlock = (BUDGET_FLOOR_STEP / BUDGET_PREVIEW_STEP) * (BUDGET_FLOOR_STEP / BUDGET_PREVIEW_STEP);
+	double predictedTileMs = (nowMs() - statsStartMs) * threads / std::max((int)floorTiles, 1) * tracedPerBlock;
+	std::atomic<int> tilesKeptAtFloor(0);
+	std::atomic<int> previewTiles(0);
+	std::atomic<long long> previewTileUs(0);
+	forEachTile(false, [&](int x0, int y0, int x1, int y1)
+	{
+		double startMs = nowMs();
+		int done = previewTiles;
+		double tileMs = (done > 0) ? previewTileUs / 1000.0 / done : predictedTileMs;
+		if (startMs + tileMs > previewEndMs)
+		{
+			tilesKeptAtFloor++;
+			return;
+		}
+		renderTileCoarse(x0, y0, x1, y1, BUDGET_PREVIEW_STEP);
+		previewTileUs += (long long)((nowMs() - startMs) * 1000.0);
+		previewTiles++;
+	});
+	rayTracingRecursionLayers = fullLayers;
+	stats.budgetMs = budgetMs;
+	stats.budgetStep = (tilesKeptAtFloor > 0) ? BUDGET_FLOOR_STEP : BUDGET_PREVIEW_STEP;
+	stats.budgetLayers = 0;
+	double previewMs = nowMs() - statsStartMs;
+	long long previewPixels = stats.primaryRays;
+	
+	// The probe measures how many rays each layer of recursion adds to a pixel, and how long those rays take (its
+	// colors aren't used). It traces a quarter as many pixels as the preview, but with every layer, so each tile
+	// is only started while the probe is within its share of the time left.
+	std::vector<long long> layersBefore = *layerRays;
+	double probeStartMs = nowMs();
+	double probeEndMs = probeStartMs + (deadlineMs - probeStartMs) * BUDGET_PROBE_SHARE;
+	if (tilesKeptAtFloor == 0)
+	{
+		forEachTile(false, [this, probeEndMs](int x0, int y0, int x1, int y1)
+		{
+			if (nowMs() >= probeEndMs) return;
+			for (int j = y0; j < y1; j += BUDGET_PROBE_STEP)
+			{
+				for (int i = x0; i < x1; i += BUDGET_PROBE_STEP)
+				{
+					calculatePixelColor(std::min(i + BUDGET_PROBE_STEP / 2, x1 - 1), std::min(j + BUDGET_PROBE_STEP / 2, y1 - 1));
+				}
+			}
+		});
+	}
+	double probeMs = nowMs() - probeStartMs;
+	long long probePixels = stats.primaryRays - previewPixels;
+	
+	// A pixel (on all the threads) takes as long as in the preview, plus the time of the rays that its layers of
+	// recursion add.
+	double msPerPixel0 = previewMs / std::max(previewPixels, 1LL);
+	std::vector<double> deepRaysPerPixel(fullLayers + 1, 0.0);
+	for (int k = 1; k <= fullLayers; k++)
+	{
+		int layer = std::min(k, TRACE_LAYERS - 1);
+		deepRaysPerPixel[k] = deepRaysPerPixel[k - 1]
+			+ (double)(layerRays->at(layer) - layersBefore.at(layer)) / std::max(probePixels, 1LL);
+	}
+	double msPerDeepRay = std::max(probeMs - probePixels * msPerPixel0, 0.0)
+		/ std::max(deepRaysPerPixel[fullLayers] * probePixels, 1.0);
+	std::vector<double> msPerPixel(fullLayers + 1);
+	for (int k = 0; k <= fullLayers; k++)
+	{
+		msPerPixel[k] = msPerPixel0 + deepRaysPerPixel[k] * msPerDeepRay;
+	}
+	
+	// The best pass predicted to fit in the time left: layers of recursion are given up first, then resolution.
+	int bx0, by0, bx1, by1;
+	getRenderBounds(bx0, by0, bx1, by1);
+	double pixels = (double)(bx1 - bx0) * (by1 - by0);
+	double planMs = (deadlineMs - nowMs()) * BUDGET_SAFETY;
+	int step = 0;
+	int layers = 0;
+	for (int s = 1; s < BUDGET_PREVIEW_STEP && step == 0 && probePixels > 0; s *= 2)
+	{
+		for (int d = fullLayers; d >= 0 && step == 0; d--)
+		{
+			if (pixels / (s * s) * msPerPixel[d] <= planMs)
+			{
+				step = s;
+				layers = d;
+			}
+		}
+	}
+	
+	int tilesLeftOut = 0;
+	if (step > 0)
+	{
+		// Each tile is only started if it can be finished (on one thread) by the deadline; the others keep the
+		// preview. Once tiles have finished, how long they took is used instead of the prediction.
+		std::atomic<int> tilesKeptAtPreview(0);
+		std::atomic<long long> pixelsDone(0);
+		std::atomic<long long> tileUs(0);
+		double predictedMsPerPixel = msPerPixel[layers] * threads / (step * step);
+		rayTracingRecursionLayers = layers;
+		forEachTile(loadingText, [&](int x0, int y0, int x1, int y1)
+		{
+			double startMs = nowMs();
+			long long done = pixelsDone;
+			double msPerPixel = (done > 0) ? tileUs / 1000.0 / done : predictedMsPerPixel;
+			if (startMs + (x1 - x0) * (y1 - y0) * msPerPixel > deadlineMs)
+			{
+				tilesKeptAtPreview++;
+				return;
+			}
+			
+			if (step == 1)
+			{
+				renderTile(x0, y0, x1, y1);
+			}
+			else
+			{
+				renderTileCoarse(x0, y0, x1, y1, step);
+			}
+			tileUs += (long long)((nowMs() - startMs) * 1000.0);
+			pixelsDone += (x1 - x0) * (y1 - y0);
+		});
+		rayTracingRecursionLayers = fullLayers;
+		
+		tilesLeftOut = tilesKeptAtPreview;
+		if (tilesLeftOut < stats.tiles)
+		{
+			stats.budgetStep = step;
+			stats.budgetLayers = layers;
+		}
+	}
+	
+	// Anti-aliasing comes last, with as many samples as are predicted to fit, once every pixel has been traced.
+	if (step == 1 && tilesLeftOut == 0 && antiAliasingSamples > 1 && recordingHits())
+	{
+		std::vector<bool> refine;
+		int count = findRefinePixels(nullptr, refine);
+		double sampleMs = msPerPixel[layers];
+		planMs = (deadlineMs - nowMs()) * BUDGET_SAFETY;
+		int grid = antiAliasingGrid;
+		while (grid >= 2 && (double)count * grid * grid * sampleMs > planMs)
+		{
+			grid--;
+		}
+		if (count > 0 && grid >= 2)
+		{
+			rayTracingRecursionLayers = layers;
+			tilesLeftOut = resamplePixels(false, refine, grid, deadlineMs, sampleMs * threads);
+			rayTracingRecursionLayers = fullLayers;
+			stats.budgetSamples = grid * grid;
+		}
+	}
+	stats.budgetTilesDropped = tilesLeftOut;
+	
+	// The pixels and rays of the frame don't all belong to its final quality.
+	historyValid = false;
+	invalidateTileReaches();
+	endStats();
+	
+	if (loadingText)
+	{
+		stats.printBudget(std::cout);
+	}
+}
+
+bool Viewport::recordingHits()
+{
+	return keepFrame && (reprojection || antiAliasingSamples > 1);
+}
+
+void Viewport::getRenderBounds(int &x0, int &y0, int &x1, int &y1)
+{
+	if (regionActive)
+	{
+		x0 = regionX0;
+		y0 = regionY0;
+		x1 = regionX1;
+		y1 = regionY1;
+	}
+	else
+	{
+		x0 = 0;
+		y0 = 0;
+		x1 = width;
+		y1 = height;
+	}
+}
+
+int Viewport::tileIndex(int x0, int y0)
+{
+	return (y0 / TILE_SIZE) * tilesPerRow + x0 / TILE_SIZE;
+}
+
+TileReach &Viewport::getTileReach(int x0, int y0)
+{
+	return tileReaches->at(tileIndex(x0, y0));
+}
+
+void Viewport::invalidateTileReaches()
+{
+	for (int k = 0; k < (int)tileReaches->size(); k++)
+	{
+		tileReaches->at(k).reset(false);
+	}
+}
+
+bool Viewport::projectBounds(const AABB &box, float &minI, float &minJ, float &maxI, float &maxJ)
+{
+	// The camera basis (see getRayDir).
+	FCoord3D b1, b2, b3;
+	camera.getBasis(b1, b2, b3);
+	float focal = camera.getFocalLength();
+	float span = (float)(std::min(width, height) - 1);
+	
+	// The box is convex, so (if it is wholly in front of the camera) it projects inside the rectangle around its corners.
+	minI = minJ = INFINITY;
+	maxI = maxJ = -INFINITY;
+	int behind = 0;
+	for (int k = 0; k < 8; k++)
+	{
+		FCoord3D corner = FCoord3D((k & 1) ? box.max.x : box.min.x, (k & 2) ? box.max.y : box.min.y, (k & 4) ? box.max.z : box.min.z);
+		FCoord3D v = corner.minus(camera.fromPoint);
+		float z = v.dotProduct(b3);
+		if (z <= 0.0)
+		{
+			behind++;
+			continue;
+		}
+		
+		float i = focal * v.dotProduct(b1) / z * span + 0.5 * (width - 1);
+		float j = focal * v.dotProduct(b2) / z * span + 0.5 * (height - 1);
+		minI = std::min(minI, i);
+		minJ = std::min(minJ, j);
+		maxI = std::max(maxI, i);
+		maxJ = std::max(maxJ, j);
+	}
+	if (behind == 8)
+	{
+		minI = minJ = INFINITY;
+		maxI = maxJ = -INFINITY;
+	}
+	return behind == 0 || behind == 8;
+}
+
+RGB Viewport::clampColor(RGB color)
+{
+	float max = color.red;
+	if (color.green > max) max = color.green;
+	if (color.blue > max) max = color.blue;
+	
+	if (max > 1.0)
+	{
+		color = color.scale(1.0 / max);
+	}
+	return color;
+}
+
+void Viewport::beginStats()
+{
+	int x0, y0, x1, y1;
+	getRenderBounds(x0, y0, x1, y1);
+	
+	stats = RenderStats();
+	stats.width = x1 - x0;
+	stats.height = y1 - y0;
+	if (x1 > x0 && y1 > y0)
+	{
+		stats.tiles = ((x1 - 1) / TILE_SIZE - x0 / TILE_SIZE + 1) * ((y1 - 1) / TILE_SIZE - y0 / TILE_SIZE + 1);
+	}
+	layerRays->assign(TRACE_LAYERS, 0);
+	statsStartMs = nowMs();
+}
+
+void Viewport::endStats()
+{
+	stats.renderMs = nowMs() - statsStartMs;
+}
+
+uint64_t Viewport::frameKey()
+{
+	// The shapes are hashed by their geometry hashes, so that large meshes aren't written out for every frame.
+	// The camera, lights and the other scene attributes are this viewport's own.
+	std::ostringstream attributes;
+	attributes.precision(std::numeric_limits<float>::max_digits10);
+	writeSceneAttributes(attributes);
+	std::string text = attributes.str();
+	uint64_t key = hashBytes(text.data(), text.size(), shapes->shapesHash());
+	key = hashBytes(&width, sizeof(width), key);
+	key = hashBytes(&height, sizeof(height), key);
+	key = hashBytes(&rayTracingRecursionLayers, sizeof(rayTracingRecursionLayers), key);
+	key = hashBytes(&antiAliasingSamples, sizeof(antiAliasingSamples), key);
+	if (antiAliasingSamples > 1)
+	{
+		key = hashBytes(&antiAliasingThreshold, sizeof(antiAliasingThreshold), key);
+	}
+	return key;
+}
+
+bool Viewport::showCachedFrame(uint64_t key, bool loadingText)
+{
+	std::vector<float> pixels;
+	if (!frameCache->get(key, (size_t)width * height * 3, pixels))
+	{
+		return false;
+	}
+	
+	beginStats();
+	stats.fromCache = true;
+	forEachTile(false, [&](int x0, int y0, int x1, int y1)
+	{
+		for (int j = y0; j < y1; j++)
+		{
+			for (int i = x0; i < x1; i++)
+			{
+				int index = (i + j * width) * 3;
+				pixelMake(i, j, RGB(pixels.at(index), pixels.at(index + 1), pixels.at(index + 2)));
+			}
+		}
+	});
+	
+	// The primary hits of the cached frame are not known, nor where its rays went.
+	historyValid = false;
+	invalidateTileReaches();
+	endStats();
+	
+	if (loadingText)
+	{
+		std::cout << "Frame " << hashToString(key) << " shown from the frame cache." << std::endl;
+	}
+	return true;
+}
+
+void Viewport::storeFrame(uint64_t key)
+{
+	std::vector<float> pixels;
+	readPixels(0, 0, width, height, pixels);
+	frameCache->put(key, pixels);
+}
+
+int Viewport::countTiles()
+{
+	std::vector<TileRect> tiles;
+	listTiles(tiles);
+	return tiles.size();
+}
+
+int Viewport::tileFloatsPerPixel()
+{
+	// The color, followed by the hit point, shape index, view dependence and diffuse light when primary hits are
+	// recorded.
+	return recordingHits() ? 11 : 3;
+}
+
+void Viewport::readTile(int x0, int y0, int x1, int y1, std::vector<float>& data)
+{
+	int n = tileFloatsPerPixel();
+	bool hits = (n == 11 && (int)history->size() == width * height);
+	data.clear();
+	data.reserve((x1 - x0) * (y1 - y0) * n);
+	for (int j = y0; j < y1; j++)
+	{
+		for (int i = x0; i < x1; i++)
+		{
+			RGB color = pixelGet(i, j);
+			data.push_back(color.red);
+			data.push_back(color.green);
+			data.push_back(color.blue);
+			if (n == 11)
+			{
+				PrimaryHit hit = hits ? history->at(i + j * width) : PrimaryHit();
+				data.push_back(hit.point.x);
+				data.push_back(hit.point.y);
+				data.push_back(hit.point.z);
+				data.push_back(hit.shapeIndex);
+				data.push_back(hit.viewDependent ? 1.0 : 0.0);
+				data.push_back(hit.diffuse);
+				data.push_back(hit.eyeDistance);
+				data.push_back(hit.lightDistance);
+			}
+		}
+	}
+}
+
+bool Viewport::writeTile(int x0, int y0, int x1, int y1, const std::vector<float>& data)
+{
+	int n = tileFloatsPerPixel();
+	if ((int)data.size() != (x1 - x0) * (y1 - y0) * n) return false;
+	
+	bool hits = (n == 11 && (int)history->size() == width * height);
+	const float* p = data.data();
+	for (int j = y0; j < y1; j++)
+	{
+		for (int i = x0; i < x1; i++, p += n)
+		{
+			RGB color = RGB(p[0], p[1], p[2]);
+			pixelMake(i, j, color);
+			if (hits)
+			{
+				PrimaryHit& hit = history->at(i + j * width);
+				hit.point = FCoord3D(p[3], p[4], p[5]);
+				hit.shapeIndex = (int)p[6];
+				hit.viewDependent = (p[7] != 0.0);
+				hit.diffuse = p[8];
+				hit.eyeDistance = p[9];
+				hit.lightDistance = p[10];
+				hit.color = color;
+			}
+		}
+	}
+	return true;
+}
+
+bool Viewport::restoreCheckpointTile(int x0, int y0, int x1, int y1)
+{
+	std::vector<float> data;
+	return checkpoint->restoreTile(x0, y0, x1, y1, data) && writeTile(x0, y0, x1, y1, data);
+}
+
+void Viewport::saveCheckpointTile(int x0, int y0, int x1, int y1)
+{
+	std::vector<float> data;
+	readTile(x0, y0, x1, y1, data);
+	checkpoint->saveTile(x0, y0, x1, y1, data);
+}
@@ -9,13 +9,77 @@
  * 
  */
 
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <vector>
 
+#include "bvh.h"
+#include "camera.h"
+#include "memoryUsage.h"
 #include "misc.h"
+#include "renderStats.h"
+#include "tileOrder.h"
 
+class Checkpoint;
+class FrameBuffer;
+class FrameCache;
+class RenderCluster;
 class ShapeCollection;
 class SurfaceShape;
+class ThreadPool;
 struct PhongLightSource;
+struct SceneChanges;
+
+// Called from the render threads each time a tile of the viewport has finished rendering.
+// The rectangle is given in screen coordinates.
+typedef std::function<void(int x, int y, int width, int height)> TileListener;
+
+// What the primary ray of a pixel hit when it was last rendered. Used to reproject the pixel after a camera move.
+struct PrimaryHit
+{
+	PrimaryHit();
+	
+	// The world position of the hit.
+	FCoord3D point;
+	// The index of the shape that was hit (-1 if the ray hit nothing).
+	int shapeIndex;
+	// True if the color depends on the viewing direction (reflection, refraction, a specular highlight, or a
+	// color too bright to be rescaled).
+	bool viewDependent;
+	// The diffuse light, which falls off with the length of the path from the eye to the lights: the color
+	// has diffuse times the shape's color in it. The path is the distance from the eye plus lightDistance (with
+	// several lights, the distance that makes small camera moves change the light as they do).
+	float diffuse;
+	float eyeDistance;
+	float lightDistance;
+	// The final (clamped) color of the pixel.
+	RGB color;
+};
+
+// Where the reflected, refracted and shadow rays of a tile went when it was last rendered. (Its primary rays only
+// reach what can be seen through the tile.) A change to the scene that none of them reach can't change the tile.
+struct TileReach
+{
+	TileReach();
+	
+	// Forgets the rays, and sets whether the tile's rays are being recorded.
+	void reset(bool _valid);
+	// Records a ray that ended at a surface or a light.
+	void addSegment(FCoord3D p0, FCoord3D p1);
+	// Records a ray that left the scene without hitting anything.
+	void addEscape(FCoord3D p0, FCoord3D d);
+	// Returns true if any recorded ray may pass through the box.
+	bool mayReach(const AABB &box) const;
+	
+	// False if the rays of the tile weren't recorded when it was last drawn (such as when it was reprojected).
+	bool valid;
+	// The box around every ray that ended. The box contains the rays, since it contains both their ends.
+	AABB segments;
+	// The boxes around the start points and the directions of the rays that escaped.
+	AABB escapeOrigins;
+	AABB escapeDirections;
+};
 
 
 
@@ -23,11 +87,13 @@ class Viewport
 {
 	public:
 		/*** Public Member Functions ***/
-		Viewport(Coord _origin, int _size, ShapeCollection* _shapes);
+		Viewport(Coord _origin, int _width, int _height, ShapeCollection* _shapes);
+		// Destroys the light sources.
+		~Viewport();
 		
-		// Equivalent to makePix, but draws relative to this viewport.
+		// Draws a pixel into the frame buffer, relative to this viewport (nothing is drawn without a frame buffer).
 		void pixelMake(int x, int y, RGB color);
-		// Equivalent to getPix, but relative to this viewport.
+		// Returns a pixel of the frame buffer, relative to this viewport (black without a frame buffer).
 		RGB pixelGet(int x, int y);
 		// Returns true if the pixel can be drawn in the viewport.
 		bool pixelIn(int x, int y);
@@ -36,10 +102,44 @@ class Viewport
 		void readSceneAttributes(std::istream& s);
 		void writeSceneAttributes(std::ostream& s);
 		
-		// Returns the size of this viewport.
-		int getSize();
+		// Returns the origin/width/height of this viewport.
+		Coord getOrigin();
+		int getWidth();
+		int getHeight();
+		
+		// Sets the thread pool used to render tiles. If not set, tiles are rendered on the calling thread.
+		void setThreadPool(ThreadPool* _pool);
+		ThreadPool* getThreadPool();
+		// Sets the function that is notified when a tile has finished rendering.
+		void setTileListener(TileListener _listener);
+		// Sets the order the tiles of a frame are rendered (and handed to render workers) in. While finished tiles
+		// are dropped (see setKeepFrame), they are rendered in scanline order, so that only a band is held at once.
+		void setTileOrder(TileOrder order);
+		TileOrder getTileOrder();
+		// Sets the point, relative to this viewport, that the focus order spirals out from. It may be set from
+		// any thread, and is used from the next frame on.
+		void setTileFocus(int x, int y);
+		void getTileFocus(int &x, int &y);
+		// Sets the cache that finished frames are stored in and looked up from (may be null).
+		void setFrameCache(FrameCache* _cache);
+		FrameCache* getFrameCache();
+		// Sets whether the pixels of a finished frame can be read back. They can't when each tile is written out
+		// and dropped as soon as it finishes, so passes that need the whole frame are skipped: anti-aliasing,
+		// reprojection, and storing the frame in the frame cache.
+		void setKeepFrame(bool _keepFrame);
+		bool getKeepFrame();
+		// Sets the checkpoint that the tiles of full redraws are saved to and resumed from (may be null).
+		void setCheckpoint(Checkpoint* _checkpoint);
+		// Sets the buffer the viewport draws into (may be null, in which case nothing is drawn). The viewport is
+		// drawn at its origin in the buffer.
+		void setFrameBuffer(FrameBuffer* _frameBuffer);
+		FrameBuffer* getFrameBuffer();
+		// Sets the cluster that full redraws hand their tiles out to while it has workers (may be null).
+		void setCluster(RenderCluster* _cluster);
 		
 		// Camera Viewing Model getters/setters.
+		void setCamera(Camera _camera);
+		Camera getCamera();
 		void setFromPoint(FCoord3D ff);
 		FCoord3D getFromPoint();
 		void setAtPoint(FCoord3D a);
@@ -47,6 +147,13 @@ class Viewport
 		void setUpVector(FCoord3D u);
 		FCoord3D getUpVector();
 		void setViewingAngle(float alphaDeg);
+		float getViewingAngle();
+		
+		// Scene attribute getters/setters.
+		void setBackgroundColor(RGB c);
+		RGB getBackgroundColor();
+		void setAmbientIntensity(float f);
+		float getAmbientIntensity();
 		
 		// Moves the camera/atPoint/fromPoint in relation to the current viewing direction.
 		void moveCamera(Direction d, float f);
@@ -56,11 +163,21 @@ class Viewport
 		// Add/delete a light source to/from the scene.
 		void addLight(PhongLightSource* light);
 		void deleteLight(int index);
+		// Removes (and destroys) all light sources.
+		void clearLights();
+		// Makes the viewport render the same scene as another one (of any size), from its own camera: the light
+		// sources are replaced with copies of the other's, and its background, ambient light, anti-aliasing settings
+		// and time budget are copied.
+		void copySceneFrom(Viewport* scene);
+		// Returns a light source/the number of light sources.
+		PhongLightSource* getLight(int index);
+		int numLights();
 		
 		// Draws an outline of the viewport. The outline is drawn on the pixels outside the
 		// drawing area. Shapes inside the viewport will never draw over the outline.
 		void drawOutline();
-		// Fills the viewport with the background color.
+		// Fills the viewport with the background color. On a NUMA-aware thread pool, each tile is filled by a worker
+		// of the node that renders it (see tileNode), so the frame buffer's memory for it is placed on that node.
 		void fillBackground();
 		
 		// Draws a small diamond at the specified position.
@@ -70,15 +187,89 @@ class Viewport
 		
 		// Re-renders all pixels of the viewport.
 		void redraw(bool loadingText);
+		// Re-renders the viewport after only the camera has changed. If reprojection is enabled, pixels from the
+		// previous frame are moved to where they appear from the new camera (with their diffuse light rescaled to
+		// the new distance from the eye), and only the rest are re-traced. Falls back to a full redraw when too
+		// many pixels would need re-tracing.
+		void redrawCameraMove(bool loadingText);
+		// Re-renders the viewport after the shapes changed, re-tracing only the tiles that the changed shapes may
+		// show up in: those whose pixels see them, or whose reflected, refracted or shadow rays may reach them.
+		// Anti-aliasing is only redone in those tiles. Falls back to a full redraw when the change may affect every
+		// pixel, or the tiles of the last frame weren't all recorded.
+		void redrawChanges(bool loadingText, const SceneChanges &changes);
+		// Re-renders the pixels in the rectangle [x0, x1) x [y0, y1) of the viewport.
+		void renderTile(int x0, int y0, int x1, int y1);
+		// Re-renders the rectangle at a lower resolution: one pixel is traced for each block of step x step pixels,
+		// and the block is filled with its color.
+		void renderTileCoarse(int x0, int y0, int x1, int y1, int step);
+		// Prepares for tiles to be rendered one at a time with renderTile, outside of a redraw (as render workers
+		// do): the shapes are prepared, and the primary hits are recorded if anti-aliasing or reprojection need them.
+		void prepareTiles();
+		// Returns the number of tiles that redraws render.
+		int countTiles();
+		// Returns the number of values each pixel of an encoded tile has (see readTile).
+		int tileFloatsPerPixel();
+		// Encodes the pixels of the tile as floats: the color of each pixel (bottom row first), followed by its
+		// primary hit if hits are recorded. Checkpoints and render workers pass tiles around in this form.
+		void readTile(int x0, int y0, int x1, int y1, std::vector<float>& data);
+		// Draws a tile encoded by readTile, along with its primary hits. Returns false if the data doesn't fit it.
+		bool writeTile(int x0, int y0, int x1, int y1, const std::vector<float>& data);
 		// Performs ray tracing to calculate the color of the specified pixel.
 		RGB calculatePixelColor(int i, int j);
+		RGB calculatePixelColor(int i, int j, PrimaryHit* hit);
+		// Performs ray tracing to calculate the color at a (fractional) position within the viewport.
+		RGB calculateSampleColor(float x, float y, PrimaryHit* hit);
 		// Performs recursive ray tracing to calculate the color that a ray encounters.
-		RGB calculatePhongColor(FCoord3D fromPoint, FCoord3D rayDir, int rLayer, std::vector<bool> inShape, float recursiveScaling);
+		// If hit is given, it is filled with what the ray hit first.
+		RGB calculatePhongColor(FCoord3D fromPoint, FCoord3D rayDir, int rLayer, std::vector<bool> inShape, float recursiveScaling,
+			PrimaryHit* hit = nullptr);
 		// Returns the ray direction of a pixel.
 		FCoord3D getRayDir(int i, int j);
+		// Returns the ray direction through a (fractional) position within the viewport.
+		FCoord3D getRayDir(float x, float y);
 		// Returns the combined refractive index of a set of shapes (used if shapes overlap).
 		float getRefractiveIndex(std::vector<bool> inShape);
 		
+		// Enables/disables reprojection of the previous frame after camera moves.
+		// threshold is the largest fraction of pixels that may be re-traced before a full redraw is done instead.
+		void setReprojection(bool enabled, float threshold);
+		bool getReprojection();
+		float getReprojectionThreshold();
+		
+		// Sets adaptive anti-aliasing. Pixels whose color differs from a neighbour by more than the threshold
+		// (or that border a different shape) are re-traced with up to maxSamples samples. The samples are a square
+		// grid over the pixel, so maxSamples is rounded down to a square number; fewer than 4 disables it.
+		void setAntiAliasing(int maxSamples, float threshold);
+		int getAntiAliasingSamples();
+		float getAntiAliasingThreshold();
+		
+		// Sets the time a redraw may take in milliseconds (0 for no limit). Redraws with a budget always have a whole
+		// frame by the deadline: a very coarse frame is traced first, refined to a preview in part of the budget,
+		// and then as much of the frame as is predicted to fit in the time left, lowering the anti-aliasing samples, then the reflection layers, then the resolution.
+		// Tiles that can't be finished in time keep a lower quality. The quality reached is in the statistics.
+		// Budgets are ignored while finished tiles are dropped (see setKeepFrame).
+		void setBudget(double ms);
+		double getBudget();
+		
+		// Returns the statistics of the last rendered frame.
+		RenderStats getStats();
+		// Returns the memory used by the viewport's shapes, frame buffer and per-pixel records, along with the
+		// frame cache and the mapped files (without a budget).
+		MemoryUsage getMemoryUsage();
+		
+		// Restricts rendering to the rectangle [x0, x1) x [y0, y1) of the viewport (clipped to the viewport).
+		// Pixels outside the region are left untouched by redraws.
+		void setRegion(int x0, int y0, int x1, int y1);
+		// Renders the whole viewport again.
+		void clearRegion();
+		// Returns true (and the region) if rendering is restricted to a region.
+		bool getRegion(int &x0, int &y0, int &x1, int &y1);
+		
+		// Copies the pixels of the rectangle [x0, x1) x [y0, y1) of the viewport as RGB floats, bottom row first.
+		void readPixels(int x0, int y0, int x1, int y1, std::vector<float>& pixels);
+		// Copies the pixels into a buffer of (x1 - x0) * (y1 - y0) * 3 floats, in the same order.
+		void readPixels(int x0, int y0, int x1, int y1, float* pixels);
+		
 	private:
 		/*** Private Member Functions ***/
 		static const RGB OUTLINE_COLOR_DEFAULT() {return RGB(0.5, 0.5, 0.5);}
@@ -87,13 +278,117 @@ class Viewport
 		static const RGB CURVE_COLOR() {return RGB(1, 1, 1);}
 		static const RGB CONTROL_COLOR() {return RGB(1, 0, 0);}
 		
+		// The width and height of the square tiles the viewport is split into when rendering.
+		static const int TILE_SIZE = 32;
+		// Reprojected pixels that are further away than a neighbour by more than this fraction are re-traced,
+		// since they may be showing through a crack in the nearer surface.
+		static constexpr float REPROJECTION_DEPTH_TOLERANCE = 0.05;
+		// Budgeted redraws start by tracing one pixel for each block of this many pixels square, without
+		// reflections or refractions, so that there is a whole frame however small the budget is.
+		static const int BUDGET_FLOOR_STEP = 32;
+		// They then refine it to a preview that traces one pixel for each block of this many pixels square, in the
+		// share of the budget the preview is given.
+		static const int BUDGET_PREVIEW_STEP = 8;
+		static constexpr float BUDGET_PREVIEW_SHARE = 0.25;
+		// Budgeted redraws then trace one pixel for each block of this many pixels square with every layer of
+		// recursion, to measure how many rays each layer adds. The probe's colors aren't used, so it may only take
+		// a share of the time left.
+		static const int BUDGET_PROBE_STEP = 16;
+		static constexpr float BUDGET_PROBE_SHARE = 0.25;
+		// The fraction of the time left that a budgeted pass is planned to take, leaving room for misestimates.
+		static constexpr float BUDGET_SAFETY = 0.8;
+		
+		// Splits the viewport into tiles, and runs the work function for each tile on the thread pool.
+		// The tile listener is notified after each tile. Tiles set in skip (indexed as the tile reaches are)
+		// are left out.
+		void forEachTile(bool loadingText, std::function<void(int, int, int, int)> work,
+			const std::vector<bool>* skip = nullptr);
+		// Returns the tiles that redraws render, in the order they are rendered in (see setTileOrder).
+		void listTiles(std::vector<TileRect> &tiles);
+		// Returns the node of the thread pool that renders the row of tiles starting at y0 (-1 if the pool isn't
+		// NUMA-aware, or the frame isn't kept). The viewport is split into a band of rows for each node, so a node writes the same part of
+		// the frame buffer every frame.
+		int tileNode(int y0);
+		// Prepares the shapes for rendering, along with their copies for the nodes of the pool if the collection
+		// is replicated (see ShapeCollection::prepareReplicas).
+		void prepareScene();
+		// Hands the tiles of a full redraw out to the workers of the cluster. Tiles restored from the checkpoint
+		// are counted as resumed. The tiles that were drawn are set in done (indexed as the tile reaches are).
+		void renderRemoteTiles(bool useCheckpoint, std::atomic<int> &tilesResumed, std::vector<bool> &done);
+		// Traces a single pixel, clamps the color, and draws it.
+		void tracePixel(int i, int j);
+		// Anti-aliases the pixels that differ from their neighbours. If candidates is given, only those pixels
+		// are considered. Requires the primary hits of the frame.
+		void refinePixels(bool loadingText, const std::vector<bool>* candidates);
+		// Sets the pixels that differ from their neighbours in refine. Returns how many there are, or -1 if the
+		// primary hits of the frame aren't recorded.
+		int findRefinePixels(const std::vector<bool>* candidates, std::vector<bool> &refine);
+		// Re-traces the pixels set in refine with a grid x grid of samples each. If there is a deadline (the time
+		// in milliseconds, or 0), tiles that wouldn't be finished by it are left out, taking sampleMs for each
+		// sample on a single thread. Returns the number of tiles left out.
+		int resamplePixels(bool loadingText, const std::vector<bool> &refine, int grid, double deadlineMs,
+			double sampleMs);
+		// Renders a frame within the time budget (see setBudget).
+		void redrawBudgeted(bool loadingText);
+		// Returns true if the primary hits of each pixel need to be recorded while rendering.
+		bool recordingHits();
+		// Returns the rectangle [x0, x1) x [y0, y1) that redraws render (the region, or the whole viewport).
+		void getRenderBounds(int &x0, int &y0, int &x1, int &y1);
+		// Returns the index of the tile with the corner (x0, y0) on the grid tiles are rendered on.
+		int tileIndex(int x0, int y0);
+		// Returns the reach of the tile with the corner (x0, y0).
+		TileReach &getTileReach(int x0, int y0);
+		// Marks every tile as not recorded.
+		void invalidateTileReaches();
+		// Finds the pixels that the box covers, as seen from the camera. Returns false if the box is partly
+		// behind the camera (so it may cover any pixel), and an empty rectangle if it is wholly behind it.
+		bool projectBounds(const AABB &box, float &minI, float &minJ, float &maxI, float &maxJ);
+		// Scales the color down so that no component is larger than 1.
+		static RGB clampColor(RGB color);
+		
+		// Starts/finishes collecting statistics for a frame.
+		void beginStats();
+		void endStats();
+		
+		// Returns the key of the current frame in the frame cache: a hash of the shapes (see ShapeCollection::shapesHash),
+		// the scene attributes of this viewport and the resolution.
+		uint64_t frameKey();
+		// Draws the frame with the given key if it is cached. Returns true if it was.
+		bool showCachedFrame(uint64_t key, bool loadingText);
+		// Stores the pixels of the viewport in the frame cache.
+		void storeFrame(uint64_t key);
+		
+		// Draws the tile from the checkpoint (along with its primary hits, if they are recorded).
+		// Returns false if the checkpoint doesn't have it.
+		bool restoreCheckpointTile(int x0, int y0, int x1, int y1);
+		// Adds the finished tile to the checkpoint.
+		void saveCheckpointTile(int x0, int y0, int x1, int y1);
+		
 		/*** Private Member Variables ***/
 		// Defines the origin of this viewport on the screen.
 		Coord origin;
 		// Defines the size of this viewport.
-		int size;
+		int width;
+		int height;
 		// Stores the shapes in this viewport.
 		ShapeCollection* shapes;
+		// The threads used to render tiles (may be null).
+		ThreadPool* pool;
+		// Notified each time a tile has finished rendering (may be null).
+		TileListener tileListener;
+		// Holds previously rendered frames (may be null).
+		FrameCache* frameCache;
+		// False if the pixels of finished tiles are dropped (see setKeepFrame).
+		bool keepFrame;
+		// Holds the finished tiles of the frame being rendered (may be null).
+		Checkpoint* checkpoint;
+		// The buffer pixels are drawn into (may be null).
+		FrameBuffer* frameBuffer;
+		// Renders tiles on other processes (may be null).
+		RenderCluster* cluster;
+		// The scene as last sent to the cluster's workers (null until then), and the hash of its shapes.
+		std::shared_ptr<const std::string> clusterScene;
+		uint64_t clusterShapesKey;
 		
 		// The color that is drawn around the viewport.
 		RGB outlineColor;
@@ -101,14 +396,8 @@ class Viewport
 		RGB backgroundColor;
 		
 		/** CVM Parameters **/
-		// The point where the camera resides.
-		FCoord3D fromPoint;
-		// The point where the camera is looking.
-		FCoord3D atPoint;
-		// The "up" direction.
-		FCoord3D upVector;
-		// How wide the camera view angle is.
-		float viewingAngleDeg;
+		// The camera the scene is rendered from.
+		Camera camera;
 		
 		/** Phong Paramaters **/
 		// Holds all light sources in the scene.
@@ -118,6 +407,60 @@ class Viewport
 		// Defines how many recursive calls to make (at max) to determine the color at a pixel.
 		int rayTracingRecursionLayers;
 		
+		/** Reprojection **/
+		// True if the primary hits of each frame are kept for reprojection.
+		bool reprojection;
+		// The largest fraction of pixels that may be re-traced by a reprojected redraw.
+		float reprojectionThreshold;
+		// The primary hit of each pixel in the last frame (indexed by i + j * width).
+		std::vector<PrimaryHit>* history;
+		// True if every entry of the history belongs to the current frame.
+		bool historyValid;
+		
+		/** Anti-aliasing **/
+		// The most samples traced through a refined pixel (a square number, or 1 when anti-aliasing is off), and the
+		// width of the grid they are spread over.
+		int antiAliasingSamples;
+		int antiAliasingGrid;
+		// The color difference between neighbouring pixels that causes them to be refined.
+		float antiAliasingThreshold;
+		
+		/** Tile Reach **/
+		// The reach of each tile, on the grid tiles are rendered on (row by row from the bottom left tile).
+		std::vector<TileReach>* tileReaches;
+		// The number of tiles in each row of the grid.
+		int tilesPerRow;
+		
+		/** Tile Order **/
+		// The order tiles are rendered in.
+		TileOrder tileOrder;
+		// The point the focus order spirals out from.
+		std::atomic<int> focusX;
+		std::atomic<int> focusY;
+		// How long each tile took to render the last time it was rendered (0 if it hasn't been), on the same grid.
+		std::vector<float>* tileCosts;
+		
+		/** Time Budget **/
+		// The time a redraw may take in milliseconds (0 for no limit).
+		double budgetMs;
+		// The rays traced at each layer of recursion in the current frame, along with their shadow rays.
+		std::vector<long long>* layerRays;
+		
+		/** Region of Interest **/
+		// True if rendering is restricted to a region.
+		bool regionActive;
+		// The region, [regionX0, regionX1) x [regionY0, regionY1).
+		int regionX0;
+		int regionY0;
+		int regionX1;
+		int regionY1;
+		
+		/** Statistics **/
+		// The statistics of the last (or current) frame.
+		RenderStats stats;
+		// When the current frame was started (in milliseconds).
+		double statsStartMs;
+		
 };
 
 #endif
\ No newline at end of file